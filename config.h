@@ -1,15 +1,47 @@
 /* config.h.  Generated from config.h.in by configure.  */
 /* config.h.in.  Generated from configure.ac by autoheader.  */
 
+/* Define to 1 if you have the declaration of `UDP_GRO', and to 0 if you
+   don't. */
+#define HAVE_DECL_UDP_GRO 1
+
+/* Define to 1 if you have the declaration of `UDP_SEGMENT', and to 0 if you
+   don't. */
+#define HAVE_DECL_UDP_SEGMENT 1
+
+/* Define to 1 if you have the `fallocate' function. */
+#define HAVE_FALLOCATE 1
+
+/* Define to 1 if you have the `fstatvfs' function. */
+#define HAVE_FSTATVFS 1
+
 /* Define to 1 if you have the <inttypes.h> header file. */
 #define HAVE_INTTYPES_H 1
 
+/* Define to 1 if you have the `io_uring_register_buffers_sparse' function. */
+/* #undef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE */
+
 /* Define to 1 if you have the `tftp' library (-ltftp). */
 /* #undef HAVE_LIBTFTP */
 
+/* Define to 1 if you have liburing. */
+/* #undef HAVE_LIBURING */
+
+/* Define to 1 if you have the <liburing.h> header file. */
+/* #undef HAVE_LIBURING_H */
+
+/* Define to 1 if you have the `madvise' function. */
+#define HAVE_MADVISE 1
+
 /* Define to 1 if you have the <memory.h> header file. */
 #define HAVE_MEMORY_H 1
 
+/* Define to 1 if you have the `recvmmsg' function. */
+#define HAVE_RECVMMSG 1
+
+/* Define to 1 if you have the `sendmmsg' function. */
+#define HAVE_SENDMMSG 1
+
 /* Define to 1 if you have the <setjmp.h> header file. */
 #define HAVE_SETJMP_H 1
 
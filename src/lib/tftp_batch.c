@@ -0,0 +1,318 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_batch.c
+ * @brief TFTP protocol library.
+ * Batch transfers from manifest file.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#include <apr_strings.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tftp_batch.h"
+#include "util.h"
+
+/**
+ * Resolved host address.
+ */
+struct batch_host {
+  char          *ip;      /*!< IP address or NULL if host is not resolved. */
+  apr_status_t  status;   /*!< Resolution status. */
+};
+
+/**
+ * Resolve host of the entry once per batch. Transfers get IP address,
+ * so host name lookup is not repeated for every file.
+ * @return IP address or NULL if host can not be resolved.
+ */
+static const char *batch_resolve (struct tftp_batch *batch, struct tftp_batch_entry *entry)
+{
+  const char *host = entry->params.host;
+  struct batch_host *addr = apr_hash_get (batch->hosts, host, APR_HASH_KEY_STRING);
+  apr_sockaddr_t *sa;
+
+  if (addr == NULL) {
+    addr = apr_pcalloc (batch->mp, sizeof(struct batch_host));
+    addr->status = apr_sockaddr_info_get (&sa, host, APR_INET, entry->params.port, 0, batch->mp);
+    if (addr->status == APR_SUCCESS) {
+      apr_sockaddr_ip_get (&addr->ip, sa);
+      DBG("Resolved host %s to %s.", host, addr->ip);
+    } else {
+      ERR("Failed get socket address info UDP:%s:%d.", host, entry->params.port);
+    }
+    apr_hash_set (batch->hosts, host, APR_HASH_KEY_STRING, addr);
+  }
+  entry->status = addr->status;
+  return addr->ip;
+}
+
+static void batch_fill (struct tftp_batch *batch);
+
+/**
+ * Transfer of the entry is over. Start next one.
+ */
+static void batch_done (struct tftp_machine *machine, void *baton)
+{
+  struct tftp_batch_entry *entry = baton;
+  struct tftp_batch *batch = entry->batch;
+
+  // called from worker thread when batch runs with scheduler
+  entry->status = machine->status;
+  // machine pool is destroyed right after callback
+  if (machine->errmsg) {
+    apr_cpystrn (entry->errmsg, machine->errmsg, sizeof(entry->errmsg));
+  }
+  if (entry->status != APR_SUCCESS) {
+    apr_atomic_inc32 (&batch->failed);
+  }
+  if (batch->sched == NULL) {
+    batch->running--;
+    batch_fill (batch);
+  }
+}
+
+/**
+ * Create machine for the entry and add it to event loop.
+ */
+static void batch_start (struct tftp_batch *batch, struct tftp_batch_entry *entry)
+{
+  struct tftp_machine *machine;
+  struct tftp_params params = entry->params;
+  apr_status_t rv;
+
+  params.host = batch_resolve (batch, entry);
+  if (params.host == NULL) {
+    apr_atomic_inc32 (&batch->failed);
+    return;
+  }
+
+  entry->status = tftp_proto_create (&machine, batch->mp, &params);
+  if (entry->status != APR_SUCCESS) {
+    apr_atomic_inc32 (&batch->failed);
+    return;
+  }
+
+  if (batch->sched) {
+    entry->status = APR_EINCOMPLETE;
+    rv = tftp_sched_add (batch->sched, machine, batch_done, entry);
+    if (rv != APR_SUCCESS) {
+      tftp_proto_destroy (machine);
+      entry->status = rv;
+      apr_atomic_inc32 (&batch->failed);
+    }
+    return;
+  }
+
+  // transfer may be over before tftp_loop_add returns
+  batch->running++;
+  entry->status = tftp_loop_add (batch->loop, machine, batch_done, entry);
+  if (entry->status != APR_SUCCESS) {
+    tftp_proto_destroy (machine);
+    batch->running--;
+    apr_atomic_inc32 (&batch->failed);
+  }
+}
+
+/**
+ * Start transfers until concurrency limit is reached.
+ * Called again from completion callbacks, so only outer call fills.
+ */
+static void batch_fill (struct tftp_batch *batch)
+{
+  struct tftp_batch_entry *entry;
+
+  if (batch->filling) return;
+  batch->filling = TRUE;
+  while (batch->running < batch->jobs && batch->next < batch->entries->nelts) {
+    entry = &APR_ARRAY_IDX(batch->entries, batch->next, struct tftp_batch_entry);
+    batch->next++;
+    batch_start (batch, entry);
+  }
+  batch->filling = FALSE;
+}
+
+/**
+ * Parse manifest line and append entry.
+ * @return APR status. APR_BADARG if line is invalid.
+ */
+static apr_status_t batch_parse_line (struct tftp_batch *batch, const char *line,
+                                      unsigned int num, struct tftp_params *defaults)
+{
+  const char *sep = " \t\r\n";
+  char *last;
+  char *str = apr_pstrdup (batch->mp, line);
+  char *action = apr_strtok (str, sep, &last);
+  struct tftp_batch_entry *entry;
+
+  // empty line or comment
+  if (action == NULL || *action == '#') {
+    return APR_SUCCESS;
+  }
+
+  entry = &APR_ARRAY_PUSH(batch->entries, struct tftp_batch_entry);
+  entry->params = *defaults;
+  entry->line = num;
+  entry->status = APR_EINCOMPLETE;
+  entry->errmsg[0] = '\0';
+  entry->batch = batch;
+
+  if (apr_strnatcasecmp (action, "get") == 0) {
+    entry->params.action = GET;
+  } else if (apr_strnatcasecmp (action, "put") == 0) {
+    entry->params.action = PUT;
+  } else {
+    ERR("Manifest line %u: invalid action: %s", num, action);
+    return APR_BADARG;
+  }
+  entry->params.host = apr_strtok (NULL, sep, &last);
+  entry->params.remote_file = apr_strtok (NULL, sep, &last);
+  if (entry->params.remote_file == NULL) {
+    ERR("Manifest line %u: missing TFTP server host or remote file name.", num);
+    return APR_BADARG;
+  }
+  entry->params.local_file = apr_strtok (NULL, sep, &last);
+  if (entry->params.local_file == NULL) {
+    entry->params.local_file = entry->params.remote_file;
+  }
+  if (apr_strtok (NULL, sep, &last) != NULL) {
+    ERR("Manifest line %u: too many parameters.", num);
+    return APR_BADARG;
+  }
+  DBG("Manifest line %u: %s %s %s %s", num, action, entry->params.host,
+      entry->params.remote_file, entry->params.local_file);
+
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_batch_create (struct tftp_batch **new, apr_pool_t *mp,
+                                unsigned int jobs, unsigned int threads)
+{
+  apr_status_t rv;
+  struct tftp_batch *batch = apr_pcalloc (mp, sizeof(struct tftp_batch));
+
+  // worker threads are started by tftp_batch_run
+  if (threads == 1) {
+    rv = tftp_loop_create (&batch->loop, mp, jobs);
+    if (rv != APR_SUCCESS) {
+      return rv;
+    }
+  }
+  batch->mp = mp;
+  batch->threads = threads;
+  batch->entries = apr_array_make (mp, 64, sizeof(struct tftp_batch_entry));
+  batch->hosts = apr_hash_make (mp);
+  batch->jobs = jobs;
+  *new = batch;
+
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_batch_load (struct tftp_batch *batch, const char *path,
+                              struct tftp_params *defaults)
+{
+  apr_status_t rv;
+  apr_file_t *file;
+  char line[BATCH_LINE_LEN];
+  unsigned int num = 0;
+  bool std = strcmp (path, "-") == 0;
+
+  if (std) {
+    rv = apr_file_open_stdin (&file, batch->mp);
+  } else {
+    rv = apr_file_open (&file, path, APR_FOPEN_READ|APR_FOPEN_BUFFERED, APR_OS_DEFAULT, batch->mp);
+  }
+  if (rv != APR_SUCCESS) {
+    ERR("Failed open manifest %s", path);
+    return rv;
+  }
+
+  while ((rv = apr_file_gets (line, sizeof(line), file)) == APR_SUCCESS) {
+    num++;
+    if (strlen (line) == sizeof(line) - 1 && line[sizeof(line) - 2] != '\n') {
+      ERR("Manifest line %u is too long.", num);
+      rv = APR_BADARG;
+      break;
+    }
+    rv = batch_parse_line (batch, line, num, defaults);
+    if (rv != APR_SUCCESS) break;
+  }
+  if (!std) {
+    apr_file_close (file);
+  }
+  if (rv != APR_EOF) {
+    return rv;
+  }
+  LOG("Loaded %d transfers from manifest %s", batch->entries->nelts, path);
+
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_batch_run (struct tftp_batch *batch)
+{
+  apr_status_t rv;
+  int i;
+
+  if (batch->threads > 1) {
+    rv = tftp_sched_create (&batch->sched, batch->mp, batch->threads, batch->jobs);
+    if (rv != APR_SUCCESS) {
+      return rv;
+    }
+    // tftp_sched_add blocks while all workers are busy
+    for (i = 0; i < batch->entries->nelts; i++) {
+      batch_start (batch, &APR_ARRAY_IDX(batch->entries, i, struct tftp_batch_entry));
+    }
+    rv = tftp_sched_wait (batch->sched);
+  } else {
+    batch_fill (batch);
+    rv = tftp_loop_run (batch->loop);
+  }
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+
+  return batch->failed ? APR_EGENERAL : APR_SUCCESS;
+}
+
+void tftp_batch_report (struct tftp_batch *batch)
+{
+  int i;
+  char error[256];
+  struct tftp_batch_entry *entry;
+
+  for (i = 0; i < batch->entries->nelts; i++) {
+    entry = &APR_ARRAY_IDX(batch->entries, i, struct tftp_batch_entry);
+    printf("%-4s %s %s:%s %s %s", entry->status == APR_SUCCESS ? "OK" : "FAIL",
+           entry->params.action == GET ? "GET" : "PUT",
+           entry->params.host, entry->params.remote_file,
+           entry->params.action == GET ? "->" : "<-",
+           entry->params.local_file);
+    if (entry->errmsg[0]) {
+      printf(" (%s)", entry->errmsg);
+    } else if (entry->status != APR_SUCCESS) {
+      printf(" (%s)", apr_strerror (entry->status, error, sizeof(error)));
+    }
+    printf("\n");
+  }
+  printf("%d transfers, %u failed.\n", batch->entries->nelts, batch->failed);
+}
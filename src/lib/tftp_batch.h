@@ -0,0 +1,125 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_batch.h
+ * @brief TFTP protocol library.
+ * Batch transfers from manifest file.
+ *
+ * Manifest has one transfer per line:
+ * @code
+ * get|put HOST REMOTE_FILE [LOCAL_FILE]
+ * @endcode
+ * Empty lines and lines started with '#' are ignored. All transfers run
+ * in one event loop (see tftp_loop.h) or in event loops of worker threads
+ * (see tftp_sched.h) with limited number of concurrent transfers. Every
+ * host name is resolved once per batch.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_BATCH_H
+#define __TFTP_BATCH_H
+
+#include <apr_tables.h>
+#include <apr_hash.h>
+
+#include "tftp_proto.h"
+#include "tftp_loop.h"
+#include "tftp_sched.h"
+
+/*! Default number of concurrent transfers. */
+#define BATCH_JOBS 16
+/*! Maximal number of concurrent transfers. */
+#define BATCH_JOBS_MAX 1024
+/*! Maximal number of worker threads. */
+#define BATCH_THREADS_MAX 256
+/*! Maximal length of error message saved for report. */
+#define BATCH_ERRMSG_LEN 128
+/*! Maximal length of manifest line. */
+#define BATCH_LINE_LEN 4096
+
+struct tftp_batch;
+
+/**
+ * Manifest entry and its transfer result.
+ */
+struct tftp_batch_entry {
+  struct tftp_params  params;   /*!< Transfer parameters. */
+  unsigned int        line;     /*!< Manifest line number. */
+  apr_status_t        status;   /*!< Transfer result. */
+  char                errmsg[BATCH_ERRMSG_LEN]; /*!< Error message from server or empty. */
+  struct tftp_batch   *batch;   /*!< Batch of the entry. */
+};
+
+/**
+ * Batch structure.
+ */
+struct tftp_batch {
+  apr_pool_t          *mp;      /*!< APR memory pool. */
+  struct tftp_loop    *loop;    /*!< Event loop running transfers in one thread. */
+  struct tftp_sched   *sched;   /*!< Scheduler running transfers in many threads. */
+  apr_array_header_t  *entries; /*!< Manifest entries (struct tftp_batch_entry). */
+  apr_hash_t          *hosts;   /*!< Resolved IP address by host name. */
+  unsigned int        jobs;     /*!< Maximal concurrent transfers. */
+  unsigned int        threads;  /*!< Worker threads. */
+  unsigned int        next;     /*!< Next entry to start. */
+  unsigned int        running;  /*!< Running transfers. */
+  volatile apr_uint32_t failed; /*!< Failed transfers. Updated from worker threads. */
+  bool                filling;  /*!< Starting transfers, guards recursion. */
+};
+
+/**
+ * Create batch.
+ * @param batch   Created batch
+ * @param mp      APR memory pool
+ * @param jobs    Maximal concurrent transfers
+ * @param threads Worker threads. One thread runs transfers in event loop
+ *                of the caller, more threads run them with scheduler.
+ * @return APR status
+ */
+apr_status_t tftp_batch_create (struct tftp_batch **batch, apr_pool_t *mp,
+                                unsigned int jobs, unsigned int threads);
+
+/**
+ * Read manifest entries. Parameters other than action, host and files
+ * are copied from defaults.
+ * @param batch     Batch
+ * @param path      Manifest file name or "-" for stdin
+ * @param defaults  Command line parameters
+ * @return APR status. APR_BADARG if manifest has invalid line.
+ */
+apr_status_t tftp_batch_load (struct tftp_batch *batch, const char *path,
+                              struct tftp_params *defaults);
+
+/**
+ * Run all transfers of the batch.
+ * @param batch   Batch
+ * @return APR_SUCCESS when all transfers succeeded.
+ */
+apr_status_t tftp_batch_run (struct tftp_batch *batch);
+
+/**
+ * Print result of every transfer and summary.
+ * @param batch   Batch
+ */
+void tftp_batch_report (struct tftp_batch *batch);
+
+#endif
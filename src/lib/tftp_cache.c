@@ -0,0 +1,236 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_cache.c
+ * @brief TFTP protocol library.
+ * Cache of prebuilt DATA packets of files served by server.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+#include <string.h>
+#include <apr_strings.h>
+
+#include "tftp_cache.h"
+#include "tftp_msg.h"
+#include "util.h"
+
+/**
+ * Unlink entry from least recently used list.
+ */
+static void cache_unlink (struct tftp_cache *cache, struct tftp_cache_entry *entry)
+{
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+  entry->next = entry->prev = NULL;
+}
+
+/**
+ * Link entry to the head of least recently used list.
+ */
+static void cache_link (struct tftp_cache *cache, struct tftp_cache_entry *entry)
+{
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head) {
+    cache->head->prev = entry;
+  } else {
+    cache->tail = entry;
+  }
+  cache->head = entry;
+}
+
+/**
+ * Free entry memory.
+ */
+static void cache_destroy (struct tftp_cache *cache, struct tftp_cache_entry *entry)
+{
+  cache->used -= entry->mem;
+  apr_pool_destroy (entry->mp);
+}
+
+/**
+ * Remove entry from cache. Entry used by transfers is destroyed
+ * when it is released.
+ */
+static void cache_remove (struct tftp_cache *cache, struct tftp_cache_entry *entry)
+{
+  apr_hash_set (cache->entries, entry->key, APR_HASH_KEY_STRING, NULL);
+  cache_unlink (cache, entry);
+  if (entry->refs == 0) {
+    cache_destroy (cache, entry);
+  } else {
+    entry->stale = 1;
+  }
+}
+
+/**
+ * Evict not used entries from the tail of least recently used list
+ * until memory fits the limit.
+ * @return FALSE if memory does not fit because entries are used.
+ */
+static int cache_evict (struct tftp_cache *cache, apr_size_t mem)
+{
+  struct tftp_cache_entry *entry = cache->tail;
+  struct tftp_cache_entry *prev;
+
+  while (entry && cache->used + mem > cache->max) {
+    prev = entry->prev;
+    if (entry->refs == 0) {
+      DBG("Evict %s from cache.", entry->key);
+      cache_remove (cache, entry);
+      cache->evicted++;
+    }
+    entry = prev;
+  }
+  return cache->used + mem <= cache->max;
+}
+
+apr_status_t tftp_cache_create (struct tftp_cache **new, apr_pool_t *mp, apr_size_t max)
+{
+  struct tftp_cache *cache = apr_pcalloc(mp, sizeof(struct tftp_cache));
+  apr_status_t rv;
+
+  // entries outlive transfers created later from the same pool
+  rv = apr_pool_create (&cache->mp, mp);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  cache->max = max;
+  cache->entries = apr_hash_make (cache->mp);
+
+  *new = cache;
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_cache_acquire (struct tftp_cache_entry **new, struct tftp_cache *cache,
+                                 apr_file_t *file, const char *path, unsigned int blksize,
+                                 unsigned int rollover)
+{
+  struct tftp_cache_entry *entry;
+  apr_finfo_t finfo;
+  apr_uint64_t blocks;
+  apr_pool_t *mp;
+  apr_status_t rv;
+  char key[1024];
+
+  rv = apr_file_info_get (&finfo, APR_FINFO_TYPE | APR_FINFO_SIZE | APR_FINFO_MTIME | APR_FINFO_IDENT, file);
+  if (rv != APR_SUCCESS || finfo.filetype != APR_REG) {
+    return rv != APR_SUCCESS ? rv : APR_EBADF;
+  }
+  apr_snprintf (key, sizeof(key), "%u:%u:%s", blksize, rollover, path);
+
+  entry = apr_hash_get (cache->entries, key, APR_HASH_KEY_STRING);
+  if (entry && (entry->inode != finfo.inode || entry->device != finfo.device ||
+                entry->mtime != finfo.mtime || entry->size != finfo.size)) {
+    DBG("File %s has changed. Drop it from cache.", path);
+    cache_remove (cache, entry);
+    entry = NULL;
+  }
+  if (entry) {
+    cache_unlink (cache, entry);
+    cache_link (cache, entry);
+    entry->refs++;
+    cache->hits++;
+    *new = entry;
+    return APR_SUCCESS;
+  }
+
+  // last block is shorter than block size, may be empty
+  blocks = finfo.size / blksize + 1;
+  if (blocks * (blksize + 4) > cache->max || !cache_evict (cache, blocks * (blksize + 4))) {
+    DBG("File %s does not fit cache.", path);
+    return APR_ENOSPC;
+  }
+
+  rv = apr_pool_create (&mp, cache->mp);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  entry = apr_pcalloc(mp, sizeof(struct tftp_cache_entry));
+  entry->cache = cache;
+  entry->mp = mp;
+  entry->key = apr_pstrdup (mp, key);
+  entry->inode = finfo.inode;
+  entry->device = finfo.device;
+  entry->mtime = finfo.mtime;
+  entry->size = finfo.size;
+  entry->blksize = blksize;
+  entry->rollover = rollover;
+  entry->blocks = blocks;
+  entry->mem = blocks * (blksize + 4);
+  entry->packets = apr_palloc(mp, entry->mem);
+
+  cache->used += entry->mem;
+  apr_hash_set (cache->entries, entry->key, APR_HASH_KEY_STRING, entry);
+  cache_link (cache, entry);
+  entry->refs = 1;
+  cache->misses++;
+  DBG("Caching %s: %" APR_UINT64_T_FMT " packets, %" APR_SIZE_T_FMT " bytes.", path, blocks, entry->mem);
+
+  *new = entry;
+  return APR_SUCCESS;
+}
+
+void tftp_cache_release (struct tftp_cache_entry *entry)
+{
+  entry->refs--;
+  if (entry->refs == 0 && entry->stale) {
+    cache_destroy (entry->cache, entry);
+  }
+}
+
+apr_status_t tftp_cache_cleanup (void *data)
+{
+  tftp_cache_release (data);
+  return APR_SUCCESS;
+}
+
+const char *tftp_cache_packet (struct tftp_cache_entry *entry, apr_uint64_t seq)
+{
+  if (seq > entry->ready) {
+    return NULL;
+  }
+  return entry->packets + (seq - 1) * (entry->blksize + 4);
+}
+
+void tftp_cache_fill (struct tftp_cache_entry *entry, apr_uint64_t seq, const char *data)
+{
+  apr_off_t left = entry->size - (apr_off_t)(seq - 1) * entry->blksize;
+  char *packet;
+
+  if (seq != entry->ready + 1 || seq > entry->blocks) {
+    return;
+  }
+  packet = entry->packets + (seq - 1) * (entry->blksize + 4);
+  tftp_create_data_header (packet, tftp_block_wire (seq, entry->rollover));
+  if (left > 0) {
+    memcpy (packet + 4, data, left < entry->blksize ? left : entry->blksize);
+  }
+  entry->ready = seq;
+}
@@ -0,0 +1,148 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_cache.h
+ * @brief TFTP protocol library.
+ * Cache of prebuilt DATA packets of files served by server.
+ *
+ * Every block of a cached file is stored as complete DATA packet
+ * (header and payload), so sender window of RRQ transfer sends
+ * packets right from cache without reading file or building packets.
+ * Packets are built in order by transfers sending the block for the
+ * first time (tftp_cache_fill), so file is never read all at once in
+ * event loop.
+ * Entry is keyed by file path, block size and block rollover and is
+ * valid while file inode, size and modification time are the same.
+ * Entries are reference counted by transfers. Entries not used by
+ * any transfer are evicted in least recently used order when cache
+ * memory limit is reached.
+ *
+ * Cache is not thread safe. It is used by transfers of one event loop
+ * (see tftp_server.h).
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_CACHE_H
+#define __TFTP_CACHE_H
+
+#include <apr_general.h>
+#include <apr_file_io.h>
+#include <apr_file_info.h>
+#include <apr_hash.h>
+
+struct tftp_cache;
+
+/**
+ * Cached file.
+ */
+struct tftp_cache_entry {
+  struct tftp_cache       *cache;   /*!< Owner cache. */
+  apr_pool_t              *mp;      /*!< Memory pool of entry and its packets. */
+  const char              *key;     /*!< Hash key: block size, rollover and path. */
+  apr_ino_t               inode;    /*!< File inode. */
+  apr_dev_t               device;   /*!< File device. */
+  apr_time_t              mtime;    /*!< File modification time. */
+  apr_off_t               size;     /*!< File size. */
+  unsigned int            blksize;  /*!< Block size of packets. */
+  unsigned int            rollover; /*!< Block number after 65535: 0 or 1. */
+  char                    *packets; /*!< DATA packets of blksize + 4 bytes. */
+  apr_uint64_t            blocks;   /*!< Number of packets. */
+  apr_uint64_t            ready;    /*!< Number of packets built from the first one. */
+  apr_size_t              mem;      /*!< Memory of packets. */
+  unsigned int            refs;     /*!< Transfers sending packets of entry. */
+  int                     stale;    /*!< File has changed, entry is destroyed when it is released. */
+  struct tftp_cache_entry *next;    /*!< Next less recently used entry. */
+  struct tftp_cache_entry *prev;    /*!< Previous more recently used entry. */
+};
+
+/**
+ * Cache of DATA packets.
+ */
+struct tftp_cache {
+  apr_pool_t              *mp;      /*!< Memory pool of entries. */
+  apr_hash_t              *entries; /*!< Valid entries by key. */
+  struct tftp_cache_entry *head;    /*!< Most recently used entry. */
+  struct tftp_cache_entry *tail;    /*!< Least recently used entry. */
+  apr_size_t              max;      /*!< Memory limit of packets. */
+  apr_size_t              used;     /*!< Memory of packets of all entries. */
+  apr_uint64_t            hits;     /*!< Transfers served from existing entry. */
+  apr_uint64_t            misses;   /*!< Transfers which built new entry. */
+  apr_uint64_t            evicted;  /*!< Entries evicted to fit memory limit. */
+};
+
+/**
+ * Create cache.
+ * @param cache   Created cache
+ * @param mp      APR memory pool
+ * @param max     Memory limit of cached packets
+ * @return APR status
+ */
+apr_status_t tftp_cache_create (struct tftp_cache **cache, apr_pool_t *mp, apr_size_t max);
+
+/**
+ * Get entry of opened file and take reference to it.
+ * New entry is created if file is not cached or file has changed.
+ * Its packets are built later with tftp_cache_fill.
+ * @param entry   Cache entry
+ * @param cache   Cache
+ * @param file    Opened file
+ * @param path    File path
+ * @param blksize Block size
+ * @param rollover Block number after 65535: 0 or 1.
+ * @return APR status. APR_ENOSPC if file does not fit memory limit.
+ */
+apr_status_t tftp_cache_acquire (struct tftp_cache_entry **entry, struct tftp_cache *cache,
+                                 apr_file_t *file, const char *path, unsigned int blksize,
+                                 unsigned int rollover);
+
+/**
+ * Drop reference to entry taken by tftp_cache_acquire.
+ * @param entry   Cache entry
+ */
+void tftp_cache_release (struct tftp_cache_entry *entry);
+
+/**
+ * Memory pool cleanup releasing entry (see tftp_cache_release).
+ * @param data    Cache entry
+ * @return APR_SUCCESS
+ */
+apr_status_t tftp_cache_cleanup (void *data);
+
+/**
+ * DATA packet of logical block number.
+ * @param entry   Cache entry
+ * @param seq     Logical block number starting from 1
+ * @return Packet of 4 bytes header and up to blksize bytes of file
+ *         or NULL if packet is not built yet.
+ */
+const char *tftp_cache_packet (struct tftp_cache_entry *entry, apr_uint64_t seq);
+
+/**
+ * Build the next packet of entry from block of file sent by transfer.
+ * Block other than the next one is ignored.
+ * @param entry   Cache entry
+ * @param seq     Logical block number starting from 1
+ * @param data    Block of file: blksize bytes or the rest of file
+ */
+void tftp_cache_fill (struct tftp_cache_entry *entry, apr_uint64_t seq, const char *data);
+
+#endif
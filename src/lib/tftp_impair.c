@@ -0,0 +1,366 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_impair.c
+ * @brief TFTP protocol library.
+ * In-process network impairment relay.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+#include <apr_strings.h>
+#include <apr_poll.h>
+#include <apr_thread_proc.h>
+#include <stdlib.h>
+
+#include "tftp_impair.h"
+#include "tftp_msg.h"
+#include "util.h"
+
+/*! Largest relayed datagram: DATA of maximal block size. */
+#define IMPAIR_DGRAM (BLKSIZE_MAX + 4)
+
+/*! Relay checks if it is stopped at least this often. */
+#define IMPAIR_POLL apr_time_from_msec(20)
+
+/**
+ * Delayed datagram.
+ */
+struct impair_dgram {
+  apr_time_t  due;        /*!< Delivery time. */
+  int         to_server;  /*!< Direction: client to server or server to client. */
+  apr_size_t  len;        /*!< Datagram length. */
+  char        *data;      /*!< Datagram of IMPAIR_DGRAM bytes. */
+};
+
+/**
+ * Impairment relay.
+ */
+struct tftp_impair {
+  struct tftp_impair_cfg    cfg;          /*!< Impairments. */
+  struct tftp_impair_stats  stats;        /*!< Counters. */
+  apr_pool_t                *mp;          /*!< Memory pool. */
+  apr_pool_t                *thread_mp;   /*!< Memory pool of relay thread. Pools are not thread safe. */
+  apr_socket_t              *client_sock; /*!< Socket facing client. */
+  apr_socket_t              *server_sock; /*!< Socket facing server. */
+  apr_sockaddr_t            *client;      /*!< Last client address. */
+  apr_sockaddr_t            *server;      /*!< Server address, transfer id of the last response. */
+  apr_sockaddr_t            *from;        /*!< Source of received datagram. */
+  apr_port_t                port;         /*!< Relay port. */
+  apr_uint32_t              rand;         /*!< Random generator state. */
+  struct impair_dgram       queue[IMPAIR_QUEUE]; /*!< Delayed datagrams in arrival order. */
+  unsigned int              count;        /*!< Number of delayed datagrams. */
+  char                      *buf;         /*!< Receive buffer. */
+  apr_thread_t              *thread;      /*!< Relay thread. */
+  volatile apr_uint32_t     stop;         /*!< Relay is stopped. */
+};
+
+/**
+ * Next random number from 0 to 1 (xorshift32).
+ */
+static double impair_rand (struct tftp_impair *impair)
+{
+  apr_uint32_t x = impair->rand;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  impair->rand = x;
+  return (x >> 8) / 16777216.0;
+}
+
+/**
+ * Queue datagram for delivery at given time.
+ */
+static void impair_queue (struct tftp_impair *impair, int to_server, apr_size_t len, apr_time_t due)
+{
+  struct impair_dgram *dgram;
+
+  if (impair->count == IMPAIR_QUEUE) {
+    impair->stats.dropped++;
+    return;
+  }
+  dgram = &impair->queue[impair->count++];
+  if (dgram->data == NULL) {
+    dgram->data = apr_palloc(impair->thread_mp, IMPAIR_DGRAM);
+  }
+  memcpy (dgram->data, impair->buf, len);
+  dgram->len = len;
+  dgram->due = due;
+  dgram->to_server = to_server;
+}
+
+/**
+ * Apply impairments to received datagram.
+ */
+static void impair_dgram (struct tftp_impair *impair, int to_server, apr_size_t len)
+{
+  struct tftp_impair_cfg *cfg = &impair->cfg;
+  apr_time_t now = apr_time_now();
+  apr_time_t due;
+  int copies = 1;
+
+  if (impair_rand (impair) < cfg->loss) {
+    impair->stats.dropped++;
+    return;
+  }
+  if (impair_rand (impair) < cfg->dup) {
+    impair->stats.duplicated++;
+    copies = 2;
+  }
+  while (copies--) {
+    if (impair_rand (impair) < cfg->reorder) {
+      impair->stats.reordered++;
+      due = now;
+    } else {
+      due = now + cfg->delay + (apr_interval_time_t)(cfg->jitter * impair_rand (impair));
+    }
+    impair_queue (impair, to_server, len, due);
+  }
+}
+
+/**
+ * Deliver datagrams that are due.
+ * @return Time of the next delivery or zero.
+ */
+static apr_time_t impair_deliver (struct tftp_impair *impair, apr_time_t now)
+{
+  struct impair_dgram *dgram;
+  struct impair_dgram sent;
+  apr_time_t next = 0;
+  apr_size_t len;
+  unsigned int i = 0;
+
+  while (i < impair->count) {
+    dgram = &impair->queue[i];
+    if (dgram->due > now) {
+      if (next == 0 || dgram->due < next) {
+        next = dgram->due;
+      }
+      i++;
+      continue;
+    }
+    len = dgram->len;
+    if (dgram->to_server) {
+      apr_socket_sendto (impair->server_sock, impair->server, 0, dgram->data, &len);
+    } else if (impair->client) {
+      apr_socket_sendto (impair->client_sock, impair->client, 0, dgram->data, &len);
+    }
+    impair->stats.forwarded++;
+    // keep arrival order of the rest, buffer is reused at the end
+    sent = *dgram;
+    memmove (dgram, dgram + 1, (impair->count - i - 1) * sizeof(struct impair_dgram));
+    impair->queue[--impair->count] = sent;
+  }
+  return next;
+}
+
+/**
+ * Receive all datagrams waiting on socket.
+ */
+static void impair_recv (struct tftp_impair *impair, apr_socket_t *sock)
+{
+  int to_server = sock == impair->client_sock;
+  apr_size_t len;
+
+  for (;;) {
+    len = IMPAIR_DGRAM;
+    if (apr_socket_recvfrom (impair->from, sock, 0, impair->buf, &len) != APR_SUCCESS) {
+      break;
+    }
+    // learn client address and server transfer id
+    if (to_server) {
+      if (impair->client == NULL) {
+        apr_sockaddr_info_get (&impair->client, "127.0.0.1", APR_INET, 0, 0, impair->mp);
+      }
+      memcpy (&impair->client->sa, &impair->from->sa, impair->from->salen);
+      impair->client->port = impair->from->port;
+    } else {
+      memcpy (&impair->server->sa, &impair->from->sa, impair->from->salen);
+      impair->server->port = impair->from->port;
+    }
+    impair_dgram (impair, to_server, len);
+  }
+}
+
+/**
+ * Relay thread.
+ */
+static void * APR_THREAD_FUNC impair_thread (apr_thread_t *thread, void *data)
+{
+  struct tftp_impair *impair = data;
+  apr_pollfd_t pfd[2];
+  apr_interval_time_t timeout;
+  apr_time_t now, next;
+  apr_int32_t num;
+  int i;
+
+  memset (pfd, 0, sizeof(pfd));
+  pfd[0].p = pfd[1].p = impair->mp;
+  pfd[0].desc_type = pfd[1].desc_type = APR_POLL_SOCKET;
+  pfd[0].reqevents = pfd[1].reqevents = APR_POLLIN;
+  pfd[0].desc.s = impair->client_sock;
+  pfd[1].desc.s = impair->server_sock;
+
+  while (!impair->stop) {
+    now = apr_time_now();
+    next = impair_deliver (impair, now);
+    timeout = next ? next - now : IMPAIR_POLL;
+    if (timeout > IMPAIR_POLL) {
+      timeout = IMPAIR_POLL;
+    }
+    if (apr_poll (pfd, 2, &num, timeout) != APR_SUCCESS) {
+      continue;
+    }
+    for (i = 0; i < 2; i++) {
+      if (pfd[i].rtnevents & APR_POLLIN) {
+        impair_recv (impair, pfd[i].desc.s);
+      }
+    }
+  }
+  apr_thread_exit (thread, APR_SUCCESS);
+  return NULL;
+}
+
+/**
+ * Memory pool cleanup. Stops relay thread before sockets are closed.
+ */
+static apr_status_t impair_cleanup (void *data)
+{
+  struct tftp_impair *impair = data;
+  apr_status_t rv;
+
+  impair->stop = 1;
+  apr_thread_join (&rv, impair->thread);
+  apr_pool_destroy (impair->thread_mp);
+  return APR_SUCCESS;
+}
+
+/**
+ * Create non-blocking UDP socket bound to loopback.
+ */
+static apr_status_t impair_socket (apr_socket_t **sock, apr_pool_t *mp)
+{
+  apr_sockaddr_t *addr;
+  apr_status_t rv;
+
+  rv = apr_sockaddr_info_get (&addr, "127.0.0.1", APR_INET, 0, 0, mp);
+  if (rv != APR_SUCCESS) return rv;
+  rv = apr_socket_create (sock, APR_INET, SOCK_DGRAM, APR_PROTO_UDP, mp);
+  if (rv != APR_SUCCESS) return rv;
+  rv = apr_socket_bind (*sock, addr);
+  if (rv != APR_SUCCESS) return rv;
+  return apr_socket_opt_set (*sock, APR_SO_NONBLOCK, 1);
+}
+
+apr_status_t tftp_impair_create (struct tftp_impair **new, apr_pool_t *mp,
+                                 const struct tftp_impair_cfg *cfg, apr_sockaddr_t *server)
+{
+  struct tftp_impair *impair;
+  apr_sockaddr_t *local;
+  apr_status_t rv;
+
+  impair = apr_pcalloc(mp, sizeof(struct tftp_impair));
+  impair->mp = mp;
+  impair->cfg = *cfg;
+  impair->rand = cfg->seed ? cfg->seed : 1;
+  impair->buf = apr_palloc(mp, IMPAIR_DGRAM);
+
+  rv = impair_socket (&impair->client_sock, mp);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to create impairment relay socket.");
+    return rv;
+  }
+  rv = impair_socket (&impair->server_sock, mp);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to create impairment relay socket.");
+    return rv;
+  }
+  apr_socket_addr_get (&local, APR_LOCAL, impair->client_sock);
+  impair->port = local->port;
+  apr_sockaddr_info_get (&impair->from, "127.0.0.1", APR_INET, 0, 0, mp);
+  // server address changes to its transfer id
+  apr_sockaddr_info_get (&impair->server, "127.0.0.1", APR_INET, server->port, 0, mp);
+  memcpy (&impair->server->sa, &server->sa, server->salen);
+
+  rv = apr_pool_create (&impair->thread_mp, NULL);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  rv = apr_thread_create (&impair->thread, NULL, impair_thread, impair, mp);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to start impairment relay thread.");
+    apr_pool_destroy (impair->thread_mp);
+    return rv;
+  }
+  apr_pool_cleanup_register (mp, impair, impair_cleanup, apr_pool_cleanup_null);
+  DBG("Impairment relay on port %u: loss %.3f dup %.3f reorder %.3f delay %" APR_TIME_T_FMT
+      " us jitter %" APR_TIME_T_FMT " us seed %u.", impair->port, cfg->loss, cfg->dup, cfg->reorder,
+      cfg->delay, cfg->jitter, cfg->seed);
+
+  *new = impair;
+  return APR_SUCCESS;
+}
+
+apr_port_t tftp_impair_port (struct tftp_impair *impair)
+{
+  return impair->port;
+}
+
+void tftp_impair_stats (struct tftp_impair *impair, struct tftp_impair_stats *stats)
+{
+  *stats = impair->stats;
+}
+
+apr_status_t tftp_impair_parse (struct tftp_impair_cfg *cfg, const char *spec, apr_pool_t *mp)
+{
+  char *list, *item, *last, *value, *end;
+  double num;
+
+  memset (cfg, 0, sizeof(struct tftp_impair_cfg));
+  list = apr_pstrdup (mp, spec);
+  for (item = apr_strtok (list, ",", &last); item; item = apr_strtok (NULL, ",", &last)) {
+    value = strchr (item, '=');
+    if (value == NULL) {
+      break;
+    }
+    *value++ = '\0';
+    num = strtod (value, &end);
+    if (*end != '\0' || num < 0) {
+      break;
+    }
+    if (strcmp (item, "loss") == 0 && num <= 1) {
+      cfg->loss = num;
+    } else if (strcmp (item, "dup") == 0 && num <= 1) {
+      cfg->dup = num;
+    } else if (strcmp (item, "reorder") == 0 && num <= 1) {
+      cfg->reorder = num;
+    } else if (strcmp (item, "delay") == 0) {
+      cfg->delay = (apr_interval_time_t)(num * 1000);
+    } else if (strcmp (item, "jitter") == 0) {
+      cfg->jitter = (apr_interval_time_t)(num * 1000);
+    } else if (strcmp (item, "seed") == 0) {
+      cfg->seed = (apr_uint32_t)num;
+    } else {
+      break;
+    }
+  }
+  return item == NULL ? APR_SUCCESS : APR_BADARG;
+}
@@ -0,0 +1,105 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_impair.h
+ * @brief TFTP protocol library.
+ * In-process network impairment. UDP relay between client and server
+ * drops, duplicates, reorders and delays datagrams in both directions.
+ * Client sends requests to relay port on loopback instead of server.
+ * Impairments are drawn from seeded random generator, so runs with the
+ * same seed and traffic are reproducible without root or netem.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_IMPAIR_H
+#define __TFTP_IMPAIR_H
+
+#include <apr_general.h>
+#include <apr_network_io.h>
+#include <apr_time.h>
+
+/*! Maximal number of delayed datagrams. Datagrams over it are dropped. */
+#define IMPAIR_QUEUE 256
+
+/**
+ * Impairment configuration. Probabilities are from 0 to 1.
+ */
+struct tftp_impair_cfg {
+  double              loss;     /*!< Probability to drop datagram. */
+  double              dup;      /*!< Probability to deliver datagram twice. */
+  double              reorder;  /*!< Probability to deliver datagram without delay,
+                                     ahead of delayed ones. */
+  apr_interval_time_t delay;    /*!< Delay of every datagram. */
+  apr_interval_time_t jitter;   /*!< Maximal random addition to delay. */
+  apr_uint32_t        seed;     /*!< Random generator seed. */
+};
+
+/**
+ * Impairment counters of both directions.
+ */
+struct tftp_impair_stats {
+  apr_uint64_t forwarded;   /*!< Delivered datagrams, duplicates included. */
+  apr_uint64_t dropped;     /*!< Dropped datagrams. */
+  apr_uint64_t duplicated;  /*!< Duplicated datagrams. */
+  apr_uint64_t reordered;   /*!< Datagrams delivered ahead of delayed ones. */
+};
+
+/*! Impairment relay. */
+struct tftp_impair;
+
+/**
+ * Start relay thread. Relay is stopped when memory pool is destroyed.
+ * @param impair  Created relay
+ * @param mp      APR memory pool
+ * @param cfg     Impairments
+ * @param server  Server address. Server may answer from other port (transfer id).
+ * @return APR status
+ */
+apr_status_t tftp_impair_create (struct tftp_impair **impair, apr_pool_t *mp,
+                                 const struct tftp_impair_cfg *cfg, apr_sockaddr_t *server);
+
+/**
+ * Relay port on loopback where client sends requests.
+ * @param impair  Relay
+ * @return Port
+ */
+apr_port_t tftp_impair_port (struct tftp_impair *impair);
+
+/**
+ * Get impairment counters. Counters are updated by relay thread,
+ * they are exact when transfer is over.
+ * @param impair  Relay
+ * @param stats   Counters
+ */
+void tftp_impair_stats (struct tftp_impair *impair, struct tftp_impair_stats *stats);
+
+/**
+ * Parse impairments from "loss=0.05,dup=0.01,reorder=0.1,delay=2,jitter=1,seed=7".
+ * Delay and jitter are in milliseconds. Missing values are zero.
+ * @param cfg   Impairments
+ * @param spec  Impairments string
+ * @param mp    APR memory pool
+ * @return APR status. APR_BADARG on unknown name or invalid value.
+ */
+apr_status_t tftp_impair_parse (struct tftp_impair_cfg *cfg, const char *spec, apr_pool_t *mp);
+
+#endif
@@ -0,0 +1,776 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_io.c
+ * @brief TFTP protocol library.
+ * Datagram I/O of TFTP machine.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+#define _GNU_SOURCE
+#include <config.h>
+#include <apr_portable.h>
+#include <string.h>
+
+#include "tftp_io.h"
+#include "util.h"
+
+#if defined(HAVE_SENDMMSG) && defined(HAVE_RECVMMSG)
+#define IO_HAVE_MMSG 1
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <errno.h>
+#if HAVE_DECL_UDP_SEGMENT && HAVE_DECL_UDP_GRO
+#define IO_HAVE_GSO 1
+#endif
+#ifdef HAVE_LIBURING
+#define IO_HAVE_URING 1
+#include <liburing.h>
+#endif
+#endif
+
+/*! Receive buffer of the ring slot. One more byte follows every datagram. */
+#define ring_buf(io, slot) ((io)->ring + (slot) * ((io)->buf_size + 1))
+
+#ifdef IO_HAVE_URING
+/**
+ * Message of io_uring receive operation.
+ */
+struct io_recv_msg {
+  struct msghdr hdr;  /*!< Message header. */
+  struct iovec  iov;  /*!< Receive buffer. */
+};
+#endif
+
+#ifdef IO_HAVE_GSO
+/*! Control message buffer size of one sent message. */
+#define IO_CTRL_SIZE CMSG_SPACE(sizeof(uint16_t))
+
+/**
+ * Enable UDP segmentation and receive offload if kernel supports them.
+ */
+static void io_gso_init (struct tftp_io *io, apr_pool_t *mp)
+{
+  apr_os_sock_t fd;
+  int val = 0;
+  socklen_t len = sizeof(val);
+
+  apr_os_sock_get (&fd, io->sock);
+  io->gso = getsockopt (fd, IPPROTO_UDP, UDP_SEGMENT, &val, &len) == 0;
+  val = 1;
+  io->gro = setsockopt (fd, IPPROTO_UDP, UDP_GRO, &val, sizeof(val)) == 0;
+  if (io->gso) {
+    io->ctrl = apr_pcalloc(mp, io->queue_size * IO_CTRL_SIZE);
+  }
+  if (io->gro) {
+    io->gro_buf = apr_palloc(mp, IO_GRO_SIZE + 1);
+  }
+  DBG("UDP segmentation offload: %s, receive offload: %s.",
+      io->gso ? "on" : "off", io->gro ? "on" : "off");
+}
+#endif
+
+apr_status_t tftp_io_init (struct tftp_io *io, apr_pool_t *mp, apr_socket_t *sock,
+                           enum io_mode mode, unsigned int batch, apr_size_t buf_size)
+{
+  unsigned int addrs;
+
+#ifndef IO_HAVE_GSO
+  if (mode == IO_GSO) {
+    DBG("System does not support UDP segmentation offload. Use mmsg I/O.");
+    mode = IO_MMSG;
+  }
+#endif
+#ifndef IO_HAVE_URING
+  if (mode == IO_URING) {
+    DBG("System does not support io_uring. Use mmsg I/O.");
+    mode = IO_MMSG;
+  }
+#endif
+#ifndef IO_HAVE_MMSG
+  if (mode == IO_MMSG) {
+    DBG("System does not support sendmmsg/recvmmsg. Use APR I/O.");
+    mode = IO_APR;
+  }
+#endif
+  if (mode == IO_APR || batch < 1) {
+    batch = 1;
+  } else if (batch > IO_BATCH) {
+    batch = IO_BATCH;
+  }
+  memset (io, 0, sizeof(struct tftp_io));
+  io->mode = mode;
+  io->sock = sock;
+  io->buf_size = buf_size;
+  io->queue_size = batch;
+  io->queue = apr_pcalloc(mp, batch * sizeof(struct tftp_io_pkt));
+  io->buf_index = -1;
+  if (mode == IO_APR) {
+    io->bounce = apr_palloc(mp, buf_size);
+  }
+  io->ring_size = batch;
+#ifdef IO_HAVE_GSO
+  if (mode == IO_GSO) {
+    io_gso_init (io, mp);
+    if (!io->gso && !io->gro) {
+      DBG("Kernel does not support UDP segmentation offload. Use mmsg I/O.");
+      io->mode = IO_MMSG;
+    }
+  }
+#endif
+  // one coalesced datagram holds up to IO_GSO_SEGS packets from one source
+  if (io->gro) {
+    io->ring_size = IO_GSO_SEGS;
+    addrs = 1;
+  } else {
+    io->ring = apr_palloc(mp, batch * (buf_size + 1));
+    addrs = batch;
+  }
+  io->ring_data = apr_pcalloc(mp, io->ring_size * sizeof(char *));
+  io->ring_len = apr_pcalloc(mp, io->ring_size * sizeof(apr_size_t));
+  io->ring_src = apr_pcalloc(mp, io->ring_size * sizeof(unsigned int));
+#ifdef IO_HAVE_MMSG
+  if (mode != IO_APR) {
+    io->msgs = apr_pcalloc(mp, batch * sizeof(struct mmsghdr));
+    // header and body of every queued packet
+    io->iovs = apr_pcalloc(mp, 2 * batch * sizeof(struct iovec));
+    io->segs = apr_pcalloc(mp, batch * sizeof(unsigned int));
+    io->ring_addr = apr_pcalloc(mp, addrs * sizeof(struct sockaddr_storage));
+    io->addr_len = apr_pcalloc(mp, addrs * sizeof(unsigned int));
+  }
+#endif
+#ifdef IO_HAVE_URING
+  if (mode == IO_URING) {
+    io->rmsg = apr_pcalloc(mp, sizeof(struct io_recv_msg));
+  }
+#endif
+  DBG("Datagram I/O: %s, %u datagrams per call.", io_mode_str[io->mode], batch);
+
+  return APR_SUCCESS;
+}
+
+#ifdef IO_HAVE_MMSG
+/*! Queued packet length. */
+#define pkt_len(pkt) ((pkt)->len + (pkt)->body_len)
+
+/**
+ * Build message headers for queued packets starting from packet "from".
+ * Every packet takes one or two I/O vectors. With segmentation offload,
+ * packets of the same size are joined in one message. Only the last of
+ * them may be shorter.
+ * @return Number of messages.
+ */
+static unsigned int io_mmsg_build (struct tftp_io *io, apr_sockaddr_t *addr, unsigned int from)
+{
+  struct mmsghdr *msgs = io->msgs;
+  struct iovec *iovs = io->iovs;
+  struct tftp_io_pkt *queue = io->queue;
+  unsigned int i, p, n, segs, vec = 0;
+  apr_size_t len;
+
+  for (i = 0, p = from; p < io->queued; i++, p += segs) {
+    len = pkt_len(&queue[p]);
+    segs = 1;
+    while (io->gso && p + segs < io->queued && segs < IO_GSO_SEGS
+           && pkt_len(&queue[p + segs - 1]) == pkt_len(&queue[p])
+           && pkt_len(&queue[p + segs]) <= pkt_len(&queue[p])
+           && len + pkt_len(&queue[p + segs]) <= IO_GSO_SIZE) {
+      len += pkt_len(&queue[p + segs]);
+      segs++;
+    }
+    memset (&msgs[i], 0, sizeof(struct mmsghdr));
+    msgs[i].msg_hdr.msg_name = &addr->sa;
+    msgs[i].msg_hdr.msg_namelen = addr->salen;
+    msgs[i].msg_hdr.msg_iov = &iovs[vec];
+    for (n = p; n < p + segs; n++) {
+      iovs[vec].iov_base = (void *)queue[n].data;
+      iovs[vec++].iov_len = queue[n].len;
+      if (queue[n].body_len) {
+        iovs[vec].iov_base = (void *)queue[n].body;
+        iovs[vec++].iov_len = queue[n].body_len;
+      }
+    }
+    msgs[i].msg_hdr.msg_iovlen = &iovs[vec] - msgs[i].msg_hdr.msg_iov;
+#ifdef IO_HAVE_GSO
+    if (segs > 1) {
+      // kernel splits buffer into datagrams of the first packet size
+      struct cmsghdr *cm;
+      msgs[i].msg_hdr.msg_control = (char *)io->ctrl + i * IO_CTRL_SIZE;
+      msgs[i].msg_hdr.msg_controllen = IO_CTRL_SIZE;
+      cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+      cm->cmsg_level = IPPROTO_UDP;
+      cm->cmsg_type = UDP_SEGMENT;
+      cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      *(uint16_t *)CMSG_DATA(cm) = pkt_len(&queue[p]);
+    }
+#endif
+    io->segs[i] = segs;
+  }
+
+  return i;
+}
+
+/**
+ * Send queued packets with sendmmsg.
+ */
+static apr_status_t io_mmsg_flush (struct tftp_io *io, apr_sockaddr_t *addr)
+{
+  struct pollfd pfd;
+  apr_os_sock_t fd;
+  unsigned int i, count, sent = 0;
+  int n;
+
+  apr_os_sock_get (&fd, io->sock);
+  while (sent < io->queued) {
+    count = io_mmsg_build (io, addr, sent);
+    n = sendmmsg (fd, io->msgs, count, 0);
+    if (n >= 0) {
+      for (i = 0; i < (unsigned int)n; i++) {
+        sent += io->segs[i];
+      }
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      // Socket buffer is full: wait shortly until it is drained. Rest of
+      // the queue is left to retransmission like lost packets, so one
+      // transfer does not block event loop.
+      pfd.fd = fd;
+      pfd.events = POLLOUT;
+      if (poll (&pfd, 1, IO_SEND_WAIT) == 0) {
+        DBG("Socket send buffer is full. Drop %u packets.", io->queued - sent);
+        break;
+      }
+    } else if (io->gso && (errno == EIO || errno == EINVAL)) {
+      // device has no checksum offload or segment exceeds path MTU
+      DBG("UDP segmentation offload failed. Send packets one by one.");
+      io->gso = 0;
+    } else if (errno != EINTR) {
+      io->queued = 0;
+      return APR_FROM_OS_ERROR(errno);
+    }
+  }
+  io->queued = 0;
+
+  return APR_SUCCESS;
+}
+
+/**
+ * Wait until socket is readable according to socket timeout,
+ * like apr_socket_recvfrom does.
+ */
+static apr_status_t io_wait_readable (struct tftp_io *io, apr_os_sock_t fd)
+{
+  struct pollfd pfd;
+  apr_interval_time_t timeout;
+  int n;
+
+  apr_socket_timeout_get (io->sock, &timeout);
+  if (timeout == 0) {
+    return APR_EAGAIN;
+  }
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  n = poll (&pfd, 1, timeout < 0 ? -1 : (int)((timeout + 999) / 1000));
+  if (n == 0) {
+    return APR_TIMEUP;
+  }
+  if (n < 0 && errno != EINTR) {
+    return APR_FROM_OS_ERROR(errno);
+  }
+  return APR_SUCCESS;
+}
+
+/**
+ * Read all queued datagrams with recvmmsg.
+ */
+static apr_status_t io_mmsg_fill (struct tftp_io *io)
+{
+  struct mmsghdr *msgs = io->msgs;
+  struct iovec *iovs = io->iovs;
+  struct sockaddr_storage *addrs = io->ring_addr;
+  apr_os_sock_t fd;
+  apr_status_t rv;
+  unsigned int i;
+  int n;
+
+  apr_os_sock_get (&fd, io->sock);
+  for (i = 0; i < io->ring_size; i++) {
+    iovs[i].iov_base = ring_buf(io, i);
+    iovs[i].iov_len = io->buf_size;
+    memset (&msgs[i], 0, sizeof(struct mmsghdr));
+    msgs[i].msg_hdr.msg_name = &addrs[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  for (;;) {
+    n = recvmmsg (fd, msgs, io->ring_size, MSG_DONTWAIT, NULL);
+    if (n > 0) break;
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      return APR_FROM_OS_ERROR(errno);
+    }
+    if ((rv = io_wait_readable (io, fd)) != APR_SUCCESS) {
+      return rv;
+    }
+  }
+
+  // message headers are reused for sending, keep what is needed
+  for (i = 0; i < (unsigned int)n; i++) {
+    io->ring_data[i] = ring_buf(io, i);
+    io->ring_len[i] = msgs[i].msg_len;
+    io->ring_src[i] = i;
+    io->addr_len[i] = msgs[i].msg_hdr.msg_namelen;
+  }
+  io->ring_head = 0;
+  io->ring_count = n;
+
+  return APR_SUCCESS;
+}
+#endif
+
+#ifdef IO_HAVE_GSO
+/**
+ * Read one datagram with receive offload and split it into packets.
+ */
+static apr_status_t io_gro_fill (struct tftp_io *io)
+{
+  char ctrl[CMSG_SPACE(sizeof(int))];
+  struct iovec iov = { io->gro_buf, IO_GRO_SIZE };
+  struct msghdr hdr;
+  struct cmsghdr *cm;
+  apr_os_sock_t fd;
+  apr_status_t rv;
+  apr_size_t seg, off;
+  unsigned int i;
+  ssize_t n;
+
+  apr_os_sock_get (&fd, io->sock);
+  for (;;) {
+    memset (&hdr, 0, sizeof(hdr));
+    hdr.msg_name = io->ring_addr;
+    hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = ctrl;
+    hdr.msg_controllen = sizeof(ctrl);
+    n = recvmsg (fd, &hdr, MSG_DONTWAIT);
+    if (n >= 0) break;
+    if (errno == EINTR) continue;
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return APR_FROM_OS_ERROR(errno);
+    }
+    if ((rv = io_wait_readable (io, fd)) != APR_SUCCESS) {
+      return rv;
+    }
+  }
+
+  // without control message datagram is not coalesced
+  seg = n;
+  for (cm = CMSG_FIRSTHDR(&hdr); cm; cm = CMSG_NXTHDR(&hdr, cm)) {
+    if (cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_GRO) {
+      seg = *(int *)CMSG_DATA(cm);
+    }
+  }
+  io->addr_len[0] = hdr.msg_namelen;
+  i = 0;
+  off = 0;
+  do {
+    io->ring_data[i] = io->gro_buf + off;
+    io->ring_len[i] = (apr_size_t)n - off < seg ? (apr_size_t)n - off : seg;
+    io->ring_src[i] = 0;
+    off += seg;
+    i++;
+  } while (off < (apr_size_t)n && i < io->ring_size);
+  if (i > 1) {
+    DBG("Received %u packets in one datagram of %ld bytes.", i, (long)n);
+  }
+  io->ring_head = 0;
+  io->ring_count = i;
+
+  return APR_SUCCESS;
+}
+#endif
+
+#ifdef IO_HAVE_URING
+/**
+ * Keep status of the first failed operation.
+ * Operations linked after failed one are canceled.
+ */
+static void io_uring_fail (struct tftp_io *io, int res)
+{
+  if (io->error == APR_SUCCESS) {
+    io->error = res < 0 ? APR_FROM_OS_ERROR(-res) : APR_INCOMPLETE;
+  }
+}
+
+/**
+ * Datagram is received to the first ring buffer.
+ */
+static void io_uring_recv_done (struct tftp_uring_op *op, int res)
+{
+  struct tftp_io *io = op->baton;
+  struct io_recv_msg *msg = io->rmsg;
+
+  io->inflight--;
+  io->armed = 0;
+  if (res >= 0) {
+    io->ring_data[0] = ring_buf(io, 0);
+    io->ring_len[0] = res;
+    io->ring_src[0] = 0;
+    io->addr_len[0] = msg->hdr.msg_namelen;
+    io->ring_head = 0;
+    io->ring_count = 1;
+  } else if (!io->closing || res != -ECANCELED) {
+    io_uring_fail (io, res);
+  }
+  io->notify (io->baton);
+}
+
+/**
+ * Datagram is sent.
+ */
+static void io_uring_send_done (struct tftp_uring_op *op, int res)
+{
+  struct tftp_io *io = op->baton;
+
+  io->inflight--;
+  if (res < 0) {
+    io_uring_fail (io, res);
+  }
+  io->notify (io->baton);
+}
+
+/**
+ * Receive is canceled or it was already completed.
+ */
+static void io_uring_cancel_done (struct tftp_uring_op *op, int res)
+{
+  struct tftp_io *io = op->baton;
+
+  io->inflight--;
+  io->notify (io->baton);
+}
+
+/**
+ * Queue receive to the first ring buffer. Receive ends the chain,
+ * nothing waits for the next datagram.
+ */
+static apr_status_t io_uring_arm (struct tftp_io *io)
+{
+  struct io_recv_msg *msg = io->rmsg;
+  struct io_uring_sqe *sqe = tftp_uring_sqe (io->uring);
+  apr_os_sock_t fd;
+
+  if (sqe == NULL) {
+    return APR_ENOMEM;
+  }
+  apr_os_sock_get (&fd, io->sock);
+  memset (&msg->hdr, 0, sizeof(struct msghdr));
+  msg->iov.iov_base = ring_buf(io, 0);
+  msg->iov.iov_len = io->buf_size;
+  msg->hdr.msg_name = io->ring_addr;
+  msg->hdr.msg_namelen = sizeof(struct sockaddr_storage);
+  msg->hdr.msg_iov = &msg->iov;
+  msg->hdr.msg_iovlen = 1;
+  io_uring_prep_recvmsg (sqe, fd, &msg->hdr, 0);
+  tftp_uring_queue (io->uring, sqe, &io->recv_op, &io->chain);
+  io->chain.last = NULL;
+  io->armed = 1;
+  io->inflight++;
+
+  return APR_SUCCESS;
+}
+
+/**
+ * Queue sends of all queued packets after file write.
+ */
+static apr_status_t io_uring_flush (struct tftp_io *io, apr_sockaddr_t *addr)
+{
+  struct mmsghdr *msgs = io->msgs;
+  struct io_uring_sqe *sqe;
+  apr_os_sock_t fd;
+  apr_status_t rv;
+  unsigned int i, count;
+
+  // Window larger than the queue is flushed more than once per poll.
+  // Kernel reads message headers of queued sends on submission, so
+  // they are submitted before the headers are built again.
+  if (io->built && io->send_gen == tftp_uring_gen (io->uring) &&
+      (rv = tftp_uring_submit (io->uring)) != APR_SUCCESS) {
+    io->queued = 0;
+    return rv;
+  }
+  apr_os_sock_get (&fd, io->sock);
+  count = io_mmsg_build (io, addr, 0);
+  io->queued = 0;
+  for (i = 0; i < count; i++) {
+    sqe = tftp_uring_sqe (io->uring);
+    if (sqe == NULL) {
+      return APR_ENOMEM;
+    }
+    io_uring_prep_sendmsg (sqe, fd, &msgs[i].msg_hdr, 0);
+    tftp_uring_queue (io->uring, sqe, &io->send_op, &io->chain);
+    io->inflight++;
+  }
+  io->built = 1;
+  io->send_gen = tftp_uring_gen (io->uring);
+
+  return APR_SUCCESS;
+}
+#endif
+
+void tftp_io_uring_attach (struct tftp_io *io, struct tftp_uring *uring,
+                           tftp_io_notify_cb notify, void *baton)
+{
+#ifdef IO_HAVE_URING
+  io->uring = uring;
+  io->notify = notify;
+  io->baton = baton;
+  io->recv_op.complete = io_uring_recv_done;
+  io->send_op.complete = io_uring_send_done;
+  io->cancel_op.complete = io_uring_cancel_done;
+  io->recv_op.baton = io->send_op.baton = io->cancel_op.baton = io;
+  io->chain.last = NULL;
+  if (io->fixed) {
+    io->buf_index = tftp_uring_buf_register (uring, io->fixed, io->fixed_len);
+  }
+  DBG("Datagram I/O uses io_uring, registered buffer #%d.", io->buf_index);
+#endif
+}
+
+void tftp_io_uring_detach (struct tftp_io *io)
+{
+  if (io->uring) {
+    if (io->buf_index >= 0) {
+      tftp_uring_buf_unregister (io->uring, io->buf_index);
+    }
+    io->buf_index = -1;
+    io->uring = NULL;
+  }
+}
+
+void tftp_io_uring_reserve (struct tftp_io *io)
+{
+  // file write, sends and receive
+  if (io->uring) {
+    tftp_uring_reserve (io->uring, io->queue_size + 2);
+  }
+}
+
+void tftp_io_uring_cancel (struct tftp_io *io)
+{
+#ifdef IO_HAVE_URING
+  struct io_uring_sqe *sqe;
+
+  io->closing = 1;
+  if (io->uring == NULL || !io->armed) {
+    return;
+  }
+  sqe = tftp_uring_sqe (io->uring);
+  if (sqe == NULL) {
+    ERR("Failed to cancel receive operation.");
+    return;
+  }
+  io_uring_prep_cancel (sqe, &io->recv_op, 0);
+  tftp_uring_queue (io->uring, sqe, &io->cancel_op, NULL);
+  io->inflight++;
+#endif
+}
+
+void tftp_io_register (struct tftp_io *io, char *buf, apr_size_t len)
+{
+  io->fixed = buf;
+  io->fixed_len = len;
+#ifdef IO_HAVE_URING
+  // buffer allocated after io_uring is attached
+  if (io->uring && io->buf_index < 0) {
+    io->buf_index = tftp_uring_buf_register (io->uring, buf, len);
+  }
+#endif
+}
+
+apr_status_t tftp_io_write_at (struct tftp_io *io, apr_file_t *file, const char *data,
+                               apr_size_t len, apr_off_t off, struct tftp_uring_op *op)
+{
+#ifdef IO_HAVE_URING
+  struct io_uring_sqe *sqe;
+  apr_os_file_t fd;
+
+  if (io->uring == NULL || io->closing) {
+    return APR_ENOTIMPL;
+  }
+  if (io->error != APR_SUCCESS) {
+    return io->error;
+  }
+  sqe = tftp_uring_sqe (io->uring);
+  if (sqe == NULL) {
+    return APR_ENOMEM;
+  }
+  apr_os_file_get (&fd, file);
+  if (io->buf_index >= 0 && data >= io->fixed && data + len <= io->fixed + io->fixed_len) {
+    io_uring_prep_write_fixed (sqe, fd, data, len, off, io->buf_index);
+  } else {
+    io_uring_prep_write (sqe, fd, data, len, off);
+  }
+  tftp_uring_queue (io->uring, sqe, op, NULL);
+  io->inflight++;
+  return APR_SUCCESS;
+#else
+  return APR_ENOTIMPL;
+#endif
+}
+
+void tftp_io_write_done (struct tftp_io *io, int res, apr_size_t len)
+{
+#ifdef IO_HAVE_URING
+  io->inflight--;
+  if (res < 0 || (apr_size_t)res != len) {
+    io_uring_fail (io, res);
+  }
+  io->notify (io->baton);
+#endif
+}
+
+apr_status_t tftp_io_send (struct tftp_io *io, apr_sockaddr_t *addr, const char *data, apr_size_t len)
+{
+  return tftp_io_sendv (io, addr, data, len, NULL, 0);
+}
+
+apr_status_t tftp_io_sendv (struct tftp_io *io, apr_sockaddr_t *addr, const char *data, apr_size_t len,
+                            const char *body, apr_size_t body_len)
+{
+  apr_status_t rv;
+
+  if (io->mode == IO_APR) {
+    if (body_len) {
+      // APR has no scatter/gather send to address
+      memcpy (io->bounce, data, len);
+      memcpy (io->bounce + len, body, body_len);
+      data = io->bounce;
+      len += body_len;
+    }
+    rv = apr_socket_sendto (io->sock, addr, 0, data, &len);
+    if (APR_STATUS_IS_EAGAIN(rv)) {
+      DBG("Socket send buffer is full. Drop packet.");
+      return APR_SUCCESS;
+    }
+    return rv;
+  }
+  if (io->queued == io->queue_size) {
+    rv = tftp_io_flush (io, addr);
+    if (rv != APR_SUCCESS) {
+      return rv;
+    }
+  }
+  io->queue[io->queued].data = data;
+  io->queue[io->queued].len = len;
+  io->queue[io->queued].body = body;
+  io->queue[io->queued].body_len = body_len;
+  io->queued++;
+
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_io_flush (struct tftp_io *io, apr_sockaddr_t *addr)
+{
+  if (io->queued == 0) {
+    return APR_SUCCESS;
+  }
+#ifdef IO_HAVE_URING
+  if (io->uring) {
+    return io_uring_flush (io, addr);
+  }
+#endif
+#ifdef IO_HAVE_MMSG
+  return io_mmsg_flush (io, addr);
+#else
+  return APR_ENOTIMPL;
+#endif
+}
+
+apr_status_t tftp_io_recv (struct tftp_io *io, apr_sockaddr_t *addr, char **data, apr_size_t *len)
+{
+  apr_status_t rv;
+  unsigned int slot;
+
+  // previous datagram might be terminated over the next one
+  if (io->tail) {
+    *io->tail = io->tail_byte;
+    io->tail = NULL;
+  }
+#ifdef IO_HAVE_URING
+  if (io->uring && io->error != APR_SUCCESS) {
+    return io->error;
+  }
+  // datagram is received by io_uring, caller is notified
+  if (io->uring && io->ring_count == 0) {
+    if (!io->armed && (rv = io_uring_arm (io)) != APR_SUCCESS) {
+      return rv;
+    }
+    return APR_EAGAIN;
+  }
+#endif
+  if (io->ring_count == 0) {
+    if (io->mode == IO_APR) {
+      io->ring_len[0] = io->buf_size;
+      rv = apr_socket_recvfrom (addr, io->sock, 0, io->ring, &io->ring_len[0]);
+      if (rv != APR_SUCCESS) {
+        return rv;
+      }
+      io->ring_data[0] = io->ring;
+      io->ring_head = 0;
+      io->ring_count = 1;
+    } else {
+#if defined(IO_HAVE_GSO)
+      rv = io->gro ? io_gro_fill (io) : io_mmsg_fill (io);
+#elif defined(IO_HAVE_MMSG)
+      rv = io_mmsg_fill (io);
+#else
+      rv = APR_ENOTIMPL;
+#endif
+      if (rv != APR_SUCCESS) {
+        return rv;
+      }
+    }
+  }
+
+  slot = io->ring_head;
+#ifdef IO_HAVE_MMSG
+  if (io->mode != IO_APR) {
+    // source address is transfer ID of the server
+    unsigned int src = io->ring_src[slot];
+    struct sockaddr_storage *from = (struct sockaddr_storage *)io->ring_addr + src;
+    addr->salen = io->addr_len[src] < sizeof(addr->sa) ? io->addr_len[src] : sizeof(addr->sa);
+    memcpy (&addr->sa, from, addr->salen);
+    addr->port = ntohs(((struct sockaddr_in *)from)->sin_port);
+  }
+#endif
+  *data = io->ring_data[slot];
+  *len = io->ring_len[slot];
+  io->tail = *data + *len;
+  io->tail_byte = *io->tail;
+  io->ring_head = (slot + 1) % io->ring_size;
+  io->ring_count--;
+
+  return APR_SUCCESS;
+}
@@ -0,0 +1,265 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_io.h
+ * @brief TFTP protocol library.
+ * Datagram I/O of TFTP machine.
+ *
+ * Packets are queued with tftp_io_send and sent with tftp_io_flush.
+ * Received packets are stored in ring of buffers and returned one by one
+ * with tftp_io_recv. With IO_MMSG whole queue is sent with one sendmmsg
+ * call and all queued datagrams are read with one recvmmsg call.
+ * IO_APR uses apr_socket_sendto and apr_socket_recvfrom per packet and
+ * is used when system does not support sendmmsg/recvmmsg.
+ * IO_GSO is IO_MMSG with UDP segmentation offload: queued packets of
+ * the same size are sent as one message and kernel splits it into
+ * datagrams (UDP_SEGMENT). Receive offload (UDP_GRO)
+ * delivers coalesced datagrams in one buffer which is split back into
+ * packets here.
+ * IO_URING queues sends, receives and file writes to io_uring of the
+ * event loop (see tftp_uring.h). It is IO_MMSG until machine is added
+ * to event loop and when loop can not create the ring.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_IO_H
+#define __TFTP_IO_H
+
+#include <apr_network_io.h>
+#include <apr_file_io.h>
+
+#include "tftp_uring.h"
+
+/*! Maximal number of datagrams sent or received with one system call. */
+#define IO_BATCH 32
+
+/*! Maximal wait in ms for full socket send buffer. Packets not sent are retransmitted. */
+#define IO_SEND_WAIT 10
+
+/*! Maximal number of segments in one offload buffer (kernel UDP_MAX_SEGMENTS). */
+#define IO_GSO_SEGS 64
+
+/*! Maximal size of one offload buffer: UDP payload over IPv6. */
+#define IO_GSO_SIZE (65535 - 8 - 40)
+
+/*! Receive offload buffer size: largest UDP datagram. */
+#define IO_GRO_SIZE 65535
+
+/*! @enum io_mode Datagram I/O implementation. */
+enum io_mode {
+  IO_APR,   /*!< One APR call per datagram. */
+  IO_MMSG,  /*!< sendmmsg/recvmmsg batches. */
+  IO_GSO,   /*!< sendmmsg/recvmsg with UDP segmentation and receive offload. */
+  IO_URING  /*!< Operations queued to io_uring of event loop. */
+};
+
+/*! I/O mode string representation. */
+static char *io_mode_str[] = {"apr", "mmsg", "gso", "uring"};
+
+/*! io_uring completion callback of machine I/O. */
+typedef void (*tftp_io_notify_cb)(void *baton);
+
+/**
+ * Queued outgoing packet.
+ */
+struct tftp_io_pkt {
+  const char  *data;    /*!< Packet or its header. Must not change until queue is flushed. */
+  apr_size_t  len;      /*!< Packet or header length. */
+  const char  *body;    /*!< Rest of the packet in other buffer or NULL. */
+  apr_size_t  body_len; /*!< Rest of the packet length. */
+};
+
+/**
+ * Datagram I/O structure.
+ */
+struct tftp_io {
+  enum io_mode        mode;       /*!< I/O implementation. */
+  apr_socket_t        *sock;      /*!< Socket. */
+  struct tftp_io_pkt  *queue;     /*!< Outgoing packets. */
+  char                *bounce;    /*!< Packet assembled from two buffers for IO_APR. */
+  unsigned int        queue_size; /*!< Maximal number of queued packets. */
+  unsigned int        queued;     /*!< Number of queued packets. */
+  char                *ring;      /*!< Receive buffers. */
+  char                **ring_data;/*!< Received datagrams. */
+  apr_size_t          *ring_len;  /*!< Received datagrams length. */
+  unsigned int        *ring_src;  /*!< Received datagrams source address index. */
+  void                *ring_addr; /*!< Source addresses. */
+  unsigned int        *addr_len;  /*!< Source addresses length. */
+  apr_size_t          buf_size;   /*!< Receive buffer size. */
+  unsigned int        ring_size;  /*!< Number of receive buffers. */
+  unsigned int        ring_head;  /*!< Next received datagram. */
+  unsigned int        ring_count; /*!< Received and not read datagrams. */
+  char                *tail;      /*!< Byte after last returned datagram. */
+  char                tail_byte;  /*!< Saved value of the byte after last returned datagram. */
+  int                 gso;        /*!< Send with UDP segmentation offload. */
+  int                 gro;        /*!< Receive with UDP receive offload. */
+  char                *gro_buf;   /*!< Receive offload buffer. */
+  unsigned int        *segs;      /*!< Number of packets in each sent message. */
+  void                *ctrl;      /*!< System call control messages. */
+  void                *msgs;      /*!< System call message headers. */
+  void                *iovs;      /*!< System call I/O vectors. */
+  struct tftp_uring   *uring;     /*!< io_uring of event loop or NULL. */
+  struct tftp_uring_chain chain;  /*!< Linked operations of machine step. */
+  struct tftp_uring_op recv_op;   /*!< Receive operation. */
+  struct tftp_uring_op send_op;   /*!< Send operations. */
+  struct tftp_uring_op cancel_op; /*!< Receive cancel operation. */
+  void                *rmsg;      /*!< Receive operation message header. */
+  unsigned int        inflight;   /*!< Submitted and not completed operations. */
+  int                 armed;      /*!< Receive operation is queued. */
+  int                 closing;    /*!< Receive operation is canceled. */
+  int                 built;      /*!< Message headers hold queued sends (see send_gen). */
+  unsigned long       send_gen;   /*!< Submission of queued sends. Headers are in use till then. */
+  char                *fixed;     /*!< Buffer of file writes or NULL. */
+  apr_size_t          fixed_len;  /*!< Buffer of file writes length. */
+  int                 buf_index;  /*!< Registered buffer index of file writes buffer or -1. */
+  apr_status_t        error;      /*!< Status of the first failed operation. */
+  tftp_io_notify_cb   notify;     /*!< Completion callback. */
+  void                *baton;     /*!< Completion callback argument. */
+};
+
+/**
+ * Init datagram I/O. Falls back to IO_MMSG and then to IO_APR if mode
+ * is not supported.
+ * @param io        I/O structure
+ * @param mp        APR memory pool
+ * @param sock      Socket
+ * @param mode      Requested I/O implementation
+ * @param batch     Maximal number of datagrams per system call
+ * @param buf_size  Maximal datagram size
+ * @return APR status
+ */
+apr_status_t tftp_io_init (struct tftp_io *io, apr_pool_t *mp, apr_socket_t *sock,
+                           enum io_mode mode, unsigned int batch, apr_size_t buf_size);
+
+/**
+ * Queue packet. Queue is flushed when it is full.
+ * @param io      I/O structure
+ * @param addr    Destination address
+ * @param data    Packet. Must not change until queue is flushed.
+ * @param len     Packet length
+ * @return APR status
+ */
+apr_status_t tftp_io_send (struct tftp_io *io, apr_sockaddr_t *addr, const char *data, apr_size_t len);
+
+/**
+ * Queue packet of two buffers (scatter/gather), e.g. DATA header
+ * and block of mapped file. Body is never copied, except with IO_APR.
+ * @param io        I/O structure
+ * @param addr      Destination address
+ * @param data      Packet header. Must not change until queue is flushed.
+ * @param len       Packet header length
+ * @param body      Rest of the packet. Must not change until queue is flushed.
+ * @param body_len  Rest of the packet length
+ * @return APR status
+ */
+apr_status_t tftp_io_sendv (struct tftp_io *io, apr_sockaddr_t *addr, const char *data, apr_size_t len,
+                            const char *body, apr_size_t body_len);
+
+/**
+ * Send all queued packets. With IO_GSO, packets of the same size
+ * are sent as one message. Last of them may be shorter.
+ * @param io      I/O structure
+ * @param addr    Destination address
+ * @return APR status
+ */
+apr_status_t tftp_io_flush (struct tftp_io *io, apr_sockaddr_t *addr);
+
+/**
+ * Receive next datagram. Waits according to socket timeout.
+ * Received datagram is followed by one writable byte. Byte is restored
+ * on the next call, so datagram may be terminated in place.
+ * @param io      I/O structure
+ * @param addr    Source address of the datagram
+ * @param data    Datagram in receive buffer, valid until next call
+ * @param len     Datagram length
+ * @return APR status. APR_EAGAIN or APR_TIMEUP if nothing is received.
+ */
+apr_status_t tftp_io_recv (struct tftp_io *io, apr_sockaddr_t *addr, char **data, apr_size_t *len);
+
+/**
+ * Buffer of file writes. Registered to io_uring when it is attached
+ * or right away if io_uring is already attached.
+ * @param io      I/O structure
+ * @param buf     Buffer
+ * @param len     Buffer length
+ */
+void tftp_io_register (struct tftp_io *io, char *buf, apr_size_t len);
+
+/**
+ * Queue file write at offset to io_uring. Write is not linked to
+ * datagram operations and counts as in flight until operation handler
+ * calls tftp_io_write_done. Data must not change until then.
+ * @param io      I/O structure
+ * @param file    File
+ * @param data    Data
+ * @param len     Data length
+ * @param off     File offset
+ * @param op      Write operation
+ * @return APR status. APR_ENOTIMPL if io_uring is not attached.
+ */
+apr_status_t tftp_io_write_at (struct tftp_io *io, apr_file_t *file, const char *data,
+                               apr_size_t len, apr_off_t off, struct tftp_uring_op *op);
+
+/**
+ * Queued file write is completed.
+ * @param io      I/O structure
+ * @param res     Operation result
+ * @param len     Data length
+ */
+void tftp_io_write_done (struct tftp_io *io, int res, apr_size_t len);
+
+/**
+ * Use io_uring of event loop.
+ * @param io      I/O structure
+ * @param uring   io_uring engine
+ * @param notify  Called when operation is completed
+ * @param baton   Callback argument
+ */
+void tftp_io_uring_attach (struct tftp_io *io, struct tftp_uring *uring,
+                           tftp_io_notify_cb notify, void *baton);
+
+/**
+ * Stop using io_uring. No operation may be in flight.
+ * @param io      I/O structure
+ */
+void tftp_io_uring_detach (struct tftp_io *io);
+
+/**
+ * Make room in io_uring for operations of one machine step,
+ * so linked operations are submitted together.
+ * @param io      I/O structure
+ */
+void tftp_io_uring_reserve (struct tftp_io *io);
+
+/**
+ * Cancel queued receive operation. Machine does not wait anymore.
+ * @param io      I/O structure
+ */
+void tftp_io_uring_cancel (struct tftp_io *io);
+
+/*! Check if received datagrams are waiting in ring. */
+#define tftp_io_pending(io) ((io)->ring_count > 0)
+
+/*! Check if io_uring operations are in flight. */
+#define tftp_io_busy(io) ((io)->inflight > 0)
+
+#endif
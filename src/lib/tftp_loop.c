@@ -0,0 +1,416 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_loop.c
+ * @brief TFTP protocol library.
+ * Event loop for many concurrent transfers in one thread.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#include "tftp_loop.h"
+#include "util.h"
+
+/**
+ * Transfer running in event loop.
+ */
+struct tftp_session {
+  struct tftp_machine *machine; /*!< TFTP machine. */
+  struct tftp_loop    *loop;    /*!< Event loop. */
+  apr_pollfd_t        pfd;      /*!< Pollset descriptor of machine socket. */
+  apr_pollfd_t        group_pfd; /*!< Pollset descriptor of multicast group socket of client. */
+  struct tftp_timer   timer;    /*!< Retransmission timer. */
+  tftp_loop_done_cb   done;     /*!< Completion callback. */
+  void                *baton;   /*!< Completion callback argument. */
+  struct tftp_session *next;    /*!< Next session of the loop. */
+  struct tftp_session *prev;    /*!< Previous session of the loop. */
+  bool                closing;  /*!< Transfer is over, waiting for io_uring operations. */
+};
+
+/**
+ * Remove session from pollset and timers of the loop.
+ */
+static void session_unlink (struct tftp_session *session)
+{
+  struct tftp_loop *loop = session->loop;
+
+  tftp_timer_cancel (&loop->wheel, &session->timer);
+  if (session->machine->io.uring == NULL) {
+    apr_pollset_remove (loop->pollset, &session->pfd);
+  }
+  if (session->group_pfd.desc.s) {
+    apr_pollset_remove (loop->pollset, &session->group_pfd);
+    session->group_pfd.desc.s = NULL;
+  }
+  if (session->prev) {
+    session->prev->next = session->next;
+  } else {
+    loop->list = session->next;
+  }
+  if (session->next) {
+    session->next->prev = session->prev;
+  }
+  session->next = session->prev = NULL;
+  loop->sessions--;
+}
+
+/**
+ * Finished transfer waits until its io_uring operations are completed.
+ * Buffers and descriptors are in use till then.
+ * @return TRUE if operations are in flight.
+ */
+static bool session_closing (struct tftp_session *session)
+{
+  struct tftp_machine *machine = session->machine;
+
+  if (machine->io.uring == NULL) {
+    return FALSE;
+  }
+  if (!session->closing) {
+    session->closing = TRUE;
+    tftp_timer_cancel (&session->loop->wheel, &session->timer);
+    tftp_io_uring_cancel (&machine->io);
+  }
+  if (tftp_io_busy (&machine->io)) {
+    return TRUE;
+  }
+  // queued file writes are part of transfer result
+  if (machine->io.error != APR_SUCCESS && machine->status == APR_SUCCESS) {
+    ERR("Failed to complete I/O of %s.", machine->remote_file);
+    machine->status = machine->io.error;
+  }
+  return FALSE;
+}
+
+/**
+ * Client joins multicast group on OACK of server. Group socket is
+ * polled together with machine socket.
+ */
+static void session_group (struct tftp_session *session)
+{
+  struct tftp_machine *machine = session->machine;
+  apr_status_t rv;
+
+  if (machine->mcast == NULL || machine->mcast->sock == NULL || session->group_pfd.desc.s) {
+    return;
+  }
+  session->group_pfd.p = machine->mp;
+  session->group_pfd.desc_type = APR_POLL_SOCKET;
+  session->group_pfd.reqevents = APR_POLLIN;
+  session->group_pfd.desc.s = machine->mcast->sock;
+  session->group_pfd.client_data = session;
+  rv = apr_pollset_add (session->loop->pollset, &session->group_pfd);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to add multicast group of %s to pollset.", machine->remote_file);
+    session->group_pfd.desc.s = NULL;
+    machine->status = rv;
+    machine->state = END;
+  }
+}
+
+/**
+ * Datagrams of previous batch call are not parsed yet.
+ */
+static bool session_pending (struct tftp_machine *machine)
+{
+  return tftp_io_pending (&machine->io) || (machine->mcast && tftp_io_pending (&machine->mcast->io));
+}
+
+/**
+ * Arm retransmission timer of waiting machine or
+ * release finished transfer.
+ */
+static void session_update (struct tftp_session *session)
+{
+  struct tftp_loop *loop = session->loop;
+  struct tftp_machine *machine = session->machine;
+
+  // client joins multicast group on OACK
+  if (machine->state != END) {
+    session_group (session);
+  }
+  if (machine->state != END) {
+    if (machine->wait && !tftp_timer_pending (&session->timer)) {
+      tftp_timer_add (&loop->wheel, &session->timer, tftp_rtt_deadline (&machine->rtt));
+    }
+    return;
+  }
+  if (session_closing (session)) {
+    return;
+  }
+
+  DBG("Transfer of %s is over.", machine->remote_file);
+  session_unlink (session);
+  tftp_io_uring_detach (&machine->io);
+  if (session->done) {
+    session->done (machine, session->baton);
+  }
+  // session is allocated from machine pool
+  tftp_proto_destroy (machine);
+}
+
+/**
+ * Socket of the machine is readable.
+ */
+static void session_input (struct tftp_session *session)
+{
+  struct tftp_machine *machine = session->machine;
+  int i;
+
+  tftp_io_uring_reserve (&machine->io);
+  // drain datagrams already received with one batch call
+  for (i = 0; (i < LOOP_BATCH || session_pending (machine)) && machine->wait; i++) {
+    tftp_proto_recv (machine);
+    if (machine->wait) {
+      break;  // socket is drained
+    }
+    tftp_timer_cancel (&session->loop->wheel, &session->timer);
+    tftp_proto_run (machine);
+  }
+  session_update (session);
+}
+
+/**
+ * Retransmission timer of the machine expired.
+ */
+static void session_timeout (struct tftp_timer *timer, void *baton)
+{
+  struct tftp_session *session = baton;
+
+  tftp_io_uring_reserve (&session->machine->io);
+  tftp_proto_timer (session->machine);
+  tftp_proto_run (session->machine);
+  session_update (session);
+}
+
+/**
+ * io_uring operation of the machine is completed.
+ */
+static void session_notify (void *baton)
+{
+  struct tftp_session *session = baton;
+  struct tftp_machine *machine = session->machine;
+
+  if (session->closing) {
+    session_update (session);
+  } else if (session_pending (machine) || machine->io.error != APR_SUCCESS) {
+    session_input (session);
+  }
+}
+
+/**
+ * Shared io_uring of the loop. Created for the first transfer that
+ * uses it. Loop falls back to epoll if ring can not be created.
+ */
+static struct tftp_uring *loop_uring (struct tftp_loop *loop)
+{
+  if (loop->uring || loop->uring_failed) {
+    return loop->uring;
+  }
+  if (tftp_uring_create (&loop->uring, loop->mp, loop->size) == APR_SUCCESS) {
+    // completions are polled with wakeup pipe and timers
+    loop->uring_pfd.p = loop->mp;
+    loop->uring_pfd.desc_type = APR_POLL_FILE;
+    loop->uring_pfd.reqevents = APR_POLLIN;
+    loop->uring_pfd.desc.f = tftp_uring_file (loop->uring);
+    loop->uring_pfd.client_data = NULL;
+    if (apr_pollset_add (loop->pollset, &loop->uring_pfd) == APR_SUCCESS) {
+      return loop->uring;
+    }
+    ERR("Failed to add io_uring to pollset.");
+  }
+  DBG("io_uring is not available. Use epoll.");
+  loop->uring = NULL;
+  loop->uring_failed = TRUE;
+  return NULL;
+}
+
+apr_status_t tftp_loop_create (struct tftp_loop **new, apr_pool_t *mp, apr_uint32_t size)
+{
+  apr_status_t rv;
+  struct tftp_loop *loop = apr_pcalloc(mp, sizeof(struct tftp_loop));
+
+  // wakeable, so other threads can interrupt poll (see tftp_loop_wakeup)
+  rv = apr_pollset_create_ex (&loop->pollset, size, mp, APR_POLLSET_WAKEABLE, APR_POLLSET_EPOLL);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to create pollset for %u transfers.", size);
+    return rv;
+  }
+  loop->mp = mp;
+  loop->size = size;
+  tftp_wheel_init (&loop->wheel, apr_time_now());
+  *new = loop;
+
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_loop_add (struct tftp_loop *loop, struct tftp_machine *machine,
+                            tftp_loop_done_cb done, void *baton)
+{
+  struct tftp_session *session = apr_pcalloc(machine->mp, sizeof(struct tftp_session));
+
+  session->machine = machine;
+  session->done = done;
+  session->baton = baton;
+  tftp_timer_init (&session->timer, session_timeout, session);
+
+  // machine never blocks in event loop
+  apr_socket_timeout_set (machine->sock, 0);
+
+  session->pfd.p = machine->mp;
+  session->pfd.desc_type = APR_POLL_SOCKET;
+  session->pfd.reqevents = APR_POLLIN;
+  session->pfd.desc.s = machine->sock;
+  session->pfd.client_data = session;
+
+  if (machine->io.mode == IO_URING) {
+    struct tftp_uring *uring = loop_uring (loop);
+    if (uring) {
+      tftp_io_uring_attach (&machine->io, uring, session_notify, session);
+    } else {
+      machine->io.mode = IO_MMSG;
+    }
+  }
+
+  return tftp_loop_attach (loop, session);
+}
+
+apr_status_t tftp_loop_listen (struct tftp_loop *loop, apr_socket_t *sock,
+                               tftp_loop_input_cb input, void *baton)
+{
+  apr_status_t rv;
+
+  apr_socket_timeout_set (sock, 0);
+  loop->listen_pfd.p = loop->mp;
+  loop->listen_pfd.desc_type = APR_POLL_SOCKET;
+  loop->listen_pfd.reqevents = APR_POLLIN;
+  loop->listen_pfd.desc.s = sock;
+  loop->listen_pfd.client_data = &loop->listen_pfd;
+  rv = apr_pollset_add (loop->pollset, &loop->listen_pfd);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to add listening socket to pollset.");
+    return rv;
+  }
+  loop->listen = input;
+  loop->listen_baton = baton;
+
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_loop_attach (struct tftp_loop *loop, struct tftp_session *session)
+{
+  apr_status_t rv;
+  struct tftp_machine *machine = session->machine;
+
+  session->loop = loop;
+  // io_uring receives datagrams of its transfers
+  if (machine->io.uring == NULL) {
+    rv = apr_pollset_add (loop->pollset, &session->pfd);
+    if (rv != APR_SUCCESS) {
+      ERR("Failed to add transfer of %s to pollset.", machine->remote_file);
+      return rv;
+    }
+  }
+  session->next = loop->list;
+  session->prev = NULL;
+  if (loop->list) {
+    loop->list->prev = session;
+  }
+  loop->list = session;
+  loop->sessions++;
+
+  // send request or arm timer of running transfer
+  tftp_io_uring_reserve (&machine->io);
+  tftp_proto_run (machine);
+  session_update (session);
+
+  return APR_SUCCESS;
+}
+
+struct tftp_session *tftp_loop_detach (struct tftp_loop *loop)
+{
+  struct tftp_session *session = loop->list;
+
+  if (session == NULL || loop->uring) return NULL;
+  session_unlink (session);
+  DBG("Detached transfer of %s.", session->machine->remote_file);
+
+  return session;
+}
+
+void *tftp_loop_session_baton (struct tftp_session *session)
+{
+  return session->baton;
+}
+
+apr_status_t tftp_loop_poll (struct tftp_loop *loop, apr_interval_time_t timeout)
+{
+  apr_status_t rv;
+  apr_int32_t num, i;
+  const apr_pollfd_t *descs;
+  apr_interval_time_t next = tftp_wheel_timeout (&loop->wheel, apr_time_now());
+
+  if (timeout < 0 || (next >= 0 && next < timeout)) {
+    timeout = next;
+  }
+  // operations queued by transfers since last poll
+  if (loop->uring && (rv = tftp_uring_submit (loop->uring)) != APR_SUCCESS) {
+    return rv;
+  }
+  rv = apr_pollset_poll (loop->pollset, timeout, &num, &descs);
+  if (rv != APR_SUCCESS && !APR_STATUS_IS_TIMEUP(rv) && !APR_STATUS_IS_EINTR(rv)) {
+    ERR("Failed to poll transfers sockets.");
+    return rv;
+  }
+  if (rv == APR_SUCCESS) {
+    for (i = 0; i < num; i++) {
+      if (descs[i].client_data == NULL) {
+        tftp_uring_reap (loop->uring);
+      } else if (descs[i].client_data == &loop->listen_pfd) {
+        loop->listen (loop->listen_baton);
+      } else {
+        session_input (descs[i].client_data);
+      }
+    }
+  }
+  tftp_wheel_advance (&loop->wheel, apr_time_now());
+
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_loop_wakeup (struct tftp_loop *loop)
+{
+  return apr_pollset_wakeup (loop->pollset);
+}
+
+apr_status_t tftp_loop_run (struct tftp_loop *loop)
+{
+  apr_status_t rv;
+
+  while (loop->sessions > 0) {
+    rv = tftp_loop_poll (loop, -1);
+    if (rv != APR_SUCCESS) {
+      return rv;
+    }
+  }
+
+  return APR_SUCCESS;
+}
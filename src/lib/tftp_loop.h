@@ -0,0 +1,160 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_loop.h
+ * @brief TFTP protocol library.
+ * Event loop for many concurrent transfers in one thread.
+ *
+ * Sockets of all transfers are registered in APR pollset (epoll on Linux)
+ * and retransmission timers live in hierarchical timing wheel
+ * (see tftp_timer.h). Machine is advanced only when packet is received
+ * or its timer expires.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_LOOP_H
+#define __TFTP_LOOP_H
+
+#include <apr_poll.h>
+
+#include "tftp_proto.h"
+#include "tftp_timer.h"
+
+/*! Maximal number of packets received from one socket per poll. */
+#define LOOP_BATCH 64
+
+/**
+ * Transfer completion callback. Called when machine reaches END state,
+ * right before machine is destroyed.
+ */
+typedef void (*tftp_loop_done_cb)(struct tftp_machine *machine, void *baton);
+
+/*! Transfer running in event loop. */
+struct tftp_session;
+
+/**
+ * Input callback of socket polled by event loop together with
+ * transfers (see tftp_loop_listen). Called when socket is readable.
+ */
+typedef void (*tftp_loop_input_cb)(void *baton);
+
+/**
+ * Event loop structure.
+ */
+struct tftp_loop {
+  apr_pool_t        *mp;        /*!< APR memory pool. */
+  apr_pollset_t     *pollset;   /*!< Sockets of running transfers. */
+  struct tftp_wheel wheel;      /*!< Retransmission timers. */
+  unsigned int      sessions;   /*!< Number of running transfers. */
+  struct tftp_session *list;    /*!< Running transfers. */
+  apr_uint32_t      size;       /*!< Maximal number of concurrent transfers. */
+  struct tftp_uring *uring;     /*!< io_uring of transfers with IO_URING or NULL (see tftp_uring.h). */
+  apr_pollfd_t      uring_pfd;  /*!< Pollset descriptor of io_uring. */
+  bool              uring_failed; /*!< io_uring can not be created, transfers use epoll. */
+  apr_pollfd_t      listen_pfd; /*!< Pollset descriptor of listening socket. */
+  tftp_loop_input_cb listen;    /*!< Input callback of listening socket or NULL. */
+  void              *listen_baton; /*!< Input callback argument. */
+};
+
+/**
+ * Create event loop.
+ * @param loop  Created event loop
+ * @param mp    APR memory pool
+ * @param size  Maximal number of concurrent transfers
+ * @return APR status
+ */
+apr_status_t tftp_loop_create (struct tftp_loop **loop, apr_pool_t *mp, apr_uint32_t size);
+
+/**
+ * Start transfer in event loop. Loop takes ownership of the machine
+ * and destroys it when transfer is over.
+ * @param loop    Event loop
+ * @param machine TFTP machine created with tftp_proto_create
+ * @param done    Completion callback or NULL
+ * @param baton   Completion callback argument
+ * @return APR status
+ */
+apr_status_t tftp_loop_add (struct tftp_loop *loop, struct tftp_machine *machine,
+                            tftp_loop_done_cb done, void *baton);
+
+/**
+ * Poll socket that receives requests (server) together with transfers.
+ * Callback starts transfers with tftp_loop_add. Loop polls one
+ * listening socket.
+ * @param loop    Event loop
+ * @param sock    Listening socket
+ * @param input   Input callback
+ * @param baton   Input callback argument
+ * @return APR status
+ */
+apr_status_t tftp_loop_listen (struct tftp_loop *loop, apr_socket_t *sock,
+                               tftp_loop_input_cb input, void *baton);
+
+/**
+ * Add transfer detached from other loop (see tftp_loop_detach).
+ * Machine keeps its state and retransmission timer is armed again.
+ * @param loop    Event loop
+ * @param session Detached session
+ * @return APR status
+ */
+apr_status_t tftp_loop_attach (struct tftp_loop *loop, struct tftp_session *session);
+
+/**
+ * Remove one running transfer from event loop, so it can be attached
+ * to loop of other thread. Machine and session are not destroyed.
+ * Transfers of loop with io_uring are never detached: their operations
+ * are in flight in the loop ring.
+ * @param loop  Event loop
+ * @return Detached session or NULL if loop has no transfers.
+ */
+struct tftp_session *tftp_loop_detach (struct tftp_loop *loop);
+
+/**
+ * Completion callback argument of the session.
+ * @param session Session
+ * @return Callback argument
+ */
+void *tftp_loop_session_baton (struct tftp_session *session);
+
+/**
+ * Wait for packets or timers and advance transfers once.
+ * @param loop    Event loop
+ * @param timeout Maximal time to wait or -1 to wait for the next timer
+ * @return APR status
+ */
+apr_status_t tftp_loop_poll (struct tftp_loop *loop, apr_interval_time_t timeout);
+
+/**
+ * Interrupt tftp_loop_poll. Can be called from any thread.
+ * @param loop  Event loop
+ * @return APR status
+ */
+apr_status_t tftp_loop_wakeup (struct tftp_loop *loop);
+
+/**
+ * Run event loop until all transfers are over.
+ * @param loop  Event loop
+ * @return APR status
+ */
+apr_status_t tftp_loop_run (struct tftp_loop *loop);
+
+#endif
@@ -0,0 +1,220 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_mcast.c
+ * @brief TFTP protocol library.
+ * Multicast transfers (RFC2090).
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+#include <string.h>
+
+#include "tftp_mcast.h"
+#include "util.h"
+
+/*! Initial number of blocks of client bitmap when file size is unknown. */
+#define MCAST_BITS_MIN 1024
+
+/**
+ * Address of interface of route to server. Connecting UDP socket
+ * sends nothing, kernel only selects route.
+ */
+static apr_status_t mcast_iface (apr_sockaddr_t **iface, apr_pool_t *mp, apr_sockaddr_t *server)
+{
+  apr_socket_t *sock;
+  apr_status_t rv;
+
+  rv = apr_socket_create (&sock, APR_INET, SOCK_DGRAM, APR_PROTO_UDP, mp);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  rv = apr_socket_connect (sock, server);
+  if (rv == APR_SUCCESS) {
+    rv = apr_socket_addr_get (iface, APR_LOCAL, sock);
+  }
+  apr_socket_close (sock);
+  return rv;
+}
+
+/**
+ * Grow bitmap to hold block.
+ */
+static void mcast_grow (struct tftp_mcast *mcast, apr_uint64_t seq)
+{
+  apr_uint64_t len = mcast->bits_len ? mcast->bits_len * 2 : MCAST_BITS_MIN;
+  unsigned char *bits;
+
+  if (len < seq) {
+    len = seq;
+  }
+  len = APR_ALIGN(len, 8);
+  bits = apr_pcalloc(mcast->mp, len / 8);
+  if (mcast->bits) {
+    memcpy (bits, mcast->bits, mcast->bits_len / 8);
+  }
+  mcast->bits = bits;
+  mcast->bits_len = len;
+}
+
+apr_status_t tftp_mcast_join (struct tftp_mcast **new, apr_pool_t *mp, const char *addr, apr_port_t port,
+                              apr_sockaddr_t *server, enum io_mode mode, apr_size_t buf_size)
+{
+  struct tftp_mcast *mcast = apr_pcalloc(mp, sizeof(struct tftp_mcast));
+  apr_sockaddr_t *iface;
+  apr_status_t rv;
+
+  mcast->mp = mp;
+  mcast->next = 1;
+  rv = apr_sockaddr_info_get (&mcast->group, addr, APR_INET, port, 0, mp);
+  if (rv != APR_SUCCESS) {
+    ERR("Invalid multicast group %s:%u.", addr, port);
+    return rv;
+  }
+  rv = mcast_iface (&iface, mp, server);
+  if (rv != APR_SUCCESS) {
+    ERR("No route to server for multicast group.");
+    return rv;
+  }
+  rv = apr_socket_create (&mcast->sock, APR_INET, SOCK_DGRAM, APR_PROTO_UDP, mp);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  // clients on the same host share group port
+  apr_socket_opt_set (mcast->sock, APR_SO_REUSEADDR, 1);
+  rv = apr_socket_bind (mcast->sock, mcast->group);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to bind multicast group %s:%u.", addr, port);
+    return rv;
+  }
+  rv = apr_mcast_join (mcast->sock, mcast->group, iface, NULL);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to join multicast group %s:%u.", addr, port);
+    return rv;
+  }
+  apr_socket_timeout_set (mcast->sock, 0);
+  rv = tftp_io_init (&mcast->io, mp, mcast->sock, mode == IO_URING ? IO_MMSG : mode, IO_BATCH, buf_size);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  DBG("Joined multicast group %s:%u.", addr, port);
+
+  *new = mcast;
+  return APR_SUCCESS;
+}
+
+int tftp_mcast_test (struct tftp_mcast *mcast, apr_uint64_t seq)
+{
+  return seq > 0 && seq <= mcast->bits_len && (mcast->bits[(seq - 1) / 8] & (1 << ((seq - 1) % 8)));
+}
+
+void tftp_mcast_set (struct tftp_mcast *mcast, apr_uint64_t seq)
+{
+  if (seq > mcast->bits_len) {
+    mcast_grow (mcast, seq);
+  }
+  mcast->bits[(seq - 1) / 8] |= 1 << ((seq - 1) % 8);
+  while (tftp_mcast_test (mcast, mcast->next)) {
+    mcast->next++;
+  }
+}
+
+apr_status_t tftp_mcast_serve (struct tftp_mcast **new, apr_pool_t *mp, apr_socket_t *sock,
+                               apr_sockaddr_t *group, apr_sockaddr_t *iface, apr_sockaddr_t *master,
+                               apr_uint64_t blocks)
+{
+  struct tftp_mcast *mcast = apr_pcalloc(mp, sizeof(struct tftp_mcast));
+  struct tftp_mcast_client *client;
+  apr_status_t rv;
+
+  mcast->mp = mp;
+  mcast->group = group;
+  mcast->blocks = blocks;
+  rv = apr_sockaddr_info_get (&mcast->from, NULL, APR_INET, 0, 0, mp);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  if (iface) {
+    rv = apr_mcast_interface (sock, iface);
+    if (rv != APR_SUCCESS) {
+      ERR("Failed to set multicast interface.");
+      return rv;
+    }
+  }
+  // clients on server host receive group too
+  apr_mcast_loopback (sock, 1);
+
+  mcast->clients = apr_array_make (mp, 8, sizeof(struct tftp_mcast_client));
+  client = apr_array_push (mcast->clients);
+  client->addr = master;
+  client->done = 0;
+  mcast->master = 0;
+
+  *new = mcast;
+  return APR_SUCCESS;
+}
+
+struct tftp_mcast_client *tftp_mcast_find (struct tftp_mcast *mcast, apr_sockaddr_t *addr)
+{
+  struct tftp_mcast_client *clients = (struct tftp_mcast_client *)mcast->clients->elts;
+  int i;
+
+  for (i = 0; i < mcast->clients->nelts; i++) {
+    if (clients[i].addr->port == addr->port && apr_sockaddr_equal (clients[i].addr, addr)) {
+      return &clients[i];
+    }
+  }
+  return NULL;
+}
+
+struct tftp_mcast_client *tftp_mcast_add (struct tftp_mcast *mcast, const char *host, apr_port_t port)
+{
+  struct tftp_mcast_client *client;
+  apr_sockaddr_t *addr;
+
+  if (apr_sockaddr_info_get (&addr, host, APR_INET, port, 0, mcast->mp) != APR_SUCCESS) {
+    return NULL;
+  }
+  client = tftp_mcast_find (mcast, addr);
+  if (client == NULL) {
+    client = apr_array_push (mcast->clients);
+    client->addr = addr;
+  }
+  // client asks for file again
+  client->done = 0;
+  return client;
+}
+
+struct tftp_mcast_client *tftp_mcast_next (struct tftp_mcast *mcast)
+{
+  struct tftp_mcast_client *clients = (struct tftp_mcast_client *)mcast->clients->elts;
+  unsigned int n = mcast->clients->nelts;
+  unsigned int i, idx;
+
+  clients[mcast->master].done = 1;
+  for (i = 1; i < n; i++) {
+    idx = (mcast->master + i) % n;
+    if (!clients[idx].done) {
+      mcast->master = idx;
+      return &clients[idx];
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,143 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_mcast.h
+ * @brief TFTP protocol library.
+ * Multicast transfers (RFC2090).
+ *
+ * Server sends every block of RRQ once to the multicast group. Only
+ * master client acknowledges blocks, the rest of the clients (passive)
+ * collect blocks from the group. When master client has the file,
+ * server makes one of the clients still missing blocks the master.
+ * New master acknowledges the block before its first missing one and
+ * server continues from there. Client tracks received blocks in bitmap,
+ * so blocks can come in any order.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_MCAST_H
+#define __TFTP_MCAST_H
+
+#include <apr_general.h>
+#include <apr_network_io.h>
+#include <apr_tables.h>
+
+#include "tftp_io.h"
+
+/**
+ * Client of server multicast transfer.
+ */
+struct tftp_mcast_client {
+  apr_sockaddr_t      *addr;      /*!< Client address (transaction id). */
+  int                 done;       /*!< Client has the file or does not answer. */
+};
+
+/**
+ * Multicast transfer state of client or server.
+ */
+struct tftp_mcast {
+  apr_pool_t          *mp;        /*!< Memory pool of transfer. */
+  apr_sockaddr_t      *group;     /*!< Group address and port. */
+  apr_socket_t        *sock;      /*!< Group socket of client. */
+  struct tftp_io      io;         /*!< Datagram I/O of group socket. */
+  unsigned char       *bits;      /*!< Received blocks bitmap of client. First bit is block 1. */
+  apr_uint64_t        bits_len;   /*!< Number of blocks bitmap holds. */
+  apr_uint64_t        next;       /*!< First missing block of client. */
+  apr_uint64_t        last;       /*!< Number of blocks. Zero until client receives last block. */
+  apr_array_header_t  *clients;   /*!< Clients of server transfer or NULL on client. */
+  unsigned int        master;     /*!< Master client index. */
+  apr_sockaddr_t      *from;      /*!< Source of packet received by server. */
+  apr_uint64_t        blocks;     /*!< Number of blocks of file served by server. */
+  const char          *path;      /*!< File served by server. */
+};
+
+/**
+ * Join multicast group announced by server.
+ * Group is joined on interface of route to server.
+ * @param mcast     Created multicast state
+ * @param mp        APR memory pool
+ * @param addr      Group address
+ * @param port      Group port
+ * @param server    Server address
+ * @param mode      Datagram I/O of group socket
+ * @param buf_size  Maximal datagram size
+ * @return APR status
+ */
+apr_status_t tftp_mcast_join (struct tftp_mcast **mcast, apr_pool_t *mp, const char *addr, apr_port_t port,
+                              apr_sockaddr_t *server, enum io_mode mode, apr_size_t buf_size);
+
+/**
+ * Block is received.
+ * @param mcast   Multicast state
+ * @param seq     Logical block number starting from 1
+ * @return Non-zero if block is received
+ */
+int tftp_mcast_test (struct tftp_mcast *mcast, apr_uint64_t seq);
+
+/**
+ * Mark block received and move first missing block.
+ * @param mcast   Multicast state
+ * @param seq     Logical block number starting from 1
+ */
+void tftp_mcast_set (struct tftp_mcast *mcast, apr_uint64_t seq);
+
+/**
+ * Serve file to group from socket of server transfer.
+ * @param mcast   Created multicast state
+ * @param mp      APR memory pool
+ * @param sock    Socket of server transfer
+ * @param group   Group address and port
+ * @param iface   Address of interface to send from or NULL for default
+ * @param master  Address of the first client. It is master client.
+ * @param blocks  Number of blocks of served file
+ * @return APR status
+ */
+apr_status_t tftp_mcast_serve (struct tftp_mcast **mcast, apr_pool_t *mp, apr_socket_t *sock,
+                               apr_sockaddr_t *group, apr_sockaddr_t *iface, apr_sockaddr_t *master,
+                               apr_uint64_t blocks);
+
+/**
+ * Add client to server transfer. Client which is already added is
+ * returned again.
+ * @param mcast   Multicast state
+ * @param host    Client IP address
+ * @param port    Client port
+ * @return Client or NULL if address is invalid
+ */
+struct tftp_mcast_client *tftp_mcast_add (struct tftp_mcast *mcast, const char *host, apr_port_t port);
+
+/**
+ * Find client of server transfer by address.
+ * @param mcast   Multicast state
+ * @param addr    Client address
+ * @return Client or NULL
+ */
+struct tftp_mcast_client *tftp_mcast_find (struct tftp_mcast *mcast, apr_sockaddr_t *addr);
+
+/**
+ * Master client is done. Make the next client missing blocks master.
+ * @param mcast   Multicast state
+ * @return New master client or NULL if all clients are done
+ */
+struct tftp_mcast_client *tftp_mcast_next (struct tftp_mcast *mcast);
+
+#endif
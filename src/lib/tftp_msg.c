@@ -1,848 +0,0 @@
-
-#line 1 "tftp_msg.rl"
-/**
- * tftpclient -- TFTP client application.
- * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
- *
- * This file is part of tftpclient.
- *
- * tftpclient is free software: you can redistribute it and/or modify
- * it under the terms of the GNU General Public License as published by
- * the Free Software Foundation, either version 3 of the License, or
- * (at your option) any later version.
- *
- * tftpclient is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License
- * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
- */
-
-/**
- * @file tftp_msg.c
- * @brief TFTP protocol library.
- * Message parsing and creating.
- *
- * @author Stas Kobzar <staskobzar@gmail.com>
- */
-#include "tftp_msg.h"
-
-/**
- * Ragel Finit State Machine
- */
-
-#line 98 "tftp_msg.rl"
-
-
-
-#line 41 "tftp_msg.c"
-static const char _tftp_actions[] = {
-	0, 1, 0, 1, 1, 1, 2, 1, 
-	3, 1, 5, 1, 6, 1, 7, 2, 
-	2, 4
-};
-
-static const char _tftp_key_offsets[] = {
-	0, 0, 1, 6, 8, 11, 17, 19, 
-	21, 23, 24, 26, 28, 30, 32, 34, 
-	36, 38, 40, 42, 44, 46, 46, 46, 
-	46, 46, 46, 46, 46, 48, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51, 51, 51, 51, 51, 51, 51, 51, 
-	51
-};
-
-static const char _tftp_trans_keys[] = {
-	0, 1, 2, 3, 4, 5, 1, 127, 
-	0, 1, 127, 77, 78, 79, 109, 110, 
-	111, 65, 97, 73, 105, 76, 108, 0, 
-	69, 101, 84, 116, 65, 97, 83, 115, 
-	67, 99, 73, 105, 73, 105, 67, 99, 
-	84, 116, 69, 101, 84, 116, 1, 127, 
-	0, 1, 127, 0
-};
-
-static const char _tftp_single_lengths[] = {
-	0, 1, 5, 0, 1, 6, 2, 2, 
-	2, 1, 2, 2, 2, 2, 2, 2, 
-	2, 2, 2, 2, 2, 0, 0, 0, 
-	0, 0, 0, 0, 0, 1, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0
-};
-
-static const char _tftp_range_lengths[] = {
-	0, 0, 0, 1, 1, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 1, 1, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0
-};
-
-static const short _tftp_index_offsets[] = {
-	0, 0, 2, 8, 10, 13, 20, 23, 
-	26, 29, 31, 34, 37, 40, 43, 46, 
-	49, 52, 55, 58, 61, 64, 65, 66, 
-	67, 68, 69, 70, 71, 73, 76, 77, 
-	78, 79, 80, 81, 82, 83, 84, 85, 
-	86, 87, 88, 89, 90, 91, 92, 93, 
-	94, 95, 96, 97, 98, 99, 100, 101, 
-	102, 103, 104, 105, 106, 107, 108, 109, 
-	110, 111, 112, 113, 114, 115, 116, 117, 
-	118, 119, 120, 121, 122, 123, 124, 125, 
-	126, 127, 128, 129, 130, 131, 132, 133, 
-	134, 135, 136, 137, 138, 139, 140, 141, 
-	142, 143, 144, 145, 146, 147, 148, 149, 
-	150, 151, 152, 153, 154, 155, 156, 157, 
-	158, 159, 160, 161, 162, 163, 164, 165, 
-	166, 167, 168, 169, 170, 171, 172, 173, 
-	174, 175, 176, 177, 178, 179, 180, 181, 
-	182, 183, 184, 185, 186, 187, 188, 189, 
-	190, 191, 192, 193, 194, 195, 196, 197, 
-	198, 199, 200, 201, 202, 203, 204, 205, 
-	206, 207, 208, 209, 210, 211, 212, 213, 
-	214, 215, 216, 217, 218, 219, 220, 221, 
-	222, 223, 224, 225, 226, 227, 228, 229, 
-	230, 231, 232, 233, 234, 235, 236, 237, 
-	238, 239, 240, 241, 242, 243, 244, 245, 
-	246, 247, 248, 249, 250, 251, 252, 253, 
-	254, 255, 256, 257, 258, 259, 260, 261, 
-	262, 263, 264, 265, 266, 267, 268, 269, 
-	270, 271, 272, 273, 274, 275, 276, 277, 
-	278, 279, 280, 281, 282, 283, 284, 285, 
-	286, 287, 288, 289, 290, 291, 292, 293, 
-	294, 295, 296, 297, 298, 299, 300, 301, 
-	302, 303, 304, 305, 306, 307, 308, 309, 
-	310, 311, 312, 313, 314, 315, 316, 317, 
-	318, 319, 320, 321, 322, 323, 324, 325, 
-	326, 327, 328, 329, 330, 331, 332, 333, 
-	334, 335, 336, 337, 338, 339, 340, 341, 
-	342, 343, 344, 345, 346, 347, 348, 349, 
-	350, 351, 352, 353, 354, 355, 356, 357, 
-	358, 359, 360, 361, 362, 363, 364, 365, 
-	366, 367, 368, 369, 370, 371, 372, 373, 
-	374, 375, 376, 377, 378, 379, 380, 381, 
-	382, 383, 384, 385, 386, 387, 388, 389, 
-	390, 391, 392, 393, 394, 395, 396, 397, 
-	398, 399, 400, 401, 402, 403, 404, 405, 
-	406, 407, 408, 409, 410, 411, 412, 413, 
-	414, 415, 416, 417, 418, 419, 420, 421, 
-	422, 423, 424, 425, 426, 427, 428, 429, 
-	430, 431, 432, 433, 434, 435, 436, 437, 
-	438, 439, 440, 441, 442, 443, 444, 445, 
-	446, 447, 448, 449, 450, 451, 452, 453, 
-	454, 455, 456, 457, 458, 459, 460, 461, 
-	462, 463, 464, 465, 466, 467, 468, 469, 
-	470, 471, 472, 473, 474, 475, 476, 477, 
-	478, 479, 480, 481, 482, 483, 484, 485, 
-	486, 487, 488, 489, 490, 491, 492, 493, 
-	494, 495, 496, 497, 498, 499, 500, 501, 
-	502, 503, 504, 505, 506, 507, 508, 509, 
-	510, 511, 512, 513, 514, 515, 516, 517, 
-	518, 519, 520, 521, 522, 523, 524, 525, 
-	526, 527, 528, 529, 530, 531, 532, 533, 
-	534, 535, 536, 537, 538, 539, 540, 541, 
-	542, 543, 544, 545, 546, 547, 548, 549, 
-	550, 551, 552, 553, 554, 555, 556, 557, 
-	558, 559, 560, 561, 562, 563, 564, 565, 
-	566, 567, 568, 569, 570, 571, 572, 573, 
-	574, 575, 576, 577, 578, 579, 580, 581, 
-	582, 583, 584, 585, 586, 587, 588, 589, 
-	590
-};
-
-static const short _tftp_trans_targs[] = {
-	2, 0, 3, 3, 21, 24, 26, 0, 
-	4, 0, 5, 4, 0, 6, 10, 17, 
-	6, 10, 17, 0, 7, 7, 0, 8, 
-	8, 0, 9, 9, 0, 30, 0, 11, 
-	11, 0, 12, 12, 0, 13, 13, 0, 
-	14, 14, 0, 15, 15, 0, 16, 16, 
-	0, 9, 9, 0, 18, 18, 0, 19, 
-	19, 0, 20, 20, 0, 9, 9, 0, 
-	22, 23, 31, 25, 543, 27, 28, 29, 
-	0, 544, 29, 0, 0, 32, 33, 34, 
-	35, 36, 37, 38, 39, 40, 41, 42, 
-	43, 44, 45, 46, 47, 48, 49, 50, 
-	51, 52, 53, 54, 55, 56, 57, 58, 
-	59, 60, 61, 62, 63, 64, 65, 66, 
-	67, 68, 69, 70, 71, 72, 73, 74, 
-	75, 76, 77, 78, 79, 80, 81, 82, 
-	83, 84, 85, 86, 87, 88, 89, 90, 
-	91, 92, 93, 94, 95, 96, 97, 98, 
-	99, 100, 101, 102, 103, 104, 105, 106, 
-	107, 108, 109, 110, 111, 112, 113, 114, 
-	115, 116, 117, 118, 119, 120, 121, 122, 
-	123, 124, 125, 126, 127, 128, 129, 130, 
-	131, 132, 133, 134, 135, 136, 137, 138, 
-	139, 140, 141, 142, 143, 144, 145, 146, 
-	147, 148, 149, 150, 151, 152, 153, 154, 
-	155, 156, 157, 158, 159, 160, 161, 162, 
-	163, 164, 165, 166, 167, 168, 169, 170, 
-	171, 172, 173, 174, 175, 176, 177, 178, 
-	179, 180, 181, 182, 183, 184, 185, 186, 
-	187, 188, 189, 190, 191, 192, 193, 194, 
-	195, 196, 197, 198, 199, 200, 201, 202, 
-	203, 204, 205, 206, 207, 208, 209, 210, 
-	211, 212, 213, 214, 215, 216, 217, 218, 
-	219, 220, 221, 222, 223, 224, 225, 226, 
-	227, 228, 229, 230, 231, 232, 233, 234, 
-	235, 236, 237, 238, 239, 240, 241, 242, 
-	243, 244, 245, 246, 247, 248, 249, 250, 
-	251, 252, 253, 254, 255, 256, 257, 258, 
-	259, 260, 261, 262, 263, 264, 265, 266, 
-	267, 268, 269, 270, 271, 272, 273, 274, 
-	275, 276, 277, 278, 279, 280, 281, 282, 
-	283, 284, 285, 286, 287, 288, 289, 290, 
-	291, 292, 293, 294, 295, 296, 297, 298, 
-	299, 300, 301, 302, 303, 304, 305, 306, 
-	307, 308, 309, 310, 311, 312, 313, 314, 
-	315, 316, 317, 318, 319, 320, 321, 322, 
-	323, 324, 325, 326, 327, 328, 329, 330, 
-	331, 332, 333, 334, 335, 336, 337, 338, 
-	339, 340, 341, 342, 343, 344, 345, 346, 
-	347, 348, 349, 350, 351, 352, 353, 354, 
-	355, 356, 357, 358, 359, 360, 361, 362, 
-	363, 364, 365, 366, 367, 368, 369, 370, 
-	371, 372, 373, 374, 375, 376, 377, 378, 
-	379, 380, 381, 382, 383, 384, 385, 386, 
-	387, 388, 389, 390, 391, 392, 393, 394, 
-	395, 396, 397, 398, 399, 400, 401, 402, 
-	403, 404, 405, 406, 407, 408, 409, 410, 
-	411, 412, 413, 414, 415, 416, 417, 418, 
-	419, 420, 421, 422, 423, 424, 425, 426, 
-	427, 428, 429, 430, 431, 432, 433, 434, 
-	435, 436, 437, 438, 439, 440, 441, 442, 
-	443, 444, 445, 446, 447, 448, 449, 450, 
-	451, 452, 453, 454, 455, 456, 457, 458, 
-	459, 460, 461, 462, 463, 464, 465, 466, 
-	467, 468, 469, 470, 471, 472, 473, 474, 
-	475, 476, 477, 478, 479, 480, 481, 482, 
-	483, 484, 485, 486, 487, 488, 489, 490, 
-	491, 492, 493, 494, 495, 496, 497, 498, 
-	499, 500, 501, 502, 503, 504, 505, 506, 
-	507, 508, 509, 510, 511, 512, 513, 514, 
-	515, 516, 517, 518, 519, 520, 521, 522, 
-	523, 524, 525, 526, 527, 528, 529, 530, 
-	531, 532, 533, 534, 535, 536, 537, 538, 
-	539, 540, 541, 542, 0, 0, 0, 0
-};
-
-static const char _tftp_trans_actions[] = {
-	0, 0, 11, 13, 0, 0, 0, 0, 
-	0, 0, 1, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 3, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 5, 0, 0, 0, 0, 5, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0
-};
-
-static const char _tftp_eof_actions[] = {
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 0, 
-	0, 0, 0, 0, 0, 0, 0, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 7, 
-	7, 7, 7, 7, 7, 7, 7, 15, 
-	9
-};
-
-static const int tftp_start = 1;
-static const int tftp_first_final = 30;
-static const int tftp_error = 0;
-
-static const int tftp_en_tftp = 1;
-
-
-#line 101 "tftp_msg.rl"
-
-tftp_pack* tftp_packet_read (char* packet, apr_size_t len, apr_pool_t *mp)
-{
-  int cs;
-  char *p     = packet;
-  char *pe    = p + len;
-  char *eof   = pe;
-  char *mark  = p + 2;
-  uint16_t block_num;
-  tftp_pack *pack = (tftp_pack *) apr_palloc (mp, sizeof(tftp_pack));
-  pack->data = (union data*) apr_palloc (mp, sizeof(union data));
-
-  
-#line 593 "tftp_msg.c"
-	{
-	cs = tftp_start;
-	}
-
-#line 114 "tftp_msg.rl"
-  
-#line 600 "tftp_msg.c"
-	{
-	int _klen;
-	unsigned int _trans;
-	const char *_acts;
-	unsigned int _nacts;
-	const char *_keys;
-
-	if ( p == pe )
-		goto _test_eof;
-	if ( cs == 0 )
-		goto _out;
-_resume:
-	_keys = _tftp_trans_keys + _tftp_key_offsets[cs];
-	_trans = _tftp_index_offsets[cs];
-
-	_klen = _tftp_single_lengths[cs];
-	if ( _klen > 0 ) {
-		const char *_lower = _keys;
-		const char *_mid;
-		const char *_upper = _keys + _klen - 1;
-		while (1) {
-			if ( _upper < _lower )
-				break;
-
-			_mid = _lower + ((_upper-_lower) >> 1);
-			if ( (*p) < *_mid )
-				_upper = _mid - 1;
-			else if ( (*p) > *_mid )
-				_lower = _mid + 1;
-			else {
-				_trans += (unsigned int)(_mid - _keys);
-				goto _match;
-			}
-		}
-		_keys += _klen;
-		_trans += _klen;
-	}
-
-	_klen = _tftp_range_lengths[cs];
-	if ( _klen > 0 ) {
-		const char *_lower = _keys;
-		const char *_mid;
-		const char *_upper = _keys + (_klen<<1) - 2;
-		while (1) {
-			if ( _upper < _lower )
-				break;
-
-			_mid = _lower + (((_upper-_lower) >> 1) & ~1);
-			if ( (*p) < _mid[0] )
-				_upper = _mid - 2;
-			else if ( (*p) > _mid[1] )
-				_lower = _mid + 2;
-			else {
-				_trans += (unsigned int)((_mid - _keys)>>1);
-				goto _match;
-			}
-		}
-		_trans += _klen;
-	}
-
-_match:
-	cs = _tftp_trans_targs[_trans];
-
-	if ( _tftp_trans_actions[_trans] == 0 )
-		goto _again;
-
-	_acts = _tftp_actions + _tftp_trans_actions[_trans];
-	_nacts = (unsigned int) *_acts++;
-	while ( _nacts-- > 0 )
-	{
-		switch ( *_acts++ )
-		{
-	case 0:
-#line 36 "tftp_msg.rl"
-	{
-    pack->data->rq.len_filename = p - mark;
-    pack->data->rq.filename = apr_pstrmemdup(mp, mark, pack->data->rq.len_filename);
-    mark = p + 1;
-  }
-	break;
-	case 1:
-#line 42 "tftp_msg.rl"
-	{
-    pack->data->rq.len_mode = p - mark;
-    pack->data->rq.mode = apr_pstrmemdup(mp, mark, pack->data->rq.len_mode);
-    if(apr_strnatcasecmp (pack->data->rq.mode, MODE_OCTET) == 0) {
-      pack->data->rq.e_mode = E_OCTET;
-    } else if( apr_strnatcasecmp (pack->data->rq.mode, MODE_ASCII) == 0) {
-      pack->data->rq.e_mode = E_ASCII;
-    } else {
-      pack->data->rq.e_mode = E_MAIL;
-    }
-  }
-	break;
-	case 2:
-#line 54 "tftp_msg.rl"
-	{
-    unsigned char low = *mark & 0xff;       // get lower byte and make sure it is 1 byte
-    unsigned char hi  = *(mark +1) & 0xff;  // get higher byte and make sure it is 1 byte
-    block_num = hi | (low << 8);
-    mark = p;
-  }
-	break;
-	case 6:
-#line 90 "tftp_msg.rl"
-	{pack->opcode = E_RRQ;}
-	break;
-	case 7:
-#line 91 "tftp_msg.rl"
-	{pack->opcode = E_WRQ;}
-	break;
-#line 712 "tftp_msg.c"
-		}
-	}
-
-_again:
-	if ( cs == 0 )
-		goto _out;
-	if ( ++p != pe )
-		goto _resume;
-	_test_eof: {}
-	if ( p == eof )
-	{
-	const char *__acts = _tftp_actions + _tftp_eof_actions[cs];
-	unsigned int __nacts = (unsigned int) *__acts++;
-	while ( __nacts-- > 0 ) {
-		switch ( *__acts++ ) {
-	case 2:
-#line 54 "tftp_msg.rl"
-	{
-    unsigned char low = *mark & 0xff;       // get lower byte and make sure it is 1 byte
-    unsigned char hi  = *(mark +1) & 0xff;  // get higher byte and make sure it is 1 byte
-    block_num = hi | (low << 8);
-    mark = p;
-  }
-	break;
-	case 3:
-#line 61 "tftp_msg.rl"
-	{
-    pack->opcode = E_DATA;
-    apr_size_t len = p - mark;
-    pack->data->data.block = block_num;
-    pack->data->data.length = len;
-    memcpy (pack->data->data.data, mark, len + 1);
-  }
-	break;
-	case 4:
-#line 69 "tftp_msg.rl"
-	{
-    pack->opcode = E_ACK;
-    pack->data->ack.block = block_num;
-  }
-	break;
-	case 5:
-#line 74 "tftp_msg.rl"
-	{
-    pack->opcode = E_ERROR;
-    pack->data->error.ercode = block_num;
-    pack->data->error.msg_len = p - mark - 1; // -1 for last 0x0 byte
-    pack->data->error.msg = apr_pstrmemdup(mp, mark, pack->data->error.msg_len);
-  }
-	break;
-#line 763 "tftp_msg.c"
-		}
-	}
-	}
-
-	_out: {}
-	}
-
-#line 115 "tftp_msg.rl"
-
-  if ( cs < tftp_first_final )
-    return NULL;
-
-  return pack;
-}
-
-apr_size_t tftp_create_rrq (char *buf, struct pack_rq *rq)
-{
-  return tftp_req_pack(buf, E_RRQ, rq);
-}
-
-apr_size_t tftp_create_wrq (char *buf, struct pack_rq *rq)
-{
-  return tftp_req_pack(buf, E_WRQ, rq);
-}
-
-apr_size_t tftp_create_data (char *buf, struct pack_data *data)
-{
-  int len = apr_snprintf (buf, 5, "%c%c%c%c",
-    0x0, E_DATA, low_byte(data->block), hi_byte(data->block));
-
-  for (; len < data->length + 4; len++) {
-    buf[len] = data->data[len - 4];
-  }
-  return len;
-}
-
-apr_size_t tftp_create_ack (char *buf, int block)
-{
-  return apr_snprintf (buf, DATA_SIZE, "%c%c%c%c",
-    0x0, E_ACK, low_byte(block), hi_byte(block));
-}
-
-apr_size_t tftp_create_error (char *buf, struct pack_error *error)
-{
-  return apr_snprintf (buf, DATA_SIZE, "%c%c%c%c%.*s%c",
-    0x0, E_ERROR, 0x0, error->ercode, (int)error->msg_len,
-    error->msg, 0x0);
-}
-
-apr_size_t tftp_str_ntoh (apr_pool_t *mp, char *buf, apr_size_t len)
-{
-  char *nbuf = apr_palloc (mp, len);
-  apr_size_t i, new_len = 0;
-  for (i = 0; i < len; i++) {
-    if (buf[i] == APR_ASCII_CR && buf[i + 1] == '\0') {
-      i++;
-    } else if (buf[i] == APR_ASCII_CR && buf[i + 1] == APR_ASCII_LF) {
-      nbuf[new_len++] = APR_ASCII_LF;
-      i++;
-    } else {
-      nbuf[new_len++] = buf[i];
-    }
-  }
-  apr_cpystrn(buf, nbuf, new_len + 1);
-  return new_len;
-}
-
-apr_size_t tftp_str_hton (apr_pool_t *mp, char *buf, apr_size_t len)
-{
-  char *nbuf = apr_palloc (mp, len);
-  apr_size_t i, new_len = 0;
-  for (i = 0; i < len; i++) {
-    if (buf[i] == APR_ASCII_CR && buf[i + 1] != APR_ASCII_LF) {
-      nbuf[new_len++] = APR_ASCII_CR;
-      nbuf[new_len++] = '\0';
-    } else if (buf[i] == APR_ASCII_LF && buf[i - 1] != APR_ASCII_CR) {
-      nbuf[new_len++] = APR_ASCII_CR;
-      nbuf[new_len++] = APR_ASCII_LF;
-    } else {
-      nbuf[new_len++] = buf[i];
-    }
-  }
-  apr_cpystrn(buf, nbuf, new_len + 1);
-  return new_len;
-}
-
@@ -31,6 +31,8 @@
 #include <stdint.h>
 #include <apr_strings.h>
 
+#include "tftp_netascii.h"
+
 #define MODE_OCTET "octet"      /*!< define octet mode */
 #define MODE_ASCII "netascii"   /*!< define netascii mode */
 
@@ -42,16 +44,18 @@
 
 #define BUF_SIZE   DATA_SIZE + 4 /*!< TFTP packet buffer size */
 
-/*! @def tftp_req_pack(buf, opcode, pack)
- * Create request packet as char array.
- * @param buf     Result buffer as char array
- * @param opcode  TFTP packet opcode. E_RRQ or E_WRQ.
- * @param pack    Packet structure pack_rq
- */
-#define tftp_req_pack(buf, opcode, pack) apr_snprintf ((buf),     \
-                DATA_SIZE + 4, "%c%c%.*s%c%.*s%c", 0x0, (opcode), \
-                (pack)->len_filename, (pack)->filename, 0x0,      \
-                (pack)->len_mode, (pack)->mode, 0x0 )
+#define BLKSIZE_MIN 8           /*!< Minimal block size as defined in RFC2348 */
+#define BLKSIZE_MAX 65464       /*!< Maximal block size as defined in RFC2348 */
+
+#define WINDOWSIZE_MAX 65535   /*!< Maximal window size as defined in RFC7440 */
+
+#define BLOCK_MAX 65535        /*!< Maximal block number. Next block rolls over to 0 or 1. */
+
+#define OPT_BLKSIZE    "blksize"    /*!< Block size option name (RFC2348) */
+#define OPT_WINDOWSIZE "windowsize" /*!< Window size option name (RFC7440) */
+#define OPT_TIMEOUT    "timeout"    /*!< Timeout interval option name (RFC2349) */
+#define OPT_TSIZE      "tsize"      /*!< Transfer size option name (RFC2349) */
+#define OPT_MULTICAST  "multicast"  /*!< Multicast option name (RFC2090) */
 
 /*! @def low_byte(num)
  * Get lower byte of short int
@@ -94,11 +98,13 @@ enum opcodes {
   E_DATA  = 0x03, /*!< Data */
   E_ACK   = 0x04, /*!< Acknowledgment */
   E_ERROR = 0x05, /*!< Error */
+  E_OACK  = 0x06, /*!< Option Acknowledgment (RFC2347) */
+  E_TIMEOUT,      /*!< Retransmission timer expired. Machine event only, not a packet. */
 };
 
 /*! String representation of opcode. */
 static char *opcode_str[] = {
-  "UNDEFINED", "RRQ", "WRQ", "DATA", "ACK", "ERROR"
+  "UNDEFINED", "RRQ", "WRQ", "DATA", "ACK", "ERROR", "OACK", "TIMEOUT"
 };
 
 /*!
@@ -114,7 +120,24 @@ enum ercode {
    ERR_ILLEGAL,   /*!< Illegal TFTP operation. */
    ERR_XFERID,    /*!< Unknown transfer ID. */
    ERR_EXISTS,    /*!< File already exists. */
-   ERR_NOUSER     /*!< No such user. */
+   ERR_NOUSER,    /*!< No such user. */
+   ERR_OPTION     /*!< Options negotiation failed (RFC2347). */
+};
+
+/**
+ * TFTP options as defined in RFC2347.
+ * Zero value means that option is not set.
+ */
+struct tftp_opts {
+  unsigned int blksize;       /*!< Block size in bytes (RFC2348) */
+  unsigned int windowsize;    /*!< Number of blocks per ACK (RFC7440) */
+  unsigned int timeout;       /*!< Retransmission timeout in seconds (RFC2349) */
+  apr_off_t    tsize;         /*!< Transfer size in bytes (RFC2349). Zero in RRQ asks for file size. */
+  unsigned int has_tsize;     /*!< Transfer size option is set, even if tsize is zero. */
+  unsigned int has_multicast; /*!< Multicast option is set (RFC2090). Value is empty in RRQ. */
+  char         mc_addr[16];   /*!< Multicast group IPv4 address or empty if group is not changed. */
+  unsigned int mc_port;       /*!< Multicast group port or zero if group is not changed. */
+  unsigned int mc_master;     /*!< Client is master client and acknowledges blocks. */
 };
 
 /**
@@ -127,6 +150,7 @@ struct pack_rq {
   char *mode;                 /*!< Transfer mode as string (netascii, octet, mail) */
   unsigned int len_mode;      /*!< Transfer mode string length */
   enum mode e_mode;           /*!< Transfer mode enum value */
+  struct tftp_opts opts;      /*!< Requested options */
 };
 
 /**
@@ -134,9 +158,9 @@ struct pack_rq {
  */
 struct pack_data {
   uint16_t block;       /*!< block number 2 bytes */
-  char data[DATA_SIZE]; /*!< data field up to 512 bytes */
-  apr_size_t length;    /*!< data 2 bytes field length. When transfer, should be 512 bytes.
-                                If less then 512 bytes, then this is the last TFTP packet. */
+  char *data;           /*!< data field up to block size bytes (512 by default) */
+  apr_size_t length;    /*!< data field length. When transfer, should be block size.
+                                If less then block size, then this is the last TFTP packet. */
 };
 
 /**
@@ -156,6 +180,14 @@ struct pack_error {
   unsigned int msg_len; /*!< error message length */
 };
 
+/**
+ * TFTP OACK packet structure without opcode.
+ * Structure: opt1 0x00 value1 0x00 ... optN 0x00 valueN 0x00
+ */
+struct pack_oack {
+  struct tftp_opts opts;  /*!< Acknowledged options */
+};
+
 /**
  * TFTP packet union for data
  */
@@ -164,6 +196,7 @@ union data {
   struct pack_data  data; /*!< DATA packet */
   struct pack_ack   ack;  /*!< ACK packet */
   struct pack_error error;/*!< ERROR packet */
+  struct pack_oack  oack; /*!< OACK packet */
 };
 
 /**
@@ -177,8 +210,43 @@ struct tftp_pack_s {
 /*! TFTP packet type */
 typedef struct tftp_pack_s tftp_pack;
 
+/**
+ * Slice of packet buffer.
+ */
+struct tftp_slice {
+  char *ptr;        /*!< First byte in packet buffer */
+  apr_size_t len;   /*!< Length in bytes */
+};
+
+/**
+ * TFTP packet view. Fields point into the buffer of received packet,
+ * so view is valid as long as the buffer is not changed.
+ * File name, mode and error message are followed by 0x0 in the packet.
+ */
+struct tftp_packet_view {
+  uint16_t opcode;            /*!< opcode of TFTP packet: WRQ, RRQ, DATA etc. */
+  uint16_t block;             /*!< DATA or ACK block number, ERROR code */
+  struct tftp_slice data;     /*!< DATA payload */
+  struct tftp_slice filename; /*!< RRQ/WRQ file name */
+  struct tftp_slice mode;     /*!< RRQ/WRQ transfer mode string */
+  enum mode e_mode;           /*!< RRQ/WRQ transfer mode enum value */
+  struct tftp_slice msg;      /*!< ERROR message */
+  struct tftp_opts opts;      /*!< RRQ/WRQ requested or OACK acknowledged options */
+};
+
+/**
+ * Parse tftp packet received from socket without copying.
+ * @param view   TFTP packet view to fill
+ * @param packet TFTP packet
+ * @param len    Packet length
+ * @return view or NULL if packet if failed to parse
+ */
+struct tftp_packet_view *tftp_packet_view_read (struct tftp_packet_view *view,
+                                                char *packet, apr_size_t len);
+
 /**
  * Read tftp packet received from socket.
+ * Packet fields are copied to memory pool (see tftp_packet_view_read).
  * @param packet TFTP packet
  * @param len    Packet length
  * @param mp     APR memory pool
@@ -186,19 +254,79 @@ typedef struct tftp_pack_s tftp_pack;
  */
 tftp_pack* tftp_packet_read (char* packet, apr_size_t len, apr_pool_t *mp);
 
+/**
+ * Packet builder. Writes packet fields straight into caller buffer.
+ * Field that does not fit is not written and builder is marked
+ * as overflown, so fields can be appended without checking each one.
+ */
+struct tftp_builder {
+  char        *buf;     /*!< Packet buffer */
+  apr_size_t  size;     /*!< Buffer size */
+  apr_size_t  len;      /*!< Packet length */
+  int         overflow; /*!< Field did not fit into buffer */
+};
+
+/**
+ * Start packet in buffer.
+ * @param b     Packet builder
+ * @param buf   Packet buffer
+ * @param size  Buffer size
+ */
+void tftp_build_init (struct tftp_builder *b, char *buf, apr_size_t size);
+
+/**
+ * Append 16 bit field in network byte order: opcode, block number, error code.
+ * @param b     Packet builder
+ * @param num   Field value
+ */
+void tftp_build_u16 (struct tftp_builder *b, uint16_t num);
+
+/**
+ * Append string field followed by 0x0 byte.
+ * @param b     Packet builder
+ * @param str   String, may be not 0x0 terminated
+ * @param len   String length
+ */
+void tftp_build_str (struct tftp_builder *b, const char *str, apr_size_t len);
+
+/**
+ * Append option as "name 0x0 value 0x0" pair with decimal value.
+ * @param b     Packet builder
+ * @param name  Option name, 0x0 terminated
+ * @param value Option value
+ */
+void tftp_build_opt (struct tftp_builder *b, const char *name, apr_uint64_t value);
+
+/**
+ * Finish packet.
+ * @param b     Packet builder
+ * @return Packet length or zero if packet does not fit into buffer.
+ */
+apr_size_t tftp_build_end (struct tftp_builder *b);
+
+/**
+ * Append TFTP options to request or OACK packet.
+ * Only options with non-zero value are added.
+ * @param buf   Buffer where options will be stored as "name 0x0 value 0x0" pairs.
+ * @param size  Buffer size left.
+ * @param opts  Options structure
+ * @return Options length or zero if options do not fit into buffer.
+ */
+apr_size_t tftp_opts_pack (char *buf, apr_size_t size, struct tftp_opts *opts);
+
 /**
  * Create TFTP RRQ packet.
- * @param buf   Buffer where the result TFTP packet will be stored as char array.
+ * @param buf   Buffer of BUF_SIZE where the result TFTP packet will be stored as char array.
  * @param rq    RRQ packet structure
- * @return Packet length
+ * @return Packet length or zero if request does not fit into buffer.
  */
 apr_size_t tftp_create_rrq (char *buf, struct pack_rq *rq);
 
 /**
  * Create TFTP WRQ packet.
- * @param buf   Buffer where the result TFTP packet will be stored as char array.
+ * @param buf   Buffer of BUF_SIZE where the result TFTP packet will be stored as char array.
  * @param rq    RRQ packet structure
- * @return Packet length
+ * @return Packet length or zero if request does not fit into buffer.
  */
 apr_size_t tftp_create_wrq (char *buf, struct pack_rq *rq);
 
@@ -211,44 +339,56 @@ apr_size_t tftp_create_wrq (char *buf, struct pack_rq *rq);
 apr_size_t tftp_create_data (char *buf, struct pack_data *data);
 
 /**
- * Create TFTP ACK packet.
- * @param buf   Buffer where the result TFTP packet will be stored as char array.
+ * Create header of TFTP DATA packet. Data is sent from its own
+ * buffer (scatter/gather) or placed right after the header.
+ * @param buf   Buffer where 4 bytes of header will be stored.
  * @param block Block number
- * @return Packet length
+ * @return Header length
  */
-apr_size_t tftp_create_ack (char *buf, int block);
+apr_size_t tftp_create_data_header (char *buf, uint16_t block);
 
 /**
- * Create TFTP ERROR packet.
- * @param buf   Buffer where the result TFTP packet will be stored as char array.
- * @param error ERROR packet structure
+ * Block number in packet of logical block number that never wraps.
+ * After BLOCK_MAX block number rolls over to 0 or 1. Logical block 0
+ * is request acknowledgement and it is always 0.
+ * @param seq       Logical block number
+ * @param rollover  Block number after BLOCK_MAX: 0 or 1
+ * @return Block number in packet
+ */
+uint16_t tftp_block_wire (apr_uint64_t seq, unsigned int rollover);
+
+/**
+ * Number of blocks from logical block to the next block with given
+ * number in packet. Block before logical block is far ahead.
+ * @param seq       Logical block number
+ * @param block     Block number in packet
+ * @param rollover  Block number after BLOCK_MAX: 0 or 1
+ * @return Distance in blocks: 0 is the same block, 1 is the next one.
+ */
+apr_uint64_t tftp_block_delta (apr_uint64_t seq, uint16_t block, unsigned int rollover);
+
+/**
+ * Create TFTP OACK packet.
+ * @param buf   Buffer of BUF_SIZE where the result TFTP packet will be stored as char array.
+ * @param opts  Acknowledged options
  * @return Packet length
  */
-apr_size_t tftp_create_error (char *buf, struct pack_error *error);
+apr_size_t tftp_create_oack (char *buf, struct tftp_opts *opts);
 
 /**
- * Helper function for ASCII mode transfer.
- * Converts string received from network to host as
- * specified in "Telnet Protocol Specification", see RFC1350 section 1.
- * Converting CR, NUL -> CR and CR, LF -> LF.
- * @param mp    APR memory pool pointer
- * @param buf   String to convert
- * @param len   String length
- * @return String length after convertion
+ * Create TFTP ACK packet.
+ * @param buf   Buffer where the result TFTP packet will be stored as char array.
+ * @param block Block number
+ * @return Packet length
  */
-apr_size_t tftp_str_ntoh (apr_pool_t *mp, char *buf, apr_size_t len);
+apr_size_t tftp_create_ack (char *buf, int block);
 
 /**
- * Helper function for ASCII mode transfer.
- * Converts string to network before send it as
- * specified in "Telnet Protocol Specification", see RFC1350 section 1.
- * Converting CR, NUL -> CR and CR, LF -> LF.
- * Converting CR -> CR, NUL and LF -> CR, LF.
- * @param mp    APR memory pool pointer
- * @param buf   String to convert
- * @param len   String length
- * @return String length after convertion
+ * Create TFTP ERROR packet. Message longer than fits into BUF_SIZE is truncated.
+ * @param buf   Buffer of BUF_SIZE where the result TFTP packet will be stored as char array.
+ * @param error ERROR packet structure
+ * @return Packet length
  */
-apr_size_t tftp_str_hton (apr_pool_t *mp, char *buf, apr_size_t len);
+apr_size_t tftp_create_error (char *buf, struct pack_error *error);
 
 #endif
@@ -25,8 +25,72 @@
  *
  * @author Stas Kobzar <staskobzar@gmail.com>
  */
+#include <string.h>
 #include "tftp_msg.h"
 
+/**
+ * Set multicast option (RFC2090). Value is empty in request and is
+ * "addr,port,mc" in OACK. Address and port are empty when server only
+ * changes master client.
+ * @param opts  Options structure
+ * @param value Option value, 0x0 terminated
+ */
+static void tftp_opt_multicast (struct tftp_opts *opts, const char *value)
+{
+  const char *port, *mc;
+  apr_int64_t num;
+
+  if (*value == '\0') {
+    opts->has_multicast = 1;
+    return;
+  }
+  port = strchr (value, ',');
+  mc = port ? strchr (port + 1, ',') : NULL;
+  if (mc == NULL || port - value >= sizeof(opts->mc_addr) ||
+      (mc[1] != '0' && mc[1] != '1') || mc[2] != '\0') {
+    return;
+  }
+  num = apr_atoi64 (port + 1);
+  if (num < 0 || num > 65535) {
+    return;
+  }
+  memcpy (opts->mc_addr, value, port - value);
+  opts->mc_addr[port - value] = '\0';
+  opts->mc_port = num;
+  opts->mc_master = mc[1] == '1';
+  opts->has_multicast = 1;
+}
+
+/**
+ * Set option value by option name.
+ * Unknown options and invalid values are ignored as required by RFC2347.
+ * @param opts  Options structure
+ * @param name  Option name, 0x0 terminated
+ * @param value Option value, 0x0 terminated
+ */
+static void tftp_opt_set (struct tftp_opts *opts, const char *name, const char *value)
+{
+  apr_int64_t num = apr_atoi64 (value);
+
+  if (apr_strnatcasecmp (name, OPT_BLKSIZE) == 0) {
+    if (num >= BLKSIZE_MIN && num <= BLKSIZE_MAX)
+      opts->blksize = num;
+  } else if (apr_strnatcasecmp (name, OPT_WINDOWSIZE) == 0) {
+    if (num >= 1 && num <= WINDOWSIZE_MAX)
+      opts->windowsize = num;
+  } else if (apr_strnatcasecmp (name, OPT_TIMEOUT) == 0) {
+    if (num >= 1 && num <= 255)
+      opts->timeout = num;
+  } else if (apr_strnatcasecmp (name, OPT_TSIZE) == 0) {
+    if (num >= 0 && *value >= '0' && *value <= '9') {
+      opts->tsize = num;
+      opts->has_tsize = 1;
+    }
+  } else if (apr_strnatcasecmp (name, OPT_MULTICAST) == 0) {
+    tftp_opt_multicast (opts, value);
+  }
+}
+
 /**
  * Ragel Finit State Machine
  */
@@ -34,21 +98,32 @@
   machine tftp;
 
   action filename {
-    pack->data->rq.len_filename = fpc - mark;
-    pack->data->rq.filename = apr_pstrmemdup(mp, mark, pack->data->rq.len_filename);
+    view->filename.ptr = mark;
+    view->filename.len = fpc - mark;
     mark = p + 1;
   }
 
   action mode {
-    pack->data->rq.len_mode = fpc - mark;
-    pack->data->rq.mode = apr_pstrmemdup(mp, mark, pack->data->rq.len_mode);
-    if(apr_strnatcasecmp (pack->data->rq.mode, MODE_OCTET) == 0) {
-      pack->data->rq.e_mode = E_OCTET;
-    } else if( apr_strnatcasecmp (pack->data->rq.mode, MODE_ASCII) == 0) {
-      pack->data->rq.e_mode = E_ASCII;
+    view->mode.ptr = mark;
+    view->mode.len = fpc - mark;
+    if(apr_strnatcasecmp (view->mode.ptr, MODE_OCTET) == 0) {
+      view->e_mode = E_OCTET;
+    } else if( apr_strnatcasecmp (view->mode.ptr, MODE_ASCII) == 0) {
+      view->e_mode = E_ASCII;
     } else {
-      pack->data->rq.e_mode = E_MAIL;
+      view->e_mode = E_MAIL;
     }
+    mark = p + 1;
+  }
+
+  action opt_name {
+    opt_name = mark;
+    mark = p + 1;
+  }
+
+  action opt_value {
+    tftp_opt_set (&view->opts, opt_name, mark);
+    mark = p + 1;
   }
 
   action block {
@@ -59,23 +134,22 @@
   }
 
   action pack_data {
-    pack->opcode = E_DATA;
-    apr_size_t len = fpc - mark;
-    pack->data->data.block = block_num;
-    pack->data->data.length = len;
-    memcpy (pack->data->data.data, mark, len + 1);
+    view->opcode = E_DATA;
+    view->block = block_num;
+    view->data.ptr = mark;
+    view->data.len = fpc - mark;
   }
 
   action pack_ack {
-    pack->opcode = E_ACK;
-    pack->data->ack.block = block_num;
+    view->opcode = E_ACK;
+    view->block = block_num;
   }
 
   action pack_error {
-    pack->opcode = E_ERROR;
-    pack->data->error.ercode = block_num;
-    pack->data->error.msg_len = fpc - mark - 1; // -1 for last 0x0 byte
-    pack->data->error.msg = apr_pstrmemdup(mp, mark, pack->data->error.msg_len);
+    view->opcode = E_ERROR;
+    view->block = block_num;
+    view->msg.ptr = mark;
+    view->msg.len = fpc - mark - 1; // -1 for last 0x0 byte
   }
 
   MODE_OCTET  = /octet/i;
@@ -86,29 +160,34 @@
   ERCODE      = BLOCK;
   ASCII       = 1..127;
 
-  RQ    = ASCII+ 0x0 @filename MODE 0x0 @mode;
-  RRQ   = 0x00 0x01 >{pack->opcode = E_RRQ;} RQ;
-  WRQ   = 0x00 0x02 >{pack->opcode = E_WRQ;} RQ;
-  DATA  = 0x00 0x03 BLOCK extend{1,512}  %pack_data;
+  OPTION = ASCII+ 0x0 @opt_name ASCII* 0x0 @opt_value;
+
+  RQ    = ASCII+ 0x0 @filename MODE 0x0 @mode OPTION*;
+  RRQ   = 0x00 0x01 >{view->opcode = E_RRQ;} RQ;
+  WRQ   = 0x00 0x02 >{view->opcode = E_WRQ;} RQ;
+  DATA  = 0x00 0x03 BLOCK extend*        %pack_data;
   ACK   = 0x00 0x04 BLOCK                %pack_ack;
   ERROR = 0x00 0x05 ERCODE ASCII+ 0x0    %pack_error;
+  OACK  = 0x00 0x06 >{view->opcode = E_OACK;} OPTION+;
 
-  tftp := (RRQ | WRQ | DATA | ACK | ERROR);
+  tftp := (RRQ | WRQ | DATA | ACK | ERROR | OACK);
 
 }%%
 
 %%write data;
 
-tftp_pack* tftp_packet_read (char* packet, apr_size_t len, apr_pool_t *mp)
+struct tftp_packet_view *tftp_packet_view_read (struct tftp_packet_view *view,
+                                                char *packet, apr_size_t len)
 {
   int cs;
   char *p     = packet;
   char *pe    = p + len;
   char *eof   = pe;
   char *mark  = p + 2;
+  char *opt_name = NULL;
   uint16_t block_num;
-  tftp_pack *pack = (tftp_pack *) apr_palloc (mp, sizeof(tftp_pack));
-  pack->data = (union data*) apr_palloc (mp, sizeof(union data));
+
+  memset (view, 0, sizeof(struct tftp_packet_view));
 
   %%write init;
   %%write exec;
@@ -116,77 +195,242 @@ tftp_pack* tftp_packet_read (char* packet, apr_size_t len, apr_pool_t *mp)
   if ( cs < tftp_first_final )
     return NULL;
 
+  return view;
+}
+
+tftp_pack* tftp_packet_read (char* packet, apr_size_t len, apr_pool_t *mp)
+{
+  struct tftp_packet_view view;
+  tftp_pack *pack;
+
+  if (tftp_packet_view_read (&view, packet, len) == NULL)
+    return NULL;
+
+  pack = (tftp_pack *) apr_palloc (mp, sizeof(tftp_pack));
+  pack->data = (union data*) apr_pcalloc (mp, sizeof(union data));
+  pack->opcode = view.opcode;
+  switch (view.opcode) {
+    case E_RRQ:
+    case E_WRQ:
+      pack->data->rq.filename = apr_pstrmemdup (mp, view.filename.ptr, view.filename.len);
+      pack->data->rq.len_filename = view.filename.len;
+      pack->data->rq.mode = apr_pstrmemdup (mp, view.mode.ptr, view.mode.len);
+      pack->data->rq.len_mode = view.mode.len;
+      pack->data->rq.e_mode = view.e_mode;
+      pack->data->rq.opts = view.opts;
+      break;
+    case E_DATA:
+      pack->data->data.block = view.block;
+      pack->data->data.length = view.data.len;
+      pack->data->data.data = apr_pstrmemdup (mp, view.data.ptr, view.data.len);
+      break;
+    case E_ACK:
+      pack->data->ack.block = view.block;
+      break;
+    case E_ERROR:
+      pack->data->error.ercode = view.block;
+      pack->data->error.msg_len = view.msg.len;
+      pack->data->error.msg = apr_pstrmemdup (mp, view.msg.ptr, view.msg.len);
+      break;
+    case E_OACK:
+      pack->data->oack.opts = view.opts;
+      break;
+  }
+
   return pack;
 }
 
-apr_size_t tftp_create_rrq (char *buf, struct pack_rq *rq)
+void tftp_build_init (struct tftp_builder *b, char *buf, apr_size_t size)
 {
-  return tftp_req_pack(buf, E_RRQ, rq);
+  b->buf = buf;
+  b->size = size;
+  b->len = 0;
+  b->overflow = 0;
 }
 
-apr_size_t tftp_create_wrq (char *buf, struct pack_rq *rq)
+void tftp_build_u16 (struct tftp_builder *b, uint16_t num)
 {
-  return tftp_req_pack(buf, E_WRQ, rq);
+  if (b->size - b->len < 2) {
+    b->overflow = 1;
+    return;
+  }
+  b->buf[b->len++] = low_byte(num);
+  b->buf[b->len++] = hi_byte(num);
 }
 
-apr_size_t tftp_create_data (char *buf, struct pack_data *data)
+void tftp_build_str (struct tftp_builder *b, const char *str, apr_size_t len)
+{
+  if (b->size - b->len < len + 1) {
+    b->overflow = 1;
+    return;
+  }
+  memcpy (b->buf + b->len, str, len);
+  b->len += len;
+  b->buf[b->len++] = 0x0;
+}
+
+void tftp_build_opt (struct tftp_builder *b, const char *name, apr_uint64_t value)
+{
+  char digits[20];  // 2^64 has 20 decimal digits
+  char *d = digits + sizeof(digits);
+
+  do {
+    *--d = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  tftp_build_str (b, name, strlen(name));
+  tftp_build_str (b, d, digits + sizeof(digits) - d);
+}
+
+apr_size_t tftp_build_end (struct tftp_builder *b)
+{
+  return b->overflow ? 0 : b->len;
+}
+
+/**
+ * Append multicast option (RFC2090). Value is empty in request,
+ * group is empty when only master client is changed.
+ * @param b     Packet builder
+ * @param opts  Options structure
+ */
+static void tftp_build_multicast (struct tftp_builder *b, struct tftp_opts *opts)
 {
-  int len = apr_snprintf (buf, 5, "%c%c%c%c",
-    0x0, E_DATA, low_byte(data->block), hi_byte(data->block));
+  char value[32];
+  apr_size_t len = 0;
 
-  for (; len < data->length + 4; len++) {
-    buf[len] = data->data[len - 4];
+  if (opts->mc_port) {
+    len = apr_snprintf (value, sizeof(value), "%s,%u,%u", opts->mc_addr, opts->mc_port, opts->mc_master);
+  } else if (opts->mc_master) {
+    len = apr_snprintf (value, sizeof(value), ",,1");
   }
-  return len;
+  tftp_build_str (b, OPT_MULTICAST, strlen(OPT_MULTICAST));
+  tftp_build_str (b, value, len);
 }
 
-apr_size_t tftp_create_ack (char *buf, int block)
+/**
+ * Append options with non-zero value.
+ * @param b     Packet builder
+ * @param opts  Options structure
+ */
+static void tftp_build_opts (struct tftp_builder *b, struct tftp_opts *opts)
 {
-  return apr_snprintf (buf, DATA_SIZE, "%c%c%c%c",
-    0x0, E_ACK, low_byte(block), hi_byte(block));
+  if (opts->blksize)
+    tftp_build_opt (b, OPT_BLKSIZE, opts->blksize);
+  if (opts->windowsize)
+    tftp_build_opt (b, OPT_WINDOWSIZE, opts->windowsize);
+  if (opts->timeout)
+    tftp_build_opt (b, OPT_TIMEOUT, opts->timeout);
+  if (opts->has_tsize)
+    tftp_build_opt (b, OPT_TSIZE, opts->tsize);
+  if (opts->has_multicast)
+    tftp_build_multicast (b, opts);
 }
 
-apr_size_t tftp_create_error (char *buf, struct pack_error *error)
+apr_size_t tftp_opts_pack (char *buf, apr_size_t size, struct tftp_opts *opts)
 {
-  return apr_snprintf (buf, DATA_SIZE, "%c%c%c%c%.*s%c",
-    0x0, E_ERROR, 0x0, error->ercode, (int)error->msg_len,
-    error->msg, 0x0);
+  struct tftp_builder b;
+
+  tftp_build_init (&b, buf, size);
+  tftp_build_opts (&b, opts);
+  return tftp_build_end (&b);
 }
 
-apr_size_t tftp_str_ntoh (apr_pool_t *mp, char *buf, apr_size_t len)
+/**
+ * Create RRQ or WRQ packet.
+ * @param buf     Buffer of BUF_SIZE
+ * @param opcode  E_RRQ or E_WRQ
+ * @param rq      Request packet structure
+ * @return Packet length or zero if request does not fit into buffer.
+ */
+static apr_size_t tftp_create_rq (char *buf, uint16_t opcode, struct pack_rq *rq)
 {
-  char *nbuf = apr_palloc (mp, len);
-  apr_size_t i, new_len = 0;
-  for (i = 0; i < len; i++) {
-    if (buf[i] == APR_ASCII_CR && buf[i + 1] == '\0') {
-      i++;
-    } else if (buf[i] == APR_ASCII_CR && buf[i + 1] == APR_ASCII_LF) {
-      nbuf[new_len++] = APR_ASCII_LF;
-      i++;
-    } else {
-      nbuf[new_len++] = buf[i];
-    }
+  struct tftp_builder b;
+
+  tftp_build_init (&b, buf, BUF_SIZE);
+  tftp_build_u16 (&b, opcode);
+  tftp_build_str (&b, rq->filename, rq->len_filename);
+  tftp_build_str (&b, rq->mode, rq->len_mode);
+  tftp_build_opts (&b, &rq->opts);
+  return tftp_build_end (&b);
+}
+
+apr_size_t tftp_create_rrq (char *buf, struct pack_rq *rq)
+{
+  return tftp_create_rq (buf, E_RRQ, rq);
+}
+
+apr_size_t tftp_create_wrq (char *buf, struct pack_rq *rq)
+{
+  return tftp_create_rq (buf, E_WRQ, rq);
+}
+
+apr_size_t tftp_create_oack (char *buf, struct tftp_opts *opts)
+{
+  struct tftp_builder b;
+
+  tftp_build_init (&b, buf, BUF_SIZE);
+  tftp_build_u16 (&b, E_OACK);
+  tftp_build_opts (&b, opts);
+  return tftp_build_end (&b);
+}
+
+apr_size_t tftp_create_data_header (char *buf, uint16_t block)
+{
+  buf[0] = 0x0;
+  buf[1] = E_DATA;
+  buf[2] = low_byte(block);
+  buf[3] = hi_byte(block);
+  return 4;
+}
+
+uint16_t tftp_block_wire (apr_uint64_t seq, unsigned int rollover)
+{
+  if (seq < rollover) {
+    return seq;
   }
-  apr_cpystrn(buf, nbuf, new_len + 1);
-  return new_len;
+  return rollover + (seq - rollover) % (BLOCK_MAX + 1 - rollover);
 }
 
-apr_size_t tftp_str_hton (apr_pool_t *mp, char *buf, apr_size_t len)
+apr_uint64_t tftp_block_delta (apr_uint64_t seq, uint16_t block, unsigned int rollover)
 {
-  char *nbuf = apr_palloc (mp, len);
-  apr_size_t i, new_len = 0;
-  for (i = 0; i < len; i++) {
-    if (buf[i] == APR_ASCII_CR && buf[i + 1] != APR_ASCII_LF) {
-      nbuf[new_len++] = APR_ASCII_CR;
-      nbuf[new_len++] = '\0';
-    } else if (buf[i] == APR_ASCII_LF && buf[i - 1] != APR_ASCII_CR) {
-      nbuf[new_len++] = APR_ASCII_CR;
-      nbuf[new_len++] = APR_ASCII_LF;
-    } else {
-      nbuf[new_len++] = buf[i];
-    }
+  apr_uint64_t cycle = BLOCK_MAX + 1 - rollover;
+
+  // block 0 is never used again after rollover to 1
+  if (block < rollover) {
+    return seq == 0 ? 0 : cycle;
   }
-  apr_cpystrn(buf, nbuf, new_len + 1);
-  return new_len;
+  return (block + cycle - tftp_block_wire (seq, rollover)) % cycle;
+}
+
+apr_size_t tftp_create_data (char *buf, struct pack_data *data)
+{
+  apr_size_t len = tftp_create_data_header (buf, data->block);
+
+  // data may be already read right after header
+  memmove (buf + len, data->data, data->length);
+  return len + data->length;
+}
+
+apr_size_t tftp_create_ack (char *buf, int block)
+{
+  buf[0] = 0x0;
+  buf[1] = E_ACK;
+  buf[2] = low_byte(block);
+  buf[3] = hi_byte(block);
+  return 4;
 }
 
+apr_size_t tftp_create_error (char *buf, struct pack_error *error)
+{
+  struct tftp_builder b;
+  apr_size_t msg_len = error->msg_len;
+
+  if (msg_len > BUF_SIZE - 5) {
+    msg_len = BUF_SIZE - 5;
+  }
+  tftp_build_init (&b, buf, BUF_SIZE);
+  tftp_build_u16 (&b, E_ERROR);
+  tftp_build_u16 (&b, error->ercode);
+  tftp_build_str (&b, error->msg, msg_len);
+  return tftp_build_end (&b);
+}
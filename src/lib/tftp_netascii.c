@@ -0,0 +1,269 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_netascii.c
+ * @brief TFTP protocol library.
+ * Netascii conversion of ASCII mode transfers.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+#include <string.h>
+
+#include "tftp_netascii.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ASCII_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/*! Carriage return. */
+#define CR '\r'
+/*! Line feed. */
+#define LF '\n'
+
+/*! Scan kernel: first byte equal to a or b, or end. */
+typedef const char *(*ascii_scan_fn)(const char *p, const char *end, char a, char b);
+
+/*! Selected scan kernel. */
+static ascii_scan_fn ascii_scan = NULL;
+
+/*! Name of selected scan kernel. */
+static const char *ascii_simd = "scalar";
+
+/**
+ * Scan byte by byte.
+ */
+static const char *ascii_scan_scalar (const char *p, const char *end, char a, char b)
+{
+  while (p < end && *p != a && *p != b) {
+    p++;
+  }
+  return p;
+}
+
+#ifdef ASCII_HAVE_X86
+/**
+ * Scan 16 bytes at a time.
+ */
+__attribute__((target("sse2")))
+static const char *ascii_scan_sse2 (const char *p, const char *end, char a, char b)
+{
+  __m128i va = _mm_set1_epi8 (a);
+  __m128i vb = _mm_set1_epi8 (b);
+  __m128i v;
+  int mask;
+
+  while (end - p >= 16) {
+    v = _mm_loadu_si128 ((const __m128i *)p);
+    mask = _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (v, va), _mm_cmpeq_epi8 (v, vb)));
+    if (mask) {
+      return p + __builtin_ctz (mask);
+    }
+    p += 16;
+  }
+  return ascii_scan_scalar (p, end, a, b);
+}
+
+/**
+ * Scan 32 bytes at a time.
+ */
+__attribute__((target("avx2")))
+static const char *ascii_scan_avx2 (const char *p, const char *end, char a, char b)
+{
+  __m256i va = _mm256_set1_epi8 (a);
+  __m256i vb = _mm256_set1_epi8 (b);
+  __m256i v;
+  unsigned int mask;
+
+  while (end - p >= 32) {
+    v = _mm256_loadu_si256 ((const __m256i *)p);
+    mask = _mm256_movemask_epi8 (_mm256_or_si256 (_mm256_cmpeq_epi8 (v, va),
+                                                  _mm256_cmpeq_epi8 (v, vb)));
+    if (mask) {
+      return p + __builtin_ctz (mask);
+    }
+    p += 32;
+  }
+  return ascii_scan_sse2 (p, end, a, b);
+}
+#endif
+
+/**
+ * Select scan kernel by processor features (CPUID).
+ */
+static void ascii_select (void)
+{
+#ifdef ASCII_HAVE_X86
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2")) {
+    ascii_simd = "avx2";
+    ascii_scan = ascii_scan_avx2;
+    return;
+  }
+  if (__builtin_cpu_supports ("sse2")) {
+    ascii_simd = "sse2";
+    ascii_scan = ascii_scan_sse2;
+    return;
+  }
+#endif
+  ascii_scan = ascii_scan_scalar;
+}
+
+const char *tftp_netascii_simd (void)
+{
+  if (ascii_scan == NULL) {
+    ascii_select ();
+  }
+  return ascii_simd;
+}
+
+void tftp_netascii_init (struct tftp_netascii *na)
+{
+  na->cr = 0;
+  na->out = -1;
+  if (ascii_scan == NULL) {
+    ascii_select ();
+  }
+}
+
+apr_size_t tftp_netascii_decode (struct tftp_netascii *na, char **buf, apr_size_t len, int eof)
+{
+  char *src = *buf;
+  char *end = src + len;
+  char *dst = src;
+  const char *cr;
+
+  // CR at the end of previous block
+  if (na->cr && src < end) {
+    na->cr = 0;
+    if (*src == LF || *src == '\0') {
+      *dst++ = *src == LF ? LF : CR;
+      src++;
+    } else {
+      *buf = --dst;
+      *dst++ = CR;
+    }
+  }
+  while (src < end) {
+    cr = ascii_scan (src, end, CR, CR);
+    // nothing is moved until the first CR, LF
+    if (dst != src) {
+      memmove (dst, src, cr - src);
+    }
+    dst += cr - src;
+    src = (char *)cr;
+    if (src == end) {
+      break;
+    }
+    if (src + 1 == end) {
+      // next byte is in the next block
+      na->cr = 1;
+      src++;
+    } else if (src[1] == LF) {
+      *dst++ = LF;
+      src += 2;
+    } else if (src[1] == '\0') {
+      *dst++ = CR;
+      src += 2;
+    } else {
+      *dst++ = *src++;
+    }
+  }
+  if (eof && na->cr) {
+    na->cr = 0;
+    *dst++ = CR;
+  }
+  return dst - *buf;
+}
+
+apr_size_t tftp_netascii_encode (struct tftp_netascii *na, char *dst, apr_size_t size,
+                                 const char *src, apr_size_t *len, int eof)
+{
+  const char *p = src;
+  const char *end = src + *len;
+  const char *run;
+  char *o = dst;
+  char *oend = dst + size;
+
+  while (o < oend) {
+    // second byte of CR pair that did not fit into previous block
+    if (na->out >= 0) {
+      *o++ = na->out;
+      na->out = -1;
+      continue;
+    }
+    if (na->cr) {
+      if (p == end && !eof) {
+        break;
+      }
+      // CR, LF is kept and bare CR becomes CR, NUL
+      na->cr = 0;
+      *o++ = CR;
+      if (p < end && *p == LF) {
+        na->out = LF;
+        p++;
+      } else {
+        na->out = '\0';
+      }
+      continue;
+    }
+    if (p == end) {
+      break;
+    }
+    run = ascii_scan (p, end - p < oend - o ? end : p + (oend - o), CR, LF);
+    memcpy (o, p, run - p);
+    o += run - p;
+    p = run;
+    if (o == oend || p == end) {
+      continue;
+    }
+    if (*p == CR) {
+      na->cr = 1;
+    } else {
+      *o++ = CR;
+      na->out = LF;
+    }
+    p++;
+  }
+  *len = p - src;
+  return o - dst;
+}
+
+apr_size_t tftp_str_ntoh (char *buf, apr_size_t len)
+{
+  struct tftp_netascii na;
+
+  tftp_netascii_init (&na);
+  len = tftp_netascii_decode (&na, &buf, len, 1);
+  buf[len] = '\0';
+  return len;
+}
+
+apr_size_t tftp_str_hton (char *dst, const char *src, apr_size_t len)
+{
+  struct tftp_netascii na;
+  apr_size_t n;
+
+  tftp_netascii_init (&na);
+  n = tftp_netascii_encode (&na, dst, 2 * len, src, &len, 1);
+  dst[n] = '\0';
+  return n;
+}
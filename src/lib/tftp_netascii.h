@@ -0,0 +1,116 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_netascii.h
+ * @brief TFTP protocol library.
+ * Netascii conversion of ASCII mode transfers (RFC1350 section 1).
+ * Buffers are scanned for CR and LF with SSE2 or AVX2 when processor
+ * supports it, and runs of bytes between them are copied in bulk.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_NETASCII_H
+#define __TFTP_NETASCII_H
+
+#include <apr_general.h>
+
+/**
+ * Streaming netascii converter. Keeps CR at the end of one block
+ * until the first byte of the next block is known.
+ */
+struct tftp_netascii {
+  int cr;   /*!< CR is held until next byte is known. */
+  int out;  /*!< Second byte of CR pair waiting for room in output or -1. */
+};
+
+/**
+ * Init streaming converter.
+ * @param na    Converter
+ */
+void tftp_netascii_init (struct tftp_netascii *na);
+
+/**
+ * Convert block received from network to host in place.
+ * Converting CR, NUL -> CR and CR, LF -> LF. CR at the end of block is
+ * held until next block. If it is followed by other byte, it is placed
+ * right before the block, so byte before buffer must be writable.
+ * @param na    Converter
+ * @param buf   Block to convert. Start of converted block.
+ * @param len   Block length
+ * @param eof   Block is the last one, held CR is written.
+ * @return Converted block length
+ */
+apr_size_t tftp_netascii_decode (struct tftp_netascii *na, char **buf, apr_size_t len, int eof);
+
+/**
+ * Convert host data to network until output is full or input is
+ * consumed. Converting CR -> CR, NUL and LF -> CR, LF; CR, LF is kept.
+ * CR pair is split between outputs if only one byte fits.
+ * @param na    Converter
+ * @param dst   Output
+ * @param size  Output size
+ * @param src   Input
+ * @param len   Input length. Consumed input length.
+ * @param eof   Input is the end of data, held CR is written.
+ * @return Output length
+ */
+apr_size_t tftp_netascii_encode (struct tftp_netascii *na, char *dst, apr_size_t size,
+                                 const char *src, apr_size_t *len, int eof);
+
+/*! @def tftp_netascii_idle(na)
+ * Converter holds no byte.
+ * @param na    Converter
+ */
+#define tftp_netascii_idle(na) (!(na)->cr && (na)->out < 0)
+
+/**
+ * Helper function for ASCII mode transfer.
+ * Converts string received from network to host in place as
+ * specified in "Telnet Protocol Specification", see RFC1350 section 1.
+ * Converting CR, NUL -> CR and CR, LF -> LF.
+ * Result is terminated with NUL, so buffer must have room for len + 1 bytes.
+ * @param buf   String to convert
+ * @param len   String length
+ * @return String length after convertion
+ */
+apr_size_t tftp_str_ntoh (char *buf, apr_size_t len);
+
+/**
+ * Helper function for ASCII mode transfer.
+ * Converts string to network before send it as
+ * specified in "Telnet Protocol Specification", see RFC1350 section 1.
+ * Converting CR -> CR, NUL and LF -> CR, LF.
+ * Result is terminated with NUL, so buffer must have room for 2 * len + 1 bytes.
+ * @param dst   Converted string
+ * @param src   String to convert
+ * @param len   String length
+ * @return String length after convertion
+ */
+apr_size_t tftp_str_hton (char *dst, const char *src, apr_size_t len);
+
+/**
+ * Name of vector instructions used for conversion.
+ * @return "avx2", "sse2" or "scalar"
+ */
+const char *tftp_netascii_simd (void);
+
+#endif
@@ -26,90 +26,591 @@
  * @author Stas Kobzar <staskobzar@gmail.com>
  */
 
+#include <config.h>
+#include <apr_portable.h>
+#ifdef HAVE_MADVISE
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_FSTATVFS
+#include <sys/statvfs.h>
+#endif
+
 #include "tftp_proto.h"
 #include "util.h"
 
+/*! File map is read ahead by chunks of this size. */
+#define MAP_READAHEAD (1 << 20)
+
 /*!
  * Finit State Machine transition table.
  */
 static struct trans_table transition[] = {
   {INIT,  E_RRQ,    tftp_proto_rq         },
   {INIT,  E_WRQ,    tftp_proto_rq         },
+  {INIT,  E_OACK,   tftp_proto_reply      },
+  {INIT,  E_ACK,    tftp_proto_reply      },
+  {INIT,  E_DATA,   tftp_proto_send_data  },
   {RECV,  E_ERROR,  tftp_proto_error      },
   {RECV,  E_DATA,   tftp_proto_recv_data  },
   {RECV,  E_ACK,    tftp_proto_send_data  },
+  {RECV,  E_OACK,   tftp_proto_oack       },
+  {RECV,  E_TIMEOUT,tftp_proto_timeout    },
   {SEND,  E_ACK,    tftp_proto_ack        },
   {SEND,  E_ERROR,  tftp_proto_error      },
+  {WAIT,  E_DATA,   tftp_proto_wait       },
+  {FILL,  E_DATA,   tftp_proto_send_data  },
+  {MASTER,  E_DATA,   tftp_proto_mcast_data },
+  {MASTER,  E_OACK,   tftp_proto_oack       },
+  {MASTER,  E_ERROR,  tftp_proto_error      },
+  {MASTER,  E_TIMEOUT,tftp_proto_timeout    },
+  {PASSIVE, E_DATA,   tftp_proto_mcast_data },
+  {PASSIVE, E_OACK,   tftp_proto_oack       },
+  {PASSIVE, E_ERROR,  tftp_proto_error      },
+  {PASSIVE, E_TIMEOUT,tftp_proto_timeout    },
   /* sentinel */
   {END,   0,        NULL                  }
 };
 
-static struct tftp_machine machine;
+/**
+ * Destination of queued packets. Server multicast transfer sends
+ * blocks to group once master client has answered.
+ * @param machine TFTP machine
+ * @return Address
+ */
+static apr_sockaddr_t *tftp_proto_dest (struct tftp_machine *machine)
+{
+  if (machine->mcast && machine->mcast->clients && machine->tid) {
+    return machine->mcast->group;
+  }
+  return machine->sockaddr;
+}
+
+/**
+ * Queue packet to server and start retransmission timer.
+ * Packet is sent when machine starts waiting for response.
+ * @param machine TFTP machine
+ * @param packet  Packet or its header
+ * @param len     Packet or header length
+ * @param body    Rest of the packet or NULL
+ * @param body_len Rest of the packet length
+ * @return APR status
+ */
+static apr_status_t tftp_proto_sendv (struct tftp_machine *machine, const char *packet, apr_size_t len,
+                                      const char *body, apr_size_t body_len)
+{
+  tftp_rtt_sent (&machine->rtt);
+  return tftp_io_sendv (&machine->io, tftp_proto_dest (machine), packet, len, body, body_len);
+}
+
+/**
+ * Queue packet to server and start retransmission timer.
+ * @param machine TFTP machine
+ * @param packet  Packet to send
+ * @param len     Packet length
+ * @return APR status
+ */
+static apr_status_t tftp_proto_send (struct tftp_machine *machine, const char *packet, apr_size_t len)
+{
+  return tftp_proto_sendv (machine, packet, len, NULL, 0);
+}
+
+/**
+ * Ask kernel to read next chunk of the file map ahead of sender window.
+ * @param machine TFTP machine
+ */
+static void tftp_proto_readahead (struct tftp_machine *machine)
+{
+#ifdef HAVE_MADVISE
+  apr_size_t len;
+
+  if (machine->map_ahead >= machine->map->size ||
+      machine->file_off + MAP_READAHEAD / 2 < machine->map_ahead) {
+    return;
+  }
+  len = machine->map->size - machine->map_ahead;
+  if (len > MAP_READAHEAD) {
+    len = MAP_READAHEAD;
+  }
+  madvise ((char *)machine->map->mm + machine->map_ahead, len, MADV_WILLNEED);
+#endif
+  machine->map_ahead += MAP_READAHEAD;
+}
+
+/**
+ * Map local file of PUT, so DATA packets are sent right from the map.
+ * File is read by blocks if it can not be mapped.
+ * @param machine TFTP machine
+ */
+static void tftp_proto_map (struct tftp_machine *machine)
+{
+#if APR_HAS_MMAP
+  apr_finfo_t finfo;
+  apr_status_t rv;
+
+  rv = apr_file_info_get (&finfo, APR_FINFO_TYPE | APR_FINFO_SIZE, machine->local_file);
+  if (rv != APR_SUCCESS || finfo.filetype != APR_REG || finfo.size == 0) {
+    return;
+  }
+  rv = apr_mmap_create (&machine->map, machine->local_file, 0, finfo.size, APR_MMAP_READ, machine->mp);
+  if (rv != APR_SUCCESS) {
+    DBG("Failed to map file. Read it by blocks.");
+    machine->map = NULL;
+    return;
+  }
+#ifdef HAVE_MADVISE
+  madvise (machine->map->mm, machine->map->size, MADV_SEQUENTIAL);
+#endif
+  machine->map_ahead = 0;
+  tftp_proto_readahead (machine);
+  DBG("Mapped file of %" APR_OFF_T_FMT " bytes.", finfo.size);
+#endif
+}
+
+/**
+ * Make room for file of transfer size acknowledged by server.
+ * Fails if file system has not enough free space.
+ * @param machine TFTP machine
+ * @param size    Transfer size
+ * @return APR status. APR_ENOSPC if file does not fit.
+ */
+static apr_status_t tftp_proto_reserve (struct tftp_machine *machine, apr_off_t size)
+{
+  apr_status_t rv;
+#ifdef HAVE_FSTATVFS
+  struct statvfs st;
+  apr_os_file_t fd;
+
+  apr_os_file_get (&fd, machine->local_file);
+  if (fstatvfs (fd, &st) == 0 && (apr_uint64_t)st.f_bavail * st.f_frsize < (apr_uint64_t)size) {
+    ERR("File of %" APR_OFF_T_FMT " bytes exceeds free disk space.", size);
+    return APR_ENOSPC;
+  }
+#endif
+  rv = tftp_sink_reserve (machine->sink, size);
+  if (APR_STATUS_IS_ENOSPC(rv)) {
+    ERR("Failed to preallocate file of %" APR_OFF_T_FMT " bytes.", size);
+    return rv;
+  }
+  if (rv != APR_SUCCESS) {
+    DBG("File is not preallocated.");
+  }
+  return APR_SUCCESS;
+}
+
+/**
+ * Print received block with transfer progress, throughput and
+ * estimated time left when transfer size is known.
+ * @param machine TFTP machine
+ */
+static void tftp_proto_progress (struct tftp_machine *machine)
+{
+  double sec = (double)(apr_time_now() - machine->start) / APR_USEC_PER_SEC;
+  double rate = sec > 0 ? machine->recv_bytes / sec : 0;
+
+  if (machine->tsize > 0 && machine->recv_bytes <= machine->tsize) {
+    LOG("<-- %-5s block# %05d [%" APR_SIZE_T_FMT " bytes] %" APR_OFF_T_FMT "/%" APR_OFF_T_FMT " bytes %3d%% %.2f MB/s ETA %.1f s",
+        opcode_str[E_DATA], machine->block, machine->view.data.len,
+        machine->recv_bytes, machine->tsize, (int)(machine->recv_bytes * 100 / machine->tsize),
+        rate / (1 << 20), rate > 0 ? (machine->tsize - machine->recv_bytes) / rate : 0.0);
+  } else {
+    LOG("<-- %-5s block# %05d [%" APR_SIZE_T_FMT " bytes] %" APR_OFF_T_FMT " bytes %.2f MB/s",
+        opcode_str[E_DATA], machine->block, machine->view.data.len,
+        machine->recv_bytes, rate / (1 << 20));
+  }
+}
+
+/**
+ * Send queued packets and wait for response.
+ * @param machine TFTP machine
+ * @return Current State.
+ */
+static state tftp_proto_expect (struct tftp_machine *machine)
+{
+  apr_status_t rv = tftp_io_flush (&machine->io, tftp_proto_dest (machine));
+
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to send packets to server.");
+    machine->status = rv;
+    return machine->state = END;
+  }
+  machine->wait = TRUE;
+  return machine->state = machine->role;
+}
+
+/**
+ * Packet of server multicast transfer came from other client than
+ * master. Passive client acknowledges last block when it has the file.
+ * @param machine TFTP machine
+ * @return FALSE if packet came from master client.
+ */
+static bool tftp_proto_mcast_other (struct tftp_machine *machine)
+{
+  struct tftp_mcast *mcast = machine->mcast;
+  struct tftp_mcast_client *client;
+
+  if (mcast->from->port == machine->sockaddr->port && apr_sockaddr_equal (mcast->from, machine->sockaddr)) {
+    return FALSE;
+  }
+  client = tftp_mcast_find (mcast, mcast->from);
+  if (client == NULL) {
+    DBG("Packet %s of unknown client. Ignore.", opcode_str[machine->view.opcode]);
+  } else if (machine->view.opcode == E_ERROR ||
+             (machine->view.opcode == E_ACK &&
+              machine->view.block == tftp_block_wire (mcast->blocks, machine->rollover))) {
+    LOG("<-- %-5s passive client port %d is done.", opcode_str[machine->view.opcode], mcast->from->port);
+    client->done = 1;
+  }
+  return TRUE;
+}
+
+/**
+ * Packet came from other host or port than transfer peer. Sender gets
+ * ERROR and transfer goes on (RFC1350). Client takes the peer from
+ * the first response, server knows it from request.
+ * @param machine TFTP machine
+ * @return TRUE if packet is discarded.
+ */
+static bool tftp_proto_unknown_tid (struct tftp_machine *machine)
+{
+  struct pack_error error = { .ercode = ERR_XFERID, .msg = "Unknown transfer ID" };
+  apr_status_t rv;
+
+  if ((machine->tid == 0 && !machine->peer_known) ||
+      (machine->from->port == machine->sockaddr->port && apr_sockaddr_equal (machine->from, machine->sockaddr))) {
+    return FALSE;
+  }
+  LOG("<-- Packet of unknown transfer ID %d. Discard.", machine->from->port);
+  // exchange buffer holds packet sent again on timeout and queued
+  // packet may be sent after return, ERROR has its own buffer
+  if (machine->xferid == NULL) {
+    machine->xferid = apr_palloc(machine->mp, BUF_SIZE);
+    error.msg_len = strlen (error.msg);
+    machine->xferid_len = tftp_create_error (machine->xferid, &error);
+  }
+  // not a packet of transfer, retransmission timer keeps running
+  rv = tftp_io_send (&machine->io, machine->from, machine->xferid, machine->xferid_len);
+  if (rv == APR_SUCCESS) {
+    rv = tftp_io_flush (&machine->io, machine->from);
+  }
+  if (rv != APR_SUCCESS) {
+    DBG("Failed to send ERROR to unknown transfer ID.");
+  }
+  return TRUE;
+}
+
+/**
+ * Receive and parse next packet of I/O.
+ * @param machine TFTP machine
+ * @param io      Machine I/O or I/O of multicast group
+ * @return Current State.
+ */
+static state tftp_proto_recv_io (struct tftp_machine *machine, struct tftp_io *io)
+{
+  // server of multicast transfer receives packets of all clients
+  apr_sockaddr_t *from = machine->mcast && machine->mcast->clients ? machine->mcast->from : machine->from;
+  apr_size_t len;
+  apr_status_t rv;
+  char *packet;
+
+  for (;;) {
+    rv = tftp_io_recv (io, from, &packet, &len);
+    if (APR_STATUS_IS_EAGAIN(rv)) {
+      return machine->state;
+    }
+    if (APR_STATUS_IS_TIMEUP(rv)) {
+      return tftp_proto_timer (machine);
+    }
+    if (rv != APR_SUCCESS) {
+      machine->wait = FALSE;
+      ERR("Failed to receive packet on response to %s.", opcode_str[machine->event]);
+      machine->status = rv;
+      return machine->state = END;
+    }
+    DBG("Recv packet len: %lu", len);
+    if (from == machine->from && tftp_proto_unknown_tid (machine)) {
+      continue;
+    }
 
-apr_status_t tftp_proto_init (apr_pool_t *mp, struct tftp_params *params)
+    // terminate payload, message of ERROR packet may lack its 0x0
+    packet[len] = '\0';
+    if (tftp_packet_view_read(&machine->view, packet, len) == NULL) {
+      machine->wait = FALSE;
+      ERR("Failed to parse packet on response to %s.", opcode_str[machine->event]);
+      return machine->state = END;
+    }
+    if (from == machine->from || !tftp_proto_mcast_other (machine)) {
+      break;
+    }
+  }
+  machine->wait = FALSE;
+  // first response comes from server transaction id (port)
+  if (machine->tid == 0) {
+    if (from == machine->from && !machine->peer_known) {
+      machine->sockaddr->salen = from->salen;
+      memcpy (&machine->sockaddr->sa, &from->sa, from->salen);
+      machine->sockaddr->port = from->port;
+    }
+    machine->tid = machine->sockaddr->port;
+    DBG("Remote transaction ID (port): %d", machine->tid);
+  }
+  machine->event = machine->view.opcode;
+  machine->state = machine->role;
+
+  DBG("Event: %s, State: %s", opcode_str[machine->event], state_str[machine->state]);
+  return machine->state;
+}
+
+/**
+ * Wait for packet of server or of multicast group.
+ * Both sockets are polled and read without blocking.
+ * @param machine TFTP machine
+ * @return Current State.
+ */
+static state tftp_proto_mcast_recv (struct tftp_machine *machine)
+{
+  struct tftp_mcast *mcast = machine->mcast;
+  apr_pollfd_t pfd[2];
+  apr_interval_time_t left = tftp_rtt_deadline (&machine->rtt) - apr_time_now ();
+  apr_int32_t num;
+  apr_status_t rv;
+
+  // datagrams of previous batch call come first
+  if (!tftp_io_pending (&machine->io) && !tftp_io_pending (&mcast->io)) {
+    if (left <= 0) {
+      return tftp_proto_timer (machine);
+    }
+    memset (pfd, 0, sizeof(pfd));
+    pfd[0].p = pfd[1].p = machine->mp;
+    pfd[0].desc_type = pfd[1].desc_type = APR_POLL_SOCKET;
+    pfd[0].reqevents = pfd[1].reqevents = APR_POLLIN;
+    pfd[0].desc.s = machine->sock;
+    pfd[1].desc.s = mcast->sock;
+    rv = apr_poll (pfd, 2, &num, left);
+    if (APR_STATUS_IS_TIMEUP(rv)) {
+      return tftp_proto_timer (machine);
+    }
+    if (rv != APR_SUCCESS && !APR_STATUS_IS_EINTR(rv)) {
+      ERR("Failed to poll sockets.");
+      machine->wait = FALSE;
+      machine->status = rv;
+      return machine->state = END;
+    }
+  }
+  apr_socket_timeout_set (machine->sock, 0);
+  return tftp_proto_recv (machine);
+}
+
+state tftp_proto_recv (struct tftp_machine *machine)
+{
+  // OACK of new master and ERROR come from server
+  tftp_proto_recv_io (machine, &machine->io);
+  if (machine->wait && machine->state != END && machine->mcast && machine->mcast->sock) {
+    tftp_proto_recv_io (machine, &machine->mcast->io);
+  }
+  return machine->state;
+}
+
+state tftp_proto_timer (struct tftp_machine *machine)
+{
+  DBG("No response to %s in %lu ms.", opcode_str[machine->event], apr_time_as_msec(machine->rtt.rto));
+  machine->wait = FALSE;
+  machine->event = E_TIMEOUT;
+  return machine->state = machine->role;
+}
+
+apr_status_t tftp_proto_create (struct tftp_machine **new, apr_pool_t *pool, struct tftp_params *params)
 {
   apr_status_t rv; // return value
   apr_int32_t file_open_flag;
+  apr_pool_t *mp;
+  struct tftp_machine *machine;
+
+  // every transfer owns a pool, so socket and file are closed when it is destroyed
+  rv = apr_pool_create(&mp, pool);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to create transfer memory pool.");
+    return rv;
+  }
+  machine = apr_pcalloc(mp, sizeof(struct tftp_machine));
 
-  machine.state = INIT;
-  machine.tid = 0;      // init transaction id
-  machine.action = params->action;
-  machine.mode = params->mode;
-  DBG("Mode is (%d) %s", machine.mode, mode_str[machine.mode]);
-  machine.mp = mp;
+  machine->state = INIT;
+  machine->role = RECV;
+  machine->status = APR_EINCOMPLETE;
+  machine->tid = 0;      // init transaction id
+  machine->action = params->action;
+  machine->mode = params->mode;
+  machine->rollover = params->rollover;
+  DBG("Mode is (%d) %s", machine->mode, mode_str[machine->mode]);
+  if (machine->mode == E_ASCII) {
+    tftp_netascii_init (&machine->netascii);
+    DBG("Netascii conversion uses %s.", tftp_netascii_simd());
+  }
+  machine->mp = mp;
 
-  rv = apr_sockaddr_info_get(&machine.sockaddr, params->host, APR_INET, params->port, 0, mp);
+  rv = apr_sockaddr_info_get(&machine->sockaddr, params->host, APR_INET, params->port, 0, mp);
   if (rv != APR_SUCCESS) {
     ERR("Failed get socket address info UDP:%s:%d.", params->host, params->port);
-    return rv;
+    goto failed;
   }
 
-  rv = apr_socket_create(&machine.sock, machine.sockaddr->family, SOCK_DGRAM, APR_PROTO_UDP, mp);
+  // source of received packets, compared with transfer peer
+  rv = apr_sockaddr_info_get(&machine->from, NULL, machine->sockaddr->family, 0, 0, mp);
+  if (rv != APR_SUCCESS) {
+    goto failed;
+  }
+
+  rv = apr_socket_create(&machine->sock, machine->sockaddr->family, SOCK_DGRAM, APR_PROTO_UDP, mp);
   if (rv != APR_SUCCESS) {
     ERR("Failed to create socket (apr_socket_create).");
-    return rv;
+    goto failed;
   }
 
-  if (machine.action == GET) {
+  if (machine->action == GET) {
     file_open_flag  = APR_FOPEN_CREATE|APR_FOPEN_WRITE|APR_FOPEN_TRUNCATE;
-    machine.event   = E_RRQ;
+    machine->event   = E_RRQ;
   } else {
     file_open_flag  = APR_FOPEN_READ;
-    machine.event   = E_WRQ;
+    machine->event   = E_WRQ;
   }
-  if (machine.mode == E_OCTET) {
+  if (machine->mode == E_OCTET) {
     DBG("Add binary flag to file open function.");
     file_open_flag |= APR_FOPEN_BINARY;
   }
 
-  DBG("Machine event: %s", opcode_str[machine.event]);
+  DBG("Machine event: %s", opcode_str[machine->event]);
 
-  rv = apr_file_open (&machine.local_file, params->local_file,
+  rv = apr_file_open (&machine->local_file, params->local_file,
         file_open_flag, APR_OS_DEFAULT, mp);
   if (rv != APR_SUCCESS) {
     ERR("Failed open file %s", params->local_file);
-    return rv;
+    goto failed;
   }
   DBG("Opened file %s", params->local_file);
-  machine.remote_file = params->remote_file;
+  machine->remote_file = params->remote_file;
+
+  // RFC1350 lock-step transfer unless server acknowledges options
+  machine->blksize = DATA_SIZE;
+  machine->windowsize = 1;
+  if (params->blksize != DATA_SIZE) {
+    machine->opts.blksize = params->blksize;
+  }
+  if (params->windowsize > 1) {
+    machine->opts.windowsize = params->windowsize;
+  }
+  if (machine->action == GET) {
+    // blocks of multicast group are written at their offsets
+    machine->opts.has_multicast = params->multicast && machine->mode == E_OCTET;
+  }
+  tftp_rtt_init (&machine->rtt, apr_time_from_sec(params->timeout ? params->timeout : TFTP_TIMEOUT));
+  // servers without options support get plain request by default
+  if (params->timeout) {
+    machine->opts.timeout = tftp_rtt_timeout_sec (&machine->rtt);
+  }
+  // File size is sent along with other options, when asked for, or
+  // when GET preallocates file written with direct I/O. Server answers
+  // tsize only if client asked for it (see tftp_proto_accept).
+  if (params->tsize || (params->direct && machine->action == GET) || machine->opts.blksize || machine->opts.windowsize ||
+      machine->opts.timeout || machine->opts.has_multicast) {
+    if (machine->action == GET) {
+      machine->opts.has_tsize = 1;
+    } else if (machine->mode == E_OCTET) {
+      apr_finfo_t finfo;
+      // netascii size is known only after conversion
+      if (apr_file_info_get (&finfo, APR_FINFO_TYPE | APR_FINFO_SIZE, machine->local_file) == APR_SUCCESS &&
+          finfo.filetype == APR_REG) {
+        machine->opts.tsize = machine->tsize = finfo.size;
+        machine->opts.has_tsize = 1;
+      }
+    }
+  }
+  machine->retries = params->retries;
+
+  machine->buf_size = BUF_SIZE;
+  if (machine->opts.blksize + 4 > machine->buf_size) {
+    machine->buf_size = machine->opts.blksize + 4;
+  }
+
+  machine->buf = apr_palloc(mp, machine->buf_size);
+  DBG("Allocated TFTP message exchange buffer with size %lu bytes.", machine->buf_size);
 
-  machine.buf = apr_palloc(mp, BUF_SIZE);
-  DBG("Allocated TFTP message exchange buffer with size %d bytes.", BUF_SIZE);
+  rv = tftp_io_init (&machine->io, mp, machine->sock, params->io_mode,
+                     params->windowsize > 1 ? params->windowsize : 1, machine->buf_size);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to init datagram I/O.");
+    goto failed;
+  }
+  DBG("Datagram I/O: %s.", io_mode_str[machine->io.mode]);
 
+  if (machine->action == GET) {
+    rv = tftp_sink_create (&machine->sink, mp, machine->local_file, &machine->io, params->direct);
+    if (rv != APR_SUCCESS) {
+      ERR("Failed to create file sink.");
+      goto failed;
+    }
+  } else {
+    unsigned int slots = params->windowsize > 1 ? params->windowsize : 1;
+    machine->win = apr_palloc(mp, slots * machine->buf_size);
+    machine->win_len = apr_pcalloc(mp, slots * sizeof(apr_size_t));
+    machine->win_body = apr_pcalloc(mp, slots * sizeof(char *));
+    machine->win_first = 1;
+    DBG("Allocated sender window of %u packets.", slots);
+    if (machine->mode == E_ASCII) {
+      // converted blocks do not match the file, read it to convert
+      machine->ascii_buf = apr_palloc(mp, machine->buf_size);
+    } else {
+      // cached packets are built from the map too (see tftp_proto_send_data)
+      tftp_proto_map (machine);
+    }
+  }
+
+  *new = machine;
   return APR_SUCCESS;
+
+failed:
+  apr_pool_destroy(mp);
+  return rv;
+}
+
+void tftp_proto_destroy (struct tftp_machine *machine)
+{
+  apr_pool_destroy(machine->mp);
 }
 
-state tftp_proto_fsm ()
+state tftp_proto_fsm (struct tftp_machine *machine)
 {
   struct trans_table *table = transition;
   state rv = END;
+
+  if (machine->state == END) {
+    return END;
+  }
+  // blocking receive with retransmission timeout
+  if (machine->wait && machine->mcast && machine->mcast->sock) {
+    tftp_proto_mcast_recv (machine);
+    if (machine->state == END || machine->wait) {
+      return machine->state;
+    }
+  } else if (machine->wait) {
+    apr_interval_time_t left = tftp_rtt_deadline (&machine->rtt) - apr_time_now ();
+    if (left > 0) {
+      apr_socket_timeout_set (machine->sock, left);
+      tftp_proto_recv (machine);
+    } else {
+      tftp_proto_timer (machine);
+    }
+    if (machine->state == END || machine->wait) {
+      return machine->state;
+    }
+  }
   do {
     if (table->current_state == END) {
-      rv = END;
+      // packet does not belong to this state, keep waiting
+      DBG("Unexpected %s in state %s. Ignore.", opcode_str[machine->event], state_str[machine->state]);
+      rv = tftp_proto_expect (machine);
       break;
     }
-    if (table->current_state == machine.state && table->event == machine.event) {
-      rv = table->action();
+    if (table->current_state == machine->state && table->event == machine->event) {
+      rv = table->action(machine);
       DBG("Next state: %s", state_str[rv]);
       break;
     }
@@ -118,168 +619,829 @@ state tftp_proto_fsm ()
   return rv;
 }
 
-state tftp_proto_rq (void)
+state tftp_proto_run (struct tftp_machine *machine)
+{
+  while (machine->state != END && !machine->wait) {
+    tftp_proto_fsm (machine);
+  }
+  return machine->state;
+}
+
+state tftp_proto_rq (struct tftp_machine *machine)
 {
   apr_size_t len;
   apr_status_t rv;
 
-  LOG("--> %-5s %s 0x0 %s", opcode_str[machine.event], machine.remote_file, mode_str[machine.mode]);
+  LOG("--> %-5s %s 0x0 %s", opcode_str[machine->event], machine->remote_file, mode_str[machine->mode]);
   struct pack_rq rq = {
-    .filename = (char *)machine.remote_file,
-    .len_filename = strlen(machine.remote_file),
-    .mode = mode_str[machine.mode],
-    .len_mode = strlen(mode_str[machine.mode]),
-    .e_mode = machine.mode
+    .filename = (char *)machine->remote_file,
+    .len_filename = strlen(machine->remote_file),
+    .mode = mode_str[machine->mode],
+    .len_mode = strlen(mode_str[machine->mode]),
+    .e_mode = machine->mode,
+    .opts = machine->opts
   };
 
-  len = tftp_req_pack (machine.buf, machine.event, &rq);
-  rv = apr_socket_sendto (machine.sock, machine.sockaddr, 0, machine.buf, &len);
-  if (rv != APR_SUCCESS) {
-    ERR("Failed to send packet %s", opcode_str[machine.event]);
-    machine.state = END;
+  if (machine->event == E_RRQ) {
+    len = tftp_create_rrq (machine->buf, &rq);
+  } else {
+    len = tftp_create_wrq (machine->buf, &rq);
+  }
+  if (len == 0) {
+    ERR("Remote file name is too long.");
+    machine->status = APR_ENAMETOOLONG;
+    machine->state = END;
     return END;
   }
-  DBG("Sent packet %s length %lu", opcode_str[machine.event], len);
-  len = BUF_SIZE;
-  rv = apr_socket_recvfrom (machine.sockaddr, machine.sock, 0, machine.buf, &len);
+  machine->buf_len = len;
+  machine->start = apr_time_now();
+  rv = tftp_proto_send (machine, machine->buf, len);
   if (rv != APR_SUCCESS) {
-    ERR("Failed to receive packet. Stop here.");
-    machine.state = END;
+    ERR("Failed to send packet %s", opcode_str[machine->event]);
+    machine->status = rv;
+    machine->state = END;
     return END;
   }
-  DBG("Sent packet length %lu", len);
-  apr_socket_addr_get(&machine.sockaddr, APR_REMOTE, machine.sock);
-  machine.tid = machine.sockaddr->port;
-  DBG("Remote transaction ID (port): %d", machine.tid);
+  DBG("Sent packet %s length %lu", opcode_str[machine->event], len);
+
+  return tftp_proto_expect (machine);
+}
+
+apr_status_t tftp_proto_accept (struct tftp_machine **new, apr_pool_t *mp,
+                                struct tftp_params *params, struct tftp_opts *req)
+{
+  struct tftp_params session = *params;
+  struct tftp_opts opts = { 0 };
+  struct tftp_machine *machine;
+  apr_status_t rv;
+
+  // size of served file is needed for tsize and multicast transfer
+  session.tsize = TRUE;
+  // server may only decrease requested values (RFC2348, RFC7440)
+  if (req->blksize) {
+    opts.blksize = req->blksize < params->blksize ? req->blksize : params->blksize;
+  }
+  if (req->windowsize) {
+    opts.windowsize = req->windowsize < params->windowsize ? req->windowsize : params->windowsize;
+  }
+  opts.timeout = req->timeout;
+  session.blksize = opts.blksize ? opts.blksize : DATA_SIZE;
+  session.windowsize = opts.windowsize ? opts.windowsize : 1;
+  session.timeout = opts.timeout ? opts.timeout : params->timeout;
+
+  rv = tftp_proto_create (&machine, mp, &session);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  // request buffer is reused by server
+  machine->remote_file = apr_pstrdup (machine->mp, params->remote_file);
+  // timeout asked by client is used as is, otherwise it is estimated
+  if (opts.timeout) {
+    tftp_rtt_fix (&machine->rtt, apr_time_from_sec(opts.timeout));
+  }
+  // only the client of request may answer
+  machine->peer_known = TRUE;
+
+  if (req->has_tsize && machine->action == PUT) {
+    // netascii size is known only after conversion
+    if (machine->mode == E_OCTET && machine->opts.has_tsize) {
+      opts.tsize = machine->tsize;
+      opts.has_tsize = 1;
+    }
+  } else if (req->has_tsize) {
+    // refuse file before the first block if it does not fit
+    rv = tftp_proto_reserve (machine, req->tsize);
+    if (rv != APR_SUCCESS) {
+      tftp_proto_destroy (machine);
+      return rv;
+    }
+    machine->tsize = opts.tsize = req->tsize;
+    opts.has_tsize = 1;
+  }
+  if (params->cache && machine->action == PUT && machine->mode == E_OCTET) {
+    // packets of negotiated block size are shared by transfers of the file
+    rv = tftp_cache_acquire (&machine->cached, params->cache, machine->local_file,
+                             params->local_file, session.blksize, machine->rollover);
+    if (rv == APR_SUCCESS) {
+      apr_pool_cleanup_register (machine->mp, machine->cached, tftp_cache_cleanup, apr_pool_cleanup_null);
+    } else {
+      machine->cached = NULL;
+    }
+  }
+  machine->opts = opts;
+  machine->blksize = session.blksize;
+  machine->windowsize = session.windowsize;
+  machine->block = 0;
+  machine->seq = 0;
+  machine->start = apr_time_now();
+
+  // reply is sent again until client answers from its transaction id
+  if (opts.blksize || opts.windowsize || opts.timeout || opts.has_tsize) {
+    machine->buf_len = tftp_create_oack (machine->buf, &opts);
+    machine->event = E_OACK;
+  } else if (machine->action == GET) {
+    machine->buf_len = tftp_create_ack (machine->buf, 0);
+    machine->event = E_ACK;
+  } else {
+    // first DATA is sent again from sender window
+    machine->tid = machine->sockaddr->port;
+    machine->event = E_DATA;
+  }
+  DBG("Accepted %s of %s: blksize %u windowsize %u.", machine->action == GET ? "WRQ" : "RRQ",
+      machine->remote_file, machine->blksize, machine->windowsize);
+
+  *new = machine;
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_proto_mcast_serve (struct tftp_machine *machine, apr_sockaddr_t *group,
+                                     apr_sockaddr_t *iface)
+{
+  apr_status_t rv;
+
+  rv = tftp_mcast_serve (&machine->mcast, machine->mp, machine->sock, group, iface,
+                         machine->sockaddr, machine->tsize / machine->blksize + 1);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  // blocks are acknowledged by one client at a time: lock-step
+  machine->windowsize = 1;
+  machine->opts.windowsize = 0;
+  machine->opts.has_multicast = 1;
+  apr_sockaddr_ip_getbuf (machine->opts.mc_addr, sizeof(machine->opts.mc_addr), group);
+  machine->opts.mc_port = group->port;
+  machine->opts.mc_master = 1;
+  machine->buf_len = tftp_create_oack (machine->buf, &machine->opts);
+  machine->event = E_OACK;
+  machine->tid = 0;
+  DBG("Multicast transfer of %s to group %s:%d.", machine->remote_file, machine->opts.mc_addr, group->port);
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_proto_mcast_join (struct tftp_machine *machine, const char *host, apr_port_t port,
+                                    struct tftp_opts *req)
+{
+  struct tftp_mcast_client *client;
+  struct tftp_opts opts = { 0 };
+  char buf[BUF_SIZE];
+  apr_size_t len;
+
+  // client takes block size of the group only if it is not larger than requested
+  if (machine->blksize > (req->blksize ? req->blksize : DATA_SIZE)) {
+    return APR_EINVAL;
+  }
+  client = tftp_mcast_add (machine->mcast, host, port);
+  if (client == NULL) {
+    return APR_EINVAL;
+  }
+  if (machine->blksize != DATA_SIZE) {
+    opts.blksize = machine->blksize;
+  }
+  if (req->has_tsize) {
+    opts.tsize = machine->tsize;
+    opts.has_tsize = 1;
+  }
+  opts.has_multicast = 1;
+  memcpy (opts.mc_addr, machine->opts.mc_addr, sizeof(opts.mc_addr));
+  opts.mc_port = machine->opts.mc_port;
+  opts.mc_master = client->addr == machine->sockaddr;
+  len = tftp_create_oack (buf, &opts);
+  LOG("--> %-5s multicast passive client %s:%d", opcode_str[E_OACK], host, port);
+  return apr_socket_sendto (machine->sock, client->addr, 0, buf, &len);
+}
+
+state tftp_proto_reply (struct tftp_machine *machine)
+{
+  apr_status_t rv;
+
+  if (machine->event == E_OACK) {
+    LOG("--> %-5s blksize %u windowsize %u timeout %u tsize %" APR_OFF_T_FMT, opcode_str[E_OACK],
+        machine->opts.blksize, machine->opts.windowsize, machine->opts.timeout, machine->opts.tsize);
+  } else {
+    LOG("--> %-5s block# %05d", opcode_str[E_ACK], 0);
+  }
+  rv = tftp_proto_send (machine, machine->buf, machine->buf_len);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to send packet %s", opcode_str[machine->event]);
+    machine->status = rv;
+    return machine->state = END;
+  }
+  return tftp_proto_expect (machine);
+}
+
+/**
+ * Move sender window of multicast transfer to block acknowledged by
+ * master client, when it is out of window. New master client
+ * acknowledges the block before its first missing one, which may be
+ * behind or ahead of the window.
+ * @param machine TFTP machine
+ * @return TRUE if window is moved.
+ */
+static bool tftp_proto_mcast_seek (struct tftp_machine *machine)
+{
+  apr_uint64_t cycle = BLOCK_MAX + 1 - machine->rollover;
+  apr_uint64_t delta, acked;
+  apr_status_t rv;
+
+  if (machine->mcast == NULL || machine->mcast->clients == NULL || machine->view.opcode != E_ACK) {
+    return FALSE;
+  }
+  delta = tftp_block_delta (machine->win_first - 1, machine->view.block, machine->rollover);
+  if (delta <= machine->win_count) {
+    return FALSE;
+  }
+  // block number is the nearest one to the window
+  if (delta < cycle / 2) {
+    acked = machine->win_first - 1 + delta;
+  } else if (cycle - delta < machine->win_first) {
+    acked = machine->win_first - 1 - (cycle - delta);
+  } else {
+    return FALSE;
+  }
+  if (acked > machine->mcast->blocks) {
+    return FALSE;
+  }
+  LOG("<-- %-5s block# %05d master client continues.", opcode_str[E_ACK], machine->view.block);
+  tftp_rtt_recv (&machine->rtt);
+  machine->win_first = acked + 1;
+  machine->win_head = 0;
+  machine->win_count = 0;
+  machine->win_sent = 0;
+  machine->file_off = acked * machine->blksize;
+  machine->eof = acked == machine->mcast->blocks;
+  if (!machine->cached && !machine->map) {
+    apr_off_t off = machine->file_off;
+    rv = apr_file_seek (machine->local_file, APR_SET, &off);
+    if (rv != APR_SUCCESS) {
+      ERR("Failed to seek file.");
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * Master client of multicast transfer has the file. Make the next
+ * client missing blocks master with OACK and wait for its ACK.
+ * @param machine TFTP machine
+ * @return FALSE if all clients are done.
+ */
+static bool tftp_proto_mcast_handover (struct tftp_machine *machine)
+{
+  struct tftp_opts opts = { 0 };
+  struct tftp_mcast_client *client = tftp_mcast_next (machine->mcast);
+
+  if (client == NULL) {
+    return FALSE;
+  }
+  // group is not changed, only master
+  opts.has_multicast = 1;
+  opts.mc_master = 1;
+  machine->sockaddr = client->addr;
+  machine->tid = 0;
+  machine->buf_len = tftp_create_oack (machine->buf, &opts);
+  machine->event = E_OACK;
+  LOG("--> %-5s multicast master client port %d", opcode_str[E_OACK], client->addr->port);
+  return tftp_proto_send (machine, machine->buf, machine->buf_len) == APR_SUCCESS;
+}
+
+state tftp_proto_timeout (struct tftp_machine *machine)
+{
+  apr_status_t rv;
+  unsigned int retries = tftp_rtt_backoff (&machine->rtt);
+
+  if (retries > machine->retries) {
+    // clients of multicast transfer go on without master which does not answer
+    if (machine->mcast && machine->mcast->clients && tftp_proto_mcast_handover (machine)) {
+      ERR("Master client does not answer after %u retransmissions.", machine->retries);
+      machine->rtt.retries = 0;
+      return tftp_proto_expect (machine);
+    }
+    ERR("Transfer timed out after %u retransmissions.", machine->retries);
+    machine->status = APR_TIMEUP;
+    return machine->state = END;
+  }
+  // passive client only collects blocks of group
+  if (machine->role == PASSIVE) {
+    DBG("No block of multicast group in %lu ms.", apr_time_as_msec(machine->rtt.rto));
+    return tftp_proto_expect (machine);
+  }
+  LOG("Timeout. Retransmission #%u, next timeout %lu ms.", retries,
+      apr_time_as_msec(machine->rtt.rto));
+
+  // no response to request, or to reply of server, yet
+  if (machine->tid == 0) {
+    rv = tftp_proto_send (machine, machine->buf, machine->buf_len);
+    if (rv != APR_SUCCESS) {
+      ERR("Failed to resend packet %s", opcode_str[machine->event]);
+      machine->status = rv;
+      return machine->state = END;
+    }
+    return tftp_proto_expect (machine);
+  }
+
+  if (machine->action == GET) {
+    // acknowledge last block received in order
+    machine->event = E_ACK;
+    machine->state = SEND;
+  } else {
+    // send again window from the first not acknowledged block
+    machine->win_sent = 0;
+    machine->event = E_DATA;
+    machine->state = FILL;
+  }
+  DBG("Event: %s, State: %s", opcode_str[machine->event], state_str[machine->state]);
+  return machine->state;
+}
+
+/**
+ * Join multicast group of OACK or become master client.
+ * @param machine TFTP machine
+ * @return Current State.
+ */
+static state tftp_proto_mcast_oack (struct tftp_machine *machine)
+{
+  struct tftp_opts *opts = &machine->view.opts;
+  apr_status_t rv;
+  char *ip;
+
+  if (machine->mcast == NULL) {
+    rv = tftp_mcast_join (&machine->mcast, machine->mp, opts->mc_addr, opts->mc_port,
+                          machine->sockaddr, machine->io.mode, machine->buf_size);
+    if (rv != APR_SUCCESS) {
+      machine->status = rv;
+      return machine->state = END;
+    }
+  }
+  machine->role = opts->mc_master ? MASTER : PASSIVE;
+  apr_sockaddr_ip_get (&ip, machine->mcast->group);
+  LOG("Multicast group %s:%d, %s client.", ip, machine->mcast->group->port,
+      opts->mc_master ? "master" : "passive");
+  if (machine->role == PASSIVE) {
+    return tftp_proto_expect (machine);
+  }
+  // master acknowledges block before the first missing one
+  machine->seq = machine->mcast->next - 1;
+  machine->block = tftp_block_wire (machine->seq, machine->rollover);
+  machine->state = SEND;
+  machine->event = E_ACK;
+  DBG("Event: %s, State: %s", opcode_str[machine->event], state_str[machine->state]);
+  return machine->state;
+}
 
-  machine.pack = tftp_packet_read(machine.buf, len, machine.mp);
-  machine.state = RECV;
-  machine.event = machine.pack->opcode;
+state tftp_proto_oack (struct tftp_machine *machine)
+{
+  apr_size_t len;
+  struct tftp_opts *opts = &machine->view.opts;
+  struct pack_error error = { .ercode = ERR_OPTION };
 
-  DBG("Event: %s, State: %s", opcode_str[machine.event], state_str[machine.state]);
+  LOG("<-- %-5s blksize %u windowsize %u timeout %u tsize %" APR_OFF_T_FMT, opcode_str[E_OACK],
+      opts->blksize, opts->windowsize, opts->timeout, opts->tsize);
+  // delayed or retransmitted OACK must not rewind transfer,
+  // multicast server sends OACK again to change master client
+  if (machine->oacked && !opts->has_multicast) {
+    if (machine->action == GET && machine->seq == 0) {
+      DBG("Duplicate OACK. Acknowledge it again.");
+      machine->state = SEND;
+      machine->event = E_ACK;
+      return machine->state;
+    }
+    DBG("Duplicate OACK. Ignore.");
+    return tftp_proto_expect (machine);
+  }
+  // server may only decrease requested values (RFC2348, RFC7440)
+  if (opts->blksize && (machine->opts.blksize == 0 || opts->blksize > machine->opts.blksize)) {
+    error.msg = "Invalid blksize";
+  } else if (opts->windowsize &&
+             (machine->opts.windowsize == 0 || opts->windowsize > machine->opts.windowsize)) {
+    error.msg = "Invalid windowsize";
+  } else if (opts->timeout && opts->timeout != machine->opts.timeout) {
+    // server must not change timeout value (RFC2349)
+    error.msg = "Invalid timeout";
+  } else if (opts->has_tsize && machine->action == GET) {
+    // refuse file before the first block if it does not fit
+    machine->tsize = opts->tsize;
+    machine->status = tftp_proto_reserve (machine, opts->tsize);
+    if (machine->status != APR_SUCCESS) {
+      error.ercode = ERR_DISKFULL;
+      error.msg = "Disk full or allocation exceeded";
+    } else {
+      machine->status = APR_EINCOMPLETE;
+    }
+  }
+  if (error.msg) {
+    ERR("Server acknowledged invalid option: %s.", error.msg);
+    machine->errmsg = error.msg;
+    error.msg_len = strlen(error.msg);
+    len = tftp_create_error (machine->buf, &error);
+    tftp_io_send (&machine->io, machine->sockaddr, machine->buf, len);
+    tftp_io_flush (&machine->io, machine->sockaddr);
+    return machine->state = END;
+  }
+  if (opts->blksize) {
+    machine->blksize = opts->blksize;
+  }
+  if (opts->windowsize) {
+    machine->windowsize = opts->windowsize;
+  }
+  DBG("Block size: %u, window size: %u", machine->blksize, machine->windowsize);
+  if (opts->timeout) {
+    // both sides use negotiated timeout (RFC2349)
+    tftp_rtt_fix (&machine->rtt, apr_time_from_sec(opts->timeout));
+  }
+  machine->oacked = TRUE;
+  tftp_rtt_recv (&machine->rtt);
+  if (opts->has_multicast && machine->opts.has_multicast) {
+    return tftp_proto_mcast_oack (machine);
+  }
 
-  return RECV;
+  // OACK acknowledges request as block number 0
+  machine->block = 0;
+  machine->seq = 0;
+  if (machine->action == GET) {
+    machine->state = SEND;
+    machine->event = E_ACK;
+    DBG("Event: %s, State: %s", opcode_str[machine->event], state_str[machine->state]);
+    return machine->state;
+  }
+  return tftp_proto_send_data (machine);
 }
 
-state tftp_proto_error (void)
+state tftp_proto_error (struct tftp_machine *machine)
 {
-  ERR("Transfer error: [%d] %s\n", machine.pack->data->error.ercode, machine.pack->data->error.msg);
-  return machine.state = END;
+  // message is followed by 0x0 in packet buffer
+  ERR("Transfer error: [%d] %s\n", machine->view.block, machine->view.msg.ptr);
+  machine->errmsg = machine->view.msg.ptr;
+  return machine->state = END;
 }
 
-state tftp_proto_recv_data (void)
+state tftp_proto_recv_data (struct tftp_machine *machine)
 {
   apr_size_t len;
   apr_status_t rv;
+  char *data = machine->view.data.ptr;
+  uint16_t block = machine->view.block;
+  apr_uint64_t delta = tftp_block_delta (machine->seq, block, machine->rollover);
 
-  machine.block = machine.pack->data->data.block;
-  if (machine.mode == E_ASCII) {
-    len = tftp_str_ntoh (machine.mp,
-                         machine.pack->data->data.data,
-                         machine.pack->data->data.length);
+  DBG("<-- %-5s block# %05d [%" APR_SIZE_T_FMT " bytes]", opcode_str[machine->view.opcode],
+      block, machine->view.data.len);
+
+  // Packet ahead of expected one means lost packet in window: acknowledge
+  // last block received in order once and drop rest of the window until
+  // sender rewinds (RFC7440). Already received block means lost ACK:
+  // acknowledge once per window of retransmitted blocks.
+  if (delta != 1) {
+    bool ahead = delta != 0 && delta < (BLOCK_MAX + 1 - machine->rollover) / 2;
+    bool ack;
+    DBG("Expected block# %05d. Last in order block# %05d.",
+        tftp_block_wire (machine->seq + 1, machine->rollover), machine->block);
+    if (ahead) {
+      ack = !machine->win_gap;
+      machine->win_gap = TRUE;
+    } else {
+      ack = machine->win_dup++ % machine->windowsize == 0;
+    }
+    if (ack) {
+      machine->state = SEND;
+      machine->event = E_ACK;
+    } else {
+      machine->state = WAIT;
+      machine->event = E_DATA;
+    }
+    return machine->state;
+  }
+  machine->win_gap = FALSE;
+  machine->win_dup = 0;
+  tftp_rtt_recv (&machine->rtt);
+  machine->block = block;
+  machine->seq++;
+  if (block == machine->rollover && machine->seq > BLOCK_MAX) {
+    DBG("Block number rolled over to %u at block %" APR_UINT64_T_FMT ".", block, machine->seq);
+  }
+  machine->win_recv++;
+
+  if (machine->mode == E_ASCII) {
+    // CR held from previous block may be placed over packet header
+    len = tftp_netascii_decode (&machine->netascii, &data, machine->view.data.len,
+                                machine->view.data.len < machine->blksize);
   } else {
-    len = machine.pack->data->data.length;
+    len = machine->view.data.len;
   }
-  LOG("<-- %-5s block# %05d [%d bytes]", opcode_str[machine.pack->opcode],
-      machine.block, machine.pack->data->data.length);
 
-  rv = apr_file_write(machine.local_file, machine.pack->data->data.data, &len);
+  rv = tftp_sink_write (machine->sink, data, len);
+  machine->recv_bytes += len;
+  tftp_proto_progress (machine);
+  // last data packet, collected data is written to file
+  if (rv == APR_SUCCESS && machine->view.data.len < machine->blksize) {
+    rv = tftp_sink_close (machine->sink);
+  }
   if (rv != APR_SUCCESS) {
     ERR("Failed to write to file");
-    return rv;
+    machine->status = rv;
+    return machine->state = END;
   }
 
   // last data packet
-  if (machine.pack->data->data.length < DATA_SIZE) {
-    len = tftp_create_ack (machine.buf, machine.block);
-    machine.state = END;
-    LOG("--> %-5s block# %05d <last data>", opcode_str[E_ACK], machine.block);
-    rv = apr_socket_sendto (machine.sock, machine.sockaddr, 0, machine.buf, &len);
+  if (machine->view.data.len < machine->blksize) {
+    len = tftp_create_ack (machine->buf, machine->block);
+    machine->state = END;
+    machine->status = APR_SUCCESS;
+    LOG("--> %-5s block# %05d <last data>", opcode_str[E_ACK], machine->block);
+    rv = tftp_io_send (&machine->io, machine->sockaddr, machine->buf, len);
+    if (rv == APR_SUCCESS) {
+      rv = tftp_io_flush (&machine->io, machine->sockaddr);
+    }
     if (rv != APR_SUCCESS) {
       ERR("Failed to send ACK");
     }
+    machine->event = E_ACK;
+  } else if (machine->win_recv < machine->windowsize) {
+    machine->state = WAIT;
+    machine->event = E_DATA;
   } else {
-    machine.state = SEND;
+    machine->state = SEND;
+    machine->event = E_ACK;
   }
-  machine.event = E_ACK;
-  DBG("Event: %s, State: %s", opcode_str[machine.event], state_str[machine.state]);
-  return machine.state;
+  DBG("Event: %s, State: %s", opcode_str[machine->event], state_str[machine->state]);
+  return machine->state;
 }
 
-state tftp_proto_send_data (void)
+state tftp_proto_mcast_data (struct tftp_machine *machine)
 {
-  apr_size_t len;
+  struct tftp_mcast *mcast = machine->mcast;
+  apr_uint64_t cycle = BLOCK_MAX + 1 - machine->rollover;
+  apr_uint64_t delta = tftp_block_delta (mcast->next - 1, machine->view.block, machine->rollover);
+  apr_uint64_t seq = mcast->next - 1 + delta;
+  apr_size_t len = machine->view.data.len;
   apr_status_t rv;
 
-  machine.block = machine.pack->data->ack.block + 1;
+  // blocks before the first missing one are received, the rest may come in any order
+  if (delta == 0 || delta >= cycle / 2 || (mcast->last && seq > mcast->last) || tftp_mcast_test (mcast, seq)) {
+    DBG("<-- %-5s block# %05d is received. Ignore.", opcode_str[E_DATA], machine->view.block);
+  } else {
+    rv = tftp_sink_write_at (machine->sink, (apr_off_t)(seq - 1) * machine->blksize,
+                             machine->view.data.ptr, len);
+    if (rv != APR_SUCCESS) {
+      ERR("Failed to write to file");
+      machine->status = rv;
+      return machine->state = END;
+    }
+    tftp_mcast_set (mcast, seq);
+    tftp_rtt_recv (&machine->rtt);
+    if (len < machine->blksize) {
+      mcast->last = seq;
+    }
+    machine->block = machine->view.block;
+    machine->recv_bytes += len;
+    tftp_proto_progress (machine);
+  }
+  machine->seq = mcast->next - 1;
+  machine->block = tftp_block_wire (machine->seq, machine->rollover);
 
-  struct pack_data data = {
-    .block = machine.block,
-    .length = DATA_SIZE
-  };
-  rv = apr_file_read (machine.local_file, (void*) data.data, &data.length);
-  if (rv != APR_SUCCESS) {
-    char error[1024];
-    apr_strerror(rv, error, 1024);
-    ERR("[%d] %s", rv, error);
-    return END;
+  if (mcast->last && mcast->next > mcast->last) {
+    rv = tftp_sink_close (machine->sink);
+    if (rv != APR_SUCCESS) {
+      ERR("Failed to write to file");
+      machine->status = rv;
+      return machine->state = END;
+    }
+    // server learns that client has the file
+    len = tftp_create_ack (machine->buf, machine->block);
+    LOG("--> %-5s block# %05d <last data>", opcode_str[E_ACK], machine->block);
+    rv = tftp_io_send (&machine->io, machine->sockaddr, machine->buf, len);
+    if (rv == APR_SUCCESS) {
+      rv = tftp_io_flush (&machine->io, machine->sockaddr);
+    }
+    if (rv != APR_SUCCESS) {
+      ERR("Failed to send ACK");
+    }
+    machine->event = E_ACK;
+    machine->status = APR_SUCCESS;
+    return machine->state = END;
+  }
+  if (machine->role == PASSIVE) {
+    return tftp_proto_expect (machine);
   }
-  DBG("Read data from file.");
+  machine->state = SEND;
+  machine->event = E_ACK;
+  DBG("Event: %s, State: %s", opcode_str[machine->event], state_str[machine->state]);
+  return machine->state;
+}
 
-  len = tftp_create_data (machine.buf, &data);
-  LOG("--> %-5s block# %05d [%d bytes]", opcode_str[E_DATA], machine.block, len);
-  rv = apr_socket_sendto (machine.sock, machine.sockaddr, 0, machine.buf, &len);
-  if (rv != APR_SUCCESS) {
-    ERR("Failed to send DATA block #%d.", data.block);
-    return machine.state = END;
+state tftp_proto_wait (struct tftp_machine *machine)
+{
+  return tftp_proto_expect (machine);
+}
+
+/**
+ * Read next block of ascii mode PUT and convert it to netascii.
+ * Block is short only at the end of file.
+ * @param machine TFTP machine
+ * @param data    Block buffer of negotiated block size
+ * @param len     Block length
+ * @return APR status
+ */
+static apr_status_t tftp_proto_read_ascii (struct tftp_machine *machine, char *data, apr_size_t *len)
+{
+  apr_size_t done = 0;
+  apr_size_t in;
+  apr_status_t rv;
+
+  while (done < machine->blksize) {
+    if (machine->ascii_pos == machine->ascii_len && !machine->ascii_eof) {
+      machine->ascii_pos = 0;
+      machine->ascii_len = machine->blksize;
+      rv = apr_file_read (machine->local_file, machine->ascii_buf, &machine->ascii_len);
+      if (rv == APR_EOF) {
+        machine->ascii_len = 0;
+        machine->ascii_eof = TRUE;
+      } else if (rv != APR_SUCCESS) {
+        return rv;
+      }
+    }
+    in = machine->ascii_len - machine->ascii_pos;
+    done += tftp_netascii_encode (&machine->netascii, data + done, machine->blksize - done,
+                                  machine->ascii_buf + machine->ascii_pos, &in, machine->ascii_eof);
+    machine->ascii_pos += in;
+    if (machine->ascii_eof && tftp_netascii_idle (&machine->netascii)) {
+      break;
+    }
   }
+  *len = done;
+  return APR_SUCCESS;
+}
 
-  len = BUF_SIZE;
-  rv = apr_socket_recvfrom (machine.sockaddr, machine.sock, 0, machine.buf, &len);
-  if (rv != APR_SUCCESS) {
-    ERR("Failed to receive packet on response to %s.", opcode_str[machine.event]);
-    return machine.state = END;
+/**
+ * Slide sender window with received ACK.
+ * ACK for a block before the end of the window rewinds the window:
+ * all not acknowledged packets are sent again (RFC7440). Repeated ACK
+ * of the block before the window is ignored.
+ * @param machine TFTP machine
+ * @return FALSE if ACK is ignored.
+ */
+static bool tftp_proto_win_ack (struct tftp_machine *machine)
+{
+  apr_uint64_t acked = 0;
+
+  // OACK on WRQ acknowledges block 0 (see tftp_proto_oack)
+  if (machine->view.opcode == E_ACK) {
+    acked = tftp_block_delta (machine->win_first - 1, machine->view.block, machine->rollover);
+    LOG("<-- %-5s block# %05d", opcode_str[E_ACK], machine->view.block);
+  }
+  if (acked > machine->win_count) {
+    DBG("ACK block# %05d is out of window. Ignore.", machine->view.block);
+    return FALSE;
+  }
+  // Window was moved by ACK of the same block already: do not resend
+  // (Sorcerer's Apprentice Syndrome). Lost first block of the window is
+  // sent again on timeout.
+  if (acked == 0 && machine->win_count > 0) {
+    DBG("Duplicate ACK block# %05d. Ignore.", machine->view.block);
+    return FALSE;
   }
-  DBG("Recved packet len: %lu", len);
-  machine.pack = tftp_packet_read(machine.buf, len, machine.mp);
-  LOG("<-- %-5s block# %05d", opcode_str[machine.pack->opcode], machine.block);
-  if (data.length < DATA_SIZE) {
-    DBG("Last packet detected.");
-    return machine.state = END;
+  if (acked < machine->win_count) {
+    DBG("Window lost after block# %05d. Rewind.",
+        tftp_block_wire (machine->win_first + acked - 1, machine->rollover));
   }
-  machine.event = machine.pack->opcode;
-  machine.state = RECV;
+  tftp_rtt_recv (&machine->rtt);
+  machine->win_first += acked;
+  machine->win_head = (machine->win_head + acked) % machine->windowsize;
+  machine->win_count -= acked;
+  machine->win_sent = 0;
 
-  DBG("Event: %s, State: %s", opcode_str[machine.event], state_str[machine.state]);
-  return machine.state;
+  return TRUE;
 }
 
-state tftp_proto_ack (void)
+state tftp_proto_send_data (struct tftp_machine *machine)
 {
   apr_size_t len;
   apr_status_t rv;
-  len = tftp_create_ack (machine.buf, machine.block);
-  LOG("--> %-5s block# %05d", opcode_str[E_ACK], machine.block, len);
-  rv = apr_socket_sendto (machine.sock, machine.sockaddr, 0, machine.buf, &len);
-  if (rv != APR_SUCCESS) {
-    ERR("Failed to send ACK.");
-    return END;
+  char *packet;
+  unsigned int slot;
+
+  if (machine->event != E_DATA) {
+    if (!tftp_proto_mcast_seek (machine) && !tftp_proto_win_ack (machine)) {
+      return tftp_proto_expect (machine);
+    }
+    if (machine->eof && machine->win_count == 0) {
+      // multicast transfer goes on until every client has the file
+      if (machine->mcast && tftp_proto_mcast_handover (machine)) {
+        return tftp_proto_expect (machine);
+      }
+      DBG("Last packet acknowledged.");
+      machine->status = APR_SUCCESS;
+      return machine->state = END;
+    }
   }
-  DBG("Sent to server %lu bytes.", len);
 
-  len = BUF_SIZE;
-  rv = apr_socket_recvfrom (machine.sockaddr, machine.sock, 0, machine.buf, &len);
+  slot = (machine->win_head + machine->win_sent) % machine->windowsize;
+  // window slot holds packet of negotiated block size or its header
+  packet = machine->win + slot * (machine->blksize + 4);
+  machine->seq = machine->win_first + machine->win_sent;
+  machine->block = tftp_block_wire (machine->seq, machine->rollover);
+
+  if (machine->win_sent == machine->win_count) {
+    const char *prebuilt = machine->cached ? tftp_cache_packet (machine->cached, machine->seq) : NULL;
+    machine->win_body[slot] = NULL;
+    if (prebuilt) {
+      // prebuilt packet is sent right from cache, retransmissions too
+      apr_off_t left = machine->cached->size - machine->file_off;
+      len = left < machine->blksize ? left : machine->blksize;
+    } else if (machine->map) {
+      // block is sent right from the file map, retransmissions too
+      apr_off_t left = machine->map->size - machine->file_off;
+      len = left < machine->blksize ? left : machine->blksize;
+      machine->win_body[slot] = (const char *)machine->map->mm + machine->file_off;
+      tftp_proto_readahead (machine);
+    } else if (machine->mode == E_ASCII) {
+      rv = tftp_proto_read_ascii (machine, packet + 4, &len);
+      if (rv != APR_SUCCESS) {
+        ERR("Failed to read file.");
+        machine->status = rv;
+        return machine->state = END;
+      }
+    } else {
+      if (machine->cached) {
+        // blocks before this one may have been sent from cache
+        apr_off_t off = machine->file_off;
+        rv = apr_file_seek (machine->local_file, APR_SET, &off);
+        if (rv != APR_SUCCESS) {
+          ERR("Failed to seek file.");
+          machine->status = rv;
+          return machine->state = END;
+        }
+      }
+      // read next block from file right after packet header
+      len = machine->blksize;
+      rv = apr_file_read (machine->local_file, packet + 4, &len);
+      if (rv != APR_SUCCESS && rv != APR_EOF) {
+        char error[1024];
+        apr_strerror(rv, error, 1024);
+        ERR("[%d] %s", rv, error);
+        machine->status = rv;
+        return machine->state = END;
+      }
+      if (rv == APR_EOF) {
+        len = 0;
+      }
+      DBG("Read data from file.");
+    }
+    machine->file_off += len;
+    machine->eof = len < machine->blksize;
+    if (prebuilt) {
+      machine->win_len[slot] = 4 + len;
+    } else {
+      machine->win_len[slot] = tftp_create_data_header (packet, machine->block) + len;
+      if (machine->cached) {
+        // the first transfer sending the block builds its cached packet
+        tftp_cache_fill (machine->cached, machine->seq,
+                         machine->win_body[slot] ? machine->win_body[slot] : packet + 4);
+      }
+    }
+    machine->win_count++;
+  }
+  machine->win_sent++;
+
+  len = machine->win_len[slot];
+  LOG("--> %-5s block# %05d [%" APR_SIZE_T_FMT " bytes]", opcode_str[E_DATA], machine->block, len);
+  if (machine->cached && tftp_cache_packet (machine->cached, machine->seq)) {
+    rv = tftp_proto_send (machine, tftp_cache_packet (machine->cached, machine->seq), len);
+  } else if (machine->win_body[slot]) {
+    rv = tftp_proto_sendv (machine, packet, 4, machine->win_body[slot], len - 4);
+  } else {
+    rv = tftp_proto_send (machine, packet, len);
+  }
   if (rv != APR_SUCCESS) {
-    ERR("Failed to receive packet after ACK.");
-    return machine.state = END;
+    ERR("Failed to send DATA block #%d.", machine->block);
+    machine->status = rv;
+    return machine->state = END;
   }
-  DBG("Recv packet len: %lu", len);
 
-  machine.pack = tftp_packet_read(machine.buf, len, machine.mp);
-  machine.event = machine.pack->opcode;
-  machine.state = RECV;
+  // keep filling window until it is full or last block is sent
+  if (machine->win_sent < machine->win_count ||
+      (machine->win_count < machine->windowsize && !machine->eof)) {
+    machine->event = E_DATA;
+    machine->state = FILL;
+    DBG("Event: %s, State: %s", opcode_str[machine->event], state_str[machine->state]);
+    return machine->state;
+  }
 
-  DBG("Event: %s, State: %s", opcode_str[machine.event], state_str[machine.state]);
-  return machine.state;
+  return tftp_proto_expect (machine);
 }
 
+state tftp_proto_ack (struct tftp_machine *machine)
+{
+  apr_size_t len;
+  apr_status_t rv;
+  len = tftp_create_ack (machine->buf, machine->block);
+  LOG("--> %-5s block# %05d", opcode_str[E_ACK], machine->block);
+  rv = tftp_proto_send (machine, machine->buf, len);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to send ACK.");
+    machine->status = rv;
+    return machine->state = END;
+  }
+  DBG("Sent to server %lu bytes.", len);
+  machine->win_recv = 0;
+
+  return tftp_proto_expect (machine);
+}
@@ -32,8 +32,14 @@
 #include <apr_general.h>
 #include <apr_network_io.h>
 #include <apr_file_io.h>
+#include <apr_mmap.h>
 
 #include "tftp_msg.h"
+#include "tftp_rtt.h"
+#include "tftp_io.h"
+#include "tftp_sink.h"
+#include "tftp_cache.h"
+#include "tftp_mcast.h"
 
 /*! Default TFTP port */
 #define TFTP_PORT 69
@@ -41,8 +47,14 @@
 /*! Boolean type. */
 typedef unsigned char bool;
 
-/*! @enum e_state TFTP machine states. */
-enum e_state { END, INIT, RECV, SEND };
+/*! @enum e_state TFTP machine states.
+ * WAIT and FILL are used by windowed transfers (RFC7440): receiver
+ * waits for next DATA of the window without ACK and sender fills the
+ * window with DATA packets without waiting for ACK.
+ * MASTER and PASSIVE replace RECV of multicast client (RFC2090): master
+ * client acknowledges blocks and passive client only collects them.
+ */
+enum e_state { END, INIT, RECV, SEND, WAIT, FILL, MASTER, PASSIVE };
 
 /*! Machine state type. */
 typedef enum e_state state;
@@ -50,7 +62,7 @@ typedef enum e_state state;
 /*!
  * State strings representation.
  */
-static char *state_str[] = { "END", "INIT", "RECV", "SEND" };
+static char *state_str[] = { "END", "INIT", "RECV", "SEND", "WAIT", "FILL", "MASTER", "PASSIVE" };
 
 /*! @enum file_action Action GET or PUT */
 enum file_action {GET, PUT};
@@ -60,18 +72,62 @@ enum file_action {GET, PUT};
  */
 struct tftp_machine {
   unsigned int      tid;          /*!< Transaction id, port of response. */
+  bool              peer_known;   /*!< Peer address and port are known from request (server). */
   const char        *remote_file; /*!< Remote file name. */
   apr_file_t        *local_file;  /*!< Local file descriptor. */
   apr_socket_t      *sock;        /*!< Socket structure. */
   apr_sockaddr_t    *sockaddr;    /*!< Socket address structure. */
+  apr_sockaddr_t    *from;        /*!< Source address of received packet. */
+  struct tftp_io    io;           /*!< Datagram I/O of socket (see tftp_io.h) */
+  struct tftp_sink  *sink;        /*!< Write-behind sink of local file for GET (see tftp_sink.h) */
   uint16_t          block;        /*!< Packet block number. */
+  apr_uint64_t      seq;          /*!< Logical number of the packet block. Never wraps. */
+  unsigned int      rollover;     /*!< Block number after 65535: 0 or 1. */
   enum file_action  action;       /*!< File action GET or PUT. */
   state             state;        /*!< Machine state. */
+  state             role;         /*!< State of waiting for packet: RECV, or MASTER or PASSIVE of multicast client. */
   enum opcodes      event;        /*!< Machine event. */
   apr_pool_t        *mp;          /*!< APR memory pool. */
   char              *buf;         /*!< Packet exchange buffer. */
   enum mode         mode;         /*!< Transaction mode: ascii or octet. */
-  tftp_pack         *pack;        /*!< TFTP packet structure (see tftp_msg.h) */
+  struct tftp_netascii netascii;  /*!< Netascii converter of ascii mode (see tftp_netascii.h) */
+  char              *ascii_buf;   /*!< Local file data of ascii mode PUT before conversion. */
+  apr_size_t        ascii_len;    /*!< Length of data in ascii_buf. */
+  apr_size_t        ascii_pos;    /*!< Converted data in ascii_buf. */
+  bool              ascii_eof;    /*!< Local file of ascii mode PUT is read to the end. */
+  struct tftp_packet_view view;   /*!< Received packet view into exchange buffer (see tftp_msg.h) */
+  apr_size_t        buf_size;     /*!< Packet exchange buffer size. */
+  apr_size_t        buf_len;      /*!< Length of the last request in exchange buffer. */
+  unsigned int      blksize;      /*!< Negotiated block size. */
+  unsigned int      windowsize;   /*!< Negotiated window size. */
+  struct tftp_opts  opts;         /*!< Options requested from server. */
+  bool              oacked;       /*!< Server acknowledged options. OACK again is a duplicate. */
+  unsigned int      win_recv;     /*!< Received DATA packets since last ACK. */
+  bool              win_gap;      /*!< Receiver acknowledged a lost packet in window. */
+  unsigned int      win_dup;      /*!< Already received DATA packets since last block in order. */
+  char              *win;         /*!< Sender window buffer of windowsize packets. */
+  apr_size_t        *win_len;     /*!< Sender window packets length. */
+  const char        **win_body;   /*!< Sender window blocks in file map. */
+  apr_mmap_t        *map;         /*!< Memory map of local file for PUT or NULL. */
+  struct tftp_cache_entry *cached; /*!< Cached DATA packets of local file for PUT or NULL (see tftp_cache.h) */
+  struct tftp_mcast *mcast;       /*!< Multicast transfer state or NULL (see tftp_mcast.h) */
+  apr_off_t         map_ahead;    /*!< End of file map requested to read ahead. */
+  apr_off_t         file_off;     /*!< Local file offset of the next block. */
+  unsigned int      win_head;     /*!< Window slot of the first not acknowledged block. */
+  unsigned int      win_count;    /*!< Number of packets in sender window. */
+  unsigned int      win_sent;     /*!< Number of packets sent from sender window. */
+  apr_uint64_t      win_first;    /*!< Logical block number of the first packet in window. */
+  bool              eof;          /*!< Last block is read from local file. */
+  apr_off_t         tsize;        /*!< Transfer size (RFC2349) or zero if unknown. */
+  apr_off_t         recv_bytes;   /*!< Bytes received and written to local file. */
+  apr_time_t        start;        /*!< Time when request was sent. */
+  struct tftp_rtt   rtt;          /*!< Round trip time estimator. */
+  unsigned int      retries;      /*!< Maximal retransmissions of the same packet. */
+  bool              wait;         /*!< Machine waits for packet or retransmission timer. */
+  apr_status_t      status;       /*!< Transfer result. APR_EINCOMPLETE until transfer is over. */
+  const char        *errmsg;      /*!< Error message received from server or NULL. */
+  char              *xferid;      /*!< ERROR packet of unknown transfer ID or NULL until one is sent. */
+  apr_size_t        xferid_len;   /*!< ERROR packet of unknown transfer ID length. */
 };
 
 /**
@@ -85,6 +141,21 @@ struct tftp_params {
   bool verbose;             /*!< Verbosity enable. */
   enum file_action action;  /*!< File action PUT or GET. */
   enum mode mode;           /*!< Transfer mode. */
+  unsigned int blksize;     /*!< Requested block size. */
+  unsigned int windowsize;  /*!< Requested window size. */
+  unsigned int timeout;     /*!< Initial retransmission timeout in seconds, sent as option (RFC2349). 0: default, not sent. */
+  unsigned int retries;     /*!< Maximal retransmissions of the same packet. */
+  const char *manifest;     /*!< Batch manifest file or "-" for stdin. */
+  unsigned int jobs;        /*!< Maximal concurrent transfers in batch mode. */
+  unsigned int threads;     /*!< Worker threads in batch mode. */
+  enum io_mode io_mode;     /*!< Datagram I/O mode. */
+  bool direct;              /*!< Write local file with direct I/O. */
+  bool tsize;               /*!< Send tsize option (RFC2349) even if request has no other option. */
+  unsigned int rollover;    /*!< Block number after 65535: 0 or 1. */
+  apr_size_t cache_size;    /*!< Memory limit of server cache of DATA packets. Zero disables cache. */
+  struct tftp_cache *cache; /*!< Cache of DATA packets of served files or NULL. */
+  bool multicast;           /*!< Request multicast transfer of GET (RFC2090). */
+  const char *mc_group;     /*!< Server multicast group "addr:port" (RFC2090) or NULL. */
 };
 
 /*!
@@ -93,51 +164,170 @@ struct tftp_params {
 struct trans_table {
   state   current_state;    /*!< State */
   enum    opcodes event;    /*!< Event */
-  state   (*action)(void);  /*!< Pointer to func to execute. */
+  state   (*action)(struct tftp_machine *machine);  /*!< Pointer to func to execute. */
 };
 
 /**
- * Inititate TFTP protocol machine.
+ * Create TFTP protocol machine for one transfer.
+ * Machine is allocated from its own sub-pool of the given pool,
+ * so any number of transfers can run in one process.
+ * @param machine Created machine.
  * @param mp      APR memory pool.
  * @param params  Command paramters
  * @return APR status
  */
-apr_status_t tftp_proto_init (apr_pool_t *mp, struct tftp_params *params);
+apr_status_t tftp_proto_create (struct tftp_machine **machine, apr_pool_t *mp, struct tftp_params *params);
+
+/**
+ * Create TFTP protocol machine for request received by server.
+ * RRQ is served as PUT and WRQ as GET of the local file. Machine
+ * answers from its own socket (transaction id) with OACK of accepted
+ * options, ACK 0 or first DATA when it is run. Octet mode file of
+ * RRQ is sent from cache of parameters if it is not NULL.
+ * @param machine Created machine.
+ * @param mp      APR memory pool.
+ * @param params  Transfer parameters: client host and port, file, action,
+ *                mode, maximal block and window size, default timeout.
+ * @param req     Options requested by client.
+ * @return APR status. APR_ENOSPC if file of requested tsize does not fit.
+ */
+apr_status_t tftp_proto_accept (struct tftp_machine **machine, apr_pool_t *mp,
+                                struct tftp_params *params, struct tftp_opts *req);
+
+/**
+ * Turn accepted RRQ into multicast transfer (RFC2090). Blocks are sent
+ * to group and requesting client becomes master client.
+ * @param machine TFTP machine created by tftp_proto_accept
+ * @param group   Group address and port
+ * @param iface   Address of interface to send from or NULL for default
+ * @return APR status
+ */
+apr_status_t tftp_proto_mcast_serve (struct tftp_machine *machine, apr_sockaddr_t *group,
+                                     apr_sockaddr_t *iface);
+
+/**
+ * Add client requesting the same file to multicast transfer. Client
+ * is answered with OACK of the group and collects blocks passively
+ * until server makes it master client.
+ * @param machine TFTP machine of multicast transfer
+ * @param host    Client IP address
+ * @param port    Client port
+ * @param req     Options requested by client
+ * @return APR status. APR_EINVAL if client can not take block size of the group.
+ */
+apr_status_t tftp_proto_mcast_join (struct tftp_machine *machine, const char *host, apr_port_t port,
+                                    struct tftp_opts *req);
 
 /**
- * Run TFTP Finit State Machine.
+ * Destroy TFTP protocol machine. Closes socket and local file.
+ * @param machine TFTP machine
+ */
+void tftp_proto_destroy (struct tftp_machine *machine);
+
+/**
+ * Run one step of TFTP Finit State Machine.
+ * When machine waits for response, blocks until packet is received
+ * or retransmission timeout expires.
+ * @param machine TFTP machine
+ * @return Current State.
+ */
+state tftp_proto_fsm (struct tftp_machine *machine);
+
+/**
+ * Run TFTP Finit State Machine until it waits for response or ends.
+ * Never blocks. Used by event loop (see tftp_loop.h).
+ * @param machine TFTP machine
+ * @return Current State.
+ */
+state tftp_proto_run (struct tftp_machine *machine);
+
+/**
+ * Receive and parse next packet from server.
+ * Packet opcode becomes machine event. If socket has no packet,
+ * machine keeps waiting. Client of multicast transfer receives
+ * blocks of the group socket too.
+ * @param machine TFTP machine
  * @return Current State.
  */
-state tftp_proto_fsm ();
+state tftp_proto_recv (struct tftp_machine *machine);
+
+/**
+ * Retransmission timer expired while machine waits for response.
+ * Machine event becomes E_TIMEOUT.
+ * @param machine TFTP machine
+ * @return Current State.
+ */
+state tftp_proto_timer (struct tftp_machine *machine);
 
 /**
  * Create and send WRQ or RRQ packet.
+ * @param machine TFTP machine
+ * @return Current State.
+ */
+state tftp_proto_rq (struct tftp_machine *machine);
+
+/**
+ * Send server reply to request: OACK or ACK 0.
+ * @param machine TFTP machine
+ * @return Current State.
+ */
+state tftp_proto_reply (struct tftp_machine *machine);
+
+/**
+ * Process OACK packet and apply negotiated options.
+ * @param machine TFTP machine
  * @return Current State.
  */
-state tftp_proto_rq (void);
+state tftp_proto_oack (struct tftp_machine *machine);
 
 /**
  * Process ERROR packet.
+ * @param machine TFTP machine
  * @return Current State.
  */
-state tftp_proto_error (void);
+state tftp_proto_error (struct tftp_machine *machine);
 
 /**
  * Create and send DATA packet.
+ * @param machine TFTP machine
  * @return Current State.
  */
-state tftp_proto_send_data (void);
+state tftp_proto_send_data (struct tftp_machine *machine);
 
 /**
  * Receive DATA packet.
+ * @param machine TFTP machine
+ * @return Current State.
+ */
+state tftp_proto_recv_data (struct tftp_machine *machine);
+
+/**
+ * Send ACK packet.
+ * @param machine TFTP machine
+ * @return Current State.
+ */
+state tftp_proto_ack (struct tftp_machine *machine);
+
+/**
+ * Retransmission timer expired. Resend last packet or window.
+ * @param machine TFTP machine
+ * @return Current State.
+ */
+state tftp_proto_timeout (struct tftp_machine *machine);
+
+/**
+ * Receive DATA packet of multicast transfer in any order.
+ * Master client acknowledges block before its first missing one.
+ * @param machine TFTP machine
  * @return Current State.
  */
-state tftp_proto_recv_data (void);
+state tftp_proto_mcast_data (struct tftp_machine *machine);
 
 /**
- * Process ACK packet.
+ * Wait for next DATA packet of the window without ACK.
+ * @param machine TFTP machine
  * @return Current State.
  */
-state tftp_proto_ack (void);
+state tftp_proto_wait (struct tftp_machine *machine);
 
 #endif
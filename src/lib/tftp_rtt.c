@@ -0,0 +1,112 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_rtt.c
+ * @brief TFTP protocol library.
+ * Round trip time estimation and retransmission timer.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#include "tftp_rtt.h"
+
+/**
+ * Clamp retransmission timeout to bounds.
+ */
+static apr_interval_time_t rto_bound (apr_interval_time_t rto)
+{
+  if (rto < RTO_MIN) return RTO_MIN;
+  if (rto > RTO_MAX) return RTO_MAX;
+  return rto;
+}
+
+void tftp_rtt_init (struct tftp_rtt *rtt, apr_interval_time_t timeout)
+{
+  rtt->srtt = 0;
+  rtt->rttvar = 0;
+  rtt->rto = rto_bound (timeout);
+  rtt->timing = 0;
+  rtt->karn = 0;
+  rtt->fixed = 0;
+  rtt->retries = 0;
+  rtt->sent = apr_time_now();
+}
+
+void tftp_rtt_fix (struct tftp_rtt *rtt, apr_interval_time_t timeout)
+{
+  rtt->rto = timeout;
+  rtt->fixed = 1;
+}
+
+void tftp_rtt_sent (struct tftp_rtt *rtt)
+{
+  rtt->sent = apr_time_now();
+  if (rtt->timing) return;
+  rtt->start = rtt->sent;
+  rtt->timing = 1;
+  rtt->karn = 0;
+}
+
+apr_time_t tftp_rtt_deadline (struct tftp_rtt *rtt)
+{
+  return rtt->sent + rtt->rto;
+}
+
+void tftp_rtt_recv (struct tftp_rtt *rtt)
+{
+  apr_interval_time_t r, delta;
+
+  rtt->retries = 0;
+  if (!rtt->timing || rtt->fixed) return;
+  rtt->timing = 0;
+  // Karn's rule: ambiguous sample of retransmitted packet is not taken
+  // and backed off timeout is kept until next valid sample.
+  if (rtt->karn) return;
+
+  r = apr_time_now() - rtt->start;
+  if (rtt->srtt == 0) {
+    rtt->srtt = r;
+    rtt->rttvar = r / 2;
+  } else {
+    delta = rtt->srtt > r ? rtt->srtt - r : r - rtt->srtt;
+    rtt->rttvar = (3 * rtt->rttvar + delta) / 4;  // beta = 1/4
+    rtt->srtt = (7 * rtt->srtt + r) / 8;          // alpha = 1/8
+  }
+  rtt->rto = rto_bound (rtt->srtt + 4 * rtt->rttvar);
+}
+
+unsigned int tftp_rtt_backoff (struct tftp_rtt *rtt)
+{
+  if (!rtt->fixed) {
+    rtt->rto = rto_bound (rtt->rto * 2);
+  }
+  rtt->karn = 1;
+  rtt->sent = apr_time_now();
+  return ++rtt->retries;
+}
+
+unsigned int tftp_rtt_timeout_sec (struct tftp_rtt *rtt)
+{
+  apr_interval_time_t sec = (rtt->rto + APR_USEC_PER_SEC - 1) / APR_USEC_PER_SEC;
+  if (sec < 1)   return 1;
+  if (sec > 255) return 255;
+  return sec;
+}
@@ -0,0 +1,114 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_rtt.h
+ * @brief TFTP protocol library.
+ * Round trip time estimation and retransmission timer.
+ * See RFC6298 for algorithm details.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_RTT_H
+#define __TFTP_RTT_H
+
+#include <apr_time.h>
+
+/*! Initial retransmission timeout in seconds */
+#define TFTP_TIMEOUT  1
+
+/*! Maximal retransmission count of the same packet. */
+#define TFTP_RETRIES  5
+
+/*! Lower bound of retransmission timeout. */
+#define RTO_MIN apr_time_from_msec(10)
+
+/*! Upper bound of retransmission timeout. */
+#define RTO_MAX apr_time_from_sec(60)
+
+/**
+ * Round trip time estimator.
+ */
+struct tftp_rtt {
+  apr_interval_time_t srtt;     /*!< Smoothed round trip time. Zero until first sample. */
+  apr_interval_time_t rttvar;   /*!< Round trip time variation. */
+  apr_interval_time_t rto;      /*!< Retransmission timeout. */
+  apr_time_t          start;    /*!< Time when measured packet was sent. */
+  apr_time_t          sent;     /*!< Time when last packet was sent or timer expired. */
+  unsigned char       timing;   /*!< Round trip time is measured. */
+  unsigned char       karn;     /*!< Measured packet was retransmitted (Karn's rule). */
+  unsigned char       fixed;    /*!< Timeout is negotiated (RFC2349), it is not estimated. */
+  unsigned int        retries;  /*!< Timeouts since last response. */
+};
+
+/**
+ * Init estimator.
+ * @param rtt     Estimator structure
+ * @param timeout Initial retransmission timeout
+ */
+void tftp_rtt_init (struct tftp_rtt *rtt, apr_interval_time_t timeout);
+
+/**
+ * Use timeout negotiated with timeout option (RFC2349). It is neither
+ * estimated from round trip time nor backed off.
+ * @param rtt     Estimator structure
+ * @param timeout Negotiated timeout
+ */
+void tftp_rtt_fix (struct tftp_rtt *rtt, apr_interval_time_t timeout);
+
+/**
+ * Packet is sent and response is expected.
+ * Starts measurement unless it is already running.
+ * @param rtt     Estimator structure
+ */
+void tftp_rtt_sent (struct tftp_rtt *rtt);
+
+/**
+ * Time when retransmission timer expires. Timer runs from the last
+ * sent packet, so ignored packets do not postpone it.
+ * @param rtt     Estimator structure
+ * @return Expiration time.
+ */
+apr_time_t tftp_rtt_deadline (struct tftp_rtt *rtt);
+
+/**
+ * Response advancing transfer is received. Takes round trip time sample unless
+ * measured packet was retransmitted and updates retransmission timeout.
+ * @param rtt     Estimator structure
+ */
+void tftp_rtt_recv (struct tftp_rtt *rtt);
+
+/**
+ * Retransmission timer expired. Doubles retransmission timeout,
+ * restarts timer and invalidates current measurement.
+ * @param rtt     Estimator structure
+ * @return Number of timeouts since last response.
+ */
+unsigned int tftp_rtt_backoff (struct tftp_rtt *rtt);
+
+/**
+ * Retransmission timeout in seconds for RFC2349 timeout option.
+ * @param rtt     Estimator structure
+ * @return Timeout rounded up to seconds in range 1-255.
+ */
+unsigned int tftp_rtt_timeout_sec (struct tftp_rtt *rtt);
+
+#endif
@@ -0,0 +1,347 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_sched.c
+ * @brief TFTP protocol library.
+ * Multi-threaded transfers scheduler.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#include "tftp_sched.h"
+#include "util.h"
+
+/*! Thief value of exited worker, it can not be asked for session. */
+#define SCHED_EXITED 0xffffffff
+
+/*! Read index written by other thread. Atomic add is a full barrier. */
+#define spsc_load(idx) apr_atomic_add32(&(idx), 0)
+
+/**
+ * Transfer passed to worker.
+ */
+struct sched_job {
+  struct tftp_machine *machine; /*!< TFTP machine. */
+  struct tftp_worker  *worker;  /*!< Worker running transfer. */
+  tftp_loop_done_cb   done;     /*!< Completion callback. */
+  void                *baton;   /*!< Completion callback argument. */
+};
+
+void tftp_spsc_init (struct tftp_spsc *queue, apr_pool_t *mp, apr_uint32_t size)
+{
+  apr_uint32_t capacity = 1;
+
+  while (capacity < size) {
+    capacity <<= 1;
+  }
+  queue->head = 0;
+  queue->tail = 0;
+  queue->mask = capacity - 1;
+  queue->items = apr_pcalloc(mp, capacity * sizeof(void *));
+}
+
+bool tftp_spsc_push (struct tftp_spsc *queue, void *item)
+{
+  apr_uint32_t tail = queue->tail;
+
+  if (tail - spsc_load(queue->head) > queue->mask) {
+    return FALSE;
+  }
+  queue->items[tail & queue->mask] = item;
+  // publish item before index
+  apr_atomic_xchg32 (&queue->tail, tail + 1);
+
+  return TRUE;
+}
+
+void *tftp_spsc_pop (struct tftp_spsc *queue)
+{
+  apr_uint32_t head = queue->head;
+  void *item;
+
+  if (head == spsc_load(queue->tail)) {
+    return NULL;
+  }
+  item = queue->items[head & queue->mask];
+  // slot can be reused by producer after index is updated
+  apr_atomic_xchg32 (&queue->head, head + 1);
+
+  return item;
+}
+
+/**
+ * Transfer is over. Release worker capacity.
+ */
+static void sched_done (struct tftp_machine *machine, void *baton)
+{
+  struct sched_job *job = baton;
+  struct tftp_worker *worker = job->worker;
+  struct tftp_sched *sched = worker->sched;
+
+  if (job->done) {
+    job->done (machine, job->baton);
+  }
+  apr_atomic_dec32 (&worker->load);
+
+  // wake up thread waiting in tftp_sched_add
+  apr_thread_mutex_lock (sched->lock);
+  apr_thread_cond_signal (sched->cond);
+  apr_thread_mutex_unlock (sched->lock);
+}
+
+/**
+ * Transfer can not be added to worker loop.
+ */
+static void sched_failed (struct sched_job *job, apr_status_t rv)
+{
+  struct tftp_machine *machine = job->machine;
+
+  machine->status = rv;
+  sched_done (machine, job);
+  tftp_proto_destroy (machine);
+}
+
+/**
+ * Pass one session to worker asking for it. Victim keeps at least
+ * one transfer, otherwise request is declined. Session is kept by
+ * victim when thief has not taken the previous one yet.
+ */
+static void sched_give (struct tftp_worker *worker)
+{
+  apr_uint32_t id = spsc_load(worker->thief);
+  struct tftp_worker *thief;
+  struct tftp_session *session;
+  apr_status_t rv;
+
+  if (id == 0 || id == SCHED_EXITED) return;
+  thief = &worker->sched->workers[id - 1];
+
+  if (worker->loop->sessions > 1 && (session = tftp_loop_detach (worker->loop))) {
+    apr_atomic_inc32 (&thief->load);
+    if (tftp_spsc_push (&thief->stolen, session)) {
+      apr_atomic_dec32 (&worker->load);
+      DBG("Worker #%u passed transfer to worker #%u.", worker->id, thief->id);
+    } else {
+      apr_atomic_dec32 (&thief->load);
+      rv = tftp_loop_attach (worker->loop, session);
+      if (rv != APR_SUCCESS) {
+        sched_failed (tftp_loop_session_baton (session), rv);
+      }
+    }
+  }
+  // thief sees session in its queue once request is cleared
+  apr_atomic_xchg32 (&worker->thief, 0);
+  tftp_loop_wakeup (thief->loop);
+}
+
+/**
+ * Ask the busiest worker for session. Only one request at a time,
+ * and not before session passed by previous one is taken from queue.
+ */
+static void sched_steal (struct tftp_worker *worker)
+{
+  struct tftp_sched *sched = worker->sched;
+  struct tftp_worker *victim = NULL;
+  apr_uint32_t load, max = 1;
+  unsigned int i;
+
+  if (spsc_load(worker->stolen.tail) != worker->stolen.head) {
+    return;
+  }
+  if (worker->victim) {
+    if (spsc_load(worker->victim->thief) == worker->id + 1) {
+      return;   // request is not served yet
+    }
+    worker->victim = NULL;
+  }
+
+  for (i = 0; i < sched->threads; i++) {
+    load = spsc_load(sched->workers[i].load);
+    if (&sched->workers[i] != worker && load > max) {
+      victim = &sched->workers[i];
+      max = load;
+    }
+  }
+  if (victim && apr_atomic_cas32 (&victim->thief, worker->id + 1, 0) == 0) {
+    worker->victim = victim;
+    tftp_loop_wakeup (victim->loop);
+  }
+}
+
+/**
+ * Worker thread. Runs event loop until scheduler is stopped
+ * and all transfers of the worker are over.
+ */
+static void * APR_THREAD_FUNC sched_worker (apr_thread_t *thread, void *data)
+{
+  struct tftp_worker *worker = data;
+  struct tftp_sched *sched = worker->sched;
+  struct tftp_loop *loop = worker->loop;
+  struct tftp_session *session;
+  struct sched_job *job;
+  apr_status_t rv;
+
+  DBG("Worker #%u started.", worker->id);
+  for (;;) {
+    while ((job = tftp_spsc_pop (&worker->inbox)) != NULL) {
+      rv = tftp_loop_add (loop, job->machine, sched_done, job);
+      if (rv != APR_SUCCESS) {
+        sched_failed (job, rv);
+      }
+    }
+    while ((session = tftp_spsc_pop (&worker->stolen)) != NULL) {
+      job = tftp_loop_session_baton (session);
+      job->worker = worker;
+      rv = tftp_loop_attach (loop, session);
+      if (rv != APR_SUCCESS) {
+        sched_failed (job, rv);
+      }
+    }
+    sched_give (worker);
+
+    if (loop->sessions == 0) {
+      sched_steal (worker);
+      if (worker->victim == NULL && spsc_load(sched->stop) && spsc_load(worker->load) == 0 &&
+          apr_atomic_cas32 (&worker->thief, SCHED_EXITED, 0) == 0) {
+        break;
+      }
+    }
+    tftp_loop_poll (loop, loop->sessions ? -1 : SCHED_STEAL_INTERVAL);
+  }
+  DBG("Worker #%u stopped.", worker->id);
+
+  apr_thread_exit (thread, APR_SUCCESS);
+  return NULL;
+}
+
+apr_status_t tftp_sched_create (struct tftp_sched **new, apr_pool_t *mp,
+                                unsigned int threads, unsigned int jobs)
+{
+  apr_status_t rv;
+  unsigned int i;
+  struct tftp_worker *worker;
+  struct tftp_sched *sched = apr_pcalloc(mp, sizeof(struct tftp_sched));
+
+  sched->mp = mp;
+  sched->threads = threads;
+  sched->capacity = (jobs + threads - 1) / threads;
+  sched->workers = apr_pcalloc(mp, threads * sizeof(struct tftp_worker));
+
+  rv = apr_thread_mutex_create (&sched->lock, APR_THREAD_MUTEX_DEFAULT, mp);
+  if (rv != APR_SUCCESS) return rv;
+  rv = apr_thread_cond_create (&sched->cond, mp);
+  if (rv != APR_SUCCESS) return rv;
+
+  for (i = 0; i < threads; i++) {
+    worker = &sched->workers[i];
+    worker->sched = sched;
+    worker->id = i;
+    rv = apr_pool_create (&worker->mp, mp);
+    if (rv != APR_SUCCESS) return rv;
+    rv = tftp_loop_create (&worker->loop, worker->mp, sched->capacity);
+    if (rv != APR_SUCCESS) return rv;
+    tftp_spsc_init (&worker->inbox, worker->mp, sched->capacity);
+    // one steal request at a time
+    tftp_spsc_init (&worker->stolen, worker->mp, 1);
+  }
+
+  for (i = 0; i < threads; i++) {
+    worker = &sched->workers[i];
+    rv = apr_thread_create (&worker->thread, NULL, sched_worker, worker, worker->mp);
+    if (rv != APR_SUCCESS) {
+      ERR("Failed to start worker thread #%u.", i);
+      sched->threads = i;
+      tftp_sched_wait (sched);
+      return rv;
+    }
+  }
+  LOG("Started %u workers, up to %u transfers each.", threads, sched->capacity);
+  *new = sched;
+
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_sched_add (struct tftp_sched *sched, struct tftp_machine *machine,
+                             tftp_loop_done_cb done, void *baton)
+{
+  struct sched_job *job = apr_pcalloc(machine->mp, sizeof(struct sched_job));
+  struct tftp_worker *worker = NULL;
+  apr_uint32_t load, min;
+  unsigned int i, idx;
+
+  job->machine = machine;
+  job->done = done;
+  job->baton = baton;
+
+  apr_thread_mutex_lock (sched->lock);
+  for (;;) {
+    // least loaded worker, round robin on equal load
+    min = sched->capacity;
+    for (i = 0; i < sched->threads; i++) {
+      idx = (sched->next + i) % sched->threads;
+      load = spsc_load(sched->workers[idx].load);
+      if (load < min) {
+        worker = &sched->workers[idx];
+        min = load;
+      }
+    }
+    if (worker) break;
+    apr_thread_cond_wait (sched->cond, sched->lock);
+  }
+  apr_thread_mutex_unlock (sched->lock);
+  sched->next = (worker->id + 1) % sched->threads;
+
+  // inbox of chosen worker may be full, try the others with free capacity
+  for (i = 0; i < sched->threads; i++) {
+    job->worker = &sched->workers[(worker->id + i) % sched->threads];
+    if (i > 0 && spsc_load(job->worker->load) >= sched->capacity) {
+      continue;
+    }
+    apr_atomic_inc32 (&job->worker->load);
+    if (tftp_spsc_push (&job->worker->inbox, job)) {
+      tftp_loop_wakeup (job->worker->loop);
+      return APR_SUCCESS;
+    }
+    apr_atomic_dec32 (&job->worker->load);
+  }
+  ERR("Inboxes of all workers are full.");
+
+  return APR_EAGAIN;
+}
+
+apr_status_t tftp_sched_wait (struct tftp_sched *sched)
+{
+  apr_status_t rv, status = APR_SUCCESS;
+  unsigned int i;
+
+  apr_atomic_xchg32 (&sched->stop, 1);
+  for (i = 0; i < sched->threads; i++) {
+    tftp_loop_wakeup (sched->workers[i].loop);
+  }
+  for (i = 0; i < sched->threads; i++) {
+    apr_thread_join (&rv, sched->workers[i].thread);
+    if (rv != APR_SUCCESS) {
+      status = rv;
+    }
+  }
+
+  return status;
+}
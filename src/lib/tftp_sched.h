@@ -0,0 +1,148 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_sched.h
+ * @brief TFTP protocol library.
+ * Multi-threaded transfers scheduler.
+ *
+ * Every worker thread runs own event loop (see tftp_loop.h). New transfers
+ * are passed to the least loaded worker through lock-free single producer
+ * single consumer queue. Worker without transfers steals running transfer
+ * from the busiest worker: victim detaches one session from its loop and
+ * passes it to thief through thief's queue of stolen sessions.
+ *
+ * Transfers are added from one thread. Completion callbacks are called
+ * from worker threads.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_SCHED_H
+#define __TFTP_SCHED_H
+
+#include <apr_atomic.h>
+#include <apr_thread_proc.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+
+#include "tftp_loop.h"
+
+/*! Poll timeout of idle worker between steal attempts. */
+#define SCHED_STEAL_INTERVAL apr_time_from_msec(10)
+
+/**
+ * Single producer single consumer lock-free queue.
+ */
+struct tftp_spsc {
+  volatile apr_uint32_t head;   /*!< Next item to pop. Written by consumer. */
+  volatile apr_uint32_t tail;   /*!< Next free slot. Written by producer. */
+  apr_uint32_t          mask;   /*!< Capacity - 1. Capacity is power of two. */
+  void                  **items;/*!< Queue slots. */
+};
+
+struct tftp_sched;
+
+/**
+ * Worker thread with own event loop.
+ */
+struct tftp_worker {
+  struct tftp_sched     *sched;   /*!< Scheduler. */
+  unsigned int          id;       /*!< Worker index. */
+  apr_pool_t            *mp;      /*!< APR memory pool of the worker. */
+  apr_thread_t          *thread;  /*!< Worker thread. */
+  struct tftp_loop      *loop;    /*!< Event loop. */
+  struct tftp_spsc      inbox;    /*!< New transfers from scheduler. */
+  struct tftp_spsc      stolen;   /*!< Sessions passed by victim worker. */
+  volatile apr_uint32_t load;     /*!< Queued and running transfers. */
+  volatile apr_uint32_t thief;    /*!< Id + 1 of worker asking for session or 0. */
+  struct tftp_worker    *victim;  /*!< Worker asked for session or NULL. */
+};
+
+/**
+ * Scheduler structure.
+ */
+struct tftp_sched {
+  apr_pool_t            *mp;        /*!< APR memory pool. */
+  struct tftp_worker    *workers;   /*!< Workers. */
+  unsigned int          threads;    /*!< Number of workers. */
+  unsigned int          capacity;   /*!< Maximal transfers per worker. */
+  unsigned int          next;       /*!< First worker to check for free capacity. */
+  volatile apr_uint32_t stop;       /*!< No more transfers will be added. */
+  apr_thread_mutex_t    *lock;      /*!< Guards waiting for free capacity. */
+  apr_thread_cond_t     *cond;      /*!< Signaled when transfer is over. */
+};
+
+/**
+ * Init queue.
+ * @param queue Queue
+ * @param mp    APR memory pool
+ * @param size  Minimal capacity
+ */
+void tftp_spsc_init (struct tftp_spsc *queue, apr_pool_t *mp, apr_uint32_t size);
+
+/**
+ * Push item to queue. Called by producer thread only.
+ * @param queue Queue
+ * @param item  Item
+ * @return FALSE if queue is full.
+ */
+bool tftp_spsc_push (struct tftp_spsc *queue, void *item);
+
+/**
+ * Pop item from queue. Called by consumer thread only.
+ * @param queue Queue
+ * @return Item or NULL if queue is empty.
+ */
+void *tftp_spsc_pop (struct tftp_spsc *queue);
+
+/**
+ * Create scheduler and start worker threads.
+ * @param sched   Created scheduler
+ * @param mp      APR memory pool
+ * @param threads Number of worker threads
+ * @param jobs    Maximal concurrent transfers of all workers
+ * @return APR status
+ */
+apr_status_t tftp_sched_create (struct tftp_sched **sched, apr_pool_t *mp,
+                                unsigned int threads, unsigned int jobs);
+
+/**
+ * Pass transfer to the least loaded worker. Blocks while all workers
+ * run maximal number of transfers. Worker destroys machine when transfer
+ * is over.
+ * @param sched   Scheduler
+ * @param machine TFTP machine created with tftp_proto_create
+ * @param done    Completion callback or NULL. Called from worker thread.
+ * @param baton   Completion callback argument
+ * @return APR status. APR_EAGAIN if inbox of every worker is full,
+ *         machine is not taken then.
+ */
+apr_status_t tftp_sched_add (struct tftp_sched *sched, struct tftp_machine *machine,
+                             tftp_loop_done_cb done, void *baton);
+
+/**
+ * Wait until all transfers are over and stop worker threads.
+ * @param sched   Scheduler
+ * @return APR status
+ */
+apr_status_t tftp_sched_wait (struct tftp_sched *sched);
+
+#endif
@@ -0,0 +1,377 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_server.c
+ * @brief TFTP protocol library.
+ * TFTP server of files in root directory.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#include <apr_strings.h>
+#include <apr_file_info.h>
+
+#include "tftp_server.h"
+#include "util.h"
+
+/**
+ * Send ERROR packet to source of request from listening socket.
+ * @param server  Server
+ * @param ercode  Error code
+ * @param msg     Error message
+ */
+static void server_error (struct tftp_server *server, enum ercode ercode, const char *msg)
+{
+  char buf[BUF_SIZE];
+  struct pack_error error = { .ercode = ercode, .msg = (char *)msg, .msg_len = strlen(msg) };
+  apr_size_t len = tftp_create_error (buf, &error);
+
+  LOG("--> %-5s [%d] %s", opcode_str[E_ERROR], ercode, msg);
+  apr_socket_sendto (server->sock, server->from, 0, buf, &len);
+}
+
+/**
+ * Transfer is over.
+ */
+static void server_done (struct tftp_machine *machine, void *baton)
+{
+  struct tftp_server *server = baton;
+
+  if (machine->mcast && machine->mcast->path) {
+    apr_hash_set (server->mcasts, machine->mcast->path, APR_HASH_KEY_STRING, NULL);
+  }
+  if (machine->status == APR_SUCCESS) {
+    server->served++;
+    LOG("Transfer of %s is completed%s.", machine->remote_file, machine->cached ? " from cache" : "");
+  } else {
+    server->failed++;
+    ERR("Transfer of %s failed.", machine->remote_file);
+  }
+}
+
+/**
+ * Free port of multicast group. Every multicast transfer is a session,
+ * so one of jobs ports is always free.
+ * @param server  Server
+ * @return Port
+ */
+static apr_port_t server_mcast_port (struct tftp_server *server)
+{
+  apr_hash_index_t *hi;
+  struct tftp_machine *machine;
+  apr_port_t port = server->mc_group->port;
+  unsigned int i;
+  void *val;
+
+  for (i = 0; i < server->jobs; i++) {
+    port = server->mc_group->port + server->mc_seq++ % server->jobs;
+    for (hi = apr_hash_first (NULL, server->mcasts); hi; hi = apr_hash_next (hi)) {
+      apr_hash_this (hi, NULL, NULL, &val);
+      machine = val;
+      if (machine->mcast->group->port == port) {
+        break;
+      }
+    }
+    if (hi == NULL) {
+      break;
+    }
+  }
+  return port;
+}
+
+/**
+ * Send file of accepted RRQ to multicast group (RFC2090).
+ * @param server  Server
+ * @param machine Accepted transfer
+ * @return APR status
+ */
+static apr_status_t server_mcast (struct tftp_server *server, struct tftp_machine *machine)
+{
+  apr_sockaddr_t *group;
+  apr_status_t rv;
+  char *ip;
+
+  apr_sockaddr_ip_get (&ip, server->mc_group);
+  rv = apr_sockaddr_info_get (&group, ip, APR_INET, server_mcast_port (server), 0, machine->mp);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  return tftp_proto_mcast_serve (machine, group, server->mc_iface);
+}
+
+/**
+ * Start transfer of received request.
+ * @param server  Server
+ * @param len     Request length in request buffer
+ */
+static void server_request (struct tftp_server *server, apr_size_t len)
+{
+  struct tftp_packet_view view;
+  struct tftp_machine *machine;
+  struct tftp_params params;
+  apr_finfo_t finfo;
+  const char *name;
+  char *path, *ip;
+  apr_status_t rv;
+  bool mcast;
+
+  if (tftp_packet_view_read (&view, server->buf, len) == NULL) {
+    server_error (server, ERR_ILLEGAL, "Illegal TFTP operation");
+    return;
+  }
+  // packets of transfers come to their own sockets
+  if (view.opcode != E_RRQ && view.opcode != E_WRQ) {
+    DBG("Ignore %s on listening socket.", opcode_str[view.opcode]);
+    return;
+  }
+  apr_sockaddr_ip_get (&ip, server->from);
+  LOG("<-- %-5s %s 0x0 %.*s from %s:%d", opcode_str[view.opcode], view.filename.ptr,
+      (int)view.mode.len, view.mode.ptr, ip, server->from->port);
+
+  if (view.e_mode == E_MAIL) {
+    server_error (server, ERR_ILLEGAL, "Mail mode is not supported");
+    return;
+  }
+  if (view.opcode == E_WRQ && !server->upload) {
+    server_error (server, ERR_ACCESS, "Write is not allowed");
+    return;
+  }
+  // file name is 0x0 terminated in packet, path never leaves root
+  for (name = view.filename.ptr; *name == '/'; name++);
+  rv = apr_filepath_merge (&path, server->root, name,
+                           APR_FILEPATH_SECUREROOT | APR_FILEPATH_NOTABSOLUTE, server->req_mp);
+  if (rv != APR_SUCCESS) {
+    server_error (server, ERR_ACCESS, "Access violation");
+    return;
+  }
+  if (view.opcode == E_RRQ &&
+      (apr_stat (&finfo, path, APR_FINFO_TYPE, server->req_mp) != APR_SUCCESS || finfo.filetype != APR_REG)) {
+    server_error (server, ERR_NOTFOUND, "File not found");
+    return;
+  }
+
+  // client of file sent to multicast group joins it
+  mcast = server->mc_group && view.opcode == E_RRQ && view.opts.has_multicast && view.e_mode == E_OCTET;
+  if (mcast) {
+    machine = apr_hash_get (server->mcasts, path, APR_HASH_KEY_STRING);
+    if (machine && tftp_proto_mcast_join (machine, ip, server->from->port, &view.opts) == APR_SUCCESS) {
+      return;
+    }
+    // group of other block size is left for its clients
+    mcast = machine == NULL;
+  }
+  if (server->loop->sessions >= server->jobs) {
+    server_error (server, ERR_UNDEF, "Server is busy");
+    return;
+  }
+
+  params = server->params;
+  params.host = ip;
+  params.port = server->from->port;
+  params.remote_file = name;
+  params.local_file = path;
+  params.action = view.opcode == E_RRQ ? PUT : GET;
+  params.mode = view.e_mode;
+
+  rv = tftp_proto_accept (&machine, server->mp, &params, &view.opts);
+  if (APR_STATUS_IS_ENOSPC(rv)) {
+    server_error (server, ERR_DISKFULL, "Disk full or allocation exceeded");
+    return;
+  }
+  if (APR_STATUS_IS_EACCES(rv)) {
+    server_error (server, ERR_ACCESS, "Access violation");
+    return;
+  }
+  if (APR_STATUS_IS_ENOENT(rv)) {
+    server_error (server, ERR_NOTFOUND, "File not found");
+    return;
+  }
+  if (rv != APR_SUCCESS) {
+    server_error (server, ERR_UNDEF, "Failed to start transfer");
+    return;
+  }
+  if (mcast && server_mcast (server, machine) != APR_SUCCESS) {
+    tftp_proto_destroy (machine);
+    server_error (server, ERR_UNDEF, "Failed to start multicast transfer");
+    return;
+  }
+  if (tftp_loop_add (server->loop, machine, server_done, server) != APR_SUCCESS) {
+    tftp_proto_destroy (machine);
+    return;
+  }
+  if (mcast) {
+    machine->mcast->path = apr_pstrdup (machine->mp, path);
+    apr_hash_set (server->mcasts, machine->mcast->path, APR_HASH_KEY_STRING, machine);
+  }
+}
+
+/**
+ * Listening socket is readable. Serve received requests.
+ */
+static void server_input (void *baton)
+{
+  struct tftp_server *server = baton;
+  apr_size_t len;
+  int i;
+
+  for (i = 0; i < LOOP_BATCH; i++) {
+    // request is copied by transfer, reuse memory of previous one
+    apr_pool_clear (server->req_mp);
+    len = BUF_SIZE;
+    if (apr_socket_recvfrom (server->from, server->sock, 0, server->buf, &len) != APR_SUCCESS) {
+      break;
+    }
+    // terminate last field, so it can be printed even if its 0x0 is missing
+    server->buf[len] = '\0';
+    server_request (server, len);
+  }
+}
+
+/**
+ * Set multicast group of server transfers.
+ * @param server  Server
+ * @param group   Group "addr:port"
+ * @return APR status
+ */
+static apr_status_t server_mcast_group (struct tftp_server *server, const char *group)
+{
+  char *host, *scope;
+  apr_port_t port;
+  apr_status_t rv;
+
+  rv = apr_parse_addr_port (&host, &scope, &port, group, server->mp);
+  if (rv != APR_SUCCESS || host == NULL || port == 0) {
+    ERR("Invalid multicast group %s.", group);
+    return rv != APR_SUCCESS ? rv : APR_EINVAL;
+  }
+  rv = apr_sockaddr_info_get (&server->mc_group, host, APR_INET, port, 0, server->mp);
+  if (rv != APR_SUCCESS) {
+    ERR("Invalid multicast group %s.", group);
+    return rv;
+  }
+  // blocks are sent from interface of listening address
+  server->mc_iface = apr_sockaddr_is_wildcard (server->addr) ? NULL : server->addr;
+  server->mcasts = apr_hash_make (server->mp);
+  LOG("Multicast group %s, ports %d-%d.", host, port, port + server->jobs - 1);
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_server_create (struct tftp_server **new, apr_pool_t *mp, struct tftp_loop *loop,
+                                 struct tftp_params *params, const char *root, bool upload,
+                                 unsigned int jobs)
+{
+  struct tftp_server *server = apr_pcalloc(mp, sizeof(struct tftp_server));
+  apr_sockaddr_t *addr;
+  apr_finfo_t finfo;
+  apr_status_t rv;
+  char *path;
+
+  server->mp = mp;
+  server->loop = loop;
+  server->params = *params;
+  server->upload = upload;
+  server->jobs = jobs;
+
+  rv = apr_filepath_merge (&path, NULL, root, APR_FILEPATH_TRUENAME, mp);
+  if (rv != APR_SUCCESS || apr_stat (&finfo, path, APR_FINFO_TYPE, mp) != APR_SUCCESS ||
+      finfo.filetype != APR_DIR) {
+    ERR("Root %s is not a directory.", root);
+    return rv != APR_SUCCESS ? rv : APR_ENOTDIR;
+  }
+  server->root = path;
+
+  rv = apr_pool_create (&server->req_mp, mp);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  server->buf = apr_palloc(mp, BUF_SIZE + 1);
+
+  if (params->cache_size > 0) {
+    // hot files are sent to concurrent clients from prebuilt packets
+    rv = tftp_cache_create (&server->params.cache, mp, params->cache_size);
+    if (rv != APR_SUCCESS) {
+      return rv;
+    }
+  }
+
+  rv = apr_sockaddr_info_get (&addr, params->host, APR_INET, params->port, 0, mp);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed get socket address info UDP:%s:%d.", params->host, params->port);
+    return rv;
+  }
+  rv = apr_sockaddr_info_get (&server->from, NULL, APR_INET, 0, 0, mp);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  rv = apr_socket_create (&server->sock, APR_INET, SOCK_DGRAM, APR_PROTO_UDP, mp);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to create socket (apr_socket_create).");
+    return rv;
+  }
+  apr_socket_opt_set (server->sock, APR_SO_REUSEADDR, 1);
+  rv = apr_socket_bind (server->sock, addr);
+  if (rv != APR_SUCCESS) {
+    ERR("Failed to bind UDP:%s:%d.", params->host, params->port);
+    return rv;
+  }
+  apr_socket_addr_get (&server->addr, APR_LOCAL, server->sock);
+
+  if (params->mc_group) {
+    rv = server_mcast_group (server, params->mc_group);
+    if (rv != APR_SUCCESS) {
+      return rv;
+    }
+  }
+
+  rv = tftp_loop_listen (loop, server->sock, server_input, server);
+  if (rv != APR_SUCCESS) {
+    return rv;
+  }
+  LOG("Serving %s on UDP:%s:%d.", server->root, params->host, server->addr->port);
+
+  *new = server;
+  return APR_SUCCESS;
+}
+
+apr_port_t tftp_server_port (struct tftp_server *server)
+{
+  return server->addr->port;
+}
+
+apr_status_t tftp_server_run (struct tftp_server *server)
+{
+  apr_status_t rv;
+
+  while (!server->stop) {
+    rv = tftp_loop_poll (server->loop, -1);
+    if (rv != APR_SUCCESS) {
+      return rv;
+    }
+  }
+
+  return APR_SUCCESS;
+}
+
+void tftp_server_stop (struct tftp_server *server)
+{
+  server->stop = 1;
+  tftp_loop_wakeup (server->loop);
+}
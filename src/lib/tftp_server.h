@@ -0,0 +1,106 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_server.h
+ * @brief TFTP protocol library.
+ * TFTP server of files in root directory.
+ *
+ * Requests are received on listening socket polled by event loop
+ * (see tftp_loop.h). Every request is served by its own protocol
+ * machine (see tftp_proto_accept) answering from ephemeral port
+ * (transaction id), so server shares transfer engine, options and
+ * datagram I/O with client. RRQ with multicast option (RFC2090) is
+ * sent to multicast group, shared by clients of the same file.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_SERVER_H
+#define __TFTP_SERVER_H
+
+#include <apr_hash.h>
+
+#include "tftp_proto.h"
+#include "tftp_loop.h"
+
+/**
+ * Server structure.
+ */
+struct tftp_server {
+  apr_pool_t          *mp;        /*!< APR memory pool. */
+  apr_pool_t          *req_mp;    /*!< Memory pool of request processing. Cleared for every request. */
+  struct tftp_loop    *loop;      /*!< Event loop running transfers. */
+  apr_socket_t        *sock;      /*!< Listening socket. */
+  apr_sockaddr_t      *addr;      /*!< Listening address. */
+  apr_sockaddr_t      *from;      /*!< Source of received request. */
+  const char          *root;      /*!< Root directory of served files. */
+  struct tftp_params  params;     /*!< Maximal block and window size, timeout, I/O and cache of transfers. */
+  bool                upload;     /*!< Clients may write files (WRQ). */
+  unsigned int        jobs;       /*!< Maximal concurrent transfers. */
+  char                *buf;       /*!< Request buffer. */
+  apr_sockaddr_t      *mc_group;  /*!< Multicast group address and first port (RFC2090) or NULL. */
+  apr_sockaddr_t      *mc_iface;  /*!< Interface of multicast transfers or NULL for default. */
+  apr_hash_t          *mcasts;    /*!< Multicast transfers by file path. */
+  unsigned int        mc_seq;     /*!< Next multicast group port offset. */
+  apr_uint64_t        served;     /*!< Completed transfers. */
+  apr_uint64_t        failed;     /*!< Failed transfers. */
+  volatile apr_uint32_t stop;     /*!< Server is stopped. */
+};
+
+/**
+ * Create server listening on host and port of parameters.
+ * Port 0 binds ephemeral port (see tftp_server_port).
+ * @param server  Created server
+ * @param mp      APR memory pool
+ * @param loop    Event loop. Its size must allow jobs transfers and listening socket.
+ * @param params  Listening host and port, maximal block and window size,
+ *                default timeout, retries, rollover, I/O of transfers,
+ *                cache memory limit and multicast group.
+ * @param root    Root directory of served files
+ * @param upload  Clients may write files
+ * @param jobs    Maximal concurrent transfers
+ * @return APR status
+ */
+apr_status_t tftp_server_create (struct tftp_server **server, apr_pool_t *mp, struct tftp_loop *loop,
+                                 struct tftp_params *params, const char *root, bool upload,
+                                 unsigned int jobs);
+
+/**
+ * Listening port.
+ * @param server  Server
+ * @return Port
+ */
+apr_port_t tftp_server_port (struct tftp_server *server);
+
+/**
+ * Run event loop of the server until it is stopped.
+ * @param server  Server
+ * @return APR status
+ */
+apr_status_t tftp_server_run (struct tftp_server *server);
+
+/**
+ * Stop server. Running transfers are abandoned. Can be called from any thread.
+ * @param server  Server
+ */
+void tftp_server_stop (struct tftp_server *server);
+
+#endif
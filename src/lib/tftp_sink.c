@@ -0,0 +1,268 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_sink.c
+ * @brief TFTP protocol library.
+ * Write-behind file sink of GET transfer.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+#define _GNU_SOURCE
+#include <config.h>
+#include <apr_portable.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "tftp_sink.h"
+#include "util.h"
+
+/**
+ * Switch direct I/O of file descriptor.
+ */
+static int sink_direct (int fd, int on)
+{
+#ifdef O_DIRECT
+  int flags = fcntl (fd, F_GETFL);
+
+  if (flags == -1) {
+    return 0;
+  }
+  flags = on ? flags | O_DIRECT : flags & ~O_DIRECT;
+  return fcntl (fd, F_SETFL, flags) == 0;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Write buffer at its offset and wait for completion.
+ */
+static apr_status_t sink_pwrite (struct tftp_sink *sink, struct tftp_sink_buf *buf)
+{
+  apr_size_t done = 0;
+  ssize_t n;
+
+  // direct I/O needs aligned length, tail of file is written through page cache
+  if (sink->direct && buf->len % SINK_ALIGN) {
+    sink->direct = !sink_direct (sink->fd, 0);
+  }
+  while (done < buf->len) {
+    n = pwrite (sink->fd, buf->data + done, buf->len - done, buf->off + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return n < 0 ? APR_FROM_OS_ERROR(errno) : APR_EGENERAL;
+    }
+    done += n;
+  }
+  buf->len = 0;
+  return APR_SUCCESS;
+}
+
+/**
+ * Asynchronous write is completed.
+ */
+static void sink_write_done (struct tftp_uring_op *op, int res)
+{
+  struct tftp_sink_buf *buf = op->baton;
+  apr_size_t len = buf->len;
+
+  buf->busy = 0;
+  buf->len = 0;
+  tftp_io_write_done (buf->sink->io, res, len);
+}
+
+/**
+ * Write current buffer. Asynchronously if machine I/O can queue it
+ * and next buffer is free, so data is collected while buffer is
+ * written. Otherwise write waits and current buffer is reused.
+ */
+static apr_status_t sink_flush (struct tftp_sink *sink)
+{
+  struct tftp_sink_buf *buf = &sink->bufs[sink->cur];
+  unsigned int next = (sink->cur + 1) % SINK_BUFS;
+
+  if (buf->len == 0) {
+    return APR_SUCCESS;
+  }
+  buf->off = sink->off - buf->len;
+  if (!sink->bufs[next].busy && buf->len == sink->buf_size &&
+      tftp_io_write_at (sink->io, sink->file, buf->data, buf->len, buf->off, &buf->op) == APR_SUCCESS) {
+    buf->busy = 1;
+    sink->cur = next;
+    return APR_SUCCESS;
+  }
+  return sink_pwrite (sink, buf);
+}
+
+/**
+ * Allocate buffers from one aligned region and register it to machine I/O.
+ */
+static void sink_alloc (struct tftp_sink *sink)
+{
+  char *region;
+  unsigned int i;
+
+  region = apr_palloc(sink->mp, SINK_BUFS * sink->buf_size + SINK_ALIGN);
+  region = (char *)APR_ALIGN((apr_uintptr_t)region, SINK_ALIGN);
+  for (i = 0; i < SINK_BUFS; i++) {
+    sink->bufs[i].data = region + i * sink->buf_size;
+  }
+  tftp_io_register (sink->io, region, SINK_BUFS * sink->buf_size);
+  DBG("Allocated file sink buffers of %lu bytes.", sink->buf_size);
+}
+
+/**
+ * Memory pool cleanup. Sink is closed when transfer is destroyed.
+ */
+static apr_status_t sink_cleanup (void *data)
+{
+  struct tftp_sink *sink = data;
+
+  if (!sink->closed) {
+    tftp_sink_close (sink);
+  }
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_sink_create (struct tftp_sink **new, apr_pool_t *mp, apr_file_t *file,
+                               struct tftp_io *io, int direct)
+{
+  struct tftp_sink *sink;
+  apr_os_file_t fd;
+  unsigned int i;
+
+  sink = apr_pcalloc(mp, sizeof(struct tftp_sink));
+  for (i = 0; i < SINK_BUFS; i++) {
+    sink->bufs[i].op.complete = sink_write_done;
+    sink->bufs[i].op.baton = &sink->bufs[i];
+    sink->bufs[i].sink = sink;
+  }
+  apr_os_file_get (&fd, file);
+  sink->file = file;
+  sink->fd = fd;
+  sink->io = io;
+  sink->mp = mp;
+  sink->buf_size = SINK_BUF_SIZE;
+
+  if (direct) {
+    sink->direct = sink_direct (fd, 1);
+    if (!sink->direct) {
+      DBG("File system does not support direct I/O.");
+    }
+  }
+  apr_pool_cleanup_register(mp, sink, sink_cleanup, apr_pool_cleanup_null);
+
+  *new = sink;
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_sink_reserve (struct tftp_sink *sink, apr_off_t size)
+{
+  // whole small file fits into one buffer
+  if (sink->bufs[0].data == NULL && size < SINK_BUF_SIZE) {
+    sink->buf_size = size > 0 ? APR_ALIGN(size, SINK_ALIGN) : SINK_ALIGN;
+  }
+#ifdef HAVE_FALLOCATE
+  if (size <= 0) {
+    return APR_SUCCESS;
+  }
+  if (fallocate (sink->fd, 0, 0, size) != 0) {
+    return APR_FROM_OS_ERROR(errno);
+  }
+  sink->reserved = size;
+  DBG("Preallocated file of %" APR_OFF_T_FMT " bytes.", size);
+  return APR_SUCCESS;
+#else
+  return APR_ENOTIMPL;
+#endif
+}
+
+apr_status_t tftp_sink_write (struct tftp_sink *sink, const char *data, apr_size_t len)
+{
+  struct tftp_sink_buf *buf;
+  apr_status_t rv;
+  apr_size_t n;
+
+  if (sink->bufs[0].data == NULL) {
+    sink_alloc (sink);
+  }
+  while (len > 0) {
+    buf = &sink->bufs[sink->cur];
+    n = sink->buf_size - buf->len;
+    if (n > len) {
+      n = len;
+    }
+    memcpy (buf->data + buf->len, data, n);
+    buf->len += n;
+    sink->off += n;
+    data += n;
+    len -= n;
+    if (buf->len == sink->buf_size) {
+      rv = sink_flush (sink);
+      if (rv != APR_SUCCESS) {
+        return rv;
+      }
+    }
+  }
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_sink_write_at (struct tftp_sink *sink, apr_off_t off, const char *data, apr_size_t len)
+{
+  apr_size_t done = 0;
+  ssize_t n;
+
+  // blocks are not aligned for direct I/O
+  if (sink->direct) {
+    sink->direct = !sink_direct (sink->fd, 0);
+  }
+  while (done < len) {
+    n = pwrite (sink->fd, data + done, len - done, off + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return n < 0 ? APR_FROM_OS_ERROR(errno) : APR_EGENERAL;
+    }
+    done += n;
+  }
+  // file is truncated to the end of the last block on close
+  if (off + (apr_off_t)len > sink->off) {
+    sink->off = off + len;
+  }
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_sink_close (struct tftp_sink *sink)
+{
+  apr_status_t rv;
+
+  sink->closed = 1;
+  rv = sink_flush (sink);
+  if (rv == APR_SUCCESS && sink->reserved > sink->off) {
+    rv = apr_file_trunc (sink->file, sink->off);
+  }
+  return rv;
+}
@@ -0,0 +1,133 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_sink.h
+ * @brief TFTP protocol library.
+ * Write-behind file sink of GET transfer. Received blocks are
+ * collected to large aligned buffers and every full buffer is
+ * written with one call at its file offset. When machine I/O uses
+ * io_uring (see tftp_io.h), full buffer is written asynchronously
+ * while blocks are collected to the other buffer.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_SINK_H
+#define __TFTP_SINK_H
+
+#include <apr_general.h>
+#include <apr_file_io.h>
+
+#include "tftp_io.h"
+
+/*! Maximal sink buffer size. */
+#define SINK_BUF_SIZE (1 << 20)
+
+/*! Sink buffers alignment required by direct I/O. */
+#define SINK_ALIGN 4096
+
+/*! Number of sink buffers. */
+#define SINK_BUFS 2
+
+struct tftp_sink;
+
+/**
+ * Sink buffer.
+ */
+struct tftp_sink_buf {
+  char                  *data;  /*!< Buffer of sink buf_size bytes. */
+  apr_size_t            len;    /*!< Collected data length. */
+  apr_off_t             off;    /*!< File offset of buffer being written. */
+  int                   busy;   /*!< Buffer is written asynchronously. */
+  struct tftp_uring_op  op;     /*!< Asynchronous write operation. */
+  struct tftp_sink      *sink;  /*!< Owner sink. */
+};
+
+/**
+ * Write-behind file sink.
+ */
+struct tftp_sink {
+  apr_file_t            *file;            /*!< Local file. */
+  int                   fd;               /*!< Local file descriptor. */
+  struct tftp_io        *io;              /*!< Machine I/O for asynchronous writes. */
+  apr_pool_t            *mp;              /*!< Memory pool of buffers. */
+  struct tftp_sink_buf  bufs[SINK_BUFS];  /*!< Buffers. Allocated when first data is collected. */
+  apr_size_t            buf_size;         /*!< Buffer size. */
+  unsigned int          cur;              /*!< Buffer collecting data. */
+  apr_off_t             off;              /*!< File offset of the next byte. */
+  apr_off_t             reserved;         /*!< Preallocated file size. */
+  int                   direct;           /*!< File is written with O_DIRECT. */
+  int                   closed;           /*!< Sink is flushed and closed. */
+};
+
+/**
+ * Create sink of local file. Sink buffers are registered to machine I/O
+ * for fixed buffer writes. Sink is closed when memory pool is destroyed.
+ * @param sink    Created sink
+ * @param mp      APR memory pool
+ * @param file    Local file opened for writing
+ * @param io      Machine I/O
+ * @param direct  Bypass page cache (O_DIRECT) if file system supports it
+ * @return APR status
+ */
+apr_status_t tftp_sink_create (struct tftp_sink **sink, apr_pool_t *mp, apr_file_t *file,
+                               struct tftp_io *io, int direct);
+
+/**
+ * Preallocate file when transfer size is known. File is truncated
+ * at close if less data is received. Buffers of small file are
+ * not larger than the file.
+ * @param sink  Sink
+ * @param size  Expected file size
+ * @return APR status. APR_ENOTIMPL if system can not preallocate file.
+ */
+apr_status_t tftp_sink_reserve (struct tftp_sink *sink, apr_off_t size);
+
+/**
+ * Collect data. Full buffer is written to file.
+ * @param sink  Sink
+ * @param data  Data
+ * @param len   Data length
+ * @return APR status
+ */
+apr_status_t tftp_sink_write (struct tftp_sink *sink, const char *data, apr_size_t len);
+
+/**
+ * Write data at file offset right away, bypassing buffers. Used by
+ * multicast transfer (RFC2090) receiving blocks out of order. Must not
+ * be mixed with tftp_sink_write.
+ * @param sink  Sink
+ * @param off   File offset
+ * @param data  Data
+ * @param len   Data length
+ * @return APR status
+ */
+apr_status_t tftp_sink_write_at (struct tftp_sink *sink, apr_off_t off, const char *data, apr_size_t len);
+
+/**
+ * Write collected data and truncate preallocated file to written size.
+ * Asynchronous writes may still be in flight (see tftp_io_busy).
+ * @param sink  Sink
+ * @return APR status
+ */
+apr_status_t tftp_sink_close (struct tftp_sink *sink);
+
+#endif
@@ -0,0 +1,197 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_timer.c
+ * @brief TFTP protocol library.
+ * Hierarchical timing wheel.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#include "tftp_timer.h"
+
+/*! Convert time to wheel ticks. */
+#define to_tick(t) ((apr_uint64_t)((t) / WHEEL_TICK))
+
+/*! Slot index of the tick on level. */
+#define slot_idx(tick, level) (((tick) >> ((level) * WHEEL_BITS)) & WHEEL_MASK)
+
+/**
+ * Link timer into the slot of the wheel by distance to expiration.
+ */
+static void timer_link (struct tftp_wheel *wheel, struct tftp_timer *timer)
+{
+  struct tftp_timer *head;
+  apr_uint64_t delta, pos;
+  unsigned int level = 0;
+
+  if (timer->expires < wheel->tick) {
+    timer->expires = wheel->tick;
+  }
+  pos = timer->expires;
+  delta = pos - wheel->tick;
+  while (level < WHEEL_LEVELS - 1 && delta >= (apr_uint64_t)1 << ((level + 1) * WHEEL_BITS)) {
+    level++;
+  }
+  // beyond the wheel span: park in the farthest slot, re-linked on cascade
+  if (delta >= (apr_uint64_t)1 << (WHEEL_LEVELS * WHEEL_BITS)) {
+    pos = wheel->tick + ((apr_uint64_t)1 << (WHEEL_LEVELS * WHEEL_BITS)) - 1;
+  }
+
+  head = &wheel->slots[level][slot_idx(pos, level)];
+  timer->next = head->next;
+  timer->prev = head;
+  head->next->prev = timer;
+  head->next = timer;
+}
+
+/**
+ * Unlink timer from slot list.
+ */
+static void timer_unlink (struct tftp_timer *timer)
+{
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = timer->prev = NULL;
+}
+
+/**
+ * Move timers of the upper level slot to lower levels.
+ * @return Slot index which was cascaded.
+ */
+static unsigned int cascade (struct tftp_wheel *wheel, unsigned int level)
+{
+  unsigned int idx = slot_idx(wheel->tick, level);
+  struct tftp_timer *head = &wheel->slots[level][idx];
+  struct tftp_timer *timer;
+
+  while (head->next != head) {
+    timer = head->next;
+    timer_unlink (timer);
+    timer_link (wheel, timer);
+  }
+  return idx;
+}
+
+/**
+ * Check if upper levels have timers to cascade on the tick.
+ */
+static int cascade_pending (struct tftp_wheel *wheel, apr_uint64_t tick)
+{
+  unsigned int level;
+  struct tftp_timer *head;
+
+  for (level = 1; level < WHEEL_LEVELS; level++) {
+    if (slot_idx(tick, level - 1) != 0) break;
+    head = &wheel->slots[level][slot_idx(tick, level)];
+    if (head->next != head) return 1;
+  }
+  return 0;
+}
+
+void tftp_wheel_init (struct tftp_wheel *wheel, apr_time_t now)
+{
+  unsigned int level, idx;
+
+  wheel->tick = to_tick(now);
+  wheel->count = 0;
+  for (level = 0; level < WHEEL_LEVELS; level++) {
+    for (idx = 0; idx < WHEEL_SIZE; idx++) {
+      wheel->slots[level][idx].next = &wheel->slots[level][idx];
+      wheel->slots[level][idx].prev = &wheel->slots[level][idx];
+    }
+  }
+}
+
+void tftp_timer_init (struct tftp_timer *timer, tftp_timer_cb cb, void *baton)
+{
+  timer->next = timer->prev = NULL;
+  timer->expires = 0;
+  timer->cb = cb;
+  timer->baton = baton;
+}
+
+void tftp_timer_add (struct tftp_wheel *wheel, struct tftp_timer *timer, apr_time_t expires)
+{
+  tftp_timer_cancel (wheel, timer);
+  // round up, so timer never expires earlier
+  timer->expires = to_tick(expires + WHEEL_TICK - 1);
+  timer_link (wheel, timer);
+  wheel->count++;
+}
+
+void tftp_timer_cancel (struct tftp_wheel *wheel, struct tftp_timer *timer)
+{
+  if (!tftp_timer_pending (timer)) return;
+  timer_unlink (timer);
+  wheel->count--;
+}
+
+unsigned int tftp_wheel_advance (struct tftp_wheel *wheel, apr_time_t now)
+{
+  apr_uint64_t target = to_tick(now);
+  unsigned int expired = 0, level;
+  struct tftp_timer *head, *timer;
+
+  while (wheel->tick <= target) {
+    if (wheel->count == 0) {
+      // nothing to cascade or expire: jump to current tick
+      wheel->tick = target + 1;
+      break;
+    }
+    // cascade upper levels when lower level wraps
+    for (level = 1; level < WHEEL_LEVELS; level++) {
+      if (slot_idx(wheel->tick, level - 1) != 0 || cascade (wheel, level) != 0) {
+        break;
+      }
+    }
+    head = &wheel->slots[0][slot_idx(wheel->tick, 0)];
+    while (head->next != head) {
+      timer = head->next;
+      timer_unlink (timer);
+      wheel->count--;
+      expired++;
+      timer->cb (timer, timer->baton);
+    }
+    wheel->tick++;
+  }
+  return expired;
+}
+
+apr_interval_time_t tftp_wheel_timeout (struct tftp_wheel *wheel, apr_time_t now)
+{
+  apr_uint64_t tick;
+  apr_time_t next;
+
+  if (wheel->count == 0) return -1;
+
+  // nearest not empty level 0 slot or not empty cascade, scan is bounded
+  // by level 1 span and wakes up loop earlier in the worst case
+  for (tick = wheel->tick; tick - wheel->tick < WHEEL_SIZE * WHEEL_SIZE; tick++) {
+    struct tftp_timer *head = &wheel->slots[0][slot_idx(tick, 0)];
+    if (head->next != head || cascade_pending (wheel, tick)) {
+      break;
+    }
+  }
+  next = (apr_time_t)tick * WHEEL_TICK;
+  if (next <= now) return 0;
+  return next - now;
+}
@@ -0,0 +1,128 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_timer.h
+ * @brief TFTP protocol library.
+ * Hierarchical timing wheel for retransmission timers of many transfers.
+ *
+ * Wheel has WHEEL_LEVELS levels of WHEEL_SIZE slots. Level 0 slot is one
+ * tick (millisecond), every next level slot covers whole previous level.
+ * Timer is placed in the level by its distance to expiration and moved
+ * down (cascaded) when lower level wraps. Add, cancel and expire are O(1).
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_TIMER_H
+#define __TFTP_TIMER_H
+
+#include <apr_time.h>
+
+#define WHEEL_BITS    6                   /*!< Bits of slot index per level */
+#define WHEEL_SIZE    (1 << WHEEL_BITS)   /*!< Slots per level */
+#define WHEEL_MASK    (WHEEL_SIZE - 1)    /*!< Slot index mask */
+#define WHEEL_LEVELS  4                   /*!< Number of levels. Max timeout is 2^24 ticks */
+
+/*! Timing wheel tick: 1 millisecond */
+#define WHEEL_TICK    apr_time_from_msec(1)
+
+struct tftp_timer;
+
+/*! Timer expiration callback. */
+typedef void (*tftp_timer_cb)(struct tftp_timer *timer, void *baton);
+
+/**
+ * Timer. Embedded into the structure of timer owner.
+ */
+struct tftp_timer {
+  struct tftp_timer *next;    /*!< Next timer in slot list. */
+  struct tftp_timer *prev;    /*!< Previous timer in slot list. */
+  apr_uint64_t      expires;  /*!< Expiration tick. */
+  tftp_timer_cb     cb;       /*!< Expiration callback. */
+  void              *baton;   /*!< Callback argument. */
+};
+
+/**
+ * Hierarchical timing wheel.
+ */
+struct tftp_wheel {
+  apr_uint64_t      tick;     /*!< Next tick to process. */
+  unsigned int      count;    /*!< Number of pending timers. */
+  struct tftp_timer slots[WHEEL_LEVELS][WHEEL_SIZE]; /*!< Slot list heads. */
+};
+
+/**
+ * Init timing wheel.
+ * @param wheel Timing wheel
+ * @param now   Current time
+ */
+void tftp_wheel_init (struct tftp_wheel *wheel, apr_time_t now);
+
+/**
+ * Init timer. Timer is not pending until it is added to the wheel.
+ * @param timer Timer
+ * @param cb    Expiration callback
+ * @param baton Callback argument
+ */
+void tftp_timer_init (struct tftp_timer *timer, tftp_timer_cb cb, void *baton);
+
+/**
+ * Add timer to the wheel. Pending timer is rescheduled.
+ * @param wheel   Timing wheel
+ * @param timer   Timer
+ * @param expires Expiration time
+ */
+void tftp_timer_add (struct tftp_wheel *wheel, struct tftp_timer *timer, apr_time_t expires);
+
+/**
+ * Cancel pending timer. Does nothing if timer is not pending.
+ * @param wheel Timing wheel
+ * @param timer Timer
+ */
+void tftp_timer_cancel (struct tftp_wheel *wheel, struct tftp_timer *timer);
+
+/**
+ * Timer is added to the wheel and not expired yet.
+ * @param timer Timer
+ * @return Non zero if timer is pending.
+ */
+#define tftp_timer_pending(timer) ((timer)->next != NULL)
+
+/**
+ * Expire all timers up to given time and run their callbacks.
+ * Callbacks may add and cancel timers.
+ * @param wheel Timing wheel
+ * @param now   Current time
+ * @return Number of expired timers.
+ */
+unsigned int tftp_wheel_advance (struct tftp_wheel *wheel, apr_time_t now);
+
+/**
+ * Time until next timer expires. Timers in upper levels are
+ * reported at the next cascade, so value may be earlier than
+ * real expiration, but never later.
+ * @param wheel Timing wheel
+ * @param now   Current time
+ * @return Interval or -1 if there are no pending timers.
+ */
+apr_interval_time_t tftp_wheel_timeout (struct tftp_wheel *wheel, apr_time_t now);
+
+#endif
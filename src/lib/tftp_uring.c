@@ -0,0 +1,268 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_uring.c
+ * @brief TFTP protocol library.
+ * io_uring engine shared by transfers of one event loop.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#include <config.h>
+#include <apr_portable.h>
+
+#include "tftp_uring.h"
+#include "util.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+
+/*! Submission queue entries per transfer. */
+#define URING_ENTRIES_PER_TRANSFER 4
+
+/*! Minimal submission queue size. */
+#define URING_ENTRIES_MIN 64
+
+/*! Maximal submission queue size. */
+#define URING_ENTRIES_MAX 4096
+
+/**
+ * io_uring engine structure.
+ */
+struct tftp_uring {
+  struct io_uring ring;     /*!< Submission and completion queues. */
+  apr_file_t      *file;    /*!< Ring descriptor. */
+  unsigned long   gen;      /*!< Submissions counter. */
+  int             *bufs;    /*!< Free registered buffer indexes. */
+  unsigned int    nbufs;    /*!< Number of free registered buffer indexes. */
+};
+
+/**
+ * Release ring with memory pool.
+ */
+static apr_status_t uring_cleanup (void *data)
+{
+  struct tftp_uring *uring = data;
+  io_uring_queue_exit (&uring->ring);
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_uring_create (struct tftp_uring **new, apr_pool_t *mp, apr_uint32_t size)
+{
+  struct tftp_uring *uring = apr_pcalloc(mp, sizeof(struct tftp_uring));
+  unsigned int entries = size * URING_ENTRIES_PER_TRANSFER;
+  int ret;
+
+  if (entries < URING_ENTRIES_MIN) {
+    entries = URING_ENTRIES_MIN;
+  } else if (entries > URING_ENTRIES_MAX) {
+    entries = URING_ENTRIES_MAX;
+  }
+  ret = io_uring_queue_init (entries, &uring->ring, 0);
+  if (ret < 0) {
+    ERR("Failed to create io_uring of %u entries.", entries);
+    return APR_FROM_OS_ERROR(-ret);
+  }
+  apr_pool_cleanup_register (mp, uring, uring_cleanup, apr_pool_cleanup_null);
+  apr_os_file_put (&uring->file, &uring->ring.ring_fd, APR_FOPEN_READ, mp);
+
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+  // one buffer table slot per transfer, filled when transfer is added
+  if (io_uring_register_buffers_sparse (&uring->ring, size) == 0) {
+    unsigned int i;
+    uring->bufs = apr_palloc(mp, size * sizeof(int));
+    for (i = 0; i < size; i++) {
+      uring->bufs[i] = size - i - 1;
+    }
+    uring->nbufs = size;
+  }
+#endif
+  DBG("Created io_uring of %u entries, %u registered buffers.", entries, uring->nbufs);
+  *new = uring;
+
+  return APR_SUCCESS;
+}
+
+apr_file_t *tftp_uring_file (struct tftp_uring *uring)
+{
+  return uring->file;
+}
+
+struct io_uring_sqe *tftp_uring_sqe (struct tftp_uring *uring)
+{
+  struct io_uring_sqe *sqe = io_uring_get_sqe (&uring->ring);
+
+  if (sqe == NULL && tftp_uring_submit (uring) == APR_SUCCESS) {
+    sqe = io_uring_get_sqe (&uring->ring);
+  }
+  return sqe;
+}
+
+void tftp_uring_queue (struct tftp_uring *uring, struct io_uring_sqe *sqe,
+                       struct tftp_uring_op *op, struct tftp_uring_chain *chain)
+{
+  io_uring_sqe_set_data (sqe, op);
+  if (chain == NULL) {
+    return;
+  }
+  // entries can be linked only within one submission
+  if (chain->last && chain->gen == uring->gen) {
+    chain->last->flags |= IOSQE_IO_LINK;
+  }
+  chain->last = sqe;
+  chain->gen = uring->gen;
+}
+
+void tftp_uring_reserve (struct tftp_uring *uring, unsigned int count)
+{
+  if (io_uring_sq_space_left (&uring->ring) < count) {
+    tftp_uring_submit (uring);
+  }
+}
+
+unsigned long tftp_uring_gen (struct tftp_uring *uring)
+{
+  return uring->gen;
+}
+
+apr_status_t tftp_uring_submit (struct tftp_uring *uring)
+{
+  int ret;
+
+  if (io_uring_sq_ready (&uring->ring) == 0) {
+    return APR_SUCCESS;
+  }
+  ret = io_uring_submit (&uring->ring);
+  uring->gen++;
+  if (ret < 0) {
+    ERR("Failed to submit io_uring entries.");
+    return APR_FROM_OS_ERROR(-ret);
+  }
+  return APR_SUCCESS;
+}
+
+unsigned int tftp_uring_reap (struct tftp_uring *uring)
+{
+  struct io_uring_cqe *cqe;
+  struct tftp_uring_op *op;
+  unsigned int count = 0;
+  int res;
+
+  // entry is released before handler runs, handler may queue new ones
+  while (io_uring_peek_cqe (&uring->ring, &cqe) == 0) {
+    op = io_uring_cqe_get_data (cqe);
+    res = cqe->res;
+    io_uring_cqe_seen (&uring->ring, cqe);
+    if (op) {
+      op->complete (op, res);
+    }
+    count++;
+  }
+  return count;
+}
+
+int tftp_uring_buf_register (struct tftp_uring *uring, void *buf, apr_size_t len)
+{
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+  struct iovec iov = { buf, len };
+  __u64 tag = 0;
+  int index;
+
+  if (uring->nbufs == 0) {
+    return -1;
+  }
+  index = uring->bufs[--uring->nbufs];
+  if (io_uring_register_buffers_update_tag (&uring->ring, index, &iov, &tag, 1) != 1) {
+    uring->nbufs++;
+    return -1;
+  }
+  return index;
+#else
+  return -1;
+#endif
+}
+
+void tftp_uring_buf_unregister (struct tftp_uring *uring, int index)
+{
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+  struct iovec iov = { NULL, 0 };
+  __u64 tag = 0;
+
+  if (index < 0) {
+    return;
+  }
+  io_uring_register_buffers_update_tag (&uring->ring, index, &iov, &tag, 1);
+  uring->bufs[uring->nbufs++] = index;
+#endif
+}
+
+#else /* HAVE_LIBURING */
+
+apr_status_t tftp_uring_create (struct tftp_uring **new, apr_pool_t *mp, apr_uint32_t size)
+{
+  DBG("System does not support io_uring.");
+  return APR_ENOTIMPL;
+}
+
+apr_file_t *tftp_uring_file (struct tftp_uring *uring)
+{
+  return NULL;
+}
+
+struct io_uring_sqe *tftp_uring_sqe (struct tftp_uring *uring)
+{
+  return NULL;
+}
+
+void tftp_uring_queue (struct tftp_uring *uring, struct io_uring_sqe *sqe,
+                       struct tftp_uring_op *op, struct tftp_uring_chain *chain)
+{
+}
+
+void tftp_uring_reserve (struct tftp_uring *uring, unsigned int count)
+{
+}
+
+unsigned long tftp_uring_gen (struct tftp_uring *uring)
+{
+  return 0;
+}
+
+apr_status_t tftp_uring_submit (struct tftp_uring *uring)
+{
+  return APR_ENOTIMPL;
+}
+
+unsigned int tftp_uring_reap (struct tftp_uring *uring)
+{
+  return 0;
+}
+
+int tftp_uring_buf_register (struct tftp_uring *uring, void *buf, apr_size_t len)
+{
+  return -1;
+}
+
+void tftp_uring_buf_unregister (struct tftp_uring *uring, int index)
+{
+}
+
+#endif /* HAVE_LIBURING */
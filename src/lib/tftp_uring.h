@@ -0,0 +1,146 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftp_uring.h
+ * @brief TFTP protocol library.
+ * io_uring engine shared by transfers of one event loop.
+ *
+ * Transfers queue socket and file operations to the ring of the loop
+ * and the loop submits all of them with one system call per poll.
+ * Operations of one machine step are linked, so file write, ACK and
+ * next receive into the same buffer run in order. Completions are
+ * signaled by ring descriptor, which is polled by the loop pollset
+ * together with wakeup pipe (see tftp_loop.h). When system does not
+ * support io_uring, tftp_uring_create fails and loop uses epoll.
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+
+#ifndef __TFTP_URING_H
+#define __TFTP_URING_H
+
+#include <apr_general.h>
+#include <apr_file_io.h>
+
+/*! io_uring engine. */
+struct tftp_uring;
+
+/*! Submission queue entry (see liburing.h) */
+struct io_uring_sqe;
+
+/**
+ * Queued operation. Completion handler is called with operation result:
+ * number of bytes or negative errno.
+ */
+struct tftp_uring_op {
+  void (*complete)(struct tftp_uring_op *op, int res); /*!< Completion handler. */
+  void *baton;                                          /*!< Handler argument. */
+};
+
+/**
+ * Chain of linked operations. Operation queued to chain starts only
+ * when previous one is completed. Chain does not outlive submission.
+ */
+struct tftp_uring_chain {
+  struct io_uring_sqe *last;  /*!< Last queued operation. */
+  unsigned long       gen;    /*!< Submission of the last operation. */
+};
+
+/**
+ * Create io_uring engine. Ring is released with memory pool.
+ * @param uring Created engine
+ * @param mp    APR memory pool
+ * @param size  Maximal number of transfers
+ * @return APR status. APR_ENOTIMPL if system has no io_uring.
+ */
+apr_status_t tftp_uring_create (struct tftp_uring **uring, apr_pool_t *mp, apr_uint32_t size);
+
+/**
+ * Ring descriptor. Readable when completions are waiting.
+ * @param uring Engine
+ * @return File structure for pollset
+ */
+apr_file_t *tftp_uring_file (struct tftp_uring *uring);
+
+/**
+ * Get free submission queue entry. Queue is submitted when it is full.
+ * @param uring Engine
+ * @return Entry or NULL.
+ */
+struct io_uring_sqe *tftp_uring_sqe (struct tftp_uring *uring);
+
+/**
+ * Queue prepared entry.
+ * @param uring Engine
+ * @param sqe   Entry prepared with io_uring_prep_* functions
+ * @param op    Completion handler
+ * @param chain Chain to link entry to or NULL
+ */
+void tftp_uring_queue (struct tftp_uring *uring, struct io_uring_sqe *sqe,
+                       struct tftp_uring_op *op, struct tftp_uring_chain *chain);
+
+/**
+ * Make sure that next count entries are submitted together.
+ * Submits queue if there is not enough room.
+ * @param uring Engine
+ * @param count Number of entries
+ */
+void tftp_uring_reserve (struct tftp_uring *uring, unsigned int count);
+
+/**
+ * Submissions counter. Entries queued while counter is the same are
+ * not submitted yet and memory they point to is not read by kernel.
+ * @param uring Engine
+ * @return Number of submissions
+ */
+unsigned long tftp_uring_gen (struct tftp_uring *uring);
+
+/**
+ * Submit queued entries.
+ * @param uring Engine
+ * @return APR status
+ */
+apr_status_t tftp_uring_submit (struct tftp_uring *uring);
+
+/**
+ * Call handlers of completed operations. Never blocks.
+ * @param uring Engine
+ * @return Number of completed operations.
+ */
+unsigned int tftp_uring_reap (struct tftp_uring *uring);
+
+/**
+ * Register buffer for fixed file operations.
+ * @param uring Engine
+ * @param buf   Buffer
+ * @param len   Buffer length
+ * @return Buffer index or -1 if buffer can not be registered.
+ */
+int tftp_uring_buf_register (struct tftp_uring *uring, void *buf, apr_size_t len);
+
+/**
+ * Release registered buffer index.
+ * @param uring Engine
+ * @param index Buffer index
+ */
+void tftp_uring_buf_unregister (struct tftp_uring *uring, int index);
+
+#endif
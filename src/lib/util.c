@@ -36,6 +36,64 @@ static const apr_getopt_option_t options[] = {
   { "get",      'g',  FALSE,  "Get file from remote tftp server."     },
   { "mode",     'm',  TRUE,   "Transfer mode. Value: octet or ascii. "
                               "If not set, then default is 'ascii'."  },
+  { "blksize",  'b',  TRUE,   "Block size in bytes (RFC2348). Value: 8-65464. "
+                              "If not set, then default is 512."      },
+  { "windowsize", 'w', TRUE,  "Number of blocks per ACK (RFC7440). Value: 1-65535. "
+                              "If not set, then default is 1."        },
+  { "timeout",  't',  TRUE,   "Retransmission timeout in seconds (RFC2349), fixed once server "
+                              "acknowledges it. Value: 1-255. If not set, then timeout is "
+                              "estimated starting from 1 and option is not sent."},
+  { "retries",  'r',  TRUE,   "Maximal retransmissions of the same packet. "
+                              "If not set, then default is 5."        },
+  { "rollover", 'R',  TRUE,   "Block number after 65535. Value: 0 or 1. "
+                              "If not set, then default is 0."        },
+  { "multicast", 'c', FALSE,  "Get file from multicast group of server (RFC2090). Octet mode only."},
+  { "tsize",    's',  FALSE,  "Ask server for file size or tell it size of put file (RFC2349). "
+                              "If not set, then option is sent only with other options "
+                              "or with direct I/O."                   },
+  { "manifest", 'M',  TRUE,   "Batch mode. Transfer files listed in manifest file, "
+                              "one 'get|put HOST REMOTE_FILE [LOCAL_FILE]' per line. "
+                              "Value: file name or '-' for stdin."  },
+  { "jobs",     'j',  TRUE,   "Maximal concurrent transfers in batch mode. "
+                              "If not set, then default is 16."       },
+  { "threads",  'T',  TRUE,   "Worker threads in batch mode, one event loop each. "
+                              "If not set, then default is 1."        },
+  { "io",       'i',  TRUE,   "Datagram I/O. Value: mmsg, gso, uring or apr. 'gso' adds UDP "
+                              "segmentation/receive offload to 'mmsg' for windowed transfers. "
+                              "'uring' runs socket and file I/O of all transfers through io_uring. "
+                              "If not set, then default is 'mmsg' when system supports it."},
+  { "direct",   'D',  FALSE,  "Write received file with direct I/O, bypassing page cache."},
+  { "verbose",  'v',  FALSE,  "Print additional infomation during transfer."},
+  { "debug",    'd',  FALSE,  "Print lots of debug data."             },
+  { "version",  'V',  FALSE,  "Print version."                        },
+  /* sentinel */
+  { NULL, 0, 0, NULL },
+};
+
+static const apr_getopt_option_t server_options[] = {
+  { "help",     'h',  FALSE,  "Print usage and breif help message."   },
+  { "address",  'a',  TRUE,   "Listening IP address. Default: 0.0.0.0." },
+  { "port",     'P',  TRUE,   "Listening port. Default: 69."          },
+  { "upload",   'u',  FALSE,  "Allow clients to write files (WRQ). Existing files are overwritten." },
+  { "blksize",  'b',  TRUE,   "Maximal block size in bytes (RFC2348). Value: 8-65464. "
+                              "If not set, then default is 65464."    },
+  { "windowsize", 'w', TRUE,  "Maximal number of blocks per ACK (RFC7440). Value: 1-65535. "
+                              "If not set, then default is 64."       },
+  { "timeout",  't',  TRUE,   "Initial retransmission timeout in seconds when client does not "
+                              "request it (RFC2349). Value: 1-255. If not set, then default is 1."},
+  { "retries",  'r',  TRUE,   "Maximal retransmissions of the same packet. "
+                              "If not set, then default is 5."        },
+  { "rollover", 'R',  TRUE,   "Block number after 65535. Value: 0 or 1. "
+                              "If not set, then default is 0."        },
+  { "jobs",     'j',  TRUE,   "Maximal concurrent transfers. "
+                              "If not set, then default is 16."       },
+  { "cache",    'c',  TRUE,   "Memory of prebuilt DATA packets of served files in megabytes. "
+                              "Value: 0 disables cache. If not set, then default is 256."},
+  { "multicast", 'g', TRUE,   "Send files to clients asking for multicast (RFC2090) to group "
+                              "'addr:port'. Concurrent files use ports from port to port+jobs-1."},
+  { "io",       'i',  TRUE,   "Datagram I/O. Value: mmsg, gso, uring or apr. "
+                              "If not set, then default is 'mmsg' when system supports it."},
+  { "direct",   'D',  FALSE,  "Write received file with direct I/O, bypassing page cache."},
   { "verbose",  'v',  FALSE,  "Print additional infomation during transfer."},
   { "debug",    'd',  FALSE,  "Print lots of debug data."             },
   { "version",  'V',  FALSE,  "Print version."                        },
@@ -49,6 +107,92 @@ char *file_action_str[] = {"GET", "PUT"};
 static bool verbose = FALSE;
 static bool debug   = FALSE;
 
+/**
+ * Parse option shared by client and server.
+ * @param params  TFTP command parameters.
+ * @param optch   Option character.
+ * @param optarg  Option value.
+ * @return APR status. APR_BADARG on invalid value, APR_NOTFOUND if option is not shared.
+ */
+static apr_status_t parse_transfer_opt (struct tftp_params *params, int optch, const char *optarg)
+{
+  char *endptr;
+  long blksize;
+  long windowsize;
+  long timeout;
+  long retries;
+  long rollover;
+
+  switch (optch) {
+    case 'b':               // set block size option
+      blksize = strtol(optarg, &endptr, 10);
+      if (*endptr != '\0' || blksize < BLKSIZE_MIN || blksize > BLKSIZE_MAX) {
+        ERR("Invalid block size: %s", optarg);
+        return APR_BADARG;
+      }
+      params->blksize = blksize;
+      break;
+    case 'w':               // set window size option
+      windowsize = strtol(optarg, &endptr, 10);
+      if (*endptr != '\0' || windowsize < 1 || windowsize > WINDOWSIZE_MAX) {
+        ERR("Invalid window size: %s", optarg);
+        return APR_BADARG;
+      }
+      params->windowsize = windowsize;
+      break;
+    case 'R':               // set block number rollover
+      rollover = strtol(optarg, &endptr, 10);
+      if (*endptr != '\0' || rollover < 0 || rollover > 1) {
+        ERR("Invalid rollover: %s", optarg);
+        return APR_BADARG;
+      }
+      params->rollover = rollover;
+      break;
+    case 't':               // set retransmission timeout
+      timeout = strtol(optarg, &endptr, 10);
+      if (*endptr != '\0' || timeout < 1 || timeout > 255) {
+        ERR("Invalid timeout: %s", optarg);
+        return APR_BADARG;
+      }
+      params->timeout = timeout;
+      break;
+    case 'r':               // set retransmissions limit
+      retries = strtol(optarg, &endptr, 10);
+      if (*endptr != '\0' || retries < 0) {
+        ERR("Invalid retries: %s", optarg);
+        return APR_BADARG;
+      }
+      params->retries = retries;
+      break;
+    case 'i':               // set datagram I/O
+      if (apr_strnatcasecmp (optarg, "mmsg") == 0) {
+        params->io_mode = IO_MMSG;
+      } else if (apr_strnatcasecmp (optarg, "apr") == 0) {
+        params->io_mode = IO_APR;
+      } else if (apr_strnatcasecmp (optarg, "gso") == 0) {
+        params->io_mode = IO_GSO;
+      } else if (apr_strnatcasecmp (optarg, "uring") == 0) {
+        params->io_mode = IO_URING;
+      } else {
+        ERR("Invalid I/O: %s", optarg);
+        return APR_BADARG;
+      }
+      break;
+    case 'D':               // enable direct I/O
+      params->direct = TRUE;
+      break;
+    case 'v':               // enable verbosity
+      verbose = TRUE;
+      break;
+    case 'd':               // enable debug output
+      debug = TRUE;
+      break;
+    default:
+      return APR_NOTFOUND;
+  }
+  return APR_SUCCESS;
+}
+
 apr_status_t parse_args (apr_pool_t *mp, struct tftp_params *params, int argc, const char **argv)
 {
   apr_status_t rv;
@@ -57,11 +201,28 @@ apr_status_t parse_args (apr_pool_t *mp, struct tftp_params *params, int argc, c
   const char *optarg;
   char *endptr;
   unsigned int port = 0;
+  long jobs;
+  long threads;
 
   // Init default parameters
   params->port = TFTP_PORT;
   params->action = GET;
   params->mode = E_ASCII;
+  params->blksize = DATA_SIZE;
+  params->windowsize = 1;
+  params->timeout = 0;
+  params->retries = TFTP_RETRIES;
+  params->manifest = NULL;
+  params->jobs = BATCH_JOBS;
+  params->threads = 1;
+  params->io_mode = IO_MMSG;
+  params->direct = FALSE;
+  params->rollover = 0;
+  params->cache_size = 0;
+  params->cache = NULL;
+  params->multicast = FALSE;
+  params->mc_group = NULL;
+  params->tsize = FALSE;
 
   apr_getopt_init(&getopt, mp, argc, argv);
 
@@ -82,6 +243,7 @@ apr_status_t parse_args (apr_pool_t *mp, struct tftp_params *params, int argc, c
           ERR("Invalid port value: %s", optarg);
           return APR_BADARG;
         }
+        params->port = port;
         break;
       case 'p':               // put file to TFTP server
         params->action = PUT;
@@ -89,11 +251,30 @@ apr_status_t parse_args (apr_pool_t *mp, struct tftp_params *params, int argc, c
       case 'g':               // get file from TFTP server
         params->action = GET;
         break;
-      case 'v':               // enable verbosity
-        verbose = TRUE;
+      case 'M':               // set batch manifest file
+        params->manifest = optarg;
+        break;
+      case 'c':               // get file from multicast group
+        params->multicast = TRUE;
         break;
-      case 'd':               // enable debug output
-        debug = TRUE;
+      case 's':               // send transfer size option
+        params->tsize = TRUE;
+        break;
+      case 'j':               // set batch concurrency
+        jobs = strtol(optarg, &endptr, 10);
+        if (*endptr != '\0' || jobs < 1 || jobs > BATCH_JOBS_MAX) {
+          ERR("Invalid jobs: %s", optarg);
+          return APR_BADARG;
+        }
+        params->jobs = jobs;
+        break;
+      case 'T':               // set batch worker threads
+        threads = strtol(optarg, &endptr, 10);
+        if (*endptr != '\0' || threads < 1 || threads > BATCH_THREADS_MAX) {
+          ERR("Invalid threads: %s", optarg);
+          return APR_BADARG;
+        }
+        params->threads = threads;
         break;
       case 'm':               // set transfer mode
         if (apr_strnatcasecmp (optarg, "ascii") == 0) {
@@ -106,13 +287,26 @@ apr_status_t parse_args (apr_pool_t *mp, struct tftp_params *params, int argc, c
         }
         break;
       default:
-        return APR_BADARG;
+        if (parse_transfer_opt (params, optch, optarg) != APR_SUCCESS) {
+          return APR_BADARG;
+        }
         break;
     }
   }
   if (rv != APR_EOF) {
     return rv;
   }
+  // batch mode takes transfers from manifest
+  if (params->manifest) {
+    if (getopt->ind < argc) {
+      for (;getopt->ind < argc; getopt->ind++)
+        ERR("Unknown parameter: %s", getopt->argv[getopt->ind]);
+      return APR_BADARG;
+    }
+    LOG("Batch transfers from manifest %s, %u concurrent in %u threads",
+        params->manifest, params->jobs, params->threads);
+    return APR_SUCCESS;
+  }
   // set host
   if (getopt->ind < argc) {
     params->host = getopt->argv[getopt->ind];
@@ -156,16 +350,119 @@ apr_status_t parse_args (apr_pool_t *mp, struct tftp_params *params, int argc, c
   return APR_SUCCESS;
 }
 
+apr_status_t parse_server_args (apr_pool_t *mp, struct tftp_params *params, const char **root,
+                                bool *upload, int argc, const char **argv)
+{
+  apr_status_t rv;
+  apr_getopt_t *getopt;
+  int optch;
+  const char *optarg;
+  char *endptr;
+  long port;
+  long jobs;
+  long cache;
+
+  // Init default parameters
+  params->host = "0.0.0.0";
+  params->port = TFTP_PORT;
+  params->blksize = BLKSIZE_MAX;
+  params->windowsize = SERVER_WINDOWSIZE;
+  params->timeout = TFTP_TIMEOUT;
+  params->retries = TFTP_RETRIES;
+  params->manifest = NULL;
+  params->jobs = BATCH_JOBS;
+  params->threads = 1;
+  params->io_mode = IO_MMSG;
+  params->direct = FALSE;
+  params->rollover = 0;
+  params->cache_size = (apr_size_t)SERVER_CACHE_MB << 20;
+  params->cache = NULL;
+  params->multicast = FALSE;
+  params->mc_group = NULL;
+  params->tsize = FALSE;
+  *upload = FALSE;
+
+  apr_getopt_init(&getopt, mp, argc, argv);
+
+  while ((rv = apr_getopt_long(getopt, server_options, &optch, &optarg)) == APR_SUCCESS) {
+    switch (optch) {
+      case 'V':               // print version and exit
+        copyright ();
+        return 1;
+      case 'h':               // print usage/help and exit
+        server_usage ();
+        return 1;
+      case 'a':               // set listening address
+        params->host = optarg;
+        break;
+      case 'P':               // set listening port
+        port = strtol(optarg, &endptr, 10);
+        if (*endptr != '\0' || port < 1 || port > 65535) {
+          ERR("Invalid port value: %s", optarg);
+          return APR_BADARG;
+        }
+        params->port = port;
+        break;
+      case 'u':               // allow WRQ
+        *upload = TRUE;
+        break;
+      case 'j':               // set concurrent transfers
+        jobs = strtol(optarg, &endptr, 10);
+        if (*endptr != '\0' || jobs < 1 || jobs > BATCH_JOBS_MAX) {
+          ERR("Invalid jobs: %s", optarg);
+          return APR_BADARG;
+        }
+        params->jobs = jobs;
+        break;
+      case 'c':               // set cache memory
+        cache = strtol(optarg, &endptr, 10);
+        if (*endptr != '\0' || cache < 0 || cache > 1048576) {
+          ERR("Invalid cache size: %s", optarg);
+          return APR_BADARG;
+        }
+        params->cache_size = (apr_size_t)cache << 20;
+        break;
+      case 'g':               // set multicast group
+        params->mc_group = optarg;
+        break;
+      default:
+        if (parse_transfer_opt (params, optch, optarg) != APR_SUCCESS) {
+          return APR_BADARG;
+        }
+        break;
+    }
+  }
+  if (rv != APR_EOF) {
+    return rv;
+  }
+  // set root directory
+  if (getopt->ind < argc) {
+    *root = getopt->argv[getopt->ind];
+    getopt->ind++;
+  } else {
+    ERR("Missing root directory.");
+    return APR_BADARG;
+  }
+  if (getopt->ind < argc) {
+    for (;getopt->ind < argc; getopt->ind++)
+      ERR("Unknown parameter: %s", getopt->argv[getopt->ind]);
+    return APR_BADARG;
+  }
+
+  return APR_SUCCESS;
+}
+
 void log_print(char *file, int line, enum loglvl level, char *fmt, ...)
 {
   va_list args;
+  if ((level == DEBUG && !debug) || (level == LOG && !verbose)) return;
+  // keep message lines whole when logging from worker threads
+  flockfile(stdout);
   switch (level) {
     case DEBUG:
-      if (!debug) return;
       printf("[DEBUG] %s:%d: ", file, line);
       break;
     case LOG:
-      if (!verbose) return;
       printf("[INFO]  ");
       break;
     case ERROR:
@@ -176,6 +473,7 @@ void log_print(char *file, int line, enum loglvl level, char *fmt, ...)
   vprintf(fmt, args);
   va_end(args);
   printf("\n");
+  funlockfile(stdout);
 }
 
 
@@ -183,6 +481,7 @@ void usage ()
 {
   const apr_getopt_option_t *opts = options;
   printf("Usage: " PACKAGE " [OPTION] HOST REMOTE_FILE [LOCAL_FILE]\n");
+  printf("       " PACKAGE " [OPTION] --manifest FILE\n");
   printf("Get file from TFTP server or put file to TFTP server.\n");
   printf("HOST        - Hostname or IP address of TFTP server.\n");
   printf("REMOTE_FILE - Source file. When  getting  file, then  it is  remote  file name.\n");
@@ -190,6 +489,30 @@ void usage ()
   printf("LOCAL_FILE  - Destination file. When  getting file, then it is  local file name\n");
   printf("              or path where to copy  file from  TFTP server. When  sending file\n");
   printf("              to remote server, this is name of file to store on remote server.\n");
+  printf("FILE        - Manifest with one transfer per line: get|put HOST REMOTE_FILE [LOCAL_FILE].\n");
+  printf("              Empty lines and lines starting with '#' are ignored.\n");
+  printf("\n");
+  printf("Mandatory arguments to long options are mandatory for short options too.\n");
+  printf("\n");
+  printf("Options:\n");
+  while (opts->optch != 0) {
+    printf("  -%c, --%s ", opts->optch, opts->name);
+    if (opts->has_arg) printf("[VALUE]");
+    printf("\n");
+    printf("        %s\n", opts->description);
+    opts++;
+  }
+
+  printf("\n");
+  copyright();
+}
+
+void server_usage ()
+{
+  const apr_getopt_option_t *opts = server_options;
+  printf("Usage: tftpd [OPTION] ROOT\n");
+  printf("Serve files of directory to TFTP clients.\n");
+  printf("ROOT        - Directory of served files. Clients can not access files outside of it.\n");
   printf("\n");
   printf("Mandatory arguments to long options are mandatory for short options too.\n");
   printf("\n");
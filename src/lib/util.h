@@ -31,6 +31,13 @@
 #include <config.h>
 #include <apr_getopt.h>
 #include "tftp_proto.h"
+#include "tftp_batch.h"
+
+/*! Default maximal window size of server transfers. */
+#define SERVER_WINDOWSIZE 64
+
+/*! Default memory limit of server cache of DATA packets in megabytes. */
+#define SERVER_CACHE_MB 256
 
 /*! @def DBG(..)
  * Print debug message when enabled.
@@ -58,7 +65,8 @@ enum loglvl {DEBUG, LOG, ERROR};
  * @param fmt     Output string format.
  * @param ...     Formatting arguments.
  */
-void log_print (char *file, int line, enum loglvl loglvl, char *fmt, ...);
+void log_print (char *file, int line, enum loglvl loglvl, char *fmt, ...)
+  __attribute__((format(printf, 4, 5)));
 
 /**
  * Parse command line arguments.
@@ -70,11 +78,29 @@ void log_print (char *file, int line, enum loglvl loglvl, char *fmt, ...);
  */
 apr_status_t parse_args (apr_pool_t *mp, struct tftp_params *params, int argc, const char **argv);
 
+/**
+ * Parse command line arguments of server.
+ * @param mp      APR memory pool.
+ * @param params  Listening address and port, limits and defaults of transfers.
+ * @param root    Root directory of served files.
+ * @param upload  Clients may write files.
+ * @param argc    Arguments count.
+ * @param argv    Arguments vector.
+ * @return APR status.
+ */
+apr_status_t parse_server_args (apr_pool_t *mp, struct tftp_params *params, const char **root,
+                                bool *upload, int argc, const char **argv);
+
 /**
  * Print usage help message.
  */
 void usage (void);
 
+/**
+ * Print server usage help message.
+ */
+void server_usage (void);
+
 /**
  * Print version and copyright message.
  */
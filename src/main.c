@@ -26,14 +26,30 @@
  */
 #include "tftp_msg.h"
 #include "tftp_proto.h"
+#include "tftp_loop.h"
+#include "tftp_batch.h"
 #include "util.h"
 
+/**
+ * Keep result of transfer. Event loop destroys machine when it is over.
+ */
+static void transfer_done (struct tftp_machine *machine, void *baton)
+{
+  apr_status_t *result = baton;
+  *result = machine->status;
+}
+
 /**
  * TFTPClient main proc.
  */
 int main(int argc, const char *argv[])
 {
   apr_pool_t *mp;
+  struct tftp_machine *machine;
+  struct tftp_loop *loop;
+  struct tftp_batch *batch;
+  apr_status_t result = APR_EINCOMPLETE;
+  int status = 0;
 
   apr_initialize();
   apr_pool_create(&mp, NULL);
@@ -45,18 +61,47 @@ int main(int argc, const char *argv[])
     goto done;
   }
 
+  if (params.manifest) {
+    DBG("Run batch transfers from %s.", params.manifest);
+    if (tftp_batch_create (&batch, mp, params.jobs, params.threads) != APR_SUCCESS ||
+        tftp_batch_load (batch, params.manifest, &params) != APR_SUCCESS) {
+      ERR("Failed to load manifest %s.", params.manifest);
+      status = 1;
+      goto done;
+    }
+    if (tftp_batch_run (batch) != APR_SUCCESS) {
+      status = 1;
+    }
+    tftp_batch_report (batch);
+    goto done;
+  }
+
+  if (tftp_loop_create (&loop, mp, 1) != APR_SUCCESS) {
+    ERR("Failed to create event loop.");
+    status = 1;
+    goto done;
+  }
+
   DBG("Init TFTP protocol machine.");
-  if (tftp_proto_init (mp, &params) != APR_SUCCESS) {
+  if (tftp_proto_create (&machine, mp, &params) != APR_SUCCESS) {
     ERR("Failed to initiate tftp proto.");
+    status = 1;
     goto done;
   }
 
   // running TFTP protocol finit state machine
   DBG("Start TFTP Finit State Machine.");
-  while(tftp_proto_fsm());
+  if (tftp_loop_add (loop, machine, transfer_done, &result) != APR_SUCCESS) {
+    tftp_proto_destroy (machine);
+    status = 1;
+    goto done;
+  }
+  if (tftp_loop_run (loop) != APR_SUCCESS || result != APR_SUCCESS) {
+    status = 1;
+  }
 
 done:
   apr_pool_destroy(mp);
   apr_terminate();
-  return 0;
+  return status;
 }
@@ -0,0 +1,74 @@
+/**
+ * tftpclient -- TFTP client application.
+ * Copyright (C) 2016, Stas Kobzar <staskobzar@modulis.ca>
+ *
+ * This file is part of tftpclient.
+ *
+ * tftpclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * tftpclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tftpclient.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file tftpd.c
+ * @brief tftpd main proc
+ *
+ * @author Stas Kobzar <staskobzar@gmail.com>
+ */
+#include "tftp_proto.h"
+#include "tftp_loop.h"
+#include "tftp_server.h"
+#include "util.h"
+
+/**
+ * TFTP server main proc.
+ */
+int main(int argc, const char *argv[])
+{
+  apr_pool_t *mp;
+  struct tftp_loop *loop;
+  struct tftp_server *server;
+  struct tftp_params params;
+  const char *root;
+  bool upload;
+  int status = 0;
+
+  apr_initialize();
+  apr_pool_create(&mp, NULL);
+
+  if (parse_server_args (mp, &params, &root, &upload, argc, argv) != APR_SUCCESS) {
+    printf("Run \"%s --help\" for options list.\n", argv[0]);
+    goto done;
+  }
+
+  // transfers and listening socket
+  if (tftp_loop_create (&loop, mp, params.jobs + 1) != APR_SUCCESS) {
+    ERR("Failed to create event loop.");
+    status = 1;
+    goto done;
+  }
+
+  if (tftp_server_create (&server, mp, loop, &params, root, upload, params.jobs) != APR_SUCCESS) {
+    ERR("Failed to start server.");
+    status = 1;
+    goto done;
+  }
+
+  if (tftp_server_run (server) != APR_SUCCESS) {
+    status = 1;
+  }
+
+done:
+  apr_pool_destroy(mp);
+  apr_terminate();
+  return status;
+}
@@ -0,0 +1,123 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "tftp_batch.h"
+
+/*
+ * Setup and teardown for batch tests.
+ */
+static int setup(void **state) {
+  apr_pool_t *mp;
+
+  apr_initialize();
+  apr_pool_create(&mp, NULL);
+
+  *state = mp;
+
+  return 0;
+}
+
+static int teardown(void **state) {
+  apr_pool_destroy(*state);
+  apr_terminate();
+  return 0;
+}
+
+/*
+ * Write manifest to temporary file and load it to batch.
+ */
+static apr_status_t load_manifest (struct tftp_batch *batch, apr_pool_t *mp, const char *text)
+{
+  apr_file_t *file;
+  char tmpl[] = "tftp_batch_test_XXXXXX";
+  const char *path;
+  struct tftp_params defaults = {
+    .port = TFTP_PORT,
+    .mode = E_OCTET,
+    .blksize = 1024,
+    .windowsize = 4,
+    .timeout = TFTP_TIMEOUT,
+    .retries = TFTP_RETRIES,
+  };
+  apr_status_t rv;
+
+  assert_int_equal (apr_file_mktemp (&file, tmpl, 0, mp), APR_SUCCESS);
+  apr_file_name_get (&path, file);
+  apr_file_puts (text, file);
+  apr_file_close (file);
+
+  rv = tftp_batch_load (batch, path, &defaults);
+  apr_file_remove (path, mp);
+
+  return rv;
+}
+
+/*
+ * Testing functions.
+ */
+
+/* Test manifest entries, comments and defaults. */
+// ----------------------------------
+static void batch_load_test (void **state)
+{
+  apr_pool_t *mp = *state;
+  struct tftp_batch *batch;
+  struct tftp_batch_entry *entry;
+
+  assert_int_equal (tftp_batch_create (&batch, mp, 4, 1), APR_SUCCESS);
+  assert_int_equal (load_manifest (batch, mp,
+                                   "# firmware images\n"
+                                   "get 10.0.0.1 fw.bin /tmp/fw.bin\n"
+                                   "\n"
+                                   "  PUT\ttftp.local   cfg.txt\r\n"
+                                   "get 10.0.0.1 last.bin"), APR_SUCCESS);
+  assert_int_equal (batch->entries->nelts, 3);
+
+  entry = &APR_ARRAY_IDX(batch->entries, 0, struct tftp_batch_entry);
+  assert_int_equal (entry->line, 2);
+  assert_int_equal (entry->params.action, GET);
+  assert_string_equal (entry->params.host, "10.0.0.1");
+  assert_string_equal (entry->params.remote_file, "fw.bin");
+  assert_string_equal (entry->params.local_file, "/tmp/fw.bin");
+  assert_int_equal (entry->params.blksize, 1024);
+  assert_int_equal (entry->params.windowsize, 4);
+  assert_int_equal (entry->status, APR_EINCOMPLETE);
+
+  entry = &APR_ARRAY_IDX(batch->entries, 1, struct tftp_batch_entry);
+  assert_int_equal (entry->line, 4);
+  assert_int_equal (entry->params.action, PUT);
+  assert_string_equal (entry->params.host, "tftp.local");
+  assert_string_equal (entry->params.remote_file, "cfg.txt");
+  assert_string_equal (entry->params.local_file, "cfg.txt");
+
+  // last line without new line
+  entry = &APR_ARRAY_IDX(batch->entries, 2, struct tftp_batch_entry);
+  assert_string_equal (entry->params.remote_file, "last.bin");
+}
+
+/* Test invalid manifest lines. */
+// ----------------------------------
+static void batch_load_invalid_test (void **state)
+{
+  apr_pool_t *mp = *state;
+  struct tftp_batch *batch;
+
+  assert_int_equal (tftp_batch_create (&batch, mp, 4, 1), APR_SUCCESS);
+  assert_int_equal (load_manifest (batch, mp, "copy 10.0.0.1 fw.bin\n"), APR_BADARG);
+  assert_int_equal (load_manifest (batch, mp, "get 10.0.0.1\n"), APR_BADARG);
+  assert_int_equal (load_manifest (batch, mp, "put 10.0.0.1 a b c\n"), APR_BADARG);
+}
+
+/*
+ * Run all tests.
+ */
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown (batch_load_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (batch_load_invalid_test, setup, teardown),
+  };
+  return cmocka_run_group_tests_name("tftpclient batch manifest tests", tests, NULL, NULL);
+}
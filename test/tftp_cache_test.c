@@ -0,0 +1,172 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "tftp_cache.h"
+
+/*
+ * Cache tests pool and file.
+ */
+static apr_pool_t *mp;
+static apr_file_t *file;
+static char path[] = "/tmp/tftp_cache_XXXXXX";
+
+/*
+ * Append len bytes of pattern to file.
+ */
+static void write_file (apr_size_t len)
+{
+  apr_off_t off = 0;
+  apr_size_t i;
+  char c;
+
+  apr_file_seek (file, APR_END, &off);
+  for (i = off; i < off + len; i++) {
+    c = (char)(i % 251);
+    assert_int_equal (apr_file_putc (c, file), APR_SUCCESS);
+  }
+  apr_file_flush (file);
+}
+
+/*
+ * Setup and teardown for cache tests.
+ */
+static int setup(void **state) {
+  apr_initialize();
+  apr_pool_create(&mp, NULL);
+  strcpy (path, "/tmp/tftp_cache_XXXXXX");
+  return apr_file_mktemp (&file, path, APR_FOPEN_CREATE|APR_FOPEN_READ|APR_FOPEN_WRITE|
+                          APR_FOPEN_DELONCLOSE, mp) != APR_SUCCESS;
+}
+
+static int teardown(void **state) {
+  apr_pool_destroy(mp);
+  apr_terminate();
+  return 0;
+}
+
+/*
+ * Testing functions.
+ */
+
+/* Test file is split to DATA packets as blocks are sent. */
+// ----------------------------------
+static void cache_packets_test (void **state)
+{
+  struct tftp_cache *cache;
+  struct tftp_cache_entry *entry;
+  const char *packet;
+  char data[1024];
+  apr_size_t i;
+
+  write_file (1024);
+  for (i = 0; i < sizeof(data); i++) {
+    data[i] = (char)(i % 251);
+  }
+  assert_int_equal (tftp_cache_create (&cache, mp, 1 << 20), APR_SUCCESS);
+  assert_int_equal (tftp_cache_acquire (&entry, cache, file, path, 512, 0), APR_SUCCESS);
+  // last packet of file of whole blocks is empty
+  assert_int_equal (entry->blocks, 3);
+  assert_int_equal (cache->used, 3 * 516);
+
+  // packets are built in order by the first transfer sending them
+  assert_null (tftp_cache_packet (entry, 1));
+  tftp_cache_fill (entry, 2, data + 512);
+  assert_null (tftp_cache_packet (entry, 2));
+  tftp_cache_fill (entry, 1, data);
+  tftp_cache_fill (entry, 2, data + 512);
+  tftp_cache_fill (entry, 3, data + 1024);
+  assert_int_equal (entry->ready, 3);
+
+  packet = tftp_cache_packet (entry, 2);
+  assert_memory_equal (packet, "\x00\x03\x00\x02", 4);
+  for (i = 0; i < 512; i++) {
+    assert_int_equal ((unsigned char)packet[4 + i], (512 + i) % 251);
+  }
+  assert_memory_equal (tftp_cache_packet (entry, 3), "\x00\x03\x00\x03", 4);
+  tftp_cache_release (entry);
+  assert_int_equal (entry->refs, 0);
+}
+
+/* Test transfers of the same file and block size share entry. */
+// ----------------------------------
+static void cache_hit_test (void **state)
+{
+  struct tftp_cache *cache;
+  struct tftp_cache_entry *entry, *hit, *other;
+
+  write_file (3000);
+  assert_int_equal (tftp_cache_create (&cache, mp, 1 << 20), APR_SUCCESS);
+  assert_int_equal (tftp_cache_acquire (&entry, cache, file, path, 1024, 0), APR_SUCCESS);
+  assert_int_equal (tftp_cache_acquire (&hit, cache, file, path, 1024, 0), APR_SUCCESS);
+  assert_true (entry == hit);
+  assert_int_equal (entry->refs, 2);
+  assert_int_equal (cache->hits, 1);
+  assert_int_equal (cache->misses, 1);
+
+  assert_int_equal (tftp_cache_acquire (&other, cache, file, path, 512, 0), APR_SUCCESS);
+  assert_true (entry != other);
+  assert_int_equal (cache->misses, 2);
+  assert_int_equal (other->blocks, 6);
+}
+
+/* Test not used entries are evicted to fit memory limit. */
+// ----------------------------------
+static void cache_evict_test (void **state)
+{
+  struct tftp_cache *cache;
+  struct tftp_cache_entry *a, *b;
+
+  write_file (4000);
+  // limit fits one entry of 512 or 1024 bytes blocks
+  assert_int_equal (tftp_cache_create (&cache, mp, 6000), APR_SUCCESS);
+  assert_int_equal (tftp_cache_acquire (&a, cache, file, path, 512, 0), APR_SUCCESS);
+  assert_int_equal (tftp_cache_acquire (&b, cache, file, path, 1024, 0), APR_ENOSPC);
+
+  tftp_cache_release (a);
+  assert_int_equal (tftp_cache_acquire (&b, cache, file, path, 1024, 0), APR_SUCCESS);
+  assert_int_equal (cache->evicted, 1);
+  assert_int_equal (cache->used, b->mem);
+
+  // file larger than limit is never cached
+  assert_int_equal (tftp_cache_acquire (&a, cache, file, path, 8, 0), APR_ENOSPC);
+}
+
+/* Test changed file is cached again. */
+// ----------------------------------
+static void cache_stale_test (void **state)
+{
+  struct tftp_cache *cache;
+  struct tftp_cache_entry *old, *entry;
+
+  write_file (1000);
+  assert_int_equal (tftp_cache_create (&cache, mp, 1 << 20), APR_SUCCESS);
+  assert_int_equal (tftp_cache_acquire (&old, cache, file, path, 512, 0), APR_SUCCESS);
+
+  write_file (1000);
+  assert_int_equal (tftp_cache_acquire (&entry, cache, file, path, 512, 0), APR_SUCCESS);
+  assert_true (entry != old);
+  assert_int_equal (entry->size, 2000);
+  assert_int_equal (old->stale, 1);
+  assert_int_equal (cache->misses, 2);
+
+  // transfer of old file keeps its packets until it is over
+  assert_int_equal (old->size, 1000);
+  tftp_cache_release (old);
+  assert_int_equal (cache->used, entry->mem);
+}
+
+/*
+ * Run all tests.
+ */
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown (cache_packets_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (cache_hit_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (cache_evict_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (cache_stale_test, setup, teardown),
+  };
+  return cmocka_run_group_tests_name("tftpclient packet cache tests", tests, NULL, NULL);
+}
@@ -0,0 +1,357 @@
+/*
+ * Packet codec microbenchmarks. Run with "make bench".
+ * Every case is repeated until it runs at least BENCH_TIME and
+ * reported as one JSON object per line:
+ * {"rev":"...","case":"read_data","size":512,"iters":N,"ns":x,"mbps":y}
+ * size is bytes processed by one call, mbps is MB/s of size.
+ * Results of two commits can be compared line by line with case and size.
+ * Packet files given after revision are parsed in turn as "read_corpus",
+ * size is their average length.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <apr_general.h>
+#include <apr_file_io.h>
+#include <apr_time.h>
+
+#include "tftp_msg.h"
+
+/*! Minimal run time of every case. */
+#define BENCH_TIME apr_time_from_msec(200)
+
+/*! Payload sizes: RFC1350, Ethernet MTU, jumbo and maximal block. */
+static const apr_size_t sizes[] = { DATA_SIZE, 1428, 8192, BLKSIZE_MAX };
+
+/*
+ * Benchmark case. Runs its function n times.
+ */
+struct bench {
+  const char  *name;      /* Case name. */
+  apr_size_t  size;       /* Bytes processed by one call. */
+  char        *src;       /* Input. */
+  apr_size_t  len;        /* Input length. */
+  char        *dst;       /* Output buffer. */
+  apr_pool_t  *mp;        /* Memory pool of parser. */
+  char        **corpus;   /* Recorded packets. */
+  apr_size_t  *corpus_len;  /* Recorded packets length. */
+  unsigned int count;     /* Number of recorded packets. */
+  apr_size_t  (*run)(struct bench *b, unsigned long n);
+};
+
+/* Result of calls, so compiler can not drop them. */
+static volatile apr_size_t sink;
+
+static apr_size_t run_read (struct bench *b, unsigned long n)
+{
+  apr_size_t sum = 0;
+  tftp_pack *pack;
+
+  while (n--) {
+    pack = tftp_packet_read (b->src, b->len, b->mp);
+    sum += pack->opcode;
+    apr_pool_clear (b->mp);
+  }
+  return sum;
+}
+
+static apr_size_t run_corpus (struct bench *b, unsigned long n)
+{
+  apr_size_t sum = 0;
+  tftp_pack *pack;
+
+  while (n--) {
+    pack = tftp_packet_read (b->corpus[n % b->count], b->corpus_len[n % b->count], b->mp);
+    sum += pack ? pack->opcode : 0;
+    apr_pool_clear (b->mp);
+  }
+  return sum;
+}
+
+static apr_size_t run_view (struct bench *b, unsigned long n)
+{
+  struct tftp_packet_view view;
+  apr_size_t sum = 0;
+
+  while (n--) {
+    sum += tftp_packet_view_read (&view, b->src, b->len)->block;
+  }
+  return sum;
+}
+
+static apr_size_t run_create_data (struct bench *b, unsigned long n)
+{
+  struct pack_data data = { .block = 1, .data = b->src, .length = b->len };
+  apr_size_t sum = 0;
+
+  while (n--) {
+    sum += tftp_create_data (b->dst, &data);
+  }
+  return sum;
+}
+
+static apr_size_t run_create_ack (struct bench *b, unsigned long n)
+{
+  apr_size_t sum = 0;
+
+  while (n--) {
+    sum += tftp_create_ack (b->dst, n & 0xffff);
+  }
+  return sum;
+}
+
+static apr_size_t run_create_error (struct bench *b, unsigned long n)
+{
+  struct pack_error error = { .ercode = ERR_NOTFOUND, .msg = b->src, .msg_len = b->len };
+  apr_size_t sum = 0;
+
+  while (n--) {
+    sum += tftp_create_error (b->dst, &error);
+  }
+  return sum;
+}
+
+static apr_size_t run_create_rrq (struct bench *b, unsigned long n)
+{
+  struct pack_rq rq = {
+    .filename = b->src, .len_filename = b->len,
+    .mode = MODE_OCTET, .len_mode = sizeof(MODE_OCTET) - 1, .e_mode = E_OCTET,
+    .opts = { .blksize = 1428, .windowsize = 16, .has_tsize = 1 }
+  };
+  apr_size_t sum = 0;
+
+  while (n--) {
+    sum += tftp_create_rrq (b->dst, &rq);
+  }
+  return sum;
+}
+
+/* Conversion is in place, so input is copied every time. See "copy" case. */
+static apr_size_t run_ntoh (struct bench *b, unsigned long n)
+{
+  apr_size_t sum = 0;
+
+  while (n--) {
+    memcpy (b->dst, b->src, b->len);
+    sum += tftp_str_ntoh (b->dst, b->len);
+  }
+  return sum;
+}
+
+static apr_size_t run_hton (struct bench *b, unsigned long n)
+{
+  apr_size_t sum = 0;
+
+  while (n--) {
+    sum += tftp_str_hton (b->dst, b->src, b->len);
+  }
+  return sum;
+}
+
+static apr_size_t run_copy (struct bench *b, unsigned long n)
+{
+  apr_size_t sum = 0;
+
+  while (n--) {
+    memcpy (b->dst, b->src, b->len);
+    sum += b->dst[n % b->len];
+  }
+  return sum;
+}
+
+/*
+ * Run case with doubling number of calls until it takes BENCH_TIME
+ * and print result.
+ */
+static void bench_run (FILE *out, const char *rev, struct bench *b)
+{
+  unsigned long n = 1;
+  apr_time_t start, elapsed;
+  double ns;
+
+  b->run (b, 1000); // warm up caches and branch predictors
+  for (;;) {
+    start = apr_time_now ();
+    sink += b->run (b, n);
+    elapsed = apr_time_now () - start;
+    if (elapsed >= BENCH_TIME) {
+      break;
+    }
+    n *= 2;
+  }
+  ns = (double)elapsed * 1000 / n;
+  fprintf (out, "{\"rev\":\"%s\",\"case\":\"%s\",\"size\":%" APR_SIZE_T_FMT
+           ",\"iters\":%lu,\"ns\":%.1f,\"mbps\":%.1f}\n",
+           rev, b->name, b->size, n, ns, b->size * 1e3 / ns);
+}
+
+/*
+ * Read recorded packets from files.
+ */
+static apr_status_t corpus_load (struct bench *b, int argc, const char *argv[], apr_pool_t *mp)
+{
+  apr_finfo_t finfo;
+  apr_file_t *file;
+  apr_status_t rv;
+  int i;
+
+  b->count = argc;
+  b->corpus = apr_palloc (mp, argc * sizeof(char *));
+  b->corpus_len = apr_palloc (mp, argc * sizeof(apr_size_t));
+  b->size = 0;
+  for (i = 0; i < argc; i++) {
+    rv = apr_file_open (&file, argv[i], APR_FOPEN_READ|APR_FOPEN_BINARY, 0, mp);
+    if (rv != APR_SUCCESS) {
+      fprintf (stderr, "Failed to open %s\n", argv[i]);
+      return rv;
+    }
+    apr_file_info_get (&finfo, APR_FINFO_SIZE, file);
+    b->corpus_len[i] = finfo.size;
+    b->corpus[i] = apr_palloc (mp, finfo.size + 1);
+    rv = apr_file_read_full (file, b->corpus[i], finfo.size, NULL);
+    apr_file_close (file);
+    if (rv != APR_SUCCESS) {
+      return rv;
+    }
+    b->size += finfo.size;
+  }
+  b->size /= argc;
+  return APR_SUCCESS;
+}
+
+/*
+ * Text of len bytes with line ends every 64 characters.
+ */
+static void fill_text (char *buf, apr_size_t len, const char *eol)
+{
+  apr_size_t i;
+
+  for (i = 0; i < len; i++) {
+    buf[i] = 'a' + i % 26;
+    if (i % 64 == 63) {
+      buf[i] = *eol;
+      if (eol[1] && i + 1 < len) {
+        buf[++i] = eol[1];
+      }
+    }
+  }
+}
+
+int main (int argc, const char *argv[])
+{
+  const char *rev = argc > 1 ? argv[1] : "unknown";
+  FILE *out = stdout;
+  apr_pool_t *mp;
+  struct bench b;
+  struct tftp_opts opts = { .blksize = 1428, .windowsize = 16, .timeout = 1,
+                            .tsize = 5000000000LL, .has_tsize = 1 };
+  struct pack_rq rq = {
+    .filename = "images/firmware-v2.bin", .len_filename = 22,
+    .mode = MODE_OCTET, .len_mode = sizeof(MODE_OCTET) - 1, .e_mode = E_OCTET,
+    .opts = { .blksize = 1428, .windowsize = 16, .has_tsize = 1 }
+  };
+  struct pack_error error = { .ercode = ERR_NOTFOUND, .msg = "File not found", .msg_len = 14 };
+  struct pack_data data = { .block = 1 };
+  char *src, *pkt, *dst, *text, *crlf;
+  unsigned int i;
+
+  apr_initialize ();
+  apr_pool_create (&mp, NULL);
+  memset (&b, 0, sizeof(b));
+  apr_pool_create (&b.mp, mp);
+
+  src = apr_palloc (mp, BLKSIZE_MAX + 4);
+  pkt = apr_palloc (mp, BLKSIZE_MAX + 4);
+  dst = apr_palloc (mp, 2 * BLKSIZE_MAX + 4);
+  text = apr_palloc (mp, BLKSIZE_MAX);
+  crlf = apr_palloc (mp, BLKSIZE_MAX);
+  memset (src, 'x', BLKSIZE_MAX);
+  fill_text (text, BLKSIZE_MAX, "\n");
+  fill_text (crlf, BLKSIZE_MAX, "\r\n");
+  fprintf (stderr, "netascii kernel: %s\n", tftp_netascii_simd ());
+
+  // parser: recorded packets, every opcode, DATA for every size
+  if (argc > 2) {
+    if (corpus_load (&b, argc - 2, argv + 2, mp) != APR_SUCCESS) {
+      return 1;
+    }
+    b.name = "read_corpus";
+    b.run = run_corpus;
+    bench_run (out, rev, &b);
+  }
+  b.src = pkt;
+  b.run = run_read;
+  b.name = "read_rrq";
+  b.size = b.len = tftp_create_rrq (pkt, &rq);
+  bench_run (out, rev, &b);
+  b.name = "read_wrq";
+  b.size = b.len = tftp_create_wrq (pkt, &rq);
+  bench_run (out, rev, &b);
+  b.name = "read_ack";
+  b.size = b.len = tftp_create_ack (pkt, 1234);
+  bench_run (out, rev, &b);
+  b.name = "read_error";
+  b.size = b.len = tftp_create_error (pkt, &error);
+  bench_run (out, rev, &b);
+  b.name = "read_oack";
+  b.size = b.len = tftp_create_oack (pkt, &opts);
+  bench_run (out, rev, &b);
+  data.data = src;
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    data.length = sizes[i];
+    b.size = b.len = tftp_create_data (pkt, &data);
+    b.name = "read_data";
+    b.run = run_read;
+    bench_run (out, rev, &b);
+    b.name = "view_data";
+    b.run = run_view;
+    bench_run (out, rev, &b);
+  }
+
+  // builders
+  b.dst = dst;
+  b.name = "create_ack";
+  b.run = run_create_ack;
+  b.size = b.len = 4;
+  bench_run (out, rev, &b);
+  b.name = "create_error";
+  b.run = run_create_error;
+  b.src = error.msg;
+  b.len = error.msg_len;
+  b.size = b.len + 5;
+  bench_run (out, rev, &b);
+  b.name = "create_rrq";
+  b.run = run_create_rrq;
+  b.src = rq.filename;
+  b.len = rq.len_filename;
+  b.size = tftp_create_rrq (dst, &rq);
+  bench_run (out, rev, &b);
+  b.src = src;
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    b.name = "create_data";
+    b.run = run_create_data;
+    b.size = b.len = sizes[i];
+    bench_run (out, rev, &b);
+  }
+
+  // netascii conversion
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    b.size = b.len = sizes[i];
+    b.name = "copy";
+    b.src = src;
+    b.run = run_copy;
+    bench_run (out, rev, &b);
+    b.name = "ntoh";
+    b.src = crlf;
+    b.run = run_ntoh;
+    bench_run (out, rev, &b);
+    b.name = "hton";
+    b.src = text;
+    b.run = run_hton;
+    bench_run (out, rev, &b);
+  }
+
+  apr_pool_destroy (mp);
+  apr_terminate ();
+  return 0;
+}
@@ -67,6 +67,105 @@ static void create_wrq_pack_test (void **state)
   assert_int_equal (pack->data->rq.e_mode, E_OCTET);
 }
 
+/* Test create RRQ tftp packet with blksize option. */
+// ----------------------------------
+static void create_rrq_opts_pack_test (void **state)
+{
+  char *buf = apr_palloc(*state, DATA_SIZE + 4);
+  struct pack_rq rrq = {
+    .filename = "pxelinux.0",
+    .len_filename = strlen("pxelinux.0"),
+    .mode = MODE_OCTET,
+    .len_mode = strlen(MODE_OCTET),
+    .e_mode = E_OCTET,
+    .opts = { .blksize = 1468 }
+  };
+  apr_size_t len = tftp_create_rrq (buf, &rrq);
+  assert_int_equal (len, 2 + 11 + 6 + 8 + 5);
+  tftp_pack *pack = tftp_packet_read(buf, len, *state);
+  assert_int_equal (pack->opcode, E_RRQ);
+  assert_string_equal (pack->data->rq.filename, "pxelinux.0");
+  assert_int_equal (pack->data->rq.opts.blksize, 1468);
+}
+
+/* Test create OACK tftp packet. */
+// ----------------------------------
+static void create_oack_pack_test (void **state)
+{
+  char *buf = apr_palloc(*state, DATA_SIZE + 4);
+  struct tftp_opts opts = { .blksize = BLKSIZE_MAX, .windowsize = 16 };
+  apr_size_t len = tftp_create_oack (buf, &opts);
+  tftp_pack *pack = tftp_packet_read(buf, len, *state);
+  assert_int_equal (pack->opcode, E_OACK);
+  assert_int_equal (pack->data->oack.opts.blksize, BLKSIZE_MAX);
+  assert_int_equal (pack->data->oack.opts.windowsize, 16);
+}
+
+/* Test create RRQ tftp packet asking for transfer size. */
+// ----------------------------------
+static void create_rrq_tsize_pack_test (void **state)
+{
+  char *buf = apr_palloc(*state, DATA_SIZE + 4);
+  struct pack_rq rrq = {
+    .filename = "pxelinux.0",
+    .len_filename = strlen("pxelinux.0"),
+    .mode = MODE_OCTET,
+    .len_mode = strlen(MODE_OCTET),
+    .e_mode = E_OCTET,
+    .opts = { .has_tsize = 1 }
+  };
+  apr_size_t len = tftp_create_rrq (buf, &rrq);
+  assert_int_equal (len, 2 + 11 + 6 + 6 + 2);
+  tftp_pack *pack = tftp_packet_read(buf, len, *state);
+  assert_int_equal (pack->data->rq.opts.has_tsize, 1);
+  assert_int_equal (pack->data->rq.opts.tsize, 0);
+
+  struct tftp_opts opts = { .tsize = 5000000000LL, .has_tsize = 1 };
+  len = tftp_create_oack (buf, &opts);
+  pack = tftp_packet_read(buf, len, *state);
+  assert_int_equal (pack->opcode, E_OACK);
+  assert_int_equal (pack->data->oack.opts.has_tsize, 1);
+  assert_true (pack->data->oack.opts.tsize == 5000000000LL);
+}
+
+/* Test create RRQ and OACK with multicast option. */
+// ----------------------------------
+static void create_multicast_pack_test (void **state)
+{
+  char *buf = apr_palloc(*state, DATA_SIZE + 4);
+  struct pack_rq rrq = {
+    .filename = "pxelinux.0",
+    .len_filename = strlen("pxelinux.0"),
+    .mode = MODE_OCTET,
+    .len_mode = strlen(MODE_OCTET),
+    .e_mode = E_OCTET,
+    .opts = { .has_multicast = 1 }
+  };
+  apr_size_t len = tftp_create_rrq (buf, &rrq);
+  assert_int_equal (len, 2 + 11 + 6 + 10 + 1);
+  tftp_pack *pack = tftp_packet_read(buf, len, *state);
+  assert_int_equal (pack->data->rq.opts.has_multicast, 1);
+  assert_int_equal (pack->data->rq.opts.mc_port, 0);
+
+  struct tftp_opts opts = { .has_multicast = 1, .mc_addr = "239.255.69.1",
+                            .mc_port = 1758, .mc_master = 1 };
+  len = tftp_create_oack (buf, &opts);
+  pack = tftp_packet_read(buf, len, *state);
+  assert_int_equal (pack->opcode, E_OACK);
+  assert_int_equal (pack->data->oack.opts.has_multicast, 1);
+  assert_string_equal (pack->data->oack.opts.mc_addr, "239.255.69.1");
+  assert_int_equal (pack->data->oack.opts.mc_port, 1758);
+  assert_int_equal (pack->data->oack.opts.mc_master, 1);
+
+  // master change keeps group and port empty
+  struct tftp_opts master = { .has_multicast = 1, .mc_master = 1 };
+  len = tftp_create_oack (buf, &master);
+  assert_memory_equal (buf + 2, "multicast\0,,1", 14);
+  pack = tftp_packet_read(buf, len, *state);
+  assert_int_equal (pack->data->oack.opts.mc_port, 0);
+  assert_int_equal (pack->data->oack.opts.mc_master, 1);
+}
+
 /* Test create DATA tftp packet. */
 // ----------------------------------
 static void create_data_pack_test (void **state)
@@ -84,11 +183,10 @@ static void create_data_pack_test (void **state)
                       "your programs";
   struct pack_data pdata = {
     .block = 12345,
+    .data = (char *)data,
     .length = strlen(data)
   };
 
-  apr_cpystrn(pdata.data, data, pdata.length + 1);
-
   len = tftp_create_data (buf, &pdata);
   pack = tftp_packet_read(buf, len, *state);
   assert_int_equal (pack->opcode, E_DATA);
@@ -96,6 +194,24 @@ static void create_data_pack_test (void **state)
   assert_int_equal (pack->data->data.block, 12345);
 }
 
+/* Test create DATA packet header for data sent from other buffer. */
+// ----------------------------------
+static void create_data_header_test (void **state)
+{
+  char buf[DATA_SIZE + 4];
+  const char data[] = "data from mapped file";
+  apr_size_t len = tftp_create_data_header (buf, 0xabcd);
+  tftp_pack *pack;
+
+  assert_int_equal (len, 4);
+  assert_memory_equal (buf, "\x00\x03\xab\xcd", 4);
+  memcpy (buf + len, data, sizeof(data));
+  pack = tftp_packet_read(buf, len + strlen(data), *state);
+  assert_int_equal (pack->opcode, E_DATA);
+  assert_int_equal (pack->data->data.block, 0xabcd);
+  assert_string_equal (pack->data->data.data, data);
+}
+
 /* Test convert CR, NUL -> CR and CR, LF -> LF in tftp packet. */
 // ----------------------------------
 static void convert_str_ntoh_test (void **state)
@@ -108,7 +224,7 @@ static void convert_str_ntoh_test (void **state)
 
   char *buf = apr_pstrmemdup(*state, str_to_conv, len);
 
-  test_len = tftp_str_ntoh (*state, buf, len);
+  test_len = tftp_str_ntoh (buf, len);
   assert_int_equal (test_len, new_len);
   assert_string_equal (str_to_test, buf);
 }
@@ -123,13 +239,40 @@ static void convert_str_hton_test (void **state)
   apr_size_t new_len = strlen(str_to_test);
   apr_size_t test_len = 0;
 
-  char *buf = apr_pstrmemdup(*state, str_to_conv, len);
+  char *buf = apr_palloc(*state, 2 * len + 1);
 
-  test_len = tftp_str_hton (*state, buf, len);
+  test_len = tftp_str_hton (buf, str_to_conv, len);
   assert_int_equal (test_len, new_len);
   assert_string_equal (str_to_test, buf);
 }
 
+/* Test netascii conversion of long strings with CR, NUL and CR at the end. */
+// ----------------------------------
+static void convert_str_long_test (void **state)
+{
+  char line[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ\n";
+  char host[1024] = "";
+  char *net = apr_palloc(*state, 2 * sizeof(host) + 1);
+  apr_size_t len, net_len, i;
+
+  // line breaks fall on every offset of vector scan
+  for (i = 0; i < 12; i++) {
+    strncat (host, line + i, sizeof(line) - 1 - i);
+  }
+  strcat (host, "end\rCR");
+  len = strlen(host);
+  net_len = tftp_str_hton (net, host, len);
+  assert_int_equal (net_len, len + 13);
+  assert_memory_equal (net + net_len - 7, "end\r\0CR", 7);
+
+  assert_int_equal (tftp_str_ntoh (net, net_len), len);
+  assert_memory_equal (net, host, len);
+
+  strcpy (net, "tail\r");
+  assert_int_equal (tftp_str_ntoh (net, 5), 5);
+  assert_string_equal (net, "tail\r");
+}
+
 
 /* Test create ACK tftp packet. */
 // ----------------------------------
@@ -166,6 +309,121 @@ static void create_error_pack_test (void **state)
   assert_int_equal (pack->data->error.msg_len, msg_len);
 }
 
+/* Test packet builder fields and overflow. */
+// ----------------------------------
+static void build_pack_test (void **state)
+{
+  struct tftp_builder b;
+  char buf[32];
+
+  tftp_build_init (&b, buf, sizeof(buf));
+  tftp_build_u16 (&b, E_OACK);
+  tftp_build_opt (&b, OPT_BLKSIZE, 1428);
+  tftp_build_opt (&b, OPT_TSIZE, 0);
+  assert_int_equal (tftp_build_end (&b), 23);
+  assert_memory_equal (buf, "\0\6blksize\0" "1428\0tsize\0" "0\0", 23);
+
+  // name fits, value 2^64 - 1 does not
+  tftp_build_opt (&b, OPT_TSIZE, 18446744073709551615ULL);
+  assert_int_equal (b.len, 29);
+  assert_int_equal (tftp_build_end (&b), 0);
+
+  tftp_build_init (&b, buf, 3);
+  tftp_build_u16 (&b, E_ACK);
+  tftp_build_u16 (&b, 1);
+  assert_int_equal (b.len, 2);
+  assert_int_equal (tftp_build_end (&b), 0);
+}
+
+/* Test request with too long file name is not created. */
+// ----------------------------------
+static void create_rrq_long_test (void **state)
+{
+  char *buf = apr_palloc(*state, BUF_SIZE);
+  char *filename = apr_palloc(*state, DATA_SIZE);
+  struct pack_rq rrq = {
+    .filename = filename,
+    .len_filename = DATA_SIZE,
+    .mode = MODE_OCTET,
+    .len_mode = strlen(MODE_OCTET),
+    .e_mode = E_OCTET
+  };
+
+  memset (filename, 'a', DATA_SIZE);
+  assert_int_equal (tftp_create_rrq (buf, &rrq), 0);
+  rrq.len_filename = BUF_SIZE - 2 - 1 - strlen(MODE_OCTET) - 1;
+  assert_int_equal (tftp_create_rrq (buf, &rrq), BUF_SIZE);
+}
+
+/* Test streaming netascii conversion with CR at the end of block. */
+// ----------------------------------
+static void convert_stream_test (void **state)
+{
+  struct tftp_netascii na;
+  char block[8];
+  char *data;
+  apr_size_t len, n;
+
+  // CR, LF split between blocks
+  tftp_netascii_init (&na);
+  memcpy (block, "....ab\r", 7);
+  data = block + 4;
+  assert_int_equal (tftp_netascii_decode (&na, &data, 3, 0), 2);
+  memcpy (block, "....\ncd", 7);
+  data = block + 4;
+  assert_int_equal (tftp_netascii_decode (&na, &data, 3, 1), 3);
+  assert_memory_equal (data, "\ncd", 3);
+
+  // bare CR is placed before next block
+  memcpy (block, "....ab\r", 7);
+  data = block + 4;
+  tftp_netascii_decode (&na, &data, 3, 0);
+  memcpy (block, "....xy", 6);
+  data = block + 4;
+  assert_int_equal (tftp_netascii_decode (&na, &data, 2, 1), 3);
+  assert_true (data == block + 3);
+  assert_memory_equal (data, "\rxy", 3);
+
+  // blocks are full after expansion, CR pair is split between blocks
+  tftp_netascii_init (&na);
+  len = 4;
+  n = tftp_netascii_encode (&na, block, 4, "a\nb\n", &len, 1);
+  assert_int_equal (n, 4);
+  assert_memory_equal (block, "a\r\nb", 4);
+  assert_int_equal (len, 3);
+  len = 1;
+  n = tftp_netascii_encode (&na, block, 3, "\n", &len, 1);
+  assert_int_equal (n, 2);
+  assert_memory_equal (block, "\r\n", 2);
+  assert_true (tftp_netascii_idle (&na));
+}
+
+/* Test block number rollover to 0 and to 1. */
+// ----------------------------------
+static void block_rollover_test (void **state)
+{
+  assert_int_equal (tftp_block_wire (1, 0), 1);
+  assert_int_equal (tftp_block_wire (BLOCK_MAX, 0), BLOCK_MAX);
+  assert_int_equal (tftp_block_wire (BLOCK_MAX + 1, 0), 0);
+  assert_int_equal (tftp_block_wire (BLOCK_MAX + 2, 0), 1);
+
+  assert_int_equal (tftp_block_wire (0, 1), 0);
+  assert_int_equal (tftp_block_wire (BLOCK_MAX, 1), BLOCK_MAX);
+  assert_int_equal (tftp_block_wire (BLOCK_MAX + 1, 1), 1);
+  assert_int_equal (tftp_block_wire (2 * BLOCK_MAX + 1, 1), 1);
+
+  // 4GB file with 512 bytes blocks
+  assert_int_equal (tftp_block_wire (8388608, 0), 0);
+  assert_int_equal (tftp_block_delta (8388607, 0, 0), 1);
+
+  assert_int_equal (tftp_block_delta (0, 0, 1), 0);
+  assert_int_equal (tftp_block_delta (0, 1, 1), 1);
+  assert_int_equal (tftp_block_delta (BLOCK_MAX, 1, 1), 1);
+  assert_int_equal (tftp_block_delta (BLOCK_MAX, 0, 1), BLOCK_MAX);
+  assert_int_equal (tftp_block_delta (BLOCK_MAX, 0, 0), 1);
+  assert_int_equal (tftp_block_delta (BLOCK_MAX + 1, BLOCK_MAX, 0), BLOCK_MAX);
+}
+
 /*
  * Run all tests.
  */
@@ -174,11 +432,21 @@ int main(void)
   const struct CMUnitTest tests[] = {
     cmocka_unit_test_setup_teardown (create_rrq_pack_test, setup, teardown),
     cmocka_unit_test_setup_teardown (create_wrq_pack_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (create_rrq_opts_pack_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (create_rrq_tsize_pack_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (create_multicast_pack_test, setup, teardown),
+    cmocka_unit_test (block_rollover_test),
+    cmocka_unit_test_setup_teardown (create_oack_pack_test, setup, teardown),
     cmocka_unit_test_setup_teardown (create_data_pack_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (create_data_header_test, setup, teardown),
     cmocka_unit_test_setup_teardown (create_ack_pack_test, setup, teardown),
     cmocka_unit_test_setup_teardown (create_error_pack_test, setup, teardown),
+    cmocka_unit_test (build_pack_test),
+    cmocka_unit_test_setup_teardown (create_rrq_long_test, setup, teardown),
     cmocka_unit_test_setup_teardown (convert_str_ntoh_test, setup, teardown),
     cmocka_unit_test_setup_teardown (convert_str_hton_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (convert_str_long_test, setup, teardown),
+    cmocka_unit_test (convert_stream_test),
   };
 
   return cmocka_run_group_tests_name("tftpclient library tests", tests, NULL, NULL);
@@ -0,0 +1,99 @@
+/*
+ * Packet parser fuzz target. Run with "make fuzz".
+ * Built with -DTFTP_LIBFUZZER it is libFuzzer target, otherwise it
+ * reads packets from files in arguments or from stdin (AFL).
+ * Packet is copied to buffer of exact length, so address sanitizer
+ * catches any read past the end of received datagram.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <apr_general.h>
+
+#include "tftp_msg.h"
+
+static apr_pool_t *mp;
+
+/*
+ * Slice must point into packet.
+ */
+static void check_slice (const struct tftp_slice *slice, const char *buf, size_t size)
+{
+  if (slice->len && (slice->ptr < buf || slice->ptr + slice->len > buf + size)) {
+    abort ();
+  }
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  struct tftp_packet_view view;
+  tftp_pack *pack;
+  char *buf;
+
+  if (mp == NULL) {
+    apr_initialize ();
+    apr_pool_create (&mp, NULL);
+  }
+  buf = malloc (size ? size : 1);
+  memcpy (buf, data, size);
+
+  if (tftp_packet_view_read (&view, buf, size)) {
+    check_slice (&view.data, buf, size);
+    check_slice (&view.filename, buf, size);
+    check_slice (&view.mode, buf, size);
+    check_slice (&view.msg, buf, size);
+    if (view.opcode == E_DATA && view.data.len != size - 4) {
+      abort ();
+    }
+    if (view.opts.blksize && (view.opts.blksize < BLKSIZE_MIN || view.opts.blksize > BLKSIZE_MAX)) {
+      abort ();
+    }
+  }
+
+  pack = tftp_packet_read (buf, size, mp);
+  if (pack && pack->opcode == E_DATA) {
+    // copy of payload is compared with packet
+    if (memcmp (pack->data->data.data, buf + 4, pack->data->data.length) != 0) {
+      abort ();
+    }
+  }
+  apr_pool_clear (mp);
+  free (buf);
+  return 0;
+}
+
+#ifndef TFTP_LIBFUZZER
+/*
+ * Read whole file.
+ */
+static size_t read_file (FILE *fp, uint8_t *buf, size_t size)
+{
+  size_t len = 0, n;
+
+  while (len < size && (n = fread (buf + len, 1, size - len, fp)) > 0) {
+    len += n;
+  }
+  return len;
+}
+
+int main (int argc, const char *argv[])
+{
+  static uint8_t buf[BLKSIZE_MAX + 4];
+  FILE *fp;
+  int i;
+
+  if (argc < 2) {
+    return LLVMFuzzerTestOneInput (buf, read_file (stdin, buf, sizeof(buf)));
+  }
+  for (i = 1; i < argc; i++) {
+    if ((fp = fopen (argv[i], "rb")) == NULL) {
+      perror (argv[i]);
+      return 1;
+    }
+    LLVMFuzzerTestOneInput (buf, read_file (fp, buf, sizeof(buf)));
+    fclose (fp);
+  }
+  return 0;
+}
+#endif
@@ -59,8 +59,27 @@ char raw_bin_data[] = {0x00,0x03,0x51,0x0f,0xfc,0xd0,0xd4,0xf4,0x14,0x86,0x98,0x
 
 char raw_last_data[] = { 0x00,0x03,0x00,0x03,0x67,0x73,0x2e,0x0a };
 
+char raw_empty_data[] = { 0x00,0x03,0x00,0x80 };
+
 char raw_ack[] = { 0x00,0x04,0x20,0x3d };
 
+/* RRQ "foo.c" octet with options "blksize" 1428 and unknown option "foo" "bar" */
+char raw_rrq_opts[] = {0x00,0x01,0x66,0x6f, 0x6f,0x2e,0x63,0x00, 0x6f,0x63,0x74,0x65,
+                       0x74,0x00,0x62,0x6c, 0x6b,0x73,0x69,0x7a, 0x65,0x00,0x31,0x34,
+                       0x32,0x38,0x00,0x66, 0x6f,0x6f,0x00,0x62, 0x61,0x72,0x00 };
+
+/* OACK "BLKSIZE" 1024 "windowsize" 8 */
+char raw_oack[] = {0x00,0x06,0x42,0x4c, 0x4b,0x53,0x49,0x5a, 0x45,0x00,0x31,0x30,
+                   0x32,0x34,0x00,0x77, 0x69,0x6e,0x64,0x6f, 0x77,0x73,0x69,0x7a,
+                   0x65,0x00,0x38,0x00 };
+
+/* OACK "timeout" 3 with invalid "blksize" 4 */
+char raw_oack_timeout[] = {0x00,0x06,0x74,0x69, 0x6d,0x65,0x6f,0x75, 0x74,0x00,0x33,0x00,
+                           0x62,0x6c,0x6b,0x73, 0x69,0x7a,0x65,0x00, 0x34,0x00 };
+
+/* OACK without options is invalid */
+char raw_empty_oack[] = {0x00,0x06};
+
 char raw_error[] = { 0x00,0x05,0x00,0x01, 0x46,0x69,0x6c,0x65,
                      0x20,0x6e,0x6f,0x74, 0x20,0x66,0x6f,0x75,
                      0x6e,0x64,0x00 };
@@ -164,6 +183,16 @@ static void read_last_data_pack_test (void **state)
   assert_string_equal (data_p, pack->data->data.data);
 }
 
+/* Test read DATA tftp packet without data. */
+// ----------------------------------
+static void read_empty_data_pack_test (void **state)
+{
+  tftp_pack *pack = tftp_packet_read(raw_empty_data, sizeof(raw_empty_data), *state);
+  assert_int_equal (pack->opcode, E_DATA);
+  assert_int_equal (pack->data->data.block, 128);
+  assert_int_equal (pack->data->data.length, 0);
+}
+
 /* Test read binary DATA tftp packet. */
 // ----------------------------------
 #include <stdio.h>
@@ -202,6 +231,34 @@ static void read_error_pack_test (void **state)
   assert_int_equal (pack->data->error.msg_len, 14);
 }
 
+/* Test read RRQ tftp packet with options. */
+// ----------------------------------
+static void read_rrq_opts_pack_test (void **state)
+{
+  tftp_pack *pack = tftp_packet_read(raw_rrq_opts, sizeof(raw_rrq_opts), *state);
+  assert_int_equal (pack->opcode, E_RRQ);
+  assert_string_equal (pack->data->rq.filename, "foo.c");
+  assert_int_equal (pack->data->rq.e_mode, E_OCTET);
+  assert_int_equal (pack->data->rq.opts.blksize, 1428);
+}
+
+/* Test read OACK tftp packet. */
+// ----------------------------------
+static void read_oack_pack_test (void **state)
+{
+  tftp_pack *pack = tftp_packet_read(raw_oack, sizeof(raw_oack), *state);
+  assert_int_equal (pack->opcode, E_OACK);
+  assert_int_equal (pack->data->oack.opts.blksize, 1024);
+  assert_int_equal (pack->data->oack.opts.windowsize, 8);
+  assert_int_equal (pack->data->oack.opts.timeout, 0);
+
+  pack = tftp_packet_read(raw_oack_timeout, sizeof(raw_oack_timeout), *state);
+  assert_int_equal (pack->opcode, E_OACK);
+  assert_int_equal (pack->data->oack.opts.timeout, 3);
+  assert_int_equal (pack->data->oack.opts.blksize, 0);
+  assert_null(tftp_packet_read(raw_empty_oack, sizeof(raw_empty_oack), *state));
+}
+
 /* Test invalid tftp packet. */
 // ----------------------------------
 static void read_invalid_pack_test (void **state)
@@ -210,6 +267,38 @@ static void read_invalid_pack_test (void **state)
   assert_null(tftp_packet_read(raw_invalid, sizeof(raw_invalid), *state));
 }
 
+/* Test packet view points into packet buffer. */
+// ----------------------------------
+static void read_view_pack_test (void **state)
+{
+  struct tftp_packet_view view;
+
+  assert_non_null (tftp_packet_view_read (&view, raw_data, sizeof(raw_data)));
+  assert_int_equal (view.opcode, E_DATA);
+  assert_int_equal (view.block, 16615);
+  assert_true (view.data.ptr == raw_data + 4);
+  assert_int_equal (view.data.len, sizeof(raw_data) - 4);
+
+  assert_non_null (tftp_packet_view_read (&view, raw_wrq, sizeof(raw_wrq)));
+  assert_int_equal (view.opcode, E_WRQ);
+  assert_true (view.filename.ptr == raw_wrq + 2);
+  assert_int_equal (view.filename.len, 6);
+  assert_string_equal (view.mode.ptr, "octet");
+  assert_int_equal (view.e_mode, E_OCTET);
+
+  assert_non_null (tftp_packet_view_read (&view, raw_error, sizeof(raw_error)));
+  assert_int_equal (view.opcode, E_ERROR);
+  assert_int_equal (view.block, 0x01);
+  assert_memory_equal (view.msg.ptr, "File not found", 14);
+  assert_int_equal (view.msg.len, 14);
+
+  assert_non_null (tftp_packet_view_read (&view, raw_oack, sizeof(raw_oack)));
+  assert_int_equal (view.opts.blksize, 1024);
+  assert_int_equal (view.opts.windowsize, 8);
+
+  assert_null (tftp_packet_view_read (&view, raw_empty_oack, sizeof(raw_empty_oack)));
+}
+
 /*
  * Run all tests.
  */
@@ -222,9 +311,13 @@ int main(void)
     cmocka_unit_test_setup_teardown (read_data_pack_test, setup, teardown),
     cmocka_unit_test_setup_teardown (read_bin_data_pack_test, setup, teardown),
     cmocka_unit_test_setup_teardown (read_last_data_pack_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (read_empty_data_pack_test, setup, teardown),
     cmocka_unit_test_setup_teardown (read_ack_pack_test, setup, teardown),
     cmocka_unit_test_setup_teardown (read_error_pack_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (read_rrq_opts_pack_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (read_oack_pack_test, setup, teardown),
     cmocka_unit_test_setup_teardown (read_invalid_pack_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (read_view_pack_test, setup, teardown),
   };
   return cmocka_run_group_tests_name("tftpclient library tests", tests, NULL, NULL);
 }
@@ -0,0 +1,290 @@
+/*
+ * Loopback TFTP responder for transfer tests.
+ * Built on packet parser and builders of TFTP library.
+ */
+#include <string.h>
+
+#include "tftp_responder.h"
+
+/*
+ * Packet exchange with client of one transfer.
+ */
+struct exchange {
+  struct tftp_responder *r;
+  apr_pool_t            *mp;      /* Cleared for every received packet. */
+  apr_sockaddr_t        *client;  /* Client address. */
+  apr_sockaddr_t        *from;    /* Source of received packet. */
+  char                  *in;      /* Receive buffer. */
+  char                  *out;     /* Send buffer. */
+  tftp_pack             *pack;    /* Received packet. */
+};
+
+static void send_packet (struct exchange *ex, const char *buf, apr_size_t len)
+{
+  apr_socket_sendto (ex->r->sock, ex->client, 0, buf, &len);
+}
+
+/*
+ * Wait for packet from client.
+ * Returns APR_TIMEUP when retransmission timeout expires.
+ */
+static apr_status_t recv_packet (struct exchange *ex)
+{
+  apr_size_t len;
+  apr_status_t rv;
+
+  for (;;) {
+    if (ex->r->stop) {
+      return APR_EOF;
+    }
+    len = BLKSIZE_MAX + 4;
+    rv = apr_socket_recvfrom (ex->from, ex->r->sock, 0, ex->in, &len);
+    if (rv != APR_SUCCESS) {
+      return APR_STATUS_IS_EAGAIN(rv) || APR_STATUS_IS_TIMEUP(rv) ? APR_TIMEUP : rv;
+    }
+    if (ex->client && ex->from->port != ex->client->port) {
+      continue;
+    }
+    apr_pool_clear (ex->mp);
+    ex->pack = tftp_packet_read (ex->in, len, ex->mp);
+    if (ex->pack) {
+      return APR_SUCCESS;
+    }
+  }
+}
+
+/*
+ * Send DATA blocks of file to client. Window slides with ACK,
+ * timeout or ACK of earlier block rewinds it (RFC7440).
+ */
+static void serve_rrq (struct exchange *ex, unsigned int blksize, unsigned int window)
+{
+  struct tftp_responder *r = ex->r;
+  apr_uint64_t blocks = r->file_len / blksize + 1;
+  apr_uint64_t first = 1, next = 1, acked;
+  unsigned int retries = 0;
+  struct pack_data data;
+  apr_size_t len, off;
+
+  while (first <= blocks) {
+    while (next < first + window && next <= blocks) {
+      off = (next - 1) * blksize;
+      data.block = tftp_block_wire (next, 0);
+      data.data = (char *)r->file + off;
+      data.length = r->file_len - off < blksize ? r->file_len - off : blksize;
+      len = tftp_create_data (ex->out, &data);
+      send_packet (ex, ex->out, len);
+      next++;
+    }
+    switch (recv_packet (ex)) {
+      case APR_SUCCESS:
+        if (ex->pack->opcode == E_ERROR) {
+          return;
+        }
+        if (ex->pack->opcode != E_ACK) {
+          continue;
+        }
+        acked = tftp_block_delta (first - 1, ex->pack->data->ack.block, 0);
+        if (acked > next - first) {
+          continue;
+        }
+        first += acked;
+        retries = 0;
+        if (first < next) {
+          next = first;
+        }
+        break;
+      case APR_TIMEUP:
+        if (++retries > r->retries) {
+          return;
+        }
+        next = first;
+        break;
+      default:
+        return;
+    }
+  }
+  r->transfers++;
+}
+
+/*
+ * Receive DATA blocks from client. ACK every window, on gap and on timeout.
+ */
+static void serve_wrq (struct exchange *ex, unsigned int blksize, unsigned int window,
+                       const char *reply, apr_size_t reply_len)
+{
+  struct tftp_responder *r = ex->r;
+  apr_uint64_t last = 0;
+  unsigned int retries = 0, win_recv = 0, dally = 0;
+  struct pack_data *data;
+  apr_size_t len;
+
+  r->recv_len = 0;
+  for (;;) {
+    switch (recv_packet (ex)) {
+      case APR_SUCCESS:
+        if (ex->pack->opcode == E_ERROR) {
+          return;
+        }
+        if (ex->pack->opcode != E_DATA) {
+          continue;
+        }
+        data = &ex->pack->data->data;
+        retries = 0;
+        if (!dally && tftp_block_delta (last, data->block, 0) == 1) {
+          if (r->recv_len + data->length > r->recv_size) {
+            char *grown;
+            r->recv_size = (r->recv_len + data->length) * 2;
+            grown = apr_palloc (r->thread_mp, r->recv_size);
+            memcpy (grown, r->recv, r->recv_len);
+            r->recv = grown;
+          }
+          memcpy (r->recv + r->recv_len, data->data, data->length);
+          r->recv_len += data->length;
+          last++;
+          if (data->length < blksize) {
+            dally = 1;
+            r->transfers++;
+          } else if (++win_recv < window) {
+            continue;
+          }
+        }
+        win_recv = 0;
+        len = tftp_create_ack (ex->out, tftp_block_wire (last, 0));
+        send_packet (ex, ex->out, len);
+        break;
+      case APR_TIMEUP:
+        // lost final ACK is sent again on DATA retransmission
+        if (dally || ++retries > r->retries) {
+          return;
+        }
+        if (last == 0) {
+          send_packet (ex, reply, reply_len);
+        } else {
+          len = tftp_create_ack (ex->out, tftp_block_wire (last, 0));
+          send_packet (ex, ex->out, len);
+        }
+        break;
+      default:
+        return;
+    }
+  }
+}
+
+/*
+ * Responder thread. Waits for requests and serves them one by one.
+ */
+static void * APR_THREAD_FUNC responder_thread (apr_thread_t *thread, void *arg)
+{
+  struct tftp_responder *r = arg;
+  struct exchange ex = { .r = r };
+  struct tftp_opts opts;
+  unsigned int blksize, window;
+  apr_size_t reply_len;
+  char *reply;
+  int opcode;
+
+  // responder thread allocates only from its own pools
+  apr_pool_create (&ex.mp, r->thread_mp);
+  apr_sockaddr_info_get (&ex.from, "127.0.0.1", APR_INET, 0, 0, r->thread_mp);
+  apr_sockaddr_info_get (&ex.client, "127.0.0.1", APR_INET, 0, 0, r->thread_mp);
+  ex.in = apr_palloc (r->thread_mp, BLKSIZE_MAX + 5);
+  ex.out = apr_palloc (r->thread_mp, BLKSIZE_MAX + 4);
+  reply = apr_palloc (r->thread_mp, BUF_SIZE);
+
+  while (!r->stop) {
+    struct exchange req = ex;
+    req.client = NULL;
+    if (recv_packet (&req) != APR_SUCCESS) {
+      continue;
+    }
+    opcode = req.pack->opcode;
+    if (opcode != E_RRQ && opcode != E_WRQ) {
+      continue;
+    }
+    // transfer is served to request source
+    memcpy (&ex.client->sa, &req.from->sa, req.from->salen);
+    ex.client->port = req.from->port;
+
+    opts = req.pack->data->rq.opts;
+    blksize = opts.blksize ? opts.blksize : DATA_SIZE;
+    window = opts.windowsize ? opts.windowsize : 1;
+    if (opts.has_tsize && opcode == E_RRQ) {
+      opts.tsize = r->file_len;
+    }
+    if (opts.blksize || opts.windowsize || opts.timeout || opts.has_tsize) {
+      reply_len = tftp_create_oack (reply, &opts);
+    } else {
+      reply_len = tftp_create_ack (reply, 0);
+    }
+
+    if (opcode == E_WRQ) {
+      send_packet (&ex, reply, reply_len);
+      serve_wrq (&ex, blksize, window, reply, reply_len);
+      continue;
+    }
+    if (reply_len > 4) {
+      // OACK is acknowledged with ACK 0
+      unsigned int retries = 0;
+      apr_status_t rv;
+      do {
+        send_packet (&ex, reply, reply_len);
+        rv = recv_packet (&ex);
+        if (rv == APR_SUCCESS && ex.pack->opcode == E_ACK && ex.pack->data->ack.block == 0) {
+          break;
+        }
+      } while ((rv == APR_TIMEUP && ++retries <= r->retries) || rv == APR_SUCCESS);
+      if (rv != APR_SUCCESS) {
+        continue;
+      }
+    }
+    serve_rrq (&ex, blksize, window);
+  }
+  apr_thread_exit (thread, APR_SUCCESS);
+  return NULL;
+}
+
+static apr_status_t responder_cleanup (void *data)
+{
+  struct tftp_responder *r = data;
+  apr_status_t rv;
+
+  r->stop = 1;
+  apr_thread_join (&rv, r->thread);
+  apr_pool_destroy (r->thread_mp);
+  return APR_SUCCESS;
+}
+
+apr_status_t tftp_responder_start (struct tftp_responder **new, apr_pool_t *mp,
+                                   const char *file, apr_size_t len)
+{
+  struct tftp_responder *r = apr_pcalloc (mp, sizeof(struct tftp_responder));
+  apr_status_t rv;
+
+  r->mp = mp;
+  r->file = file;
+  r->file_len = len;
+  r->timeout = apr_time_from_msec (50);
+  r->retries = 20;
+
+  rv = apr_sockaddr_info_get (&r->addr, "127.0.0.1", APR_INET, 0, 0, mp);
+  if (rv != APR_SUCCESS) return rv;
+  rv = apr_socket_create (&r->sock, APR_INET, SOCK_DGRAM, APR_PROTO_UDP, mp);
+  if (rv != APR_SUCCESS) return rv;
+  rv = apr_socket_bind (r->sock, r->addr);
+  if (rv != APR_SUCCESS) return rv;
+  apr_socket_addr_get (&r->addr, APR_LOCAL, r->sock);
+  apr_socket_timeout_set (r->sock, r->timeout);
+
+  rv = apr_pool_create (&r->thread_mp, NULL);
+  if (rv != APR_SUCCESS) return rv;
+  rv = apr_thread_create (&r->thread, NULL, responder_thread, r, mp);
+  if (rv != APR_SUCCESS) {
+    apr_pool_destroy (r->thread_mp);
+    return rv;
+  }
+  apr_pool_cleanup_register (mp, r, responder_cleanup, apr_pool_cleanup_null);
+
+  *new = r;
+  return APR_SUCCESS;
+}
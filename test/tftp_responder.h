@@ -0,0 +1,41 @@
+/*
+ * Loopback TFTP responder for transfer tests.
+ * Serves one in-memory file for RRQ and keeps file received with WRQ.
+ * One transfer at a time, answers from the port of requests.
+ */
+#ifndef __TFTP_RESPONDER_H
+#define __TFTP_RESPONDER_H
+
+#include <apr_general.h>
+#include <apr_network_io.h>
+#include <apr_thread_proc.h>
+
+#include "tftp_msg.h"
+
+/*
+ * Responder.
+ */
+struct tftp_responder {
+  apr_pool_t          *mp;        /* Memory pool. */
+  apr_pool_t          *thread_mp; /* Memory pool of responder thread. */
+  apr_socket_t        *sock;      /* Socket on loopback. */
+  apr_sockaddr_t      *addr;      /* Socket address. */
+  const char          *file;      /* File served to RRQ. */
+  apr_size_t          file_len;   /* File length. */
+  char                *recv;      /* File received with WRQ. */
+  apr_size_t          recv_len;   /* Received file length. */
+  apr_size_t          recv_size;  /* Received file buffer size. */
+  apr_interval_time_t timeout;    /* Retransmission timeout. */
+  unsigned int        retries;    /* Maximal retransmissions. */
+  unsigned int        transfers;  /* Completed transfers. */
+  apr_thread_t        *thread;    /* Responder thread. */
+  volatile int        stop;       /* Responder is stopped. */
+};
+
+/*
+ * Start responder thread. Responder is stopped when memory pool is destroyed.
+ */
+apr_status_t tftp_responder_start (struct tftp_responder **responder, apr_pool_t *mp,
+                                   const char *file, apr_size_t len);
+
+#endif
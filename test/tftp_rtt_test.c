@@ -0,0 +1,139 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <apr_general.h>
+#include "tftp_rtt.h"
+
+/*
+ * Setup and teardown for round trip time tests.
+ */
+static int setup(void **state) {
+  apr_initialize();
+  return 0;
+}
+
+static int teardown(void **state) {
+  apr_terminate();
+  return 0;
+}
+
+/*
+ * Testing functions.
+ */
+
+/* Test timeout bounds and conversion to RFC2349 timeout option. */
+// ----------------------------------
+static void rtt_init_test (void **state)
+{
+  struct tftp_rtt rtt;
+
+  tftp_rtt_init (&rtt, 0);
+  assert_int_equal (rtt.rto, RTO_MIN);
+  assert_int_equal (tftp_rtt_timeout_sec (&rtt), 1);
+
+  tftp_rtt_init (&rtt, apr_time_from_sec(3600));
+  assert_int_equal (rtt.rto, RTO_MAX);
+  assert_int_equal (tftp_rtt_timeout_sec (&rtt), 60);
+
+  tftp_rtt_init (&rtt, apr_time_from_msec(1500));
+  assert_int_equal (tftp_rtt_timeout_sec (&rtt), 2);
+}
+
+/* Test first and next round trip time samples. */
+// ----------------------------------
+static void rtt_sample_test (void **state)
+{
+  struct tftp_rtt rtt;
+
+  tftp_rtt_init (&rtt, apr_time_from_sec(TFTP_TIMEOUT));
+  tftp_rtt_sent (&rtt);
+  rtt.start -= apr_time_from_msec(100);
+  tftp_rtt_recv (&rtt);
+  assert_in_range (rtt.srtt, apr_time_from_msec(100), apr_time_from_msec(150));
+  assert_in_range (rtt.rto, apr_time_from_msec(300), apr_time_from_msec(450));
+
+  // no sample without sent packet
+  tftp_rtt_recv (&rtt);
+  assert_in_range (rtt.srtt, apr_time_from_msec(100), apr_time_from_msec(150));
+}
+
+/* Test exponential backoff and Karn's rule. */
+// ----------------------------------
+static void rtt_backoff_test (void **state)
+{
+  struct tftp_rtt rtt;
+
+  tftp_rtt_init (&rtt, apr_time_from_sec(TFTP_TIMEOUT));
+  tftp_rtt_sent (&rtt);
+  assert_int_equal (tftp_rtt_backoff (&rtt), 1);
+  assert_int_equal (rtt.rto, apr_time_from_sec(2));
+  tftp_rtt_sent (&rtt);
+  assert_int_equal (tftp_rtt_backoff (&rtt), 2);
+  assert_int_equal (rtt.rto, apr_time_from_sec(4));
+
+  // sample of retransmitted packet is ignored, backed off timeout is kept
+  tftp_rtt_recv (&rtt);
+  assert_int_equal (rtt.retries, 0);
+  assert_int_equal (rtt.srtt, 0);
+  assert_int_equal (rtt.rto, apr_time_from_sec(4));
+}
+
+/* Test negotiated timeout is neither estimated nor backed off. */
+// ----------------------------------
+static void rtt_fixed_test (void **state)
+{
+  struct tftp_rtt rtt;
+
+  tftp_rtt_init (&rtt, apr_time_from_sec(TFTP_TIMEOUT));
+  tftp_rtt_fix (&rtt, apr_time_from_sec(3));
+  tftp_rtt_sent (&rtt);
+  rtt.start -= apr_time_from_msec(100);
+  tftp_rtt_recv (&rtt);
+  assert_int_equal (rtt.srtt, 0);
+  assert_int_equal (rtt.rto, apr_time_from_sec(3));
+
+  tftp_rtt_sent (&rtt);
+  assert_int_equal (tftp_rtt_backoff (&rtt), 1);
+  assert_int_equal (rtt.rto, apr_time_from_sec(3));
+  assert_int_equal (tftp_rtt_deadline (&rtt), rtt.sent + apr_time_from_sec(3));
+}
+
+/* Test retransmission timer runs from the last sent packet. */
+// ----------------------------------
+static void rtt_deadline_test (void **state)
+{
+  struct tftp_rtt rtt;
+  apr_time_t sent;
+
+  tftp_rtt_init (&rtt, apr_time_from_sec(TFTP_TIMEOUT));
+  tftp_rtt_sent (&rtt);
+  sent = rtt.sent;
+  assert_int_equal (tftp_rtt_deadline (&rtt), sent + apr_time_from_sec(1));
+
+  // timer restarts on expiration with backed off timeout
+  tftp_rtt_backoff (&rtt);
+  assert_true (rtt.sent >= sent);
+  assert_int_equal (tftp_rtt_deadline (&rtt), rtt.sent + apr_time_from_sec(2));
+
+  // response does not restart timer, next sent packet does
+  sent = rtt.sent;
+  tftp_rtt_recv (&rtt);
+  assert_int_equal (rtt.sent, sent);
+}
+
+/*
+ * Run all tests.
+ */
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown (rtt_init_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (rtt_sample_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (rtt_backoff_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (rtt_deadline_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (rtt_fixed_test, setup, teardown),
+  };
+  return cmocka_run_group_tests_name("tftpclient round trip time tests", tests, NULL, NULL);
+}
@@ -0,0 +1,113 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "tftp_sched.h"
+
+#define ITEMS 100000
+
+/*
+ * Setup and teardown for scheduler tests.
+ */
+static int setup(void **state) {
+  apr_pool_t *mp;
+
+  apr_initialize();
+  apr_pool_create(&mp, NULL);
+
+  *state = mp;
+
+  return 0;
+}
+
+static int teardown(void **state) {
+  apr_pool_destroy(*state);
+  apr_terminate();
+  return 0;
+}
+
+/*
+ * Producer thread pushes ITEMS numbers to the queue.
+ */
+static void * APR_THREAD_FUNC producer (apr_thread_t *thread, void *data)
+{
+  struct tftp_spsc *queue = data;
+  long i;
+
+  for (i = 1; i <= ITEMS; i++) {
+    while (!tftp_spsc_push (queue, (void *)i)) {
+      apr_thread_yield ();
+    }
+  }
+  apr_thread_exit (thread, APR_SUCCESS);
+  return NULL;
+}
+
+/*
+ * Testing functions.
+ */
+
+/* Test queue capacity, order and wrap around. */
+// ----------------------------------
+static void spsc_queue_test (void **state)
+{
+  apr_pool_t *mp = *state;
+  struct tftp_spsc queue;
+  long i;
+
+  tftp_spsc_init (&queue, mp, 3);
+  assert_int_equal (queue.mask, 3);
+  assert_null (tftp_spsc_pop (&queue));
+
+  for (i = 1; i <= 4; i++) {
+    assert_true (tftp_spsc_push (&queue, (void *)i));
+  }
+  assert_false (tftp_spsc_push (&queue, (void *)5));
+
+  for (i = 1; i <= 10; i++) {
+    assert_int_equal ((long)tftp_spsc_pop (&queue), i);
+    assert_true (tftp_spsc_push (&queue, (void *)(i + 4)));
+  }
+  for (i = 11; i <= 14; i++) {
+    assert_int_equal ((long)tftp_spsc_pop (&queue), i);
+  }
+  assert_null (tftp_spsc_pop (&queue));
+}
+
+/* Test items pushed from other thread are popped in order. */
+// ----------------------------------
+static void spsc_thread_test (void **state)
+{
+  apr_pool_t *mp = *state;
+  struct tftp_spsc queue;
+  apr_thread_t *thread;
+  apr_status_t rv;
+  long i = 1, item;
+
+  tftp_spsc_init (&queue, mp, 64);
+  assert_int_equal (apr_thread_create (&thread, NULL, producer, &queue, mp), APR_SUCCESS);
+  while (i <= ITEMS) {
+    item = (long)tftp_spsc_pop (&queue);
+    if (item == 0) {
+      apr_thread_yield ();
+      continue;
+    }
+    assert_int_equal (item, i);
+    i++;
+  }
+  apr_thread_join (&rv, thread);
+  assert_null (tftp_spsc_pop (&queue));
+}
+
+/*
+ * Run all tests.
+ */
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown (spsc_queue_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (spsc_thread_test, setup, teardown),
+  };
+  return cmocka_run_group_tests_name("tftpclient scheduler tests", tests, NULL, NULL);
+}
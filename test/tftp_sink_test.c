@@ -0,0 +1,119 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "tftp_sink.h"
+
+/*
+ * Sink tests pool and file.
+ */
+static apr_pool_t *mp;
+static apr_file_t *file;
+static struct tftp_io io;
+
+/*
+ * Setup and teardown for sink tests.
+ */
+static int setup(void **state) {
+  char tmpl[] = "/tmp/tftp_sink_XXXXXX";
+
+  apr_initialize();
+  apr_pool_create(&mp, NULL);
+  memset (&io, 0, sizeof(io));
+  io.buf_index = -1;
+  return apr_file_mktemp (&file, tmpl, APR_FOPEN_CREATE|APR_FOPEN_READ|APR_FOPEN_WRITE|
+                          APR_FOPEN_DELONCLOSE, mp) != APR_SUCCESS;
+}
+
+static int teardown(void **state) {
+  apr_pool_destroy(mp);
+  apr_terminate();
+  return 0;
+}
+
+/*
+ * Read whole file and compare with expected pattern.
+ */
+static void assert_file (apr_size_t size)
+{
+  apr_finfo_t finfo;
+  apr_off_t off = 0;
+  apr_size_t i, len;
+  char *data;
+
+  apr_file_info_get (&finfo, APR_FINFO_SIZE, file);
+  assert_int_equal (finfo.size, size);
+  data = apr_palloc (mp, size);
+  apr_file_seek (file, APR_SET, &off);
+  assert_int_equal (apr_file_read_full (file, data, size, &len), APR_SUCCESS);
+  for (i = 0; i < size; i++) {
+    if (data[i] != (char)(i % 251)) {
+      fail_msg ("Byte %lu differs.", (unsigned long)i);
+    }
+  }
+}
+
+/*
+ * Write size bytes of pattern by blocks of blksize.
+ */
+static void write_blocks (struct tftp_sink *sink, apr_size_t size, apr_size_t blksize)
+{
+  char block[1468];
+  apr_size_t off, i, len;
+
+  for (off = 0; off < size; off += len) {
+    len = size - off < blksize ? size - off : blksize;
+    for (i = 0; i < len; i++) {
+      block[i] = (char)((off + i) % 251);
+    }
+    assert_int_equal (tftp_sink_write (sink, block, len), APR_SUCCESS);
+  }
+}
+
+/*
+ * Testing functions.
+ */
+
+/* Test blocks are collected and written at their offsets. */
+// ----------------------------------
+static void sink_write_test (void **state)
+{
+  struct tftp_sink *sink;
+  apr_size_t size = 3 * SINK_BUF_SIZE + 1000;
+
+  assert_int_equal (tftp_sink_create (&sink, mp, file, &io, 0), APR_SUCCESS);
+  write_blocks (sink, size, 1468);
+  assert_int_equal (tftp_sink_close (sink), APR_SUCCESS);
+  assert_file (size);
+}
+
+/* Test preallocated file is truncated to received size. */
+// ----------------------------------
+static void sink_reserve_test (void **state)
+{
+  struct tftp_sink *sink;
+  apr_status_t rv;
+
+  assert_int_equal (tftp_sink_create (&sink, mp, file, &io, 0), APR_SUCCESS);
+  rv = tftp_sink_reserve (sink, 2 * SINK_BUF_SIZE);
+  if (rv == APR_ENOTIMPL) {
+    skip();
+  }
+  assert_int_equal (rv, APR_SUCCESS);
+  write_blocks (sink, SINK_BUF_SIZE + 512, 512);
+  assert_int_equal (tftp_sink_close (sink), APR_SUCCESS);
+  assert_file (SINK_BUF_SIZE + 512);
+}
+
+/*
+ * Run all tests.
+ */
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown (sink_write_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (sink_reserve_test, setup, teardown),
+  };
+  return cmocka_run_group_tests_name("tftpclient file sink tests", tests, NULL, NULL);
+}
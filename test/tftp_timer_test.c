@@ -0,0 +1,128 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "tftp_timer.h"
+
+/*
+ * Timers mocks.
+ */
+static int fired[8];
+
+static void timer_cb (struct tftp_timer *timer, void *baton)
+{
+  fired[(long)baton]++;
+}
+
+/*
+ * Setup for timing wheel tests.
+ */
+static int setup(void **state) {
+  memset (fired, 0, sizeof(fired));
+  return 0;
+}
+
+/*
+ * Testing functions.
+ */
+
+/* Test timer expires not earlier than scheduled. */
+// ----------------------------------
+static void wheel_expire_test (void **state)
+{
+  struct tftp_wheel wheel;
+  struct tftp_timer timer;
+  apr_time_t now = apr_time_from_sec(1000);
+
+  tftp_wheel_init (&wheel, now);
+  tftp_timer_init (&timer, timer_cb, (void *)0);
+  assert_int_equal (tftp_wheel_timeout (&wheel, now), -1);
+
+  tftp_timer_add (&wheel, &timer, now + apr_time_from_msec(20));
+  assert_true (tftp_timer_pending (&timer));
+  assert_int_equal (tftp_wheel_timeout (&wheel, now), apr_time_from_msec(20));
+
+  assert_int_equal (tftp_wheel_advance (&wheel, now + apr_time_from_msec(19)), 0);
+  assert_int_equal (fired[0], 0);
+  assert_int_equal (tftp_wheel_advance (&wheel, now + apr_time_from_msec(20)), 1);
+  assert_int_equal (fired[0], 1);
+  assert_false (tftp_timer_pending (&timer));
+  assert_int_equal (tftp_wheel_timeout (&wheel, now), -1);
+}
+
+/* Test timers in upper levels are cascaded and expire in order. */
+// ----------------------------------
+static void wheel_cascade_test (void **state)
+{
+  struct tftp_wheel wheel;
+  struct tftp_timer timers[4];
+  apr_time_t now = apr_time_from_msec(12345);
+  apr_interval_time_t after[4] = { apr_time_from_msec(70), apr_time_from_msec(5000),
+                                   apr_time_from_sec(300), apr_time_from_sec(3) };
+  long i;
+
+  tftp_wheel_init (&wheel, now);
+  for (i = 0; i < 4; i++) {
+    tftp_timer_init (&timers[i], timer_cb, (void *)i);
+    tftp_timer_add (&wheel, &timers[i], now + after[i]);
+  }
+  // upper level timer wakes up loop at cascade, never later than expiration
+  assert_in_range (tftp_wheel_timeout (&wheel, now), 1, apr_time_from_msec(70));
+
+  tftp_wheel_advance (&wheel, now + apr_time_from_msec(69));
+  assert_int_equal (fired[0], 0);
+  tftp_wheel_advance (&wheel, now + apr_time_from_msec(70));
+  assert_int_equal (fired[0], 1);
+
+  tftp_wheel_advance (&wheel, now + apr_time_from_msec(2999));
+  assert_int_equal (fired[3], 0);
+  tftp_wheel_advance (&wheel, now + apr_time_from_sec(3));
+  assert_int_equal (fired[3], 1);
+
+  tftp_wheel_advance (&wheel, now + apr_time_from_msec(4999));
+  assert_int_equal (fired[1], 0);
+  tftp_wheel_advance (&wheel, now + apr_time_from_msec(5000));
+  assert_int_equal (fired[1], 1);
+
+  tftp_wheel_advance (&wheel, now + apr_time_from_sec(300) - 1);
+  assert_int_equal (fired[2], 0);
+  tftp_wheel_advance (&wheel, now + apr_time_from_sec(300));
+  assert_int_equal (fired[2], 1);
+}
+
+/* Test cancel and reschedule of pending timer. */
+// ----------------------------------
+static void wheel_cancel_test (void **state)
+{
+  struct tftp_wheel wheel;
+  struct tftp_timer timer;
+  apr_time_t now = 0;
+
+  tftp_wheel_init (&wheel, now);
+  tftp_timer_init (&timer, timer_cb, (void *)0);
+  tftp_timer_add (&wheel, &timer, now + apr_time_from_msec(10));
+  tftp_timer_cancel (&wheel, &timer);
+  assert_false (tftp_timer_pending (&timer));
+  assert_int_equal (tftp_wheel_advance (&wheel, now + apr_time_from_msec(10)), 0);
+
+  tftp_timer_add (&wheel, &timer, now + apr_time_from_msec(100));
+  tftp_timer_add (&wheel, &timer, now + apr_time_from_msec(200));
+  assert_int_equal (wheel.count, 1);
+  assert_int_equal (tftp_wheel_advance (&wheel, now + apr_time_from_msec(199)), 0);
+  assert_int_equal (tftp_wheel_advance (&wheel, now + apr_time_from_msec(200)), 1);
+  assert_int_equal (fired[0], 1);
+}
+
+/*
+ * Run all tests.
+ */
+int main(void)
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup (wheel_expire_test, setup),
+    cmocka_unit_test_setup (wheel_cascade_test, setup),
+    cmocka_unit_test_setup (wheel_cancel_test, setup),
+  };
+  return cmocka_run_group_tests_name("tftpclient timing wheel tests", tests, NULL, NULL);
+}
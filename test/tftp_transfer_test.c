@@ -0,0 +1,706 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include <apr_file_io.h>
+
+#include "tftp_proto.h"
+#include "tftp_loop.h"
+#include "tftp_impair.h"
+#include "tftp_server.h"
+#include "tftp_responder.h"
+
+#define FILE_LEN (1024 * 1024 + 100)
+
+/*
+ * Transfer of one file through impairment relay to loopback responder.
+ */
+struct transfer {
+  apr_pool_t            *mp;
+  char                  *file;      /* File content. */
+  char                  path[64];   /* Local file path. */
+  struct tftp_responder *responder;
+  struct tftp_impair    *impair;
+  struct tftp_params    params;
+};
+
+/*
+ * Setup and teardown for transfer tests.
+ */
+static int setup(void **state) {
+  struct transfer *t;
+  apr_pool_t *mp;
+  apr_size_t i;
+  apr_uint32_t x = 2463534242u;
+
+  apr_initialize();
+  apr_pool_create(&mp, NULL);
+
+  t = apr_pcalloc (mp, sizeof(struct transfer));
+  t->mp = mp;
+  t->file = apr_palloc (mp, FILE_LEN);
+  for (i = 0; i < FILE_LEN; i++) {
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    t->file[i] = x;
+  }
+  strcpy (t->path, "/tmp/tftp_transfer_XXXXXX");
+
+  t->params.remote_file = "file.bin";
+  t->params.local_file = t->path;
+  t->params.host = "127.0.0.1";
+  t->params.mode = E_OCTET;
+  t->params.blksize = DATA_SIZE;
+  t->params.windowsize = 1;
+  t->params.timeout = 1;
+  t->params.retries = 10;
+  t->params.io_mode = IO_MMSG;
+  *state = t;
+
+  return 0;
+}
+
+/*
+ * Setup of transfer tests with datagram I/O mode.
+ */
+static int setup_io(void **state, enum io_mode mode) {
+  struct transfer *t;
+  setup (state);
+  t = *state;
+  t->params.io_mode = mode;
+  return 0;
+}
+
+static int setup_apr(void **state)   { return setup_io (state, IO_APR); }
+static int setup_gso(void **state)   { return setup_io (state, IO_GSO); }
+static int setup_uring(void **state) { return setup_io (state, IO_URING); }
+
+static int teardown(void **state) {
+  struct transfer *t = *state;
+  apr_file_remove (t->path, NULL);
+  apr_pool_destroy(t->mp);
+  apr_terminate();
+  return 0;
+}
+
+/*
+ * Skip test when system or kernel does not support I/O mode of transfer.
+ */
+static void skip_unsupported_io (struct transfer *t)
+{
+  struct tftp_uring *uring;
+  struct tftp_io io;
+  apr_socket_t *sock;
+
+  if (t->params.io_mode == IO_GSO) {
+    assert_int_equal (apr_socket_create (&sock, APR_INET, SOCK_DGRAM, APR_PROTO_UDP, t->mp),
+                      APR_SUCCESS);
+    tftp_io_init (&io, t->mp, sock, IO_GSO, IO_BATCH, DATA_SIZE + 4);
+    apr_socket_close (sock);
+    if (io.mode != IO_GSO) {
+      printf ("UDP segmentation offload is not supported. Skip.\n");
+      skip ();
+    }
+  } else if (t->params.io_mode == IO_URING &&
+             tftp_uring_create (&uring, t->mp, 4) != APR_SUCCESS) {
+    printf ("io_uring is not supported. Skip.\n");
+    skip ();
+  }
+}
+
+/*
+ * Run client transfer through relay to the end.
+ */
+static apr_status_t client_run (struct transfer *t, enum file_action action)
+{
+  struct tftp_machine *machine;
+  struct tftp_impair_stats stats;
+  apr_file_t *file;
+  apr_size_t len = FILE_LEN;
+  apr_time_t start;
+  apr_status_t rv;
+  double sec;
+
+  // local file for PUT holds content, for GET it is replaced
+  assert_int_equal (apr_file_mktemp (&file, t->path, APR_FOPEN_CREATE|APR_FOPEN_WRITE, t->mp),
+                    APR_SUCCESS);
+  if (action == PUT) {
+    assert_int_equal (apr_file_write_full (file, t->file, len, NULL), APR_SUCCESS);
+  }
+  apr_file_close (file);
+
+  t->params.action = action;
+  t->params.port = tftp_impair_port (t->impair);
+  assert_int_equal (tftp_proto_create (&machine, t->mp, &t->params), APR_SUCCESS);
+
+  start = apr_time_now ();
+  while (tftp_proto_fsm (machine) != END);
+  sec = (double)(apr_time_now () - start) / APR_USEC_PER_SEC;
+  rv = machine->status;
+  tftp_proto_destroy (machine);
+
+  tftp_impair_stats (t->impair, &stats);
+  printf ("%s %s blksize %u window %u: %.3f sec, %.2f MB/s, forwarded %" APR_UINT64_T_FMT
+          ", dropped %" APR_UINT64_T_FMT ", duplicated %" APR_UINT64_T_FMT
+          ", reordered %" APR_UINT64_T_FMT "\n",
+          action == GET ? "GET" : "PUT", io_mode_str[t->params.io_mode],
+          t->params.blksize, t->params.windowsize,
+          sec, FILE_LEN / sec / (1024 * 1024), stats.forwarded, stats.dropped,
+          stats.duplicated, stats.reordered);
+  return rv;
+}
+
+/*
+ * Start responder and relay, run transfer to the end.
+ */
+static apr_status_t transfer_run (struct transfer *t, enum file_action action,
+                                  const struct tftp_impair_cfg *cfg)
+{
+  assert_int_equal (tftp_responder_start (&t->responder, t->mp, t->file, FILE_LEN), APR_SUCCESS);
+  assert_int_equal (tftp_impair_create (&t->impair, t->mp, cfg, t->responder->addr), APR_SUCCESS);
+  return client_run (t, action);
+}
+
+/*
+ * Server thread runs its event loop until server is stopped.
+ */
+static void * APR_THREAD_FUNC server_thread (apr_thread_t *thread, void *data)
+{
+  tftp_server_run (data);
+  apr_thread_exit (thread, APR_SUCCESS);
+  return NULL;
+}
+
+/*
+ * Multicast client runs GET in event loop of its own thread and pool
+ * the way tftpclient does.
+ */
+struct mcast_client {
+  apr_pool_t          *mp;
+  char                path[64];
+  struct tftp_params  params;
+  apr_status_t        status;
+};
+
+static void mcast_client_done (struct tftp_machine *machine, void *baton)
+{
+  struct mcast_client *c = baton;
+  c->status = machine->status;
+}
+
+static void * APR_THREAD_FUNC mcast_client_thread (apr_thread_t *thread, void *data)
+{
+  struct mcast_client *c = data;
+  struct tftp_machine *machine;
+  struct tftp_loop *loop;
+
+  c->status = tftp_loop_create (&loop, c->mp, 1);
+  if (c->status == APR_SUCCESS) {
+    c->status = tftp_proto_create (&machine, c->mp, &c->params);
+  }
+  if (c->status == APR_SUCCESS) {
+    c->status = APR_EINCOMPLETE;
+    if (tftp_loop_add (loop, machine, mcast_client_done, c) != APR_SUCCESS) {
+      tftp_proto_destroy (machine);
+    } else {
+      tftp_loop_run (loop);
+    }
+  }
+  apr_thread_exit (thread, APR_SUCCESS);
+  return NULL;
+}
+
+/*
+ * Check file is the same as served file.
+ */
+static void assert_file_equal (struct transfer *t, const char *path)
+{
+  apr_finfo_t finfo;
+  apr_file_t *file;
+  apr_size_t len = FILE_LEN;
+  char *buf = apr_palloc (t->mp, FILE_LEN);
+
+  assert_int_equal (apr_stat (&finfo, path, APR_FINFO_SIZE, t->mp), APR_SUCCESS);
+  assert_int_equal (finfo.size, FILE_LEN);
+  assert_int_equal (apr_file_open (&file, path, APR_FOPEN_READ, 0, t->mp), APR_SUCCESS);
+  assert_int_equal (apr_file_read_full (file, buf, len, &len), APR_SUCCESS);
+  assert_memory_equal (buf, t->file, FILE_LEN);
+  apr_file_close (file);
+}
+
+/*
+ * Testing functions.
+ */
+
+/* Test GET without impairments. */
+// ----------------------------------
+static void get_clean_test (void **state)
+{
+  struct transfer *t = *state;
+  struct tftp_impair_cfg cfg = { 0 };
+
+  t->params.blksize = 1428;
+  t->params.windowsize = 8;
+  assert_int_equal (transfer_run (t, GET, &cfg), APR_SUCCESS);
+  assert_int_equal (t->responder->transfers, 1);
+  assert_file_equal (t, t->path);
+}
+
+/* Test windowed GET with loss, duplicates, reordering and jitter. */
+// ----------------------------------
+static void get_impaired_test (void **state)
+{
+  struct transfer *t = *state;
+  struct tftp_impair_cfg cfg;
+
+  skip_unsupported_io (t);
+  assert_int_equal (tftp_impair_parse (&cfg,
+                    "loss=0.05,dup=0.02,reorder=0.1,delay=1,jitter=1,seed=7", t->mp),
+                    APR_SUCCESS);
+  t->params.blksize = 1428;
+  t->params.windowsize = 8;
+  assert_int_equal (transfer_run (t, GET, &cfg), APR_SUCCESS);
+  assert_file_equal (t, t->path);
+}
+
+/* Test lock-step PUT with loss, duplicates and reordering. */
+// ----------------------------------
+static void put_impaired_test (void **state)
+{
+  struct transfer *t = *state;
+  struct tftp_impair_cfg cfg;
+
+  skip_unsupported_io (t);
+  assert_int_equal (tftp_impair_parse (&cfg, "loss=0.03,dup=0.02,reorder=0.1,seed=11", t->mp),
+                    APR_SUCCESS);
+  t->params.blksize = 8192;
+  assert_int_equal (transfer_run (t, PUT, &cfg), APR_SUCCESS);
+  assert_int_equal (t->responder->recv_len, FILE_LEN);
+  assert_memory_equal (t->responder->recv, t->file, FILE_LEN);
+}
+
+/* Test windowed PUT with duplicates does not resend window for every ACK. */
+// ----------------------------------
+static void put_windowed_dup_test (void **state)
+{
+  struct transfer *t = *state;
+  struct tftp_impair_cfg cfg;
+  struct tftp_impair_stats stats;
+  apr_uint64_t blocks = FILE_LEN / 1428 + 1;
+
+  assert_int_equal (tftp_impair_parse (&cfg, "dup=0.2,seed=13", t->mp), APR_SUCCESS);
+  t->params.blksize = 1428;
+  t->params.windowsize = 8;
+  assert_int_equal (transfer_run (t, PUT, &cfg), APR_SUCCESS);
+  assert_int_equal (t->responder->recv_len, FILE_LEN);
+  assert_memory_equal (t->responder->recv, t->file, FILE_LEN);
+  // every DATA and ACK once and its duplicate, without resent windows
+  tftp_impair_stats (t->impair, &stats);
+  assert_true (stats.forwarded < 2 * (blocks + blocks / 8));
+}
+
+/* Test windowed GET with heavy loss. */
+// ----------------------------------
+static void get_heavy_loss_test (void **state)
+{
+  struct transfer *t = *state;
+  struct tftp_impair_cfg cfg;
+
+  assert_int_equal (tftp_impair_parse (&cfg, "loss=0.2,seed=3", t->mp), APR_SUCCESS);
+  t->params.blksize = 8192;
+  t->params.windowsize = 4;
+  t->params.retries = 20;
+  assert_int_equal (transfer_run (t, GET, &cfg), APR_SUCCESS);
+  assert_file_equal (t, t->path);
+}
+
+/* Test GET, cached GET and PUT of server with impairments. */
+// ----------------------------------
+static void server_impaired_test (void **state)
+{
+  struct transfer *t = *state;
+  struct tftp_impair_cfg cfg;
+  struct tftp_params sp = t->params;
+  struct tftp_server *server;
+  struct tftp_loop *loop;
+  apr_thread_t *thread;
+  apr_pool_t *smp;
+  apr_file_t *file;
+  apr_status_t rv;
+  char served[] = "/tmp/tftp_served_XXXXXX";
+  char upload[] = "/tmp/tftp_upload_XXXXXX";
+  apr_size_t len = FILE_LEN;
+
+  skip_unsupported_io (t);
+  assert_int_equal (apr_file_mktemp (&file, served, APR_FOPEN_CREATE|APR_FOPEN_WRITE, t->mp),
+                    APR_SUCCESS);
+  assert_int_equal (apr_file_write_full (file, t->file, len, NULL), APR_SUCCESS);
+  apr_file_close (file);
+  assert_int_equal (apr_file_mktemp (&file, upload, APR_FOPEN_CREATE|APR_FOPEN_WRITE, t->mp),
+                    APR_SUCCESS);
+  apr_file_close (file);
+
+  // server thread allocates transfers from its own pool
+  assert_int_equal (apr_pool_create (&smp, NULL), APR_SUCCESS);
+  assert_int_equal (tftp_loop_create (&loop, smp, 17), APR_SUCCESS);
+  sp.host = "127.0.0.1";
+  sp.port = 0;
+  sp.blksize = BLKSIZE_MAX;
+  sp.windowsize = 64;
+  sp.cache_size = 4 * FILE_LEN;
+  assert_int_equal (tftp_server_create (&server, smp, loop, &sp, "/tmp", TRUE, 16), APR_SUCCESS);
+  assert_int_equal (apr_thread_create (&thread, NULL, server_thread, server, t->mp), APR_SUCCESS);
+
+  assert_int_equal (tftp_impair_parse (&cfg, "loss=0.03,dup=0.02,reorder=0.1,seed=5", t->mp),
+                    APR_SUCCESS);
+  assert_int_equal (tftp_impair_create (&t->impair, t->mp, &cfg, server->addr), APR_SUCCESS);
+
+  t->params.blksize = 1428;
+  // window of io_uring server spans several send batches (IO_BATCH)
+  t->params.windowsize = t->params.io_mode == IO_URING ? 48 : 8;
+  t->params.remote_file = served + 5;
+  assert_int_equal (client_run (t, GET), APR_SUCCESS);
+  assert_file_equal (t, t->path);
+  apr_file_remove (t->path, NULL);
+
+  // second GET is sent from packets cached by the first one
+  strcpy (t->path, "/tmp/tftp_transfer_XXXXXX");
+  assert_int_equal (client_run (t, GET), APR_SUCCESS);
+  assert_file_equal (t, t->path);
+  apr_file_remove (t->path, NULL);
+  assert_int_equal (server->params.cache->misses, 1);
+  assert_int_equal (server->params.cache->hits, 1);
+
+  strcpy (t->path, "/tmp/tftp_transfer_XXXXXX");
+  t->params.remote_file = upload + 5;
+  assert_int_equal (client_run (t, PUT), APR_SUCCESS);
+  // server completes transfer when client has sent last block
+  apr_sleep (apr_time_from_msec (100));
+  assert_file_equal (t, upload);
+  assert_int_equal (server->served, 3);
+
+  tftp_server_stop (server);
+  apr_thread_join (&rv, thread);
+  apr_pool_destroy (smp);
+  apr_file_remove (served, NULL);
+  apr_file_remove (upload, NULL);
+}
+
+/* Test packet of other port than server transfer ID gets ERROR and is discarded. */
+// ----------------------------------
+static void unknown_tid_test (void **state)
+{
+  struct transfer *t = *state;
+  struct tftp_machine *machine;
+  apr_sockaddr_t *addr, *client;
+  apr_socket_t *sock[3];  // server listening, server transfer, other host
+  apr_finfo_t finfo;
+  apr_file_t *file;
+  char buf[DATA_SIZE + 4];
+  apr_size_t len;
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    assert_int_equal (apr_sockaddr_info_get (&addr, "127.0.0.1", APR_INET, 0, 0, t->mp), APR_SUCCESS);
+    assert_int_equal (apr_socket_create (&sock[i], APR_INET, SOCK_DGRAM, APR_PROTO_UDP, t->mp),
+                      APR_SUCCESS);
+    assert_int_equal (apr_socket_bind (sock[i], addr), APR_SUCCESS);
+    apr_socket_timeout_set (sock[i], apr_time_from_sec (1));
+  }
+  apr_socket_addr_get (&addr, APR_LOCAL, sock[0]);
+  assert_int_equal (apr_sockaddr_info_get (&client, NULL, APR_INET, 0, 0, t->mp), APR_SUCCESS);
+  assert_int_equal (apr_file_mktemp (&file, t->path, APR_FOPEN_CREATE|APR_FOPEN_WRITE, t->mp),
+                    APR_SUCCESS);
+  apr_file_close (file);
+
+  t->params.action = GET;
+  t->params.port = addr->port;
+  assert_int_equal (tftp_proto_create (&machine, t->mp, &t->params), APR_SUCCESS);
+  while (!machine->wait) {
+    tftp_proto_fsm (machine);
+  }
+  len = sizeof(buf);
+  assert_int_equal (apr_socket_recvfrom (client, sock[0], 0, buf, &len), APR_SUCCESS);
+
+  // server ignores options and sends first block from its transfer ID
+  memset (buf, 'x', sizeof(buf));
+  len = tftp_create_data_header (buf, 1) + DATA_SIZE;
+  assert_int_equal (apr_socket_sendto (sock[1], client, 0, buf, &len), APR_SUCCESS);
+  // other host sends the last block before server
+  len = tftp_create_data_header (buf, 2) + 10;
+  assert_int_equal (apr_socket_sendto (sock[2], client, 0, buf, &len), APR_SUCCESS);
+  len = tftp_create_data_header (buf, 2);
+  assert_int_equal (apr_socket_sendto (sock[1], client, 0, buf, &len), APR_SUCCESS);
+
+  while (tftp_proto_fsm (machine) != END);
+  assert_int_equal (machine->status, APR_SUCCESS);
+  assert_int_equal (machine->sockaddr->port, machine->tid);
+  tftp_proto_destroy (machine);
+
+  len = sizeof(buf);
+  assert_int_equal (apr_socket_recv (sock[2], buf, &len), APR_SUCCESS);
+  assert_int_equal (buf[1], E_ERROR);
+  assert_int_equal (buf[3], ERR_XFERID);
+  // ACK of the first and the last block of server
+  for (i = 1; i <= 2; i++) {
+    len = sizeof(buf);
+    assert_int_equal (apr_socket_recv (sock[1], buf, &len), APR_SUCCESS);
+    assert_int_equal (buf[1], E_ACK);
+    assert_int_equal (buf[3], i);
+  }
+  assert_int_equal (apr_stat (&finfo, t->path, APR_FINFO_SIZE, t->mp), APR_SUCCESS);
+  assert_int_equal (finfo.size, DATA_SIZE);
+}
+
+/* Test duplicated OACK after the first block does not rewind transfer. */
+// ----------------------------------
+static void duplicate_oack_test (void **state)
+{
+  struct transfer *t = *state;
+  struct tftp_machine *machine;
+  struct tftp_opts opts = { 0 };
+  apr_sockaddr_t *addr, *client;
+  apr_socket_t *sock[2];  // server listening, server transfer
+  apr_finfo_t finfo;
+  apr_file_t *file;
+  char buf[1024 + 4];
+  char oack[BUF_SIZE];
+  apr_size_t len, oack_len;
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    assert_int_equal (apr_sockaddr_info_get (&addr, "127.0.0.1", APR_INET, 0, 0, t->mp), APR_SUCCESS);
+    assert_int_equal (apr_socket_create (&sock[i], APR_INET, SOCK_DGRAM, APR_PROTO_UDP, t->mp),
+                      APR_SUCCESS);
+    assert_int_equal (apr_socket_bind (sock[i], addr), APR_SUCCESS);
+    apr_socket_timeout_set (sock[i], apr_time_from_sec (1));
+  }
+  apr_socket_addr_get (&addr, APR_LOCAL, sock[0]);
+  assert_int_equal (apr_sockaddr_info_get (&client, NULL, APR_INET, 0, 0, t->mp), APR_SUCCESS);
+  assert_int_equal (apr_file_mktemp (&file, t->path, APR_FOPEN_CREATE|APR_FOPEN_WRITE, t->mp),
+                    APR_SUCCESS);
+  apr_file_close (file);
+
+  t->params.action = GET;
+  t->params.port = addr->port;
+  t->params.blksize = 1024;
+  t->params.timeout = 0;
+  assert_int_equal (tftp_proto_create (&machine, t->mp, &t->params), APR_SUCCESS);
+  while (!machine->wait) {
+    tftp_proto_fsm (machine);
+  }
+  len = sizeof(buf);
+  assert_int_equal (apr_socket_recvfrom (client, sock[0], 0, buf, &len), APR_SUCCESS);
+
+  // server sends OACK again after the first block
+  opts.blksize = 1024;
+  oack_len = tftp_create_oack (oack, &opts);
+  len = oack_len;
+  assert_int_equal (apr_socket_sendto (sock[1], client, 0, oack, &len), APR_SUCCESS);
+  memset (buf, 'x', sizeof(buf));
+  len = tftp_create_data_header (buf, 1) + 1024;
+  assert_int_equal (apr_socket_sendto (sock[1], client, 0, buf, &len), APR_SUCCESS);
+  len = oack_len;
+  assert_int_equal (apr_socket_sendto (sock[1], client, 0, oack, &len), APR_SUCCESS);
+  len = tftp_create_data_header (buf, 2) + 10;
+  assert_int_equal (apr_socket_sendto (sock[1], client, 0, buf, &len), APR_SUCCESS);
+
+  while (tftp_proto_fsm (machine) != END);
+  assert_int_equal (machine->status, APR_SUCCESS);
+  assert_int_equal (machine->blksize, 1024);
+  tftp_proto_destroy (machine);
+
+  // OACK and both blocks are acknowledged once
+  for (i = 0; i <= 2; i++) {
+    len = sizeof(buf);
+    assert_int_equal (apr_socket_recv (sock[1], buf, &len), APR_SUCCESS);
+    assert_int_equal (buf[1], E_ACK);
+    assert_int_equal (buf[3], i);
+  }
+  apr_socket_timeout_set (sock[1], apr_time_from_msec (100));
+  len = sizeof(buf);
+  assert_int_not_equal (apr_socket_recv (sock[1], buf, &len), APR_SUCCESS);
+  assert_int_equal (apr_stat (&finfo, t->path, APR_FINFO_SIZE, t->mp), APR_SUCCESS);
+  assert_int_equal (finfo.size, 1024 + 10);
+}
+
+/* Test server transfer answers only the client of request. */
+// ----------------------------------
+static void server_tid_test (void **state)
+{
+  struct transfer *t = *state;
+  struct tftp_params sp = t->params;
+  struct tftp_opts req = { 0 };
+  struct tftp_machine *machine;
+  apr_sockaddr_t *addr, *server;
+  apr_socket_t *sock[2];  // client, other host
+  apr_finfo_t finfo;
+  apr_file_t *file;
+  char buf[DATA_SIZE + 4];
+  char ip[16];
+  apr_size_t len;
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    assert_int_equal (apr_sockaddr_info_get (&addr, "127.0.0.1", APR_INET, 0, 0, t->mp), APR_SUCCESS);
+    assert_int_equal (apr_socket_create (&sock[i], APR_INET, SOCK_DGRAM, APR_PROTO_UDP, t->mp),
+                      APR_SUCCESS);
+    assert_int_equal (apr_socket_bind (sock[i], addr), APR_SUCCESS);
+    apr_socket_timeout_set (sock[i], apr_time_from_sec (1));
+  }
+  apr_socket_addr_get (&addr, APR_LOCAL, sock[0]);
+  assert_int_equal (apr_sockaddr_info_get (&server, NULL, APR_INET, 0, 0, t->mp), APR_SUCCESS);
+  assert_int_equal (apr_file_mktemp (&file, t->path, APR_FOPEN_CREATE|APR_FOPEN_WRITE, t->mp),
+                    APR_SUCCESS);
+  apr_file_close (file);
+
+  // server accepts WRQ of client without options and acknowledges it
+  strcpy (ip, "127.0.0.1");
+  sp.host = ip;
+  sp.port = addr->port;
+  sp.action = GET;
+  assert_int_equal (tftp_proto_accept (&machine, t->mp, &sp, &req), APR_SUCCESS);
+  while (!machine->wait) {
+    tftp_proto_fsm (machine);
+  }
+  len = sizeof(buf);
+  assert_int_equal (apr_socket_recvfrom (server, sock[0], 0, buf, &len), APR_SUCCESS);
+  assert_int_equal (buf[1], E_ACK);
+
+  // other host races the client with the last block
+  memset (buf, 'x', sizeof(buf));
+  len = tftp_create_data_header (buf, 1) + 10;
+  assert_int_equal (apr_socket_sendto (sock[1], server, 0, buf, &len), APR_SUCCESS);
+  len = tftp_create_data_header (buf, 1) + 20;
+  assert_int_equal (apr_socket_sendto (sock[0], server, 0, buf, &len), APR_SUCCESS);
+
+  while (tftp_proto_fsm (machine) != END);
+  assert_int_equal (machine->status, APR_SUCCESS);
+  assert_int_equal (machine->tid, addr->port);
+  tftp_proto_destroy (machine);
+
+  len = sizeof(buf);
+  assert_int_equal (apr_socket_recv (sock[1], buf, &len), APR_SUCCESS);
+  assert_int_equal (buf[1], E_ERROR);
+  assert_int_equal (buf[3], ERR_XFERID);
+  len = sizeof(buf);
+  assert_int_equal (apr_socket_recv (sock[0], buf, &len), APR_SUCCESS);
+  assert_int_equal (buf[1], E_ACK);
+  assert_int_equal (buf[3], 1);
+  assert_int_equal (apr_stat (&finfo, t->path, APR_FINFO_SIZE, t->mp), APR_SUCCESS);
+  assert_int_equal (finfo.size, 20);
+}
+
+/* Test two multicast clients of loopback server. */
+// ----------------------------------
+static void server_multicast_test (void **state)
+{
+  struct transfer *t = *state;
+  struct tftp_params sp = t->params;
+  struct mcast_client clients[2];
+  struct tftp_server *server;
+  struct tftp_loop *loop;
+  apr_thread_t *thread, *threads[2];
+  apr_pool_t *smp;
+  apr_file_t *file;
+  apr_status_t rv;
+  char served[] = "/tmp/tftp_served_XXXXXX";
+  apr_size_t len = FILE_LEN;
+  int i;
+
+  assert_int_equal (apr_file_mktemp (&file, served, APR_FOPEN_CREATE|APR_FOPEN_WRITE, t->mp),
+                    APR_SUCCESS);
+  assert_int_equal (apr_file_write_full (file, t->file, len, NULL), APR_SUCCESS);
+  apr_file_close (file);
+
+  assert_int_equal (apr_pool_create (&smp, NULL), APR_SUCCESS);
+  assert_int_equal (tftp_loop_create (&loop, smp, 17), APR_SUCCESS);
+  sp.host = "127.0.0.1";
+  sp.port = 0;
+  sp.blksize = BLKSIZE_MAX;
+  sp.mc_group = "239.255.69.1:17580";
+  assert_int_equal (tftp_server_create (&server, smp, loop, &sp, "/tmp", TRUE, 16), APR_SUCCESS);
+  assert_int_equal (apr_thread_create (&thread, NULL, server_thread, server, t->mp), APR_SUCCESS);
+
+  // second client joins transfer of the first one as passive client
+  for (i = 0; i < 2; i++) {
+    struct mcast_client *c = &clients[i];
+    assert_int_equal (apr_pool_create (&c->mp, NULL), APR_SUCCESS);
+    strcpy (c->path, "/tmp/tftp_transfer_XXXXXX");
+    assert_int_equal (apr_file_mktemp (&file, c->path, APR_FOPEN_CREATE|APR_FOPEN_WRITE, c->mp),
+                      APR_SUCCESS);
+    apr_file_close (file);
+    c->params = t->params;
+    c->params.action = GET;
+    c->params.port = server->addr->port;
+    c->params.blksize = 1428;
+    c->params.remote_file = served + 5;
+    c->params.local_file = c->path;
+    c->params.multicast = TRUE;
+    assert_int_equal (apr_thread_create (&threads[i], NULL, mcast_client_thread, c, t->mp),
+                      APR_SUCCESS);
+    apr_sleep (apr_time_from_msec (10));
+  }
+
+  for (i = 0; i < 2; i++) {
+    apr_thread_join (&rv, threads[i]);
+    assert_int_equal (clients[i].status, APR_SUCCESS);
+    assert_file_equal (t, clients[i].path);
+    apr_file_remove (clients[i].path, NULL);
+    apr_pool_destroy (clients[i].mp);
+  }
+
+  tftp_server_stop (server);
+  apr_thread_join (&rv, thread);
+  apr_pool_destroy (smp);
+  apr_file_remove (served, NULL);
+}
+
+/* Test impairments string parser. */
+// ----------------------------------
+static void impair_parse_test (void **state)
+{
+  struct transfer *t = *state;
+  struct tftp_impair_cfg cfg;
+
+  assert_int_equal (tftp_impair_parse (&cfg, "loss=0.5,delay=20,jitter=5,seed=42", t->mp),
+                    APR_SUCCESS);
+  assert_true (cfg.loss == 0.5);
+  assert_true (cfg.dup == 0);
+  assert_int_equal (cfg.delay, apr_time_from_msec (20));
+  assert_int_equal (cfg.jitter, apr_time_from_msec (5));
+  assert_int_equal (cfg.seed, 42);
+
+  assert_int_equal (tftp_impair_parse (&cfg, "loss=2", t->mp), APR_BADARG);
+  assert_int_equal (tftp_impair_parse (&cfg, "latency=10", t->mp), APR_BADARG);
+  assert_int_equal (tftp_impair_parse (&cfg, "delay=x", t->mp), APR_BADARG);
+}
+
+int main(int argc, const char *argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown (impair_parse_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (get_clean_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (get_impaired_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (put_impaired_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (put_windowed_dup_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (get_heavy_loss_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (server_impaired_test, setup, teardown),
+    // the same transfers with other datagram I/O modes, io_uring runs in server loop
+    cmocka_unit_test_setup_teardown (get_impaired_test, setup_apr, teardown),
+    cmocka_unit_test_setup_teardown (put_impaired_test, setup_apr, teardown),
+    cmocka_unit_test_setup_teardown (server_impaired_test, setup_apr, teardown),
+    cmocka_unit_test_setup_teardown (get_impaired_test, setup_gso, teardown),
+    cmocka_unit_test_setup_teardown (put_impaired_test, setup_gso, teardown),
+    cmocka_unit_test_setup_teardown (server_impaired_test, setup_gso, teardown),
+    cmocka_unit_test_setup_teardown (server_impaired_test, setup_uring, teardown),
+    cmocka_unit_test_setup_teardown (server_multicast_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (unknown_tid_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (server_tid_test, setup, teardown),
+    cmocka_unit_test_setup_teardown (duplicate_oack_test, setup, teardown),
+  };
+
+  return cmocka_run_group_tests_name("TFTP transfer tests", tests, NULL, NULL);
+}